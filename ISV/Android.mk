@@ -7,6 +7,8 @@ LOCAL_SRC_FILES := \
 	omx/isv_omxcore.cpp \
 	omx/isv_omxcomponent.cpp \
 	base/isv_bufmanager.cpp \
+	base/isv_fpsestimator.cpp \
+	base/isv_frctimestamp.cpp \
 	base/isv_processor.cpp \
 	base/isv_worker.cpp \
 	profile/isv_profile.cpp
@@ -23,8 +25,11 @@ LOCAL_SHARED_LIBRARIES := \
 	libva \
 	libva-android
 
+LOCAL_STATIC_LIBRARIES := libvpp_frametap
+
 LOCAL_C_INCLUDES := \
 	$(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/../VPP \
 	$(call include-path-for, frameworks-openmax) \
 	$(TARGET_OUT_HEADERS)/libmedia_utils_vpp \
 	$(TARGET_OUT_HEADERS)/display \
@@ -43,4 +48,6 @@ endif
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(call all-makefiles-under,$(LOCAL_PATH))
+
 endif
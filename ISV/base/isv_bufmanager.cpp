@@ -17,6 +17,7 @@
 
 #include <media/hardware/HardwareAPI.h>
 #include <system/graphics.h>
+#include <cutils/atomic.h>
 #include "isv_bufmanager.h"
 #ifndef TARGET_VPP_USE_GEN
 #include "hal_public.h"
@@ -31,7 +32,8 @@ using namespace android;
 ISVBuffer::~ISVBuffer() {
     if (mWorker != NULL) {
         ALOGV("%s: mSurface %d", __func__, mSurface);
-        mWorker->freeSurface(&mSurface);
+        // the buffer is freed with the port, its gralloc buffer may be too
+        mWorker->freeSurface(&mSurface, false);
     }
 }
 
@@ -48,6 +50,7 @@ status_t ISVBuffer::initBufferInfo(uint32_t hackFormat)
 
         if (mGrallocHandle != 0) {
             if ((unsigned long)metaData->pHandle != mGrallocHandle) {
+                // the decoder may hand the old gralloc buffer back later
                 if (STATUS_OK != mWorker->freeSurface(&mSurface)) {
                     ALOGE("%s: free surface %d failed.", __func__, mSurface);
                     return UNKNOWN_ERROR;
@@ -62,6 +65,8 @@ status_t ISVBuffer::initBufferInfo(uint32_t hackFormat)
         mGrallocHandle = mBuffer;
     }
 
+    // identifies the gralloc buffer for the surface cache, 0 if unknown
+    uint64_t bufferId = 0;
 #ifdef TARGET_VPP_USE_GEN
     gralloc_module_t* pGralloc = NULL;
     ufo_buffer_details_t info;
@@ -80,17 +85,23 @@ status_t ISVBuffer::initBufferInfo(uint32_t hackFormat)
     mHeight = info.height;
     mStride = info.pitch;
     mColorFormat = info.format;
+    // flink name of the BO, global and fixed for the life of the buffer
+    if (0 == err)
+        bufferId = (uint32_t)info.name;
 #else
     IMG_native_handle_t* grallocHandle = (IMG_native_handle_t*)mGrallocHandle;
     mStride = grallocHandle->iWidth;
     mColorFormat = (hackFormat != 0) ? hackFormat : grallocHandle->iFormat;
+    // set by gralloc at allocation, unique across processes
+    bufferId = grallocHandle->ui64Stamp;
 #endif
     if (mWorker == NULL) {
         ALOGE("%s: mWorker == NULL!!", __func__);
         return UNKNOWN_ERROR;
     }
 
-    if (STATUS_OK != mWorker->allocSurface(&mWidth, &mHeight, mStride, mColorFormat, mGrallocHandle, &mSurface)) {
+    if (STATUS_OK != mWorker->allocSurface(&mWidth, &mHeight, mStride, mColorFormat,
+                mGrallocHandle, bufferId, &mSurface)) {
         ALOGE("%s: alloc surface failed, mGrallocHandle %p", __func__, mGrallocHandle);
         return UNKNOWN_ERROR;
     }
@@ -100,6 +111,74 @@ status_t ISVBuffer::initBufferInfo(uint32_t hackFormat)
     return OK;
 }
 
+ISVBufferManager::~ISVBufferManager()
+{
+    releaseRetired();
+    delete mBufferMap;
+    mBufferMap = NULL;
+}
+
+status_t ISVBufferManager::rebuildBufferMap(uint32_t bufferCount)
+{
+    uint32_t mapSize = ISV_BUFFER_MAP_MIN_SIZE;
+    // keep the load factor at most 1/2
+    while (mapSize < 2 * bufferCount)
+        mapSize <<= 1;
+
+    BufferMap* map = BufferMap::create(mapSize);
+    if (map == NULL)
+        return NO_MEMORY;
+    replaceBufferMap(map);
+    for (uint32_t i = 0; i < mBuffers.size(); i++)
+        map->insert(mBuffers.itemAt(i));
+    return OK;
+}
+
+void ISVBufferManager::replaceBufferMap(BufferMap* map)
+{
+    BufferMap* old = mBufferMap;
+    // mFrozen is already cleared, see openBufferSet
+    android_memory_barrier();
+    mBufferMap = map;
+    if (old != NULL)
+        mRetiredMaps.push_back(old);
+}
+
+void ISVBufferManager::releaseRetired()
+{
+    for (uint32_t i = 0; i < mRetiredMaps.size(); i++)
+        delete mRetiredMaps.itemAt(i);
+    mRetiredMaps.clear();
+    for (uint32_t i = 0; i < mRetiredBuffers.size(); i++)
+        delete mRetiredBuffers.itemAt(i);
+    mRetiredBuffers.clear();
+}
+
+status_t ISVBufferManager::openBufferSet()
+{
+    if (!android_atomic_acquire_load(&mFrozen))
+        return OK;
+
+    /* lookups that saw the set frozen may still walk mBufferMap, so it is
+     * left alone and the change is done on a copy. mFrozen is cleared
+     * before the copy is published: a lookup that finds the copy also
+     * finds the set open and waits for mBufferLock.
+     */
+    android_atomic_release_store(0, &mFrozen);
+    BufferMap* map = mBufferMap->copy();
+    if (map == NULL)
+        return NO_MEMORY;
+    replaceBufferMap(map);
+    return OK;
+}
+
+void ISVBufferManager::updateFrozen()
+{
+    bool frozen = !mBuffers.isEmpty() && mBuffers.size() >= mBuffers.capacity();
+    android_atomic_release_store(frozen ? 1 : 0, &mFrozen);
+    ALOGD_IF(ISV_BUFFER_MANAGER_DEBUG, "%s: buffer set is %s", __func__, frozen ? "frozen" : "open");
+}
+
 status_t ISVBufferManager::setBufferCount(int32_t size)
 {
     Mutex::Autolock autoLock(mBufferLock);
@@ -109,9 +188,13 @@ status_t ISVBufferManager::setBufferCount(int32_t size)
         return STATUS_ERROR;
     }
 #endif
+    // the map is replaced anyway, no copy is needed
+    android_atomic_release_store(0, &mFrozen);
     mBuffers.setCapacity(size);
 
-    return OK;
+    status_t ret = rebuildBufferMap(mBuffers.capacity());
+    updateFrozen();
+    return ret;
 }
 
 status_t ISVBufferManager::freeBuffer(unsigned long handle)
@@ -120,10 +203,22 @@ status_t ISVBufferManager::freeBuffer(unsigned long handle)
     for (uint32_t i = 0; i < mBuffers.size(); i++) {
         ISVBuffer* isvBuffer = mBuffers.itemAt(i);
         if (isvBuffer->getHandle() == handle) {
-            delete isvBuffer;
+            status_t ret = openBufferSet();
+            if (ret != OK)
+                return ret;
+            mBufferMap->remove(handle);
+            mRetiredBuffers.push_back(isvBuffer);
             mBuffers.removeAt(i);
             ALOGD_IF(ISV_BUFFER_MANAGER_DEBUG, "%s: remove handle 0x%08x, and then mBuffers.size() %d", __func__,
                     handle, mBuffers.size());
+            // the port is disabled once all its buffers are freed, no
+            // lookup sees the replaced maps and freed buffers any more
+            if (mBuffers.isEmpty()) {
+                releaseRetired();
+                // the gralloc buffers of the next port config are new
+                if (mWorker != NULL)
+                    mWorker->purgeSurfaceCache();
+            }
             return OK;
         }
     }
@@ -135,15 +230,12 @@ status_t ISVBufferManager::freeBuffer(unsigned long handle)
 status_t ISVBufferManager::useBuffer(unsigned long handle)
 {
     Mutex::Autolock autoLock(mBufferLock);
-    if (handle == 0 || mBuffers.size() >= mBuffers.capacity())
+    if (handle == 0 || mBuffers.size() >= mBuffers.capacity() || mBufferMap == NULL)
         return BAD_VALUE;
 
-    for (uint32_t i = 0; i < mBuffers.size(); i++) {
-        ISVBuffer* isvBuffer = mBuffers.itemAt(i);
-        if (isvBuffer->getHandle() == handle) {
-            ALOGE("%s: this buffer 0x%08x has already been registered", __func__, handle);
-            return UNKNOWN_ERROR;
-        }
+    if (mBufferMap->lookup(handle) != NULL) {
+        ALOGE("%s: this buffer 0x%08x has already been registered", __func__, handle);
+        return UNKNOWN_ERROR;
     }
 
     ISVBuffer* isvBuffer = new ISVBuffer(mWorker, handle, mMetaDataMode ? ISVBuffer::ISV_BUFFER_METADATA : ISVBuffer::ISV_BUFFER_GRALLOC);
@@ -151,6 +243,8 @@ status_t ISVBufferManager::useBuffer(unsigned long handle)
     ALOGD_IF(ISV_BUFFER_MANAGER_DEBUG, "%s: add handle 0x%08x, and then mBuffers.size() %d", __func__,
             handle, mBuffers.size());
     mBuffers.push_back(isvBuffer);
+    mBufferMap->insert(isvBuffer);
+    updateFrozen();
     return OK;
 
 }
@@ -158,15 +252,12 @@ status_t ISVBufferManager::useBuffer(unsigned long handle)
 status_t ISVBufferManager::useBuffer(const sp<ANativeWindowBuffer> nativeBuffer)
 {
     Mutex::Autolock autoLock(mBufferLock);
-    if (nativeBuffer == NULL || mBuffers.size() >= mBuffers.capacity())
+    if (nativeBuffer == NULL || mBuffers.size() >= mBuffers.capacity() || mBufferMap == NULL)
         return BAD_VALUE;
 
-    for (uint32_t i = 0; i < mBuffers.size(); i++) {
-        ISVBuffer* isvBuffer = mBuffers.itemAt(i);
-        if (isvBuffer->getHandle() == (unsigned long)nativeBuffer->handle) {
-            ALOGE("%s: this buffer 0x%08x has already been registered", __func__, nativeBuffer->handle);
-            return UNKNOWN_ERROR;
-        }
+    if (mBufferMap->lookup((unsigned long)nativeBuffer->handle) != NULL) {
+        ALOGE("%s: this buffer 0x%08x has already been registered", __func__, nativeBuffer->handle);
+        return UNKNOWN_ERROR;
     }
 
     ISVBuffer* isvBuffer = new ISVBuffer(mWorker,
@@ -178,17 +269,20 @@ status_t ISVBufferManager::useBuffer(const sp<ANativeWindowBuffer> nativeBuffer)
     ALOGD_IF(ISV_BUFFER_MANAGER_DEBUG, "%s: add handle 0x%08x, and then mBuffers.size() %d", __func__,
             nativeBuffer->handle, mBuffers.size());
     mBuffers.push_back(isvBuffer);
+    mBufferMap->insert(isvBuffer);
+    updateFrozen();
     return OK;
 }
 
 ISVBuffer* ISVBufferManager::mapBuffer(unsigned long handle)
 {
+    // load the map before checking mFrozen, see openBufferSet
+    BufferMap* map = mBufferMap;
+    android_memory_barrier();
+    // the map doesn't change while the buffer set is frozen
+    if (android_atomic_acquire_load(&mFrozen))
+        return map != NULL ? map->lookup(handle) : NULL;
+
     Mutex::Autolock autoLock(mBufferLock);
-    for (uint32_t i = 0; i < mBuffers.size(); i++) {
-        ISVBuffer* isvBuffer = mBuffers.itemAt(i);
-        if (isvBuffer->getHandle() == handle)
-            return isvBuffer;
-    }
-    return NULL;
+    return mBufferMap != NULL ? mBufferMap->lookup(handle) : NULL;
 }
-
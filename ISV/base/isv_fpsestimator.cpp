@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <utils/Log.h>
+#include "isv_fpsestimator.h"
+
+//#define LOG_NDEBUG 0
+#undef LOG_TAG
+#define LOG_TAG "isv-omxil"
+
+// frame rates ISV knows how to handle, see ISVProcessor::isFrameRateValid
+static const uint32_t kStandardFps[] = { 15, 24, 25, 30, 50, 60 };
+// allowed deviation from a standard rate, in 1/1000, covers 23.976 and 29.97
+#define SNAP_TOLERANCE  20
+
+static void sortInt64(int64_t *data, uint32_t count)
+{
+    // window is tiny and mostly sorted already, insertion sort is enough
+    for (uint32_t i = 1; i < count; i++) {
+        int64_t v = data[i];
+        uint32_t j = i;
+        while (j > 0 && data[j - 1] > v) {
+            data[j] = data[j - 1];
+            j--;
+        }
+        data[j] = v;
+    }
+}
+
+ISVFpsEstimator::ISVFpsEstimator(uint32_t windowSize)
+    :mWindowSize(windowSize),
+    mCount(0),
+    mNext(0)
+{
+    if (mWindowSize < ISV_FPS_MIN_WINDOW)
+        mWindowSize = ISV_FPS_MIN_WINDOW;
+    else if (mWindowSize > ISV_FPS_MAX_WINDOW)
+        mWindowSize = ISV_FPS_MAX_WINDOW;
+}
+
+void ISVFpsEstimator::reset()
+{
+    mCount = 0;
+    mNext = 0;
+}
+
+status_t ISVFpsEstimator::snapFps(int64_t intervalUs, uint32_t *fps)
+{
+    for (uint32_t i = 0; i < sizeof(kStandardFps) / sizeof(kStandardFps[0]); i++) {
+        int64_t nominalUs = 1000000ll / kStandardFps[i];
+        int64_t diff = intervalUs - nominalUs;
+        if (diff < 0)
+            diff = -diff;
+        if (diff * 1000 <= nominalUs * SNAP_TOLERANCE) {
+            *fps = kStandardFps[i];
+            return OK;
+        }
+    }
+    return BAD_VALUE;
+}
+
+status_t ISVFpsEstimator::addTimestamp(int64_t timeUs, uint32_t *fps)
+{
+    int64_t sorted[ISV_FPS_MAX_WINDOW];
+    int64_t deltas[ISV_FPS_MAX_WINDOW];
+    int64_t median;
+    int64_t sum = 0;
+    uint32_t numDeltas = 0;
+    uint32_t numInliers = 0;
+
+    *fps = 0;
+
+    mTimestamps[mNext] = timeUs;
+    mNext = (mNext + 1) % mWindowSize;
+    if (mCount < mWindowSize)
+        mCount++;
+
+    if (mCount < ISV_FPS_MIN_WINDOW)
+        return NOT_ENOUGH_DATA;
+
+    // reordered timestamps are fine once sorted
+    for (uint32_t i = 0; i < mCount; i++)
+        sorted[i] = mTimestamps[i];
+    sortInt64(sorted, mCount);
+
+    for (uint32_t i = 1; i < mCount; i++) {
+        int64_t delta = sorted[i] - sorted[i - 1];
+        // repeated timestamps carry no cadence information
+        if (delta > 0)
+            deltas[numDeltas++] = delta;
+    }
+    if (numDeltas < ISV_FPS_MIN_WINDOW - 1)
+        return NOT_ENOUGH_DATA;
+
+    for (uint32_t i = 0; i < numDeltas; i++)
+        sorted[i] = deltas[i];
+    sortInt64(sorted, numDeltas);
+    median = sorted[numDeltas / 2];
+
+    for (uint32_t i = 0; i < numDeltas; i++) {
+        int64_t diff = deltas[i] - median;
+        if (diff < 0)
+            diff = -diff;
+        if (diff * 4 <= median) {
+            sum += deltas[i];
+            numInliers++;
+        }
+    }
+
+    // need a clear majority of consistent intervals
+    if (numInliers * 2 <= numDeltas)
+        return NOT_ENOUGH_DATA;
+
+    status_t ret = snapFps(sum / numInliers, fps);
+    ALOGV("%s: interval %lld us from %d/%d samples, fps %d", __func__,
+            sum / numInliers, numInliers, numDeltas, *fps);
+    return ret;
+}
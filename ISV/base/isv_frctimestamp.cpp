@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "isv_frctimestamp.h"
+
+ISVFrcTimestamp::ISVFrcTimestamp()
+    :mLastInputTimeUs(-1),
+    mPhase(0)
+{
+}
+
+void ISVFrcTimestamp::reset()
+{
+    mLastInputTimeUs = -1;
+    mPhase = 0;
+}
+
+void ISVFrcTimestamp::getRatio(FRC_RATE rate, int32_t *num, int32_t *den)
+{
+    switch (rate) {
+        case FRC_RATE_2X:
+            *num = 2;
+            *den = 1;
+            break;
+        case FRC_RATE_2_5X:
+            *num = 5;
+            *den = 2;
+            break;
+        case FRC_RATE_4X:
+            *num = 4;
+            *den = 1;
+            break;
+        default:
+            *num = 1;
+            *den = 1;
+            break;
+    }
+}
+
+void ISVFrcTimestamp::update(FRC_RATE rate, uint32_t frameRate, int64_t timeUs,
+        uint32_t count, int64_t *timestamps)
+{
+    int32_t num, den;
+    getRatio(rate, &num, &den);
+
+    // fall back to the nominal rate for the first frame and after a gap
+    int64_t nominalUs = (frameRate > 0) ? 1000000ll / frameRate : 0;
+    int64_t intervalUs = timeUs - mLastInputTimeUs;
+    if (mLastInputTimeUs < 0 || intervalUs <= 0 ||
+            (nominalUs > 0 && intervalUs > nominalUs * 4))
+        intervalUs = nominalUs;
+    mLastInputTimeUs = timeUs;
+
+    /* The last output of the batch is phase / num input intervals before
+     * the input, where phase is (k * num) mod den. Each batch moves the
+     * phase by num - count * den.
+     */
+    int32_t phase = mPhase + num - (int32_t)count * den;
+    if (phase < 0 || phase >= den) {
+        // first batch after a flush or a skipped frame, pick the phase
+        // which makes this batch size valid
+        int32_t prev = (int32_t)count * den - num;
+        prev = (prev < 0) ? 0 : ((prev >= den) ? den - 1 : prev);
+        phase = prev + num - (int32_t)count * den;
+        phase = (phase < 0) ? 0 : ((phase >= den) ? den - 1 : phase);
+    }
+    mPhase = phase;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (count < 2 || intervalUs <= 0) {
+            timestamps[i] = timeUs;
+            continue;
+        }
+        int64_t steps = (int64_t)(count - 1 - i) * den + phase;
+        timestamps[i] = timeUs - steps * intervalUs / num;
+    }
+}
@@ -16,7 +16,11 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
 #include <utils/Errors.h>
+#include <utils/Timers.h>
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include "isv_processor.h"
 #include "isv_profile.h"
 #include "isv_omxcomponent.h"
@@ -28,6 +32,21 @@
 using namespace android;
 
 #define MAX_RETRY_NUM   10
+/* The output queue never holds more than MAX_OUTPUT_NUM buffers (see
+ * addOutput). Input buffers are bounded by the decoder buffer count,
+ * which is not known here, so leave a generous margin over the ISV share.
+ */
+#define OUTPUT_QUEUE_SIZE   (MAX_OUTPUT_NUM)
+#define INPUT_QUEUE_SIZE    (MAX_ISV_BUFFER_NUM * 4)
+
+// number of timestamps used to detect the frame rate
+static uint32_t getFpsWindowSize()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("isv.fps.window", value, NULL) > 0)
+        return atoi(value);
+    return ISV_FPS_DEFAULT_WINDOW;
+}
 
 ISVProcessor::ISVProcessor(bool canCallJava,
         sp<ISVBufferManager> bufferManager,
@@ -39,16 +58,33 @@ ISVProcessor::ISVProcessor(bool canCallJava,
     mThreadRunning(false),
     mISVWorker(NULL),
     mBufferManager(bufferManager),
+    mOutputBuffers(OUTPUT_QUEUE_SIZE),
     mOutputProcIdx(0),
+    mOutputBufNum(MIN_OUTPUT_NUM),
+    mOutputBufNumRequested(true),
+    mPendingFrcRate(FRC_RATE_1X),
+    mFrcSupported(false),
+    mFrcChange(false),
+    mUpdatedFrameRate(0),
+    mInputBuffers(INPUT_QUEUE_SIZE),
     mInputProcIdx(0),
+    mInputArrivals(INPUT_QUEUE_SIZE * 2),
+    mFpsEstimator(getFpsWindowSize()),
+    mFpsDetecting(false),
     mNumTaskInProcesing(0),
     mNumRetry(0),
     mError(false),
     mbFlush(false),
     mbBypass(false),
     mFlagEnd(false),
-    mFilters(0)
+    mFilters(0),
+    mFramesProcessed(0),
+    mFramesBypassed(0),
+    mFramesDropped(0),
+    mFramesRetried(0)
 {
+    memset((void*)mLatencyHistogram, 0, sizeof(mLatencyHistogram));
+
     //FIXME: for 1920 x 1088, we also consider it as 1080p
     mISVProfile = new ISVProfile(width, (height == 1088) ? 1080 : height);
 
@@ -66,20 +102,22 @@ ISVProcessor::ISVProcessor(bool canCallJava,
     if (width > 2048)
         mFilters &= ~FilterSharpening;
 
+    // FRC starts once the frame rate is known, see applyFrcChange(). Detect
+    // it from timestamps until the framework sets one
+    mFrcSupported = (mFilters & FilterFrameRateConversion) != 0;
+    mFilters &= ~FilterFrameRateConversion;
+    mFpsDetecting = mFrcSupported;
+
     memset(&mFilterParam, 0, sizeof(mFilterParam));
     //FIXME: we don't support scaling yet, so set src region equal to dst region
     mFilterParam.srcWidth = mFilterParam.dstWidth = width;
     mFilterParam.srcHeight = mFilterParam.dstHeight = height;
-    mOutputBuffers.clear();
-    mInputBuffers.clear();
-    mTimeWindow.clear();
+    mFilterParam.frcRate = FRC_RATE_1X;
 }
 
 ISVProcessor::~ISVProcessor() {
     ALOGV("ISVProcessor is deleted");
     flush();
-    mOutputBuffers.clear();
-    mInputBuffers.clear();
 
     mISVProfile = NULL;
     mFilters = 0;
@@ -98,7 +136,11 @@ void ISVProcessor::start()
     ALOGD_IF(ISV_THREAD_DEBUG, "ISVProcessor::start");
 
     if (mISVWorker == NULL) {
-        mISVWorker = new ISVWorker();
+        // reuse the worker of the previous session, its VA surfaces
+        // are cached across port reconfiguration
+        mISVWorker = mBufferManager->getWorker();
+        if (mISVWorker == NULL)
+            mISVWorker = new ISVWorker();
         if (STATUS_OK != mISVWorker->init(mFilterParam.srcWidth, mFilterParam.srcHeight))
             ALOGE("%s: mISVWorker init failed", __func__);
     }
@@ -149,10 +191,9 @@ bool ISVProcessor::getBufForFirmwareOutput(Vector<ISVBuffer*> *fillBufList,uint3
     if ((needFillNum == 0) || (needFillNum > 4))
        return false;
 
-    Mutex::Autolock autoLock(mOutputLock);
     for (i = 0; i < needFillNum; i++) {
         //fetch the render buffer from the top of output buffer queue
-        outputBuffer = mOutputBuffers.itemAt(i);
+        outputBuffer = mOutputBuffers.peek(i);
         if (!outputBuffer) {
             ALOGE("%s: failed to fetch output buffer for sync.", __func__);
             return false;
@@ -168,7 +209,6 @@ bool ISVProcessor::getBufForFirmwareOutput(Vector<ISVBuffer*> *fillBufList,uint3
 
 
 status_t ISVProcessor::updateFirmwareOutputBufStatus(uint32_t fillBufNum) {
-    int64_t timeUs;
     OMX_BUFFERHEADERTYPE *outputBuffer;
     OMX_BUFFERHEADERTYPE *inputBuffer;
     OMX_ERRORTYPE err;
@@ -184,38 +224,27 @@ status_t ISVProcessor::updateFirmwareOutputBufStatus(uint32_t fillBufNum) {
     }
     // remove one buffer from intput buffer queue
     {
-        Mutex::Autolock autoLock(mInputLock);
-        inputBuffer = mInputBuffers.itemAt(0);
+        inputBuffer = mInputBuffers.peek(0);
         err = mpOwner->releaseBuffer(kPortIndexInput, inputBuffer, false);
         if (err != OMX_ErrorNone) {
             ALOGE("%s: failed to fillInputBuffer", __func__);
             return UNKNOWN_ERROR;
         }
 
-        mInputBuffers.removeAt(0);
+        mInputBuffers.pop();
+        updateLatency(mInputArrivals.pop());
         ALOGD_IF(ISV_THREAD_DEBUG, "%s: fetch buffer %u from input buffer queue for fill to decoder, and then queue size is %d", __func__,
                 inputBuffer, mInputBuffers.size());
         mInputProcIdx--;
     }
 
     //set the time stamp for interpreted frames
-    {
-        Mutex::Autolock autoLock(mOutputLock);
-        timeUs = mOutputBuffers[0]->nTimeStamp;
+    setFrcTimestamps(fillBufNum);
 
+    {
         for(uint32_t i = 0; i < fillBufNum; i++) {
-            outputBuffer = mOutputBuffers.itemAt(i);
-            if (fillBufNum > 1) {
-                if (mFilterParam.frameRate == 24) {
-                    if (fillBufNum == 2) {
-                        outputBuffer->nTimeStamp = timeUs + 1000000ll * (i + 1) / 60 - 1000000ll * 1 / 24;
-                    } else if (fillBufNum == 3) {
-                        outputBuffer->nTimeStamp = timeUs + 1000000ll * (i + 3) / 60 - 1000000ll * 2 / 24;
-                    }
-                }
-                else
-                    outputBuffer->nTimeStamp = timeUs - 1000000ll * (fillBufNum - i - 1) / (mFilterParam.frameRate * 2);
-            }
+            // filled buffers are released in order, so each one is at the head
+            outputBuffer = mOutputBuffers.peek(0);
 
             //return filled buffers for rendering
             err = mpOwner->releaseBuffer(kPortIndexOutput, outputBuffer, false);
@@ -223,17 +252,30 @@ status_t ISVProcessor::updateFirmwareOutputBufStatus(uint32_t fillBufNum) {
                 ALOGE("%s: failed to releaseOutputBuffer", __func__);
                 return UNKNOWN_ERROR;
             }
+            mOutputBuffers.pop();
+            mOutputProcIdx--;
 
             ALOGD_IF(ISV_THREAD_DEBUG, "%s: fetch buffer %u(timestamp %.2f ms) from output buffer queue for render, and then queue size is %d", __func__,
                     outputBuffer, outputBuffer->nTimeStamp/1E3, mOutputBuffers.size());
         }
-        // remove filled buffers from output buffer queue
-        mOutputBuffers.removeItemsAt(0, fillBufNum);
-        mOutputProcIdx -= fillBufNum;
     }
     return OK;
 }
 
+void ISVProcessor::setFrcTimestamps(uint32_t fillBufNum)
+{
+    // a batch holds at most 4 outputs, see getBufForFirmwareOutput()
+    int64_t timestamps[4];
+    if (fillBufNum > 4)
+        return;
+
+    // every output of this batch carries the timestamp of the input it ends at
+    mFrcTimestamp.update(mFilterParam.frcRate, mFilterParam.frameRate,
+            mOutputBuffers.peek(0)->nTimeStamp, fillBufNum, timestamps);
+
+    for (uint32_t i = 0; i < fillBufNum; i++)
+        mOutputBuffers.peek(i)->nTimeStamp = timestamps[i];
+}
 
 bool ISVProcessor::getBufForFirmwareInput(Vector<ISVBuffer*> *procBufList,
                                    ISVBuffer **inputBuf,
@@ -255,26 +297,19 @@ bool ISVProcessor::getBufForFirmwareInput(Vector<ISVBuffer*> *procBufList,
 
     //fetch a input buffer for processing
     {
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqiring mInputLock", __func__);
-        Mutex::Autolock autoLock(mInputLock);
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqired mInputLock", __func__);
-        inputBuffer = mInputBuffers.itemAt(mInputProcIdx);
+        inputBuffer = mInputBuffers.peek(mInputProcIdx);
         if (!inputBuffer) {
             ALOGE("%s: failed to get input buffer for processing.", __func__);
             return false;
         }
         unsigned long inputHandle = reinterpret_cast<unsigned long>(inputBuffer->pBuffer);
         *inputBuf = mBufferManager->mapBuffer(inputHandle);
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: releasing mInputLock", __func__);
     }
 
     //fetch output buffers for processing
     {
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqiring mOutputLock", __func__);
-        Mutex::Autolock autoLock(mOutputLock);
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqired mOutputLock", __func__);
         for (int32_t i = 0; i < procBufCount; i++) {
-            outputBuffer = mOutputBuffers.itemAt(mOutputProcIdx + i);
+            outputBuffer = mOutputBuffers.peek(mOutputProcIdx + i);
             if (!outputBuffer) {
                 ALOGE("%s: failed to get output buffer for processing.", __func__);
                 return false;
@@ -283,7 +318,6 @@ bool ISVProcessor::getBufForFirmwareInput(Vector<ISVBuffer*> *procBufList,
             procBufList->push_back(mBufferManager->mapBuffer(outputHandle));
         }
         *procBufNum = procBufCount;
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: releasing mOutputLock", __func__);
     }
 
     return true;
@@ -295,12 +329,12 @@ status_t ISVProcessor::updateFirmwareInputBufStatus(uint32_t procBufNum)
     OMX_BUFFERHEADERTYPE *outputBuffer;
     OMX_BUFFERHEADERTYPE *inputBuffer;
 
-    inputBuffer = mInputBuffers.itemAt(mInputProcIdx);
+    inputBuffer = mInputBuffers.peek(mInputProcIdx);
     mInputProcIdx++;
+    android_atomic_inc(&mFramesProcessed);
 
-    Mutex::Autolock autoLock(mOutputLock);
     for(uint32_t i = 0; i < procBufNum; i++) {
-        outputBuffer = mOutputBuffers.editItemAt(mOutputProcIdx + i);
+        outputBuffer = mOutputBuffers.peek(mOutputProcIdx + i);
         // set output buffer timestamp as the same as input
         outputBuffer->nTimeStamp = inputBuffer->nTimeStamp;
         outputBuffer->nFilledLen = inputBuffer->nFilledLen;
@@ -336,16 +370,23 @@ bool ISVProcessor::threadLoop() {
 
     Mutex::Autolock autoLock(mLock);
 
-    if (!isReadytoRun() && !mbFlush) {
+    if (!isReadytoRun() && !mbFlush && !mFrcChange) {
         mRunCond.wait(mLock);
     }
 
+    if (mFrcChange && !mbFlush) {
+        if (mNumTaskInProcesing == 0)
+            applyFrcChange();
+        else if (!drainForFrcChange())
+            return false;
+    }
+
     if (isReadytoRun() || mbFlush) {
         procBufList.clear();
         bool bGetInBuf = getBufForFirmwareInput(&procBufList, &inputBuf, &procBufNum);
         if (bGetInBuf) {
             if (!mbFlush)
-                flags = mInputBuffers[mInputProcIdx]->nFlags;
+                flags = mInputBuffers.peek(mInputProcIdx)->nFlags;
             status_t ret = mISVWorker->process(inputBuf, procBufList, procBufNum, mbFlush, flags);
             if (ret == STATUS_OK) {
                 // for seek and EOS
@@ -356,6 +397,8 @@ bool ISVProcessor::threadLoop() {
                     mNumTaskInProcesing = 0;
                     mInputProcIdx = 0;
                     mOutputProcIdx = 0;
+                    if (mFrcChange)
+                        applyFrcChange();
 
                     mbFlush = false;
 
@@ -396,6 +439,44 @@ bool ISVProcessor::threadLoop() {
     return true;
 }
 
+bool ISVProcessor::drainForFrcChange()
+{
+    // VSP holds tasks sent at the current rate. Finish them and return
+    // their frames as usual, the inputs not yet sent stay queued for the
+    // new rate. Only a failure falls back to the flush path
+    ALOGI("%s: drain %d VSP tasks to switch FRC", __func__, mNumTaskInProcesing);
+
+    // end the VSP stream, so the outputs held back for reference are rendered
+    Vector<ISVBuffer*> noOutput;
+    if (mISVWorker->process(NULL, noOutput, 0, true, 0) != STATUS_OK) {
+        ALOGW("%s: failed to end VSP stream, flush instead", __func__);
+        mbFlush = true;
+        return true;
+    }
+
+    while (mNumTaskInProcesing > 0) {
+        Vector<ISVBuffer*> fillBufList;
+        uint32_t fillBufNum = 0;
+        if (!getBufForFirmwareOutput(&fillBufList, &fillBufNum)) {
+            ALOGW("%s: no buffers for %d VSP tasks, flush instead", __func__, mNumTaskInProcesing);
+            mbFlush = true;
+            return true;
+        }
+        if (mISVWorker->fill(fillBufList, fillBufNum) != STATUS_OK) {
+            mError = true;
+            ALOGE("ISV read firmware data error! Thread EXIT...");
+            return false;
+        }
+        mNumTaskInProcesing--;
+        updateFirmwareOutputBufStatus(fillBufNum);
+    }
+
+    // the next task starts a new VSP stream at the new rate
+    mISVWorker->reset();
+    applyFrcChange();
+    return true;
+}
+
 bool ISVProcessor::isCurrentThread() const {
     return mThreadId == androidGetThreadId();
 }
@@ -407,87 +488,214 @@ inline bool ISVProcessor::isFrameRateValid(uint32_t fps)
 
 status_t ISVProcessor::configFRC(uint32_t fps)
 {
-    if (isFrameRateValid(fps)) {
-        if (fps == 50 || fps == 60) {
-            ALOGD_IF(ISV_THREAD_DEBUG, "%s: %d fps don't need do FRC, so disable FRC", __func__, fps);
+    if (!isFrameRateValid(fps))
+        return UNKNOWN_ERROR;
+
+    Mutex::Autolock autoLock(mLock);
+    mFpsDetecting = false;
+    requestFrc(fps);
+    return OK;
+}
+
+void ISVProcessor::requestFrc(uint32_t fps)
+{
+    ALOGD_IF(ISV_THREAD_DEBUG, "%s: fps %d, %d VSP tasks in flight", __func__,
+            fps, mNumTaskInProcesing);
+    mUpdatedFrameRate = fps;
+    mFrcChange = true;
+    mRunCond.signal();
+}
+
+void ISVProcessor::applyFrcChange()
+{
+    uint32_t fps = mUpdatedFrameRate;
+    mFrcChange = false;
+    mPendingFrcRate = FRC_RATE_1X;
+    // the output phase of the old rate doesn't carry over
+    mFrcTimestamp.reset();
+
+    if (!mFrcSupported || fps == 0 || fps == 50 || fps == 60) {
+        ALOGD_IF(ISV_THREAD_DEBUG, "%s: %d fps don't need do FRC, so disable FRC", __func__, fps);
+        mFilters &= ~FilterFrameRateConversion;
+        mFilterParam.frcRate = FRC_RATE_1X;
+    } else {
+        mFilters |= FilterFrameRateConversion;
+        mFilterParam.frameRate = fps;
+        mFilterParam.frcRate = mISVProfile->getFRCRate(mFilterParam.frameRate);
+        ALOGD_IF(ISV_THREAD_DEBUG, "%s: fps is set to %d, frc rate is %d", __func__,
+                mFilterParam.frameRate, mFilterParam.frcRate);
+
+        if (getOutputBufNum(mFilterParam.frcRate) > mOutputBufNum) {
+            // run without FRC rather than stall on output buffers
+            ALOGI("%s: FRC rate %d needs %d output buffers, only %d are set, FRC off until reconfigured",
+                    __func__, mFilterParam.frcRate, getOutputBufNum(mFilterParam.frcRate), mOutputBufNum);
+            mPendingFrcRate = mFilterParam.frcRate;
             mFilters &= ~FilterFrameRateConversion;
             mFilterParam.frcRate = FRC_RATE_1X;
-        } else {
-            mFilterParam.frameRate = fps;
-            mFilterParam.frcRate = mISVProfile->getFRCRate(mFilterParam.frameRate);
-            ALOGD_IF(ISV_THREAD_DEBUG, "%s: fps is set to %d, frc rate is %d", __func__,
-                    mFilterParam.frameRate, mFilterParam.frcRate);
         }
-        return OK;
     }
 
-    return UNKNOWN_ERROR;
+    // with no filter left configFilters bypasses ISV, VSP finishes the
+    // queued buffers with the filters it has
+    if (mFilters != 0 && mISVWorker->configFilters(mFilters, &mFilterParam) != STATUS_OK)
+        ALOGE("%s: failed to config filters 0x%x", __func__, mFilters);
 }
 
-status_t ISVProcessor::calculateFps(int64_t timeStamp, uint32_t* fps)
+status_t ISVProcessor::configFilters(OMX_BUFFERHEADERTYPE* buffer)
 {
-    int32_t i = 0;
-    *fps = 0;
+    status_t ret;
+    bool reconfig;
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        if (mFpsDetecting) {
+            uint32_t fps = 0;
+            if (OK == mFpsEstimator.addTimestamp(buffer->nTimeStamp, &fps)) {
+                mFpsDetecting = false;
+                requestFrc(fps);
+                ALOGD_IF(ISV_THREAD_DEBUG, "%s: detected fps %d after %d frames", __func__,
+                        fps, mNumRetry);
+            } else if (mNumRetry++ < MAX_RETRY_NUM) {
+                return NOT_ENOUGH_DATA;
+            } else if (mNumRetry == MAX_RETRY_NUM + 1) {
+                // run without FRC for now and keep estimating, FRC is
+                // turned on as soon as the cadence settles
+                ALOGD_IF(ISV_THREAD_DEBUG, "%s: no valid frame rate after %d frames, FRC off until detected", __func__,
+                        MAX_RETRY_NUM);
+            }
+        }
+
+        // the processor thread is idle while this holds mLock, so with no
+        // task in flight FRC can switch before this buffer is queued.
+        // Otherwise the processor thread drains VSP first
+        if (mFrcChange && mNumTaskInProcesing == 0 && !mbFlush)
+            applyFrcChange();
 
-    mTimeWindow.push_back(timeStamp);
-    if (mTimeWindow.size() > WINDOW_SIZE) {
-        mTimeWindow.removeAt(0);
+        if ((buffer->nFlags & OMX_BUFFERFLAG_TFF) != 0 ||
+                (buffer->nFlags & OMX_BUFFERFLAG_BFF) != 0)
+            mFilters |= FilterDeinterlacing;
+        else
+            mFilters &= ~FilterDeinterlacing;
+
+        reconfig = checkOutputBufNum();
+
+        if (mFilters == 0) {
+            ALOGI("%s: no filter need to be config, bypass ISV", __func__);
+            ret = UNKNOWN_ERROR;
+        } else {
+            //config filters to mISVWorker
+            ret = (mISVWorker->configFilters(mFilters, &mFilterParam) == STATUS_OK) ? OK : UNKNOWN_ERROR;
+        }
     }
-    else if (mTimeWindow.size() < WINDOW_SIZE)
-        return NOT_ENOUGH_DATA;
 
-    int64_t delta = mTimeWindow[WINDOW_SIZE-1] - mTimeWindow[0];
-    if (delta == 0)
-        return NOT_ENOUGH_DATA;
+    if (reconfig)
+        mpOwner->reconfigOutputPort();
+    return ret;
+}
 
-    *fps = ceil(1.0 / delta * 1E6 * (WINDOW_SIZE-1));
-    return OK;
+bool ISVProcessor::checkOutputBufNum()
+{
+    // only resize once the frame rate is final
+    if (mOutputBufNumRequested || mFpsDetecting || mFrcChange)
+        return false;
+
+    uint32_t required = requiredOutputBufNum();
+    if (required == mOutputBufNum)
+        return false;
+
+    ALOGI("%s: %d output buffers are set, %d are needed, reconfigure output port",
+            __func__, mOutputBufNum, required);
+    mOutputBufNumRequested = true;
+    return true;
 }
 
-status_t ISVProcessor::configFilters(OMX_BUFFERHEADERTYPE* buffer)
+void ISVProcessor::setOutputBufNum(uint32_t num)
 {
-    if ((mFilters & FilterFrameRateConversion) != 0) {
-        if (!isFrameRateValid(mFilterParam.frameRate)) {
-            if (mNumRetry++ < MAX_RETRY_NUM) {
-                uint32_t fps = 0;
-                if (OK != calculateFps(buffer->nTimeStamp, &fps))
-                    return NOT_ENOUGH_DATA;
-
-                if (OK != configFRC(fps))
-                    return NOT_ENOUGH_DATA;
-            } else {
-                ALOGD_IF(ISV_THREAD_DEBUG, "%s: exceed max retry to get a valid frame rate(%d), disable FRC", __func__,
-                        mFilterParam.frameRate);
-                mFilters &= ~FilterFrameRateConversion;
-                mFilterParam.frcRate = FRC_RATE_1X;
-            }
-        }
-    }
+    if (num > MAX_OUTPUT_NUM)
+        num = MAX_OUTPUT_NUM;
+    ALOGD_IF(ISV_THREAD_DEBUG, "%s: %d output buffers", __func__, num);
 
-    if ((buffer->nFlags & OMX_BUFFERFLAG_TFF) != 0 ||
-            (buffer->nFlags & OMX_BUFFERFLAG_BFF) != 0)
-        mFilters |= FilterDeinterlacing;
-    else
-        mFilters &= ~FilterDeinterlacing;
+    Mutex::Autolock autoLock(mLock);
+    mOutputBufNum = num;
+    mOutputBufNumRequested = false;
 
-    if (mFilters == 0) {
-        ALOGI("%s: no filter need to be config, bypass ISV", __func__);
-        return UNKNOWN_ERROR;
-    }
+    // resume FRC held back for buffers, or hold it back if the port got
+    // fewer than it needs. A pending request checks the count itself
+    if (mFrcChange)
+        return;
+    if ((mPendingFrcRate != FRC_RATE_1X && getOutputBufNum(mPendingFrcRate) <= num)
+            || ((mFilters & FilterFrameRateConversion) != 0
+                && getOutputBufNum(mFilterParam.frcRate) > num))
+        requestFrc(mFilterParam.frameRate);
+}
+
+uint32_t ISVProcessor::getRequiredOutputBufNum()
+{
+    Mutex::Autolock autoLock(mLock);
+    return requiredOutputBufNum();
+}
+
+uint32_t ISVProcessor::requiredOutputBufNum() const
+{
+    // same guess as before the stream started until the frame rate is known
+    if (mFpsDetecting)
+        return getOutputBufNum(FRC_RATE_2_5X);
+
+    if (mPendingFrcRate != FRC_RATE_1X)
+        return getOutputBufNum(mPendingFrcRate);
+
+    return getOutputBufNum(((mFilters & FilterFrameRateConversion) != 0) ?
+            mFilterParam.frcRate : FRC_RATE_1X);
+}
+
+uint32_t ISVProcessor::getOutputBufNum(FRC_RATE frcRate)
+{
+    uint32_t filters = (frcRate != FRC_RATE_1X) ? FilterFrameRateConversion : 0;
+    uint32_t num = 0;
+
+    // outputs of the MIN_INPUT_NUM inputs VSP holds at once,
+    // e.g. 2.5X FRC holds 2 + 3 + 2 + 3 = 10 buffers
+    for (uint32_t i = 1; i <= MIN_INPUT_NUM; i++)
+        num += ISVWorker::getOutputBufCount(filters, frcRate, i);
+
+    if (num < MIN_OUTPUT_NUM)
+        num = MIN_OUTPUT_NUM;
+    if (num > MAX_OUTPUT_NUM)
+        num = MAX_OUTPUT_NUM;
+    return num;
+}
 
-    //config filters to mISVWorker
-    return (mISVWorker->configFilters(mFilters, &mFilterParam) == STATUS_OK) ? OK : UNKNOWN_ERROR;
+uint32_t ISVProcessor::getOutputBufNum(uint32_t width, uint32_t height, uint32_t fps)
+{
+    //FIXME: for 1920 x 1088, we also consider it as 1080p
+    sp<ISVProfile> profile = new ISVProfile(width, (height == 1088) ? 1080 : height);
+
+    if (!ISVProfile::isFRCOn()
+            || (profile->getFilterStatus() & FilterFrameRateConversion) == 0
+            || fps == 50 || fps == 60)
+        return getOutputBufNum(FRC_RATE_1X);
+
+    // the frame rate is detected later, provision for the common 24 fps
+    // clip and grow the output port if the detected rate needs more
+    if (!isFrameRateValid(fps))
+        return getOutputBufNum(FRC_RATE_2_5X);
+
+    return getOutputBufNum(profile->getFRCRate(fps));
 }
 
 void ISVProcessor::addInput(OMX_BUFFERHEADERTYPE* input)
 {
+    int64_t arrivalUs = systemTime() / 1000;
+
     if (mbFlush) {
+        android_atomic_inc(&mFramesDropped);
         mpOwner->releaseBuffer(kPortIndexInput, input, true);
         return;
     }
 
     if (mbBypass) {
         // return this buffer to framework
+        android_atomic_inc(&mFramesBypassed);
         mpOwner->releaseBuffer(kPortIndexOutput, input, false);
         return;
     }
@@ -501,6 +709,7 @@ void ISVProcessor::addInput(OMX_BUFFERHEADERTYPE* input)
     status_t ret = configFilters(input);
     if (ret == NOT_ENOUGH_DATA) {
         // release this buffer if frc is not ready.
+        android_atomic_inc(&mFramesRetried);
         mpOwner->releaseBuffer(kPortIndexInput, input, false);
         ALOGD_IF(ISV_THREAD_DEBUG, "%s: frc rate is not ready, release this buffer %u, fps %d", __func__,
                 input, mFilterParam.frameRate);
@@ -508,23 +717,26 @@ void ISVProcessor::addInput(OMX_BUFFERHEADERTYPE* input)
     } else if (ret == UNKNOWN_ERROR) {
         ALOGD_IF(ISV_THREAD_DEBUG, "%s: configFilters failed, bypass ISV", __func__);
         mbBypass = true;
+        android_atomic_inc(&mFramesBypassed);
         mpOwner->releaseBuffer(kPortIndexOutput, input, false);
         return;
     }
 
-    {
-        //put the decoded buffer into fill buffer queue
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqiring mInputLock", __func__);
-        Mutex::Autolock autoLock(mInputLock);
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqired mInputLock", __func__);
-
-        mInputBuffers.push_back(input);
-        ALOGD_IF(ISV_THREAD_DEBUG, "%s: hold pBuffer %u in input buffer queue. Intput queue size is %d, mInputProIdx %d.\
-                Output queue size is %d, mOutputProcIdx %d", __func__,
-                input, mInputBuffers.size(), mInputProcIdx,
-                mOutputBuffers.size(), mOutputProcIdx);
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: releasing mInputLock", __func__);
+    //put the decoded buffer into fill buffer queue
+    if (mInputBuffers.size() >= mInputBuffers.capacity()) {
+        // should not happen, the decoder owns fewer buffers than the queue holds
+        ALOGW("%s: input buffer queue is full, drop pBuffer %u", __func__, input);
+        android_atomic_inc(&mFramesDropped);
+        mpOwner->releaseBuffer(kPortIndexInput, input, false);
+        return;
     }
+    // the arrival goes first and is popped after the buffer, so every
+    // queued buffer has its arrival time. Only this thread pushes, so
+    // both pushes succeed once the check above passed.
+    mInputArrivals.push(arrivalUs);
+    mInputBuffers.push(input);
+    ALOGD_IF(ISV_THREAD_DEBUG, "%s: hold pBuffer %u in input buffer queue. Intput queue size is %d, output queue size is %d",
+            __func__, input, mInputBuffers.size(), mOutputBuffers.size());
 
     {
         Mutex::Autolock autoLock(mLock);
@@ -540,25 +752,19 @@ void ISVProcessor::addOutput(OMX_BUFFERHEADERTYPE* output)
         return;
     }
 
-    if (mbBypass || mOutputBuffers.size() >= MIN_OUTPUT_NUM) {
+    if (mbBypass || mOutputBuffers.size() >= mOutputBufNum) {
         // return this buffer to decoder
         mpOwner->releaseBuffer(kPortIndexInput, output, false);
         return;
     }
 
-    {
-        //push the buffer into the output queue if it is not full
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqiring mOutputLock", __func__);
-        Mutex::Autolock autoLock(mOutputLock);
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: acqired mOutputLock", __func__);
-
-        mOutputBuffers.push_back(output);
-        ALOGD_IF(ISV_THREAD_DEBUG, "%s: hold pBuffer %u in output buffer queue. Input queue size is %d, mInputProIdx %d.\
-                Output queue size is %d, mOutputProcIdx %d", __func__,
-                output, mInputBuffers.size(), mInputProcIdx,
-                mOutputBuffers.size(), mOutputProcIdx);
-        ALOGD_IF(ISV_COMPONENT_LOCK_DEBUG, "%s: releasing mOutputLock", __func__);
+    //push the buffer into the output queue if it is not full
+    if (!mOutputBuffers.push(output)) {
+        mpOwner->releaseBuffer(kPortIndexInput, output, false);
+        return;
     }
+    ALOGD_IF(ISV_THREAD_DEBUG, "%s: hold pBuffer %u in output buffer queue. Input queue size is %d, output queue size is %d",
+            __func__, output, mInputBuffers.size(), mOutputBuffers.size());
 
     {
         Mutex::Autolock autoLock(mLock);
@@ -593,25 +799,45 @@ void ISVProcessor::waitFlushFinished()
 
 void ISVProcessor::flush()
 {
+    // only called on the processor thread, or after it has exited
     OMX_BUFFERHEADERTYPE* pBuffer = NULL;
-    {
-        Mutex::Autolock autoLock(mInputLock);
-        while (!mInputBuffers.empty()) {
-            pBuffer = mInputBuffers.itemAt(0);
-            mpOwner->releaseBuffer(kPortIndexInput, pBuffer, true);
-            ALOGD_IF(ISV_THREAD_DEBUG, "%s: Flush the pBuffer %u in input buffer queue.", __func__, pBuffer);
-            mInputBuffers.removeAt(0);
-        }
-    }
-    {
-        Mutex::Autolock autoLock(mOutputLock);
-        while (!mOutputBuffers.empty()) {
-            pBuffer = mOutputBuffers.itemAt(0);
-            mpOwner->releaseBuffer(kPortIndexOutput, pBuffer, true);
-            ALOGD_IF(ISV_THREAD_DEBUG, "%s: Flush the pBuffer %u in output buffer queue.", __func__, pBuffer);
-            mOutputBuffers.removeAt(0);
-        }
+    mFrcTimestamp.reset();
+    // the timestamps before a seek say nothing about the ones after it
+    mFpsEstimator.reset();
+    while ((pBuffer = mInputBuffers.pop()) != NULL) {
+        mInputArrivals.pop();
+        android_atomic_inc(&mFramesDropped);
+        mpOwner->releaseBuffer(kPortIndexInput, pBuffer, true);
+        ALOGD_IF(ISV_THREAD_DEBUG, "%s: Flush the pBuffer %u in input buffer queue.", __func__, pBuffer);
+    }
+    while ((pBuffer = mOutputBuffers.pop()) != NULL) {
+        mpOwner->releaseBuffer(kPortIndexOutput, pBuffer, true);
+        ALOGD_IF(ISV_THREAD_DEBUG, "%s: Flush the pBuffer %u in output buffer queue.", __func__, pBuffer);
     }
     //flush finished.
     return;
 }
+
+void ISVProcessor::updateLatency(int64_t arrivalUs)
+{
+    if (arrivalUs <= 0)
+        return;
+
+    int64_t latencyMs = (systemTime() / 1000 - arrivalUs) / 1000;
+    uint32_t bucket = 0;
+    while (latencyMs > 0 && bucket < ISV_LATENCY_BUCKETS - 1) {
+        latencyMs >>= 1;
+        bucket++;
+    }
+    android_atomic_inc(&mLatencyHistogram[bucket]);
+}
+
+void ISVProcessor::getStatistics(ISV_STATISTICS *stats)
+{
+    stats->nFramesProcessed = android_atomic_acquire_load(&mFramesProcessed);
+    stats->nFramesBypassed = android_atomic_acquire_load(&mFramesBypassed);
+    stats->nFramesDropped = android_atomic_acquire_load(&mFramesDropped);
+    stats->nFramesRetried = android_atomic_acquire_load(&mFramesRetried);
+    for (uint32_t i = 0; i < ISV_LATENCY_BUCKETS; i++)
+        stats->nLatencyHistogram[i] = android_atomic_acquire_load(&mLatencyHistogram[i]);
+}
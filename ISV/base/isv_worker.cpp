@@ -50,6 +50,9 @@ enum STRENGTH {
 
 #define MAX_FRC_OUTPUT 4 /*for frcx4*/
 
+// Debug only, see VPPFrameTap.h for the properties that enable it
+#define FRAME_OUTPUT_FILE_TAP "/storage/sdcard0/isv_output.tap"
+
 using namespace android;
 
 ISVWorker::ISVWorker()
@@ -63,9 +66,25 @@ ISVWorker::ISVWorker()
     mNumFilterBuffers(0),
     mFilterFrc(VA_INVALID_ID), mFilters(0),
     mInputIndex(0), mOutputIndex(0),
-    mOutputCount(0) {
+    mOutputCount(0),
+    mSurfaceCacheIdleSize(0),
+    mSurfaceClock(0) {
     memset(&mFilterBuffers, VA_INVALID_ID, VAProcFilterCount * sizeof(VABufferID));
     memset(&mFilterParam, 0, sizeof(mFilterParam));
+
+    // sized from the video in init() unless set here
+    char value[PROPERTY_VALUE_MAX];
+    mSurfaceCacheBudget = 0;
+    mSurfaceCacheBudgetSet = false;
+    if (property_get("isv.surface.cache.kb", value, NULL) > 0) {
+        mSurfaceCacheBudget = (uint32_t)atoi(value) * 1024;
+        mSurfaceCacheBudgetSet = true;
+    }
+}
+
+ISVWorker::~ISVWorker() {
+    deinit();
+    terminateVA();
 }
 
 bool ISVWorker::isSupport() const {
@@ -102,16 +121,20 @@ uint32_t ISVWorker::getFillBufCount() {
 }
 
 uint32_t ISVWorker::getOutputBufCount(uint32_t index) {
+    return getOutputBufCount(mFilters, mFilterParam.frcRate, index);
+}
+
+uint32_t ISVWorker::getOutputBufCount(uint32_t filters, FRC_RATE frcRate, uint32_t index) {
     uint32_t bufCount = 1;
-    if (((mFilters & FilterFrameRateConversion) != 0)
+    if (((filters & FilterFrameRateConversion) != 0)
             && index > 0)
-            bufCount = mFilterParam.frcRate - (((mFilterParam.frcRate == FRC_RATE_2_5X) ? (index & 1): 0));
+            bufCount = frcRate - (((frcRate == FRC_RATE_2_5X) ? (index & 1): 0));
     return bufCount;
 }
 
 
-status_t ISVWorker::init(uint32_t width, uint32_t height) {
-    ALOGV("init");
+status_t ISVWorker::setupVA() {
+    ALOGV("setupVA");
 
     if (mDisplay != NULL) {
         ALOGE("VA is particially started");
@@ -152,6 +175,59 @@ status_t ISVWorker::init(uint32_t width, uint32_t height) {
     vaStatus = vaCreateConfig(mVADisplay, VAProfileNone, VAEntrypointVideoProc, &attrib, 1, &mVAConfig);
     CHECK_VASTATUS("vaCreateConfig");
 
+    return STATUS_OK;
+}
+
+status_t ISVWorker::terminateVA() {
+    {
+        Mutex::Autolock autoLock(mSurfaceLock);
+        for (uint32_t i = 0; i < mSurfaceCache.size(); i++) {
+            VASurfaceID surface = mSurfaceCache[i].surface;
+            if (!mSurfaceCache[i].idle)
+                ALOGW("%s: surface %d is still in use", __func__, surface);
+            if (VA_STATUS_SUCCESS != vaDestroySurfaces(mVADisplay, &surface, 1))
+                ALOGW("%s: failed to destroy surface %d", __func__, surface);
+        }
+        mSurfaceCache.clear();
+        mSurfaceCacheIdleSize = 0;
+    }
+
+    if (mVAConfig != VA_INVALID_ID) {
+        vaDestroyConfig(mVADisplay, mVAConfig);
+        mVAConfig = VA_INVALID_ID;
+    }
+
+    if (mVADisplay) {
+        vaTerminate(mVADisplay);
+        mVADisplay = NULL;
+    }
+
+    if (mDisplay) {
+        delete mDisplay;
+        mDisplay = NULL;
+    }
+
+    return STATUS_OK;
+}
+
+status_t ISVWorker::init(uint32_t width, uint32_t height) {
+    ALOGV("init");
+
+    if (mVAContext != VA_INVALID_ID) {
+        ALOGE("VA context has already been created");
+        return STATUS_ERROR;
+    }
+
+    // the VA display is kept across deinit() so cached surfaces stay valid
+    if (mVADisplay == NULL) {
+        status_t ret = setupVA();
+        if (ret != STATUS_OK) {
+            terminateVA();
+            return ret;
+        }
+    }
+
+    VAStatus vaStatus;
 
     // Create Context
     ALOGV("ready to create context");
@@ -160,11 +236,29 @@ status_t ISVWorker::init(uint32_t width, uint32_t height) {
     vaStatus = vaCreateContext(mVADisplay, mVAConfig, mWidth, mHeight, 0, NULL, 0, &mVAContext);
     CHECK_VASTATUS("vaCreateContext");
 
+    if (!mSurfaceCacheBudgetSet) {
+        // enough for a few output buffers, with room for the pitch and
+        // height alignment of the gralloc buffers
+        Mutex::Autolock autoLock(mSurfaceLock);
+        uint32_t surfaceSize = ((mWidth + 127) & ~127) * ((mHeight + 63) & ~63) * 3 / 2;
+        mSurfaceCacheBudget = ISV_SURFACE_CACHE_DEFAULT_SURFACES * surfaceSize;
+        trimSurfaceCache(mSurfaceCacheBudget);
+    }
+
+    mFrameTap = VPPFrameTap::createFromProperties("isv", FRAME_OUTPUT_FILE_TAP);
+    if (mFrameTap != NULL && mFrameTap->start(mWidth, mHeight) != OK)
+        mFrameTap.clear();
+
     ALOGV("VA has been successfully started");
     return STATUS_OK;
 }
 
 status_t ISVWorker::deinit() {
+    if (mFrameTap != NULL) {
+        mFrameTap->stop();
+        mFrameTap.clear();
+    }
+
     {
         Mutex::Autolock autoLock(mPipelineBufferLock);
         while (!mPipelineBuffers.isEmpty()) {
@@ -196,26 +290,12 @@ status_t ISVWorker::deinit() {
          mVAContext = VA_INVALID_ID;
     }
 
-    if (mVAConfig != VA_INVALID_ID) {
-        vaDestroyConfig(mVADisplay, mVAConfig);
-        mVAConfig = VA_INVALID_ID;
-    }
-
-    if (mVADisplay) {
-        vaTerminate(mVADisplay);
-        mVADisplay = NULL;
-    }
-
-    if (mDisplay) {
-        delete mDisplay;
-        mDisplay = NULL;
-    }
-
     return STATUS_OK;
 }
 
 status_t ISVWorker::allocSurface(uint32_t* width, uint32_t* height,
-        uint32_t stride, uint32_t format, unsigned long handle, int32_t* surfaceId)
+        uint32_t stride, uint32_t format, unsigned long handle,
+        uint64_t bufferId, int32_t* surfaceId)
 {
     if (mWidth == 0 || mHeight == 0) {
         ALOGE("%s: isv worker has not been initialized.", __func__);
@@ -226,6 +306,14 @@ status_t ISVWorker::allocSurface(uint32_t* width, uint32_t* height,
     *width = mWidth;
     *height = mHeight;
 #endif
+    {
+        Mutex::Autolock autoLock(mSurfaceLock);
+        if (takeCachedSurface(bufferId, *width, *height, stride, format, surfaceId)) {
+            ALOGV("%s: reuse surface %d for buffer %llu", __func__, *surfaceId, bufferId);
+            return STATUS_OK;
+        }
+    }
+
     // Create VASurfaces
     VASurfaceAttrib attribs[3];
     VASurfaceAttribExternalBuffers vaExtBuf;
@@ -302,16 +390,114 @@ status_t ISVWorker::allocSurface(uint32_t* width, uint32_t* height,
                                  vaExtBuf.height, (VASurfaceID*)surfaceId, 1, attribs, 3);
     CHECK_VASTATUS("vaCreateSurfaces");
 
-    return (vaStatus == VA_STATUS_SUCCESS) ? STATUS_OK : STATUS_ERROR;
+    ISVSurfaceCacheEntry entry;
+    entry.bufferId = bufferId;
+    entry.width = *width;
+    entry.height = *height;
+    entry.stride = stride;
+    entry.format = format;
+    entry.surface = *surfaceId;
+    entry.size = vaExtBuf.data_size;
+    entry.idle = false;
+    entry.lastUse = 0;
+    {
+        Mutex::Autolock autoLock(mSurfaceLock);
+        mSurfaceCache.push_back(entry);
+    }
+
+    return STATUS_OK;
 }
 
-status_t ISVWorker::freeSurface(int32_t* surfaceId)
+status_t ISVWorker::freeSurface(int32_t* surfaceId, bool reusable)
 {
+    if (*surfaceId == -1)
+        return STATUS_OK;
+
+    {
+        Mutex::Autolock autoLock(mSurfaceLock);
+        int32_t index = findSurfaceEntry(*surfaceId);
+        if (index >= 0) {
+            ISVSurfaceCacheEntry &entry = mSurfaceCache.editItemAt(index);
+            if (entry.idle) {
+                ALOGW("%s: surface %d has already been freed", __func__, *surfaceId);
+                return STATUS_OK;
+            }
+            if (reusable && entry.bufferId != 0 && entry.size <= mSurfaceCacheBudget) {
+                entry.idle = true;
+                entry.lastUse = ++mSurfaceClock;
+                mSurfaceCacheIdleSize += entry.size;
+                trimSurfaceCache(mSurfaceCacheBudget);
+                // the cached surface may be handed out again, forget it
+                *surfaceId = -1;
+                return STATUS_OK;
+            }
+            mSurfaceCache.removeAt(index);
+        }
+    }
+
     VAStatus vaStatus = VA_STATUS_SUCCESS;
-    vaDestroySurfaces(mVADisplay, (VASurfaceID*)surfaceId, 1);
+    vaStatus = vaDestroySurfaces(mVADisplay, (VASurfaceID*)surfaceId, 1);
     CHECK_VASTATUS("vaDestroySurfaces");
 
-    return (vaStatus == VA_STATUS_SUCCESS) ? STATUS_OK : STATUS_ERROR;
+    *surfaceId = -1;
+    return STATUS_OK;
+}
+
+int32_t ISVWorker::findSurfaceEntry(int32_t surface) const
+{
+    for (uint32_t i = 0; i < mSurfaceCache.size(); i++) {
+        if (mSurfaceCache[i].surface == surface)
+            return i;
+    }
+    return -1;
+}
+
+bool ISVWorker::takeCachedSurface(uint64_t bufferId, uint32_t width, uint32_t height,
+        uint32_t stride, uint32_t format, int32_t* surfaceId)
+{
+    if (bufferId == 0)
+        return false;
+
+    for (uint32_t i = 0; i < mSurfaceCache.size(); i++) {
+        ISVSurfaceCacheEntry &entry = mSurfaceCache.editItemAt(i);
+        if (entry.idle && entry.bufferId == bufferId
+                && entry.width == width && entry.height == height
+                && entry.stride == stride && entry.format == format) {
+            entry.idle = false;
+            mSurfaceCacheIdleSize -= entry.size;
+            *surfaceId = entry.surface;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ISVWorker::trimSurfaceCache(uint32_t budget)
+{
+    while (mSurfaceCacheIdleSize > budget) {
+        // evict the least recently freed idle surface
+        int32_t victim = -1;
+        for (uint32_t i = 0; i < mSurfaceCache.size(); i++) {
+            if (mSurfaceCache[i].idle
+                    && (victim < 0 || mSurfaceCache[i].lastUse < mSurfaceCache[victim].lastUse))
+                victim = i;
+        }
+        if (victim < 0)
+            break;
+
+        VASurfaceID surface = mSurfaceCache[victim].surface;
+        ALOGV("%s: evict surface %d", __func__, surface);
+        if (VA_STATUS_SUCCESS != vaDestroySurfaces(mVADisplay, &surface, 1))
+            ALOGW("%s: failed to destroy surface %d", __func__, surface);
+        mSurfaceCacheIdleSize -= mSurfaceCache[victim].size;
+        mSurfaceCache.removeAt(victim);
+    }
+}
+
+void ISVWorker::purgeSurfaceCache()
+{
+    Mutex::Autolock autoLock(mSurfaceLock);
+    trimSurfaceCache(0);
 }
 
 status_t ISVWorker::configFilters(uint32_t filters,
@@ -876,7 +1062,8 @@ status_t ISVWorker::fill(Vector<ISVBuffer*> outputBuffer, uint32_t outputCount)
         CHECK_VASTATUS("vaSyncSurface");
         vaStatus = STATUS_OK;
         mOutputCount++;
-        //dumpYUVFrameData(output[i]);
+        if (mFrameTap != NULL)
+            dumpYUVFrameData(output[i]);
     }
 
     {
@@ -897,12 +1084,15 @@ status_t ISVWorker::fill(Vector<ISVBuffer*> outputBuffer, uint32_t outputCount)
 }
 
 // Debug only
-#define FRAME_OUTPUT_FILE_NV12 "/storage/sdcard0/vpp_output.nv12"
 status_t ISVWorker::dumpYUVFrameData(VASurfaceID surfaceID) {
     status_t ret;
     if (surfaceID == VA_INVALID_SURFACE)
         return STATUS_ERROR;
 
+    // skip mapping the surface for frames that are not sampled
+    if (!mFrameTap->shouldTap())
+        return STATUS_OK;
+
     VAStatus vaStatus;
     VAImage image;
     unsigned char *data_ptr;
@@ -915,11 +1105,11 @@ status_t ISVWorker::dumpYUVFrameData(VASurfaceID surfaceID) {
     vaStatus = vaMapBuffer(mVADisplay, image.buf, (void **)&data_ptr);
     CHECK_VASTATUS("vaMapBuffer");
 
-    ret = writeNV12(mFilterParam.srcWidth, mFilterParam.srcHeight, data_ptr, image.pitches[0], image.pitches[1]);
-    if (ret != STATUS_OK) {
-        ALOGV("writeNV12 error");
-        return STATUS_ERROR;
-    }
+    ret = mFrameTap->tapNV12(mFilterParam.srcWidth, mFilterParam.srcHeight,
+            data_ptr + image.offsets[0], image.pitches[0],
+            data_ptr + image.offsets[1], image.pitches[1]);
+    if (ret != OK)
+        ALOGV("frame %d is not tapped: %d", mOutputCount, ret);
 
     vaStatus = vaUnmapBuffer(mVADisplay, image.buf);
     CHECK_VASTATUS("vaUnMapBuffer");
@@ -994,47 +1184,3 @@ uint32_t ISVWorker::getVppOutputFps() {
     return outputFps;
 }
 
-
-status_t ISVWorker::writeNV12(int width, int height, unsigned char *out_buf, int y_pitch, int uv_pitch) {
-    size_t result;
-    int frame_size;
-    unsigned char *y_start, *uv_start;
-    int h;
-
-    FILE *ofile = fopen(FRAME_OUTPUT_FILE_NV12, "ab");
-    if(ofile == NULL) {
-        ALOGE("Open %s failed!", FRAME_OUTPUT_FILE_NV12);
-        return STATUS_ERROR;
-    }
-
-    if (out_buf == NULL)
-    {
-        fclose(ofile);
-        return STATUS_ERROR;
-    }
-    if ((width % 2) || (height % 2))
-    {
-        fclose(ofile);
-        return STATUS_ERROR;
-    }
-    // Set frame size
-    frame_size = height * width * 3/2;
-
-    /* write y */
-    y_start = out_buf;
-    for (h = 0; h < height; ++h) {
-        result = fwrite(y_start, sizeof(unsigned char), width, ofile);
-        y_start += y_pitch;
-    }
-
-    /* write uv */
-    uv_start = out_buf + uv_pitch * height;
-    for (h = 0; h < height / 2; ++h) {
-        result = fwrite(uv_start, sizeof(unsigned char), width, ofile);
-        uv_start += uv_pitch;
-    }
-    // Close file
-    fclose(ofile);
-    return STATUS_OK;
-}
-
@@ -22,10 +22,13 @@
 #include <utils/Mutex.h>
 #include <utils/Errors.h>
 #include "isv_worker.h"
+#include "isv_bufmap.h"
 
 using namespace android;
 
 #define ISV_BUFFER_MANAGER_DEBUG 0
+// minimum number of slots in the handle map, must be power of 2
+#define ISV_BUFFER_MAP_MIN_SIZE 16
 
 class ISVWorker;
 
@@ -117,9 +120,11 @@ class ISVBufferManager: public RefBase
 public:
     ISVBufferManager()
         :mWorker(NULL),
-        mMetaDataMode(false) {}
+        mMetaDataMode(false),
+        mBufferMap(NULL),
+        mFrozen(0) {}
 
-    ~ISVBufferManager() {}
+    ~ISVBufferManager();
     // set mBuffers size
     status_t setBufferCount(int32_t size);
 
@@ -128,10 +133,18 @@ public:
     status_t useBuffer(unsigned long handle);
     status_t freeBuffer(unsigned long handle);
 
-    // Map to ISVBuffer
+    /* Map to ISVBuffer
+     * Once all buffers set by setBufferCount are registered, the buffer set
+     * is frozen and lookups don't take mBufferLock until it changes again.
+     * The map a lock-free lookup may be walking is never changed or freed:
+     * changing the buffer set works on a copy, and replaced maps and freed
+     * buffers are kept until all buffers are freed (port disabled) or the
+     * manager is gone.
+     */
     ISVBuffer* mapBuffer(unsigned long handle);
     // set isv worker
     void setWorker(sp<ISVWorker> worker) { mWorker = worker; }
+    sp<ISVWorker> getWorker() const { return mWorker; }
     void setMetaDataMode(bool metaDataMode) { mMetaDataMode = metaDataMode; }
 private:
     typedef enum {
@@ -139,11 +152,29 @@ private:
         META_DATA_MODE = 1,
     } ISV_WORK_MODE;
 
+    typedef ISVHandleMap<ISVBuffer> BufferMap;
+    // resize handle map for bufferCount buffers and insert registered buffers again
+    status_t rebuildBufferMap(uint32_t bufferCount);
+    // publish map as mBufferMap, the old map is kept until releaseRetired
+    void replaceBufferMap(BufferMap* map);
+    void releaseRetired();
+    // unfreeze the buffer set before it changes, lookups take the lock again
+    status_t openBufferSet();
+    // freeze the buffer set if all buffers are registered, otherwise unfreeze it
+    void updateFrozen();
+
     sp<ISVWorker> mWorker;
     bool mMetaDataMode;
     // VPP buffer queue
     Vector<ISVBuffer*> mBuffers;
-    Mutex mBufferLock; // to protect access to mBuffers
+    Mutex mBufferLock; // to protect access to mBuffers and mBufferMap
+    // handle -> ISVBuffer, only changed while the buffer set is not frozen
+    BufferMap* volatile mBufferMap;
+    // maps replaced and buffers freed while lock-free lookups may still see them
+    Vector<BufferMap*> mRetiredMaps;
+    Vector<ISVBuffer*> mRetiredBuffers;
+    // set when lookups can skip mBufferLock
+    volatile int32_t mFrozen;
 };
 
 
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __ISV_BUFMAP_H
+#define __ISV_BUFMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Open addressed handle -> T map with linear probing, for any T with
+ * unsigned long getHandle(). The map only holds pointers, a NULL slot is
+ * empty. Removal shifts back the rest of the probe chain, so there are no
+ * tombstones and a lookup stops at the first empty slot. lookup() only
+ * reads the slots, the owner keeps the map unchanged while lookups run
+ * without its lock.
+ */
+template <typename T>
+class ISVHandleMap
+{
+public:
+    // size must be a power of 2, returns NULL if out of memory
+    static ISVHandleMap* create(uint32_t size) {
+        ISVHandleMap* map = new ISVHandleMap;
+        if (map == NULL)
+            return NULL;
+        map->mSlots = new T*[size];
+        if (map->mSlots == NULL) {
+            delete map;
+            return NULL;
+        }
+        map->mMask = size - 1;
+        memset(map->mSlots, 0, size * sizeof(T*));
+        return map;
+    }
+
+    ~ISVHandleMap() { delete[] mSlots; }
+
+    // a map with the same entries in the same slots
+    ISVHandleMap* copy() const {
+        ISVHandleMap* map = create(size());
+        if (map != NULL)
+            memcpy(map->mSlots, mSlots, size() * sizeof(T*));
+        return map;
+    }
+
+    uint32_t size() const { return mMask + 1; }
+
+    // handles are pointers, mix the bits so aligned values spread out
+    static uint32_t hash(unsigned long handle) {
+        uint32_t h = (uint32_t)handle;
+        h ^= h >> 16;
+        h *= 0x45d9f3b;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // slot a handle is probed from
+    uint32_t home(unsigned long handle) const { return hash(handle) & mMask; }
+
+    T* slotAt(uint32_t slot) const { return mSlots[slot & mMask]; }
+
+    T* lookup(unsigned long handle) const {
+        uint32_t slot = home(handle);
+        for (uint32_t i = 0; i <= mMask; i++) {
+            T* item = mSlots[slot];
+            if (item == NULL)
+                return NULL;
+            if (item->getHandle() == handle)
+                return item;
+            slot = (slot + 1) & mMask;
+        }
+        return NULL;
+    }
+
+    // the caller keeps the map larger than the item count, so a free slot exists
+    void insert(T* item) {
+        uint32_t slot = home(item->getHandle());
+        while (mSlots[slot] != NULL)
+            slot = (slot + 1) & mMask;
+        mSlots[slot] = item;
+    }
+
+    void remove(unsigned long handle) {
+        uint32_t slot = home(handle);
+        while (mSlots[slot] != NULL && mSlots[slot]->getHandle() != handle)
+            slot = (slot + 1) & mMask;
+        if (mSlots[slot] == NULL)
+            return;
+
+        // shift back following entries of the probe chain, no tombstones needed
+        uint32_t hole = slot;
+        uint32_t next = (hole + 1) & mMask;
+        while (mSlots[next] != NULL) {
+            uint32_t from = home(mSlots[next]->getHandle());
+            // move the entry if its home slot is not in (hole, next]
+            if (((next - from) & mMask) >= ((next - hole) & mMask)) {
+                mSlots[hole] = mSlots[next];
+                hole = next;
+            }
+            next = (next + 1) & mMask;
+        }
+        mSlots[hole] = NULL;
+    }
+
+private:
+    ISVHandleMap() : mMask(0), mSlots(NULL) {}
+    ISVHandleMap(const ISVHandleMap &);
+    ISVHandleMap &operator=(const ISVHandleMap &);
+
+    uint32_t mMask;     // number of slots - 1
+    T **mSlots;
+};
+
+#endif /* __ISV_BUFMAP_H */
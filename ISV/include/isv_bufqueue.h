@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __ISV_BUFQUEUE_H
+#define __ISV_BUFQUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cutils/atomic.h>
+
+/* Fixed capacity single producer / single consumer ring queue.
+ * push() may only be called from the producer thread, peek() and pop()
+ * only from the consumer thread. size() and empty() may be called from
+ * either side. Neither side ever blocks: push() fails when the ring is
+ * full and pop() returns T() (NULL for pointers) when it is empty.
+ */
+template <typename T>
+class ISVRingQueue
+{
+public:
+    explicit ISVRingQueue(uint32_t minCapacity)
+        :mItems(NULL),
+        mMask(0),
+        mHead(0),
+        mTail(0)
+    {
+        uint32_t capacity = 1;
+        while (capacity < minCapacity)
+            capacity <<= 1;
+        mItems = new T[capacity];
+        mMask = capacity - 1;
+    }
+
+    ~ISVRingQueue() { delete[] mItems; }
+
+    uint32_t capacity() const { return mMask + 1; }
+
+    uint32_t size() const {
+        int32_t head = android_atomic_acquire_load(&mHead);
+        int32_t tail = android_atomic_acquire_load(&mTail);
+        return (uint32_t)tail - (uint32_t)head;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // producer side
+    bool push(T item) {
+        int32_t tail = mTail;
+        int32_t head = android_atomic_acquire_load(&mHead);
+        if ((uint32_t)tail - (uint32_t)head > mMask)
+            return false;
+        mItems[(uint32_t)tail & mMask] = item;
+        android_atomic_release_store((int32_t)((uint32_t)tail + 1), &mTail);
+        return true;
+    }
+
+    // consumer side, index 0 is the oldest item
+    T peek(uint32_t index) const {
+        uint32_t head = (uint32_t)mHead;
+        uint32_t tail = (uint32_t)android_atomic_acquire_load(&mTail);
+        if (index >= tail - head)
+            return T();
+        return mItems[(head + index) & mMask];
+    }
+
+    // consumer side
+    T pop() {
+        uint32_t head = (uint32_t)mHead;
+        uint32_t tail = (uint32_t)android_atomic_acquire_load(&mTail);
+        if (head == tail)
+            return T();
+        T item = mItems[head & mMask];
+        android_atomic_release_store((int32_t)(head + 1), &mHead);
+        return item;
+    }
+
+private:
+    ISVRingQueue(const ISVRingQueue &);
+    ISVRingQueue &operator=(const ISVRingQueue &);
+
+    T *mItems;
+    uint32_t mMask;
+    // only written by consumer
+    volatile int32_t mHead;
+    // only written by producer
+    volatile int32_t mTail;
+};
+
+#endif /* __ISV_BUFQUEUE_H */
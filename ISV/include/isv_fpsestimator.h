@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __ISV_FPSESTIMATOR_H
+#define __ISV_FPSESTIMATOR_H
+
+#include <stdint.h>
+#include <utils/Errors.h>
+
+using namespace android;
+
+#define ISV_FPS_MIN_WINDOW      4
+#define ISV_FPS_MAX_WINDOW      32
+#define ISV_FPS_DEFAULT_WINDOW  8
+
+/* Estimate the input frame rate from buffer timestamps.
+ * The last windowSize timestamps are kept in a ring. Each estimate sorts
+ * them, takes the median frame interval, drops intervals more than 25%
+ * away from it (jitter, reordered or repeated frames, dropped frames)
+ * and snaps the mean of the rest to a standard rate.
+ */
+class ISVFpsEstimator
+{
+public:
+    ISVFpsEstimator(uint32_t windowSize = ISV_FPS_DEFAULT_WINDOW);
+
+    // drop all samples, e.g. after seek
+    void reset();
+
+    /* add a timestamp and estimate the frame rate
+     * @return:
+     *      OK: *fps is a standard frame rate
+     *      NOT_ENOUGH_DATA: not enough consistent samples yet
+     *      BAD_VALUE: stable cadence, but not close to a standard rate
+     */
+    status_t addTimestamp(int64_t timeUs, uint32_t *fps);
+
+private:
+    // snap a frame interval to the nearest standard frame rate
+    static status_t snapFps(int64_t intervalUs, uint32_t *fps);
+
+    int64_t mTimestamps[ISV_FPS_MAX_WINDOW];
+    uint32_t mWindowSize;
+    uint32_t mCount;
+    uint32_t mNext;
+};
+
+#endif /* __ISV_FPSESTIMATOR_H */
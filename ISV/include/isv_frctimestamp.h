@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __ISV_FRCTIMESTAMP_H
+#define __ISV_FRCTIMESTAMP_H
+
+#include <stdint.h>
+#include "isv_profile.h"
+
+/* Timestamps of the frames FRC outputs.
+ * At a rate of num/den, input k ends at output floor(k * num / den) of
+ * the output grid, so each input yields a batch of outputs whose last one
+ * may lie between two inputs. The grid step is the measured input
+ * interval divided by the rate, so 23.976/29.97 fps and variable frame
+ * rate clips stay on the right grid.
+ */
+class ISVFrcTimestamp
+{
+public:
+    ISVFrcTimestamp();
+
+    // forget the input cadence and phase, e.g. after flush
+    void reset();
+
+    /* set timestamps[0..count) for a batch of count outputs ending at the
+     * input with timestamp timeUs, the last entry is the latest output.
+     * frameRate is the nominal input rate, used for the first input and
+     * after a gap in the stream. All entries are timeUs if no interval is
+     * known or the batch has a single output.
+     */
+    void update(FRC_RATE rate, uint32_t frameRate, int64_t timeUs,
+            uint32_t count, int64_t *timestamps);
+
+private:
+    static void getRatio(FRC_RATE rate, int32_t *num, int32_t *den);
+
+    int64_t mLastInputTimeUs;
+    // (k * num) mod den of the last input k
+    int32_t mPhase;
+};
+
+#endif /* __ISV_FRCTIMESTAMP_H */
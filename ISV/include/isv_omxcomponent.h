@@ -31,14 +31,20 @@
 
 #define ISV_COMPONENT_DEBUG 0
 
+/* The output buffers ISV holds depend on the FRC rate and are negotiated
+ * at runtime, see ISVProcessor::getOutputBufNum()
+ */
 #ifdef TARGET_VPP_USE_GEN
 #define MIN_INPUT_NUM           (3)
 #define MIN_OUTPUT_NUM          (3)
+#define MAX_OUTPUT_NUM          (3)
 #else
 #define MIN_INPUT_NUM           (4)    // forward reference frame number is 3 for merrifield/moorefield
-#define MIN_OUTPUT_NUM          (10)   // 2.5FRC need hold 2 + 3 + 2 + 3= 10 buffers, without FRC we set to 6
+#define MIN_OUTPUT_NUM          (6)    // without FRC we set to 6, 2.5FRC need hold 2 + 3 + 2 + 3= 10 buffers
+#define MAX_OUTPUT_NUM          (16)   // 4FRC need hold 4 + 4 + 4 + 4 = 16 buffers
 #endif
 #define MIN_ISV_BUFFER_NUM      ((MIN_OUTPUT_NUM) + (MIN_INPUT_NUM))
+#define MAX_ISV_BUFFER_NUM      ((MAX_OUTPUT_NUM) + (MIN_INPUT_NUM))
 #define UNDEQUEUED_NUM          (4)   // display system hold 4 buffers
 
 using namespace android;
@@ -51,6 +57,7 @@ public:
     ~ISVProcThreadObserver();
 
     virtual OMX_ERRORTYPE releaseBuffer(PORT_INDEX index, OMX_BUFFERHEADERTYPE* pBuffer, bool flush);
+    virtual OMX_ERRORTYPE reconfigOutputPort();
 private:
     OMX_COMPONENTTYPE *mBaseComponent;
     OMX_COMPONENTTYPE *mComponent;
@@ -74,8 +81,7 @@ public:
     OMX_ERRORTYPE freeComponent(){return (*(mCore->mFreeHandle))(static_cast<OMX_HANDLETYPE>(mComponent));}
     // return ISV component handle
     OMX_COMPONENTTYPE *getBaseComponent(){return &mBaseComponent;}
-    
-    static Vector<ISVComponent*> g_isv_components;
+
 private:
     /*
      * component methods & helpers
@@ -199,6 +205,11 @@ private:
         OMX_OUT OMX_U8 *cRole,
         OMX_IN OMX_U32 nIndex);
 
+    static OMX_ERRORTYPE EmptyBufferDone(
+        OMX_OUT OMX_HANDLETYPE hComponent,
+        OMX_OUT OMX_PTR pAppData,
+        OMX_OUT OMX_BUFFERHEADERTYPE* pBuffer);
+
     static OMX_ERRORTYPE FillBufferDone(
         OMX_OUT OMX_HANDLETYPE hComponent,
         OMX_OUT OMX_PTR pAppData,
@@ -229,6 +240,11 @@ private:
     // init & deinit functions
     status_t init(int32_t width, int32_t height);
     void deinit();
+    // output buffers ISV holds for a stream of this size
+    uint32_t getISVOutputBufNum(uint32_t width, uint32_t height);
+    // recompute mNumISVBuffers for the decoder's output port and tell the
+    // decoder if it changed, or always if force is set
+    void updateISVBufferNum(bool force);
 
     const static OMX_U8 OMX_SPEC_VERSION_MAJOR = 1;
     const static OMX_U8 OMX_SPEC_VERSION_MINOR = 0;
@@ -244,6 +260,7 @@ private:
     typedef enum OMX_ISVINDEXEXTTYPE {
         OMX_IndexISVStartUsed = OMX_IndexVendorStartUnused + 0x0000F000,
         OMX_IndexExtSetISVMode,                  /**< reference: OMX_U32 */
+        OMX_IndexExtISVStatistics,               /**< reference: ISV_STATISTICS */
     } OMX_ISVINDEXEXTTYPE;
 
     typedef enum {
@@ -272,6 +289,8 @@ private:
     int32_t mNumDecoderBuffersBak;
     uint32_t mWidth;
     uint32_t mHeight;
+    // frame rate set on the input port, 0 if unknown
+    uint32_t mInputFrameRate;
     uint32_t mUseAndroidNativeBufferIndex;
     uint32_t mStoreMetaDataInBuffersIndex;
     uint32_t mHackFormat;
@@ -283,6 +302,8 @@ private:
     bool mVPPOn;
     bool mVPPFlushing;
     bool mInitialized;
+    // decoded frames sent straight to the client because ISV is bypassed
+    volatile int32_t mFramesBypassed;
 #ifdef TARGET_VPP_USE_GEN
     // vpp thread
     sp<ISVProcessor> mProcThread;
@@ -25,6 +25,9 @@
 #include <utils/threads.h>
 #include <utils/Errors.h>
 #include "isv_bufmanager.h"
+#include "isv_bufqueue.h"
+#include "isv_fpsestimator.h"
+#include "isv_frctimestamp.h"
 #define ISV_COMPONENT_LOCK_DEBUG 0
 #define ISV_THREAD_DEBUG 0
 
@@ -35,11 +38,28 @@ typedef enum {
     kPortIndexOutput = 1
 }PORT_INDEX;
 
+// ISV stage latency histogram, bucket i counts frames held for
+// [2^(i-1), 2^i) ms, bucket 0 is below 1 ms and the last one is open ended
+#define ISV_LATENCY_BUCKETS 8
+
+/* Statistics returned by OMX.intel.index.ISVStatistics (GetConfig) */
+typedef struct ISV_STATISTICS {
+    OMX_U32 nSize;
+    OMX_VERSIONTYPE nVersion;
+    OMX_U32 nFramesProcessed;   // decoded frames sent through VSP
+    OMX_U32 nFramesBypassed;    // decoded frames passed through without processing
+    OMX_U32 nFramesDropped;     // decoded frames returned unrendered by flush or overflow
+    OMX_U32 nFramesRetried;     // decoded frames returned while waiting for the frame rate
+    OMX_U32 nLatencyHistogram[ISV_LATENCY_BUCKETS];
+} ISV_STATISTICS;
+
 class ISVBufferManager;
 class ISVProcessorObserver: public RefBase
 {
 public:
     virtual OMX_ERRORTYPE releaseBuffer(PORT_INDEX index, OMX_BUFFERHEADERTYPE* pBuffer, bool bFlush) = 0;
+    // ask the client to reconfigure the output port for a new ISV buffer count
+    virtual OMX_ERRORTYPE reconfigOutputPort() = 0;
 };
 
 class ISVProcessor : public Thread
@@ -62,20 +82,36 @@ public:
     void stop();
     bool isReadytoRun();
 
-    //configure FRC factor
+    //configure FRC factor, applied before VSP takes the next task
     status_t configFRC(uint32_t fps);
-    //add output buffer into mOutputBuffers
+    //add output buffer into mOutputBuffers, called from the OMX client thread
     void addOutput(OMX_BUFFERHEADERTYPE* output);
-    //add intput buffer into mInputBuffers
+    //add intput buffer into mInputBuffers, called from the decoder callback thread
     void addInput(OMX_BUFFERHEADERTYPE* input);
     //notify flush and wait flush finish
     void notifyFlush();
     void waitFlushFinished();
+    //whether decoded buffers bypass ISV for the rest of the session
+    bool isBypassing() const { return mbBypass; }
+    //read the frame counters and latency histogram
+    void getStatistics(ISV_STATISTICS *stats);
+    //set the output buffers ISV may hold, called when the output port is
+    //configured. FRC follows the new count before VSP takes the next task
+    void setOutputBufNum(uint32_t num);
+    //output buffers the current filters need, may differ from the ones set
+    //once the frame rate is known
+    uint32_t getRequiredOutputBufNum();
+    //output buffers needed to run FRC at frcRate
+    static uint32_t getOutputBufNum(FRC_RATE frcRate);
+    //output buffers needed for a stream before it starts, fps is 0 if unknown
+    static uint32_t getOutputBufNum(uint32_t width, uint32_t height, uint32_t fps);
 
 private:
     bool getBufForFirmwareOutput(Vector<ISVBuffer*> *fillBufList,
             uint32_t *fillBufNum);
     status_t updateFirmwareOutputBufStatus(uint32_t fillBufNum);
+    //set the time stamp of frames interpolated by FRC
+    void setFrcTimestamps(uint32_t fillBufNum);
     bool getBufForFirmwareInput(Vector<ISVBuffer*> *procBufList,
             ISVBuffer **inputBuf,
             uint32_t *procBufNum );
@@ -83,11 +119,26 @@ private:
     //flush input&ouput buffer queue
     void flush();
     //return whether this fps is valid
-    inline bool isFrameRateValid(uint32_t fps);
-    //auto calculate fps if the framework doesn't set the correct fps
-    status_t calculateFps(int64_t timeStamp, uint32_t* fps);
+    static inline bool isFrameRateValid(uint32_t fps);
     //config vpp filters
     status_t configFilters(OMX_BUFFERHEADERTYPE* buffer);
+    //ask for FRC at fps, 0 turns it off. Called with mLock held
+    void requestFrc(uint32_t fps);
+    //switch FRC to the requested rate. Called with mLock held and no VSP
+    //task in flight, the output count of a task follows the rate it was
+    //sent with
+    void applyFrcChange();
+    //finish the VSP tasks in flight through fill(), then applyFrcChange().
+    //Called on the processor thread with mLock held, returns false if the
+    //thread should exit
+    bool drainForFrcChange();
+    //account the time a released input spent in ISV
+    void updateLatency(int64_t arrivalUs);
+    //return whether the output port should be reconfigured for the
+    //buffers the current filters need
+    bool checkOutputBufNum();
+    //getRequiredOutputBufNum() with mLock held
+    uint32_t requiredOutputBufNum() const;
 
 private:
     sp<ISVProcessorObserver> mpOwner;
@@ -99,16 +150,35 @@ private:
     // buffer manager
     sp<ISVBufferManager> mBufferManager;
 
-    Vector<OMX_BUFFERHEADERTYPE*> mOutputBuffers;
-    Mutex mOutputLock; // to protect access to mOutputBuffers
+    // filled by addOutput, drained by the processor thread
+    ISVRingQueue<OMX_BUFFERHEADERTYPE*> mOutputBuffers;
+    // offset from the queue head of the first output not yet sent to VSP
     uint32_t mOutputProcIdx;
-
-    Vector<OMX_BUFFERHEADERTYPE*> mInputBuffers;
-    Mutex mInputLock; // to protect access to mFillBuffers
+    // output buffers addOutput may hold, set from the output port config
+    uint32_t mOutputBufNum;
+    // set once the client was asked to reconfigure the output port
+    bool mOutputBufNumRequested;
+    // FRC rate held back until the output port has enough buffers for it
+    FRC_RATE mPendingFrcRate;
+    // FRC is enabled by the profile and the settings
+    bool mFrcSupported;
+    // set by requestFrc(), cleared once applyFrcChange() switched to
+    // mUpdatedFrameRate
+    bool mFrcChange;
+    uint32_t mUpdatedFrameRate;
+
+    // filled by addInput, drained by the processor thread
+    ISVRingQueue<OMX_BUFFERHEADERTYPE*> mInputBuffers;
+    // offset from the queue head of the first input not yet sent to VSP
     uint32_t mInputProcIdx;
-
-    const static uint32_t WINDOW_SIZE = 4;  // must >= 2
-    Vector<int64_t>mTimeWindow;
+    // arrival time of each buffer in mInputBuffers, pushed before and
+    // popped after the buffer, so it may briefly hold one extra entry
+    ISVRingQueue<int64_t> mInputArrivals;
+
+    // auto detect fps if the framework doesn't set the correct fps,
+    // guarded by mLock so flush() can drop the samples
+    ISVFpsEstimator mFpsEstimator;
+    bool mFpsDetecting;
     // conditon for thread running
     Mutex mLock;
     Condition mRunCond;
@@ -119,6 +189,8 @@ private:
 
     uint32_t mNumTaskInProcesing;
     uint32_t mNumRetry;
+    // FRC output timestamps, see setFrcTimestamps()
+    ISVFrcTimestamp mFrcTimestamp;
     bool mError;
     bool mbFlush;
     bool mbBypass;
@@ -128,6 +200,13 @@ private:
     // ISV filter configuration
     uint32_t mFilters;
     FilterParam mFilterParam;
+
+    // statistics, updated from both the callback and processor threads
+    volatile int32_t mFramesProcessed;
+    volatile int32_t mFramesBypassed;
+    volatile int32_t mFramesDropped;
+    volatile int32_t mFramesRetried;
+    volatile int32_t mLatencyHistogram[ISV_LATENCY_BUCKETS];
 };
 
 #endif /* __ISV_THREAD_H*/
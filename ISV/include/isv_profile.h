@@ -22,6 +22,8 @@
 #define MAX_TAB_SIZE (10)
 #define MAX_STRING_LEN (50)
 
+#include <sys/types.h>
+#include <time.h>
 #include <utils/RefBase.h>
 using namespace android;
 
@@ -71,6 +73,83 @@ typedef enum _FilterType {
     FilterImageStabilization            = 0x00000400,
 } FilterType;
 
+// FRC rate lookup table covers input fps [0, ISV_PROFILE_MAX_FPS]
+#define ISV_PROFILE_MAX_FPS (120)
+
+/* Immutable snapshot of the ISV profile XML.
+ * It is parsed once per process and shared by every ISVProfile; it is
+ * only parsed again when the XML file changes.
+ */
+class ISVProfileData : public RefBase
+{
+public:
+    typedef enum _ProcFilterType {
+        ProcFilterNone = 0,
+        ProcFilterNoiseReduction,
+        ProcFilterDeinterlacing,
+        ProcFilterSharpening,
+        ProcFilterColorBalance,
+        ProcFilterDeblocking,
+        ProcFilterFrameRateConversion,
+        ProcFilterSkinToneEnhancement,
+        ProcFilterTotalColorCorrection,
+        ProcFilterNonLinearAnamorphicScaling,
+        ProcFilterImageStabilization,
+        ProcFilterCount
+    } ProcFilterType;
+
+    /* get the shared snapshot, parse the XML file if it changed */
+    static sp<ISVProfileData> get();
+
+    /* FRC rate for the input fps, constant time */
+    FRC_RATE getFRCRate(uint32_t inputFps) const;
+
+    /* dump the config data */
+    void dumpConfigData(uint32_t status) const;
+
+private:
+    ISVProfileData();
+
+    /* Get the config data from XML file */
+    void getDataFromXmlFile(void);
+
+    /* build the fps indexed FRC rate table */
+    void buildFrcRateTable();
+
+    /* handle the XML file */
+    static void startElement(void *userData, const char *name, const char **atts);
+    static void endElement(void *userData, const char *name);
+    int getFilterID(const char * name);
+    uint32_t getResolution(const char * name);
+    void getConfigData(const char *name, const char **atts);
+    void handleFilterParameter(const char *name, const char **atts);
+    void handleCommonParameter(const char *name, const char **atts);
+
+public:
+    /* whether the XML file was found */
+    bool mLoaded;
+
+    /* The default value of VPP/FRC.
+     * They will be read from config xml file.
+     */
+    int32_t mDefaultVPPStatus;
+    int32_t mDefaultFRCStatus;
+
+    ISVConfig mConfigs[ProcFilterCount];
+    ISVFRCRate mFrcRates[MAX_TAB_SIZE];
+
+private:
+    uint32_t mCurrentFilter; //used by parasing xml file
+    uint32_t mCurrentFrcTab;
+    FRC_RATE mFrcRateByFps[ISV_PROFILE_MAX_FPS + 1];
+
+    /* XML file stamp the snapshot was parsed from */
+    time_t mFileMtime;
+    off_t mFileSize;
+
+    static const int mBufSize = MAX_BUF_SIZE;
+};
+
 class ISVProfile : public RefBase
 {
 public:
@@ -95,49 +174,13 @@ private:
     /* Read the global setting for ISV */
     static int32_t getGlobalStatus();
 
-    /* Get the config data from XML file */
-    void getDataFromXmlFile(void);
-
     /* Update the filter status */
     void updateFilterStatus();
 
-    /* handle the XML file */
-    static void startElement(void *userData, const char *name, const char **atts);
-    static void endElement(void *userData, const char *name);
-    int getFilterID(const char * name);
-    uint32_t getResolution(const char * name);
-    void getConfigData(const char *name, const char **atts);
-    void handleFilterParameter(const char *name, const char **atts);
-    void handleCommonParameter(const char *name, const char **atts);
-
-    /* dump the config data */
-    void dumpConfigData();
-
-    typedef enum _ProcFilterType {
-        ProcFilterNone = 0,
-        ProcFilterNoiseReduction,
-        ProcFilterDeinterlacing,
-        ProcFilterSharpening,
-        ProcFilterColorBalance,
-        ProcFilterDeblocking,
-        ProcFilterFrameRateConversion,
-        ProcFilterSkinToneEnhancement,
-        ProcFilterTotalColorCorrection,
-        ProcFilterNonLinearAnamorphicScaling,
-        ProcFilterImageStabilization,
-        ProcFilterCount
-    } ProcFilterType;
-
 private:
     uint32_t mWidth;
     uint32_t mHeight;
 
-    /* The default value of VPP/FRC.
-     * They will be read from config xml file.
-     */
-    int32_t mDefaultVPPStatus;
-    int32_t mDefaultFRCStatus;
-
     /* the filters' status according to resolution
      * bit 0  used for ProcFilterNone
      * bit 1  used for ProcFilterNoiseReduction
@@ -146,12 +189,8 @@ private:
      */
     uint32_t mStatus;
 
-    ISVConfig mConfigs[ProcFilterCount];
-    uint32_t mCurrentFilter; //used by parasing xml file
-    ISVFRCRate mFrcRates[MAX_TAB_SIZE];
-    uint32_t mCurrentFrcTab;
-
-    static const int mBufSize = MAX_BUF_SIZE;
+    /* shared profile snapshot */
+    sp<ISVProfileData> mData;
 };
 
 #endif /* __ISV_PROFILE_H */
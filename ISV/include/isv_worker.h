@@ -25,6 +25,7 @@
 #include <utils/RefBase.h>
 #include "isv_profile.h"
 #include "isv_bufmanager.h"
+#include "VPPFrameTap.h"
 
 #define ANDROID_DISPLAY_HANDLE 0x18C34078
 #define Display unsigned int
@@ -84,6 +85,32 @@ typedef struct {
 
 class ISVBuffer;
 
+// default budget of idle VA surfaces kept by ISVWorker, in NV12 surfaces
+// of the size given to init(). isv.surface.cache.kb sets it in KB instead,
+// 0 turns the cache off
+#define ISV_SURFACE_CACHE_DEFAULT_SURFACES 4
+
+/* A VA surface wrapping a gralloc buffer. Idle entries were released by
+ * an ISVBuffer whose meta data moved to another gralloc buffer, and are
+ * kept so the same buffer can be wrapped again without vaCreateSurfaces
+ * when it reappears.
+ */
+struct ISVSurfaceCacheEntry {
+    // key, bufferId identifies the gralloc allocation, not the handle
+    // pointer, which may be reused for another buffer
+    uint64_t bufferId;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t format;
+
+    int32_t surface;
+    uint32_t size;
+    bool idle;
+    // LRU stamp, larger is more recently freed
+    uint32_t lastUse;
+};
+
 class ISVWorker : public RefBase
 {
 
@@ -91,7 +118,11 @@ class ISVWorker : public RefBase
         // config filters on or off based on video info
         status_t configFilters(uint32_t filters, const FilterParam* filterParam);
 
-        // Initialize: setupVA()->setupFilters()->setupPipelineCaps()
+        /* Initialize: setupVA()->setupFilters()->setupPipelineCaps()
+         * The VA display and surface cache are only set up on the first
+         * init(), deinit() only destroys the context and filters so they
+         * survive port reconfiguration. Both are released with the worker.
+         */
         status_t init(uint32_t width, uint32_t height);
         status_t deinit();
 
@@ -101,6 +132,9 @@ class ISVWorker : public RefBase
         // Get output buffer number needed for filling
         uint32_t getFillBufCount();
 
+        // Get output buffer number of the index-th input for the given filters and FRC rate
+        static uint32_t getOutputBufCount(uint32_t filters, FRC_RATE frcRate, uint32_t index);
+
         // Send input and output buffers to VSP to begin processing
         status_t process(ISVBuffer* input, Vector<ISVBuffer*> output, uint32_t outputCount, bool isEOS, uint32_t flags);
 
@@ -121,18 +155,37 @@ class ISVWorker : public RefBase
 
         uint32_t getVppOutputFps();
 
-        // alloc/free VA surface
+        /* alloc/free VA surface
+         * allocSurface() reuses an idle cached surface of the same buffer
+         * id, size, stride and format, a bufferId of 0 is never cached.
+         * freeSurface() keeps a reusable surface idle in the cache,
+         * evicting the least recently freed ones beyond the cache budget,
+         * and destroys it otherwise.
+         */
         status_t allocSurface(uint32_t* width, uint32_t* height,
-                uint32_t stride, uint32_t format, unsigned long handle, int32_t* surfaceId);
-        status_t freeSurface(int32_t* surfaceId);
+                uint32_t stride, uint32_t format, unsigned long handle,
+                uint64_t bufferId, int32_t* surfaceId);
+        status_t freeSurface(int32_t* surfaceId, bool reusable = true);
+        // destroy all idle cached surfaces, called once the port's buffers are freed
+        void purgeSurfaceCache();
 
         ISVWorker();
-        ~ISVWorker() {}
+        ~ISVWorker();
 
     private:
+        // Create/destroy VA display and config
+        status_t setupVA();
+        status_t terminateVA();
+
         // Check if VPP is supported
         bool isSupport() const;
 
+        // surface cache, called with mSurfaceLock held
+        int32_t findSurfaceEntry(int32_t surface) const;
+        bool takeCachedSurface(uint64_t bufferId, uint32_t width, uint32_t height,
+                uint32_t stride, uint32_t format, int32_t* surfaceId);
+        void trimSurfaceCache(uint32_t budget);
+
         // Get output buffer number needed for processing
         uint32_t getOutputBufCount(uint32_t index);
 
@@ -146,9 +199,8 @@ class ISVWorker : public RefBase
         bool isFpsSupport(int32_t fps, int32_t *fpsSet, int32_t fpsSetCnt);
 
         // Debug only
-        // Dump YUV frame
+        // Dump YUV frame to frame tap
         status_t dumpYUVFrameData(VASurfaceID surfaceID);
-        status_t writeNV12(int width, int height, unsigned char *out_buf, int y_pitch, int uv_pitch);
 
         ISVWorker(const ISVWorker &);
         ISVWorker &operator=(const ISVWorker &);
@@ -188,6 +240,18 @@ class ISVWorker : public RefBase
         uint32_t mOutputIndex;
         uint32_t mOutputCount;
 
+        // VA surfaces created by allocSurface(), in use or idle
+        Vector<ISVSurfaceCacheEntry> mSurfaceCache;
+        Mutex mSurfaceLock; // to protect access to mSurfaceCache
+        uint32_t mSurfaceCacheBudget;
+        // mSurfaceCacheBudget was set by isv.surface.cache.kb
+        bool mSurfaceCacheBudgetSet;
+        uint32_t mSurfaceCacheIdleSize;
+        uint32_t mSurfaceClock;
+
+        // debug only, NULL unless enabled by isv.frametap.* properties
+        sp<VPPFrameTap> mFrameTap;
+
         // FIXME: not very sure how to check color standard
         VAProcColorStandardType in_color_standards[VAProcColorStandardCount];
         VAProcColorStandardType out_color_standards[VAProcColorStandardCount];
@@ -20,6 +20,7 @@
 #include "isv_omxcomponent.h"
 #include <media/hardware/HardwareAPI.h>
 #include "isv_profile.h"
+#include <cutils/atomic.h>
 #ifndef TARGET_VPP_USE_GEN
 #include <OMX_IntelColorFormatExt.h>
 #endif
@@ -39,7 +40,12 @@ using namespace android;
     if (!pComp)                                                             \
         return OMX_ErrorBadParameter;
 
-Vector<ISVComponent*> ISVComponent::g_isv_components;
+// the real component was given the ISV component as its pAppData
+#define GET_ISVOMX_COMPONENT_FROM_APPDATA(hComponent, pAppData)             \
+    ISVComponent *pComp = static_cast<ISVComponent*>(pAppData);             \
+    if (!pComp || (pComp->mComponent != NULL &&                             \
+            static_cast<OMX_HANDLETYPE>(pComp->mComponent) != hComponent))  \
+        return OMX_ErrorUndefined;
 
 #ifndef TARGET_VPP_USE_GEN
 //global, static
@@ -63,6 +69,7 @@ ISVComponent::ISVComponent(
         mNumDecoderBuffersBak(0),
         mWidth(0),
         mHeight(0),
+        mInputFrameRate(0),
         mUseAndroidNativeBufferIndex(0),
         mStoreMetaDataInBuffersIndex(0),
         mHackFormat(0),
@@ -71,6 +78,7 @@ ISVComponent::ISVComponent(
         mVPPEnabled(false),
         mVPPFlushing(false),
         mInitialized(false),
+        mFramesBypassed(0),
 #ifdef TARGET_VPP_USE_GEN
         mProcThread(NULL),
 #endif
@@ -101,7 +109,6 @@ ISVComponent::ISVComponent(
     mBaseComponent.ComponentDeInit = NULL;
     mBaseComponent.UseEGLImage = NULL;
     mBaseComponent.ComponentRoleEnum = ComponentRoleEnum;
-    g_isv_components.push_back(static_cast<ISVComponent*>(this));
 
     mVPPOn = ISVProfile::isFRCOn() || ISVProfile::isVPPOn();
     ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: mVPPOn %d", __func__, mVPPOn);
@@ -120,12 +127,6 @@ ISVComponent::~ISVComponent()
         mpISVCallBacks = NULL;
     }
 
-    for (OMX_U32 i = 0; i < g_isv_components.size(); i++) {
-        if (g_isv_components.itemAt(i) == static_cast<ISVComponent*>(this)) {
-            g_isv_components.removeAt(i);
-        }
-    }
-
     memset(&mBaseComponent, 0, sizeof(OMX_COMPONENTTYPE));
     deinit();
     mVPPOn = false;
@@ -146,6 +147,9 @@ status_t ISVComponent::init(int32_t width, int32_t height)
         mProcThread = new ISVProcessor(false, mISVBufferManager, mProcThreadObserver, width, height);
         mOwnProcessor = true;
         mProcThread->start();
+        // the input port may be configured before the processor exists
+        if (mInputFrameRate != 0)
+            mProcThread->configFRC(mInputFrameRate);
     }
 #ifndef TARGET_VPP_USE_GEN
     else {
@@ -162,6 +166,51 @@ status_t ISVComponent::init(int32_t width, int32_t height)
     return STATUS_OK;
 }
 
+uint32_t ISVComponent::getISVOutputBufNum(uint32_t width, uint32_t height)
+{
+    // the running processor knows the detected frame rate
+    if (mProcThread != NULL && mOwnProcessor
+            && width == mWidth && height == mHeight)
+        return mProcThread->getRequiredOutputBufNum();
+
+    return ISVProcessor::getOutputBufNum(width, height, mInputFrameRate);
+}
+
+void ISVComponent::updateISVBufferNum(bool force)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE def;
+    SetTypeHeader(&def, sizeof(def));
+    def.nPortIndex = kPortIndexOutput;
+    if (OMX_GetParameter(mComponent, OMX_IndexParamPortDefinition, &def) != OMX_ErrorNone) {
+        ALOGW("%s: failed to get output port definition", __func__);
+        return;
+    }
+
+    int32_t number = MIN_INPUT_NUM + getISVOutputBufNum(
+            def.format.video.nFrameWidth, def.format.video.nFrameHeight);
+    if (number == mNumISVBuffers && !force)
+        return;
+
+    ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: ISV buffer number %d -> %d", __func__, mNumISVBuffers, number);
+    mNumISVBuffers = number;
+#ifndef TARGET_VPP_USE_GEN
+    // the decoder keeps these buffers out of its own reference count
+    uint32_t vppBufferNum = mNumISVBuffers;
+    OMX_INDEXTYPE index;
+    status_t error =
+        OMX_GetExtensionIndex(
+                mComponent,
+                "OMX.Intel.index.vppBufferNum",
+                &index);
+    if (error == OK) {
+        error = OMX_SetParameter(mComponent, index, (OMX_PTR)&vppBufferNum);
+    } else {
+        // ingore this error
+        ALOGW("Get vpp number index failed");
+    }
+#endif
+}
+
 void ISVComponent::deinit()
 {
     pthread_mutex_lock(&ProcThreadInstanceLock);
@@ -194,7 +243,7 @@ OMX_CALLBACKTYPE* ISVComponent::getCallBacks(OMX_CALLBACKTYPE* pCallBacks)
         return NULL;
     }
     mpISVCallBacks->EventHandler = EventHandler;
-    mpISVCallBacks->EmptyBufferDone = pCallBacks->EmptyBufferDone;
+    mpISVCallBacks->EmptyBufferDone = EmptyBufferDone;
     mpISVCallBacks->FillBufferDone = FillBufferDone;
     return mpISVCallBacks;
 }
@@ -225,6 +274,12 @@ OMX_ERRORTYPE ISVComponent::ISV_SendCommand(
             mVPPFlushing = true;
             mProcThread->notifyFlush();
         }
+
+        // the client reads the output port definition again before it
+        // enables the port, after a resolution change or a request from
+        // the processor for another ISV buffer count
+        if (Cmd == OMX_CommandPortDisable && nParam1 == kPortIndexOutput)
+            updateISVBufferNum(false);
     }
 
     return OMX_SendCommand(mComponent, Cmd, nParam1, pCmdData);
@@ -255,6 +310,7 @@ OMX_ERRORTYPE ISVComponent::ISV_GetParameter(
         if (nParamIndex == OMX_IndexParamPortDefinition
                 && def->nPortIndex == kPortIndexOutput) {
             ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: orignal bufferCountActual %d, bufferCountMin %d",  __func__, def->nBufferCountActual, def->nBufferCountMin);
+            // set by updateISVBufferNum, together with the decoder's count
             def->nBufferCountActual += mNumISVBuffers;
             def->nBufferCountMin += mNumISVBuffers;
 #ifndef TARGET_VPP_USE_GEN
@@ -294,23 +350,8 @@ OMX_ERRORTYPE ISVComponent::ISV_SetParameter(
         if (*def == ISV_AUTO) {
             mVPPEnabled = true;
             ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: mVPPEnabled -->true", __func__);
-#ifndef TARGET_VPP_USE_GEN
-            if (mVPPOn) {
-                uint32_t number = MIN_INPUT_NUM + MIN_OUTPUT_NUM;
-                OMX_INDEXTYPE index;
-                status_t error =
-                    OMX_GetExtensionIndex(
-                            mComponent,
-                            "OMX.Intel.index.vppBufferNum",
-                            &index);
-                if (error == OK) {
-                    error = OMX_SetParameter(mComponent, index, (OMX_PTR)&number);
-                } else {
-                    // ingore this error
-                    ALOGW("Get vpp number index failed");
-                }
-            }
-#endif
+            if (mVPPOn)
+                updateISVBufferNum(true);
         } else if (*def == ISV_DISABLE)
             mVPPEnabled = false;
         return OMX_ErrorNone;
@@ -324,7 +365,8 @@ OMX_ERRORTYPE ISVComponent::ISV_SetParameter(
 
             if (def->nPortIndex == kPortIndexOutput) {
                 //set the buffer count we should fill to decoder before feed buffer to VPP
-                mNumDecoderBuffersBak = mNumDecoderBuffers = def->nBufferCountActual - MIN_OUTPUT_NUM - UNDEQUEUED_NUM;
+                uint32_t outputNum = mNumISVBuffers - MIN_INPUT_NUM;
+                mNumDecoderBuffersBak = mNumDecoderBuffers = def->nBufferCountActual - outputNum - UNDEQUEUED_NUM;
                 OMX_VIDEO_PORTDEFINITIONTYPE *video_def = &def->format.video;
 
                 //FIXME: init itself here
@@ -336,6 +378,8 @@ OMX_ERRORTYPE ISVComponent::ISV_SetParameter(
                         mHeight = video_def->nFrameHeight;
                     }
                 }
+                if (mProcThread != NULL && mOwnProcessor)
+                    mProcThread->setOutputBufNum(outputNum);
                 ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: def->nBufferCountActual %d, mNumDecoderBuffersBak %d", __func__,
                         def->nBufferCountActual, mNumDecoderBuffersBak);
                 if (mISVBufferManager != NULL && OK != mISVBufferManager->setBufferCount(def->nBufferCountActual)) {
@@ -349,8 +393,10 @@ OMX_ERRORTYPE ISVComponent::ISV_SetParameter(
             if (def->nPortIndex == kPortIndexInput) {
                 OMX_VIDEO_PORTDEFINITIONTYPE *video_def = &def->format.video;
 
+                mInputFrameRate = video_def->xFramerate;
                 if (mProcThread != NULL)
                     mProcThread->configFRC(video_def->xFramerate);
+                updateISVBufferNum(false);
             }
         }
 
@@ -397,6 +443,22 @@ OMX_ERRORTYPE ISVComponent::ISV_GetConfig(
 {
     ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: nIndex 0x%08x", __func__, nIndex);
 
+    if (nIndex == static_cast<OMX_INDEXTYPE>(OMX_IndexExtISVStatistics)) {
+        ISV_STATISTICS *stats = static_cast<ISV_STATISTICS*>(pComponentConfigStructure);
+        if (stats == NULL || stats->nSize < sizeof(ISV_STATISTICS))
+            return OMX_ErrorBadParameter;
+
+        OMX_U32 size = stats->nSize;
+        OMX_VERSIONTYPE version = stats->nVersion;
+        memset(stats, 0, sizeof(ISV_STATISTICS));
+        stats->nSize = size;
+        stats->nVersion = version;
+        if (mProcThread != NULL)
+            mProcThread->getStatistics(stats);
+        stats->nFramesBypassed += android_atomic_acquire_load(&mFramesBypassed);
+        return OMX_ErrorNone;
+    }
+
     return OMX_GetConfig(mComponent, nIndex, pComponentConfigStructure);
 }
 
@@ -439,6 +501,11 @@ OMX_ERRORTYPE ISVComponent::ISV_GetExtensionIndex(
         return OMX_ErrorNone;
     }
 
+    if(!strncmp(cParameterName, "OMX.intel.index.ISVStatistics", strlen(cParameterName))) {
+        *pIndexType = static_cast<OMX_INDEXTYPE>(OMX_IndexExtISVStatistics);
+        return OMX_ErrorNone;
+    }
+
     OMX_ERRORTYPE err = OMX_GetExtensionIndex(mComponent, cParameterName, pIndexType);
 
     if(err == OMX_ErrorNone &&
@@ -606,6 +673,10 @@ OMX_ERRORTYPE ISVComponent::ISV_FillThisBuffer(
     if(!mVPPEnabled || !mVPPOn)
         return OMX_FillThisBuffer(mComponent, pBuffer);
 
+    // no active filter, hand the buffer straight back to the decoder
+    if (mProcThread->isBypassing())
+        return OMX_FillThisBuffer(mComponent, pBuffer);
+
     if (mISVBufferManager != NULL) {
         ISVBuffer* isvBuffer = mISVBufferManager->mapBuffer(reinterpret_cast<unsigned long>(pBuffer->pBuffer));
         if (isvBuffer == NULL) {
@@ -637,14 +708,9 @@ OMX_ERRORTYPE ISVComponent::FillBufferDone(
         OMX_OUT OMX_PTR pAppData,
         OMX_OUT OMX_BUFFERHEADERTYPE* pBuffer)
 {
-    ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: API entry. ISV component num %d, component handle %p on index 0", __func__,
-            g_isv_components.size(),
-            g_isv_components.itemAt(0));
-    for (OMX_U32 i = 0; i < g_isv_components.size(); i++) {
-        if (static_cast<OMX_HANDLETYPE>(g_isv_components.itemAt(i)->mComponent) == hComponent)
-            return g_isv_components.itemAt(i)->ISV_FillBufferDone(hComponent, pAppData, pBuffer);
-    }
-    return OMX_ErrorUndefined;
+    GET_ISVOMX_COMPONENT_FROM_APPDATA(hComponent, pAppData);
+
+    return pComp->ISV_FillBufferDone(hComponent, pComp->mBaseComponent.pApplicationPrivate, pBuffer);
 }
 
 OMX_ERRORTYPE ISVComponent::ISV_FillBufferDone(
@@ -664,11 +730,30 @@ OMX_ERRORTYPE ISVComponent::ISV_FillBufferDone(
         return mpCallBacks->FillBufferDone(&mBaseComponent, pAppData, pBuffer);
     }
 
+    // no active filter, skip the processor
+    if (mProcThread->isBypassing()) {
+        android_atomic_inc(&mFramesBypassed);
+        return mpCallBacks->FillBufferDone(&mBaseComponent, pAppData, pBuffer);
+    }
+
     mProcThread->addInput(pBuffer);
 
     return OMX_ErrorNone;
 }
 
+OMX_ERRORTYPE ISVComponent::EmptyBufferDone(
+        OMX_OUT OMX_HANDLETYPE hComponent,
+        OMX_OUT OMX_PTR pAppData,
+        OMX_OUT OMX_BUFFERHEADERTYPE* pBuffer)
+{
+    GET_ISVOMX_COMPONENT_FROM_APPDATA(hComponent, pAppData);
+
+    if (!pComp->mpCallBacks)
+        return OMX_ErrorUndefined;
+    return pComp->mpCallBacks->EmptyBufferDone(&pComp->mBaseComponent,
+            pComp->mBaseComponent.pApplicationPrivate, pBuffer);
+}
+
 OMX_ERRORTYPE ISVComponent::EventHandler(
         OMX_IN OMX_HANDLETYPE hComponent,
         OMX_IN OMX_PTR pAppData,
@@ -677,14 +762,10 @@ OMX_ERRORTYPE ISVComponent::EventHandler(
         OMX_IN OMX_U32 nData2,
         OMX_IN OMX_PTR pEventData)
 {
-    ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: API entry. ISV component num %d, component handle %p on index 0", __func__,
-            g_isv_components.size(),
-            g_isv_components.itemAt(0));
-    for (OMX_U32 i = 0; i < g_isv_components.size(); i++) {
-        if (static_cast<OMX_HANDLETYPE>(g_isv_components.itemAt(i)->mComponent) == hComponent)
-            return g_isv_components.itemAt(i)->ISV_EventHandler(hComponent, pAppData, eEvent, nData1, nData2, pEventData);
-    }
-    return OMX_ErrorUndefined;
+    GET_ISVOMX_COMPONENT_FROM_APPDATA(hComponent, pAppData);
+
+    return pComp->ISV_EventHandler(hComponent, pComp->mBaseComponent.pApplicationPrivate,
+            eEvent, nData1, nData2, pEventData);
 }
 
 OMX_ERRORTYPE ISVComponent::ISV_EventHandler(
@@ -767,10 +848,12 @@ OMX_ERRORTYPE ISVComponent::ISV_SetCallbacks(
             }
         }
         mpISVCallBacks->EventHandler = EventHandler;
-        mpISVCallBacks->EmptyBufferDone = pCallbacks->EmptyBufferDone;
+        mpISVCallBacks->EmptyBufferDone = EmptyBufferDone;
         mpISVCallBacks->FillBufferDone = FillBufferDone;
         mpCallBacks = pCallbacks;
-        return mComponent->SetCallbacks(mComponent, mpISVCallBacks, pAppData);
+        // the component hands this back as pAppData in every callback
+        mBaseComponent.pApplicationPrivate = pAppData;
+        return mComponent->SetCallbacks(mComponent, mpISVCallBacks, static_cast<OMX_PTR>(this));
     }
     return mComponent->SetCallbacks(mComponent, pCallbacks, pAppData);
 }
@@ -858,3 +941,15 @@ OMX_ERRORTYPE ISVProcThreadObserver::releaseBuffer(PORT_INDEX index, OMX_BUFFERH
     return err;
 }
 
+OMX_ERRORTYPE ISVProcThreadObserver::reconfigOutputPort()
+{
+    if (!mBaseComponent || !mComponent || !mpCallBacks)
+        return OMX_ErrorUndefined;
+
+    // the client disables the output port and reads the port definition
+    // again, which carries the new ISV buffer count
+    ALOGD_IF(ISV_COMPONENT_DEBUG, "%s: output port settings changed", __func__);
+    return mpCallBacks->EventHandler(mBaseComponent, mBaseComponent->pApplicationPrivate,
+            OMX_EventPortSettingsChanged, kPortIndexOutput, OMX_IndexParamPortDefinition, NULL);
+}
+
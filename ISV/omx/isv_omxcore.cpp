@@ -96,7 +96,6 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_Init(void)
                     ALOGD_IF(ISV_CORE_DEBUG, "OMX IL core: contains %ld components", g_cores[i].mNumComponents);
                 }
             } else {
-                pthread_mutex_unlock(&g_module_lock);
                 ALOGW("OMX IL core not found");
             }
         }
@@ -197,7 +196,7 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMX_GetHandle(
         OMX_ERRORTYPE omx_res = (*(g_cores[i].mGetHandle))(
                 &tempHandle,
                 const_cast<char *>(cComponentName),
-                pAppData, pISVCallBacks);
+                static_cast<OMX_PTR>(pISVComponent), pISVCallBacks);
         if(omx_res == OMX_ErrorNone) {
             pISVComponent->setComponent(static_cast<OMX_COMPONENTTYPE*>(tempHandle), &g_cores[i]);
             g_isv_components.push_back(pISVComponent);
@@ -17,7 +17,9 @@
 #include <libexpat/expat.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 #include "isv_profile.h"
 
 #undef LOG_TAG
@@ -30,19 +32,17 @@
 using namespace android;
 static const char StatusOn[][5] = {"1frc", "1vpp"};
 
-ISVProfile::ISVProfile(const uint32_t width, const uint32_t height)
+ISVProfileData::ISVProfileData()
 {
     int i;
 
-    mWidth = width;
-    mHeight = height;
-
+    mLoaded = false;
     mCurrentFilter = 0;
     mCurrentFrcTab = 0;
     mDefaultVPPStatus = 0;
     mDefaultFRCStatus = 0;
-
-    mStatus = 0;
+    mFileMtime = 0;
+    mFileSize = 0;
 
     memset(mConfigs, 0, sizeof(ISVConfig) * ProcFilterCount);
 
@@ -51,35 +51,83 @@ ISVProfile::ISVProfile(const uint32_t width, const uint32_t height)
         mFrcRates[i].rate = FRC_RATE_1X;
     }
 
-    /* get the vpp global setting */
-    //getGlobalStatus();
+    for (i = 0; i <= ISV_PROFILE_MAX_FPS; i++)
+        mFrcRateByFps[i] = FRC_RATE_1X;
+}
+
+sp<ISVProfileData> ISVProfileData::get()
+{
+    static Mutex sLock;
+    static sp<ISVProfileData> sData;
+
+    /* a stat() per session is much cheaper than parsing the XML */
+    struct stat st;
+    if (::stat(DEFAULT_XML_FILE, &st) != 0) {
+        st.st_mtime = 0;
+        st.st_size = 0;
+    }
+
+    Mutex::Autolock autoLock(sLock);
+    if (sData != NULL && sData->mFileMtime == st.st_mtime && sData->mFileSize == st.st_size)
+        return sData;
+
+    sp<ISVProfileData> data = new ISVProfileData();
+    data->mFileMtime = st.st_mtime;
+    data->mFileSize = st.st_size;
 
     /* load the config data from XML file */
-    getDataFromXmlFile();
+    data->getDataFromXmlFile();
+    data->buildFrcRateTable();
+
+    ALOGI("%s: profile %s %s", __func__, DEFAULT_XML_FILE,
+            (sData == NULL) ? "loaded" : "changed, reloaded");
+    sData = data;
+    return sData;
+}
+
+void ISVProfileData::buildFrcRateTable()
+{
+    /* walk backwards so the first entry for an fps wins, as the XML order did */
+    for (int i = MAX_TAB_SIZE - 1; i >= 0; i--) {
+        if (mFrcRates[i].input_fps <= ISV_PROFILE_MAX_FPS)
+            mFrcRateByFps[mFrcRates[i].input_fps] = mFrcRates[i].rate;
+    }
+    /* 0 fps means unknown, it never does FRC */
+    mFrcRateByFps[0] = FRC_RATE_1X;
+}
+
+FRC_RATE ISVProfileData::getFRCRate(uint32_t inputFps) const
+{
+    if (inputFps > ISV_PROFILE_MAX_FPS)
+        return FRC_RATE_1X;
+    return mFrcRateByFps[inputFps];
+}
+
+ISVProfile::ISVProfile(const uint32_t width, const uint32_t height)
+{
+    mWidth = width;
+    mHeight = height;
+
+    mStatus = 0;
+
+    /* share the profile parsed from XML file */
+    mData = ISVProfileData::get();
 
     /* update the filter status according to the configs */
     updateFilterStatus();
 
     /* dump data for debug */
-    dumpConfigData();
+    mData->dumpConfigData(mStatus);
 }
 
 ISVProfile::~ISVProfile()
 {
+    mData = NULL;
 }
 
 FRC_RATE ISVProfile::getFRCRate(uint32_t inputFps)
 {
-    FRC_RATE rate = FRC_RATE_1X;
-    int i;
-
-    for (i = 0; i < MAX_TAB_SIZE; i++) {
-        if (mFrcRates[i].input_fps == inputFps) {
-            rate = mFrcRates[i].rate;
-            break;
-        }
-    }
-    return rate;
+    return mData->getFRCRate(inputFps);
 }
 
 uint32_t ISVProfile::getFilterStatus()
@@ -102,21 +150,22 @@ bool ISVProfile::isFRCOn()
 void ISVProfile::updateFilterStatus() {
     int i;
     uint32_t area = mWidth * mHeight;
+    const ISVConfig *configs = mData->mConfigs;
 
-    for (i = 1; i < ProcFilterCount; i++) {
+    for (i = 1; i < ISVProfileData::ProcFilterCount; i++) {
         /* check config */
-        if (mConfigs[i].enabled == false)
+        if (configs[i].enabled == false)
             continue;
 
-        if (area > mConfigs[i].minResolution && area <= mConfigs[i].maxResolution)
+        if (area > configs[i].minResolution && area <= configs[i].maxResolution)
             mStatus |= 1 << i;
         /* we should cover QCIF */
-        else if (area == mConfigs[i].minResolution && area == QCIF_AREA)
+        else if (area == configs[i].minResolution && area == QCIF_AREA)
             mStatus |= 1 << i;
     }
 }
 
-int ISVProfile::getFilterID(const char * name)
+int ISVProfileData::getFilterID(const char * name)
 {
     int index = 0;
 
@@ -148,7 +197,7 @@ int ISVProfile::getFilterID(const char * name)
     return index;
 }
 
-uint32_t ISVProfile::getResolution(const char * name)
+uint32_t ISVProfileData::getResolution(const char * name)
 {
     uint32_t width = 0, height = 0;
     char *p = NULL, *str = NULL;
@@ -176,7 +225,7 @@ uint32_t ISVProfile::getResolution(const char * name)
     return width * height;
 }
 
-void ISVProfile::getConfigData(const char *name, const char **atts)
+void ISVProfileData::getConfigData(const char *name, const char **atts)
 {
     int attIndex = 0;
 
@@ -249,7 +298,7 @@ void ISVProfile::getConfigData(const char *name, const char **atts)
         ALOGE("Couldn't handle this element %s!\n", name);
 }
 
-void ISVProfile::handleFilterParameter(const char *name, const char **atts)
+void ISVProfileData::handleFilterParameter(const char *name, const char **atts)
 {
     int attIndex = 0;
 
@@ -265,7 +314,7 @@ void ISVProfile::handleFilterParameter(const char *name, const char **atts)
 
 }
 
-void ISVProfile::handleCommonParameter(const char *name, const char **atts)
+void ISVProfileData::handleCommonParameter(const char *name, const char **atts)
 {
     int attIndex = 0;
 
@@ -282,22 +331,22 @@ void ISVProfile::handleCommonParameter(const char *name, const char **atts)
         mDefaultFRCStatus = atoi(atts[attIndex + 3]);
 }
 
-void ISVProfile::startElement(void *userData, const char *name, const char **atts)
+void ISVProfileData::startElement(void *userData, const char *name, const char **atts)
 {
-    ISVProfile *profile = (ISVProfile *)userData;
+    ISVProfileData *profile = (ISVProfileData *)userData;
 
     profile->getConfigData(name, atts);
 }
 
-void ISVProfile::endElement(void *userData, const char *name)
+void ISVProfileData::endElement(void *userData, const char *name)
 {
-    ISVProfile *profile = (ISVProfile *)userData;
+    ISVProfileData *profile = (ISVProfileData *)userData;
 
     if (!strcmp(name, "Filter"))
         profile->mCurrentFilter = 0;
 }
 
-void ISVProfile::getDataFromXmlFile()
+void ISVProfileData::getDataFromXmlFile()
 {
     int done;
     void *pBuf = NULL;
@@ -309,6 +358,8 @@ void ISVProfile::getDataFromXmlFile()
         return;
     }
 
+    mLoaded = true;
+
     XML_Parser parser = ::XML_ParserCreate(NULL);
     if (NULL == parser) {
         ALOGE("@%s, line:%d, parser is NULL", __func__, __LINE__);
@@ -352,7 +403,7 @@ int32_t ISVProfile::getGlobalStatus()
     char path[80];
     int userId = 0;
     int32_t status = 0;
-    FILE *setting_handle, *config_handle;
+    FILE *setting_handle;
 
     snprintf(path, 80, "/data/user/%d/com.intel.vpp/shared_prefs/vpp_settings.xml", userId);
     ALOGI("%s: %s",__func__, path);
@@ -360,32 +411,22 @@ int32_t ISVProfile::getGlobalStatus()
     if(setting_handle == NULL) {
         ALOGE("%s: failed to open file %s\n", __func__, path);
 
-        /* Read the Filter config file to get default value */
-        config_handle = fopen(DEFAULT_XML_FILE, "r");
-        if (config_handle == NULL) {
+        /* Use the default value from the Filter config file */
+        sp<ISVProfileData> data = ISVProfileData::get();
+        if (!data->mLoaded) {
             ALOGE("%s: failed to open file %s\n", __func__, DEFAULT_XML_FILE);
             return -1;
         }
 
-        char xml_buf[MAX_BUF_SIZE + 1] = {0};
-        memset(xml_buf, 0, MAX_BUF_SIZE);
-        if (fread(xml_buf, 1, MAX_BUF_SIZE, config_handle) <= 0) {
-            ALOGE("%s: failed to read config xml file!\n", __func__);
-            fclose(config_handle);
-            return -1;
-        }
-        xml_buf[MAX_BUF_SIZE] = '\0';
-
-        if (strstr(xml_buf, "name=\"DefaultVPPStatus\" value=\"1\"") != NULL)
+        if (data->mDefaultVPPStatus == 1)
             status |= VPP_COMMON_ON;
-        if (strstr(xml_buf, "name=\"DefaultFRCStatus\" value=\"1\"") != NULL)
+        if (data->mDefaultFRCStatus == 1)
             status |= VPP_FRC_ON;
 
         ALOGI("%s: using the default status: VPP=%d, FRC=%d\n", __func__,
             ((status & VPP_COMMON_ON) == 0) ? 0 : 1,
             ((status & VPP_FRC_ON) == 0) ? 0: 1);
 
-        fclose(config_handle);
         return status;
     }
 
@@ -409,7 +450,7 @@ int32_t ISVProfile::getGlobalStatus()
     return status;
 }
 
-void ISVProfile::dumpConfigData()
+void ISVProfileData::dumpConfigData(uint32_t status) const
 {
     uint32_t i, j;
     char filterNames[][50] = {
@@ -440,7 +481,7 @@ void ISVProfile::dumpConfigData()
             (mConfigs[i].enabled == true) ? "true" : "false",
             mConfigs[i].minResolution,
             mConfigs[i].maxResolution,
-            ((mStatus & (1 << i)) == 0) ? "false" : "true");
+            ((status & (1 << i)) == 0) ? "false" : "true");
         if (mConfigs[i].paraSize) {
             ALOGI("\t\t parameters: ");
             for(j = 0; j < mConfigs[i].paraSize; j++)
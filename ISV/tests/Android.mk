@@ -0,0 +1,55 @@
+LOCAL_PATH := $(call my-dir)
+
+#### ISV host unit tests ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	isv_bufmap_test.cpp \
+	isv_bufqueue_test.cpp \
+	isv_fpsestimator_test.cpp \
+	isv_frctimestamp_test.cpp \
+	../base/isv_fpsestimator.cpp \
+	../base/isv_frctimestamp.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../include
+
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+
+LOCAL_MODULE := isv_unit_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+#### ISV device unit tests ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	isv_omxcomponent_test.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../include \
+	$(LOCAL_PATH)/../../VPP \
+	$(call include-path-for, frameworks-openmax) \
+	$(TARGET_OUT_HEADERS)/libmedia_utils_vpp \
+	$(TARGET_OUT_HEADERS)/display \
+	$(TARGET_OUT_HEADERS)/khronos/openmax \
+	$(TARGET_OUT_HEADERS)/libva \
+	$(TARGET_OUT_HEADERS)/pvr/hal
+
+ifeq ($(TARGET_VPP_USE_GEN),true)
+	LOCAL_CFLAGS += -DTARGET_VPP_USE_GEN
+endif
+
+LOCAL_SHARED_LIBRARIES := \
+	libisv_omx_core \
+	libutils \
+	libcutils \
+	libva \
+	libva-android
+
+LOCAL_MODULE := isv_component_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include "isv_bufmap.h"
+
+#define MAP_SIZE 16
+#define MAX_ITEMS 64
+
+class Item
+{
+public:
+    Item() : mHandle(0) {}
+    explicit Item(unsigned long handle) : mHandle(handle) {}
+    unsigned long getHandle() const { return mHandle; }
+    unsigned long mHandle;
+};
+
+typedef ISVHandleMap<Item> Map;
+
+// the n-th handle, spaced like gralloc handle pointers, whose home is slot
+static unsigned long handleAt(const Map *map, uint32_t slot, int n)
+{
+    for (unsigned long handle = 0x1000; ; handle += 8) {
+        if (map->home(handle) == slot && n-- == 0)
+            return handle;
+    }
+}
+
+// every item is reachable from its home without crossing an empty slot
+static void checkChains(const Map *map)
+{
+    for (uint32_t slot = 0; slot < map->size(); slot++) {
+        Item *item = map->slotAt(slot);
+        if (item == NULL)
+            continue;
+        for (uint32_t s = map->home(item->getHandle()); s != slot; s = (s + 1) % map->size())
+            EXPECT_TRUE(map->slotAt(s) != NULL) << "hole at " << s << " before " << slot;
+        EXPECT_EQ(item, map->lookup(item->getHandle()));
+    }
+}
+
+class ISVHandleMapTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp() {
+        mMap = Map::create(MAP_SIZE);
+        ASSERT_TRUE(mMap != NULL);
+    }
+    virtual void TearDown() { delete mMap; }
+
+    Item *insert(uint32_t home, int n) {
+        Item *item = &mItems[mCount++];
+        item->mHandle = handleAt(mMap, home, n);
+        mMap->insert(item);
+        return item;
+    }
+
+    Map *mMap;
+    Item mItems[MAX_ITEMS];
+    int mCount;
+
+public:
+    ISVHandleMapTest() : mMap(NULL), mCount(0) {}
+};
+
+TEST_F(ISVHandleMapTest, EmptyMap) {
+    EXPECT_EQ(16u, mMap->size());
+    for (uint32_t slot = 0; slot < mMap->size(); slot++)
+        EXPECT_TRUE(mMap->slotAt(slot) == NULL);
+    EXPECT_TRUE(mMap->lookup(0x1000) == NULL);
+    // removing from an empty map is a no-op
+    mMap->remove(0x1000);
+}
+
+TEST_F(ISVHandleMapTest, CollisionsProbeLinearly) {
+    Item *a = insert(5, 0);
+    Item *b = insert(5, 1);
+    Item *c = insert(5, 2);
+
+    EXPECT_EQ(a, mMap->slotAt(5));
+    EXPECT_EQ(b, mMap->slotAt(6));
+    EXPECT_EQ(c, mMap->slotAt(7));
+    EXPECT_EQ(a, mMap->lookup(a->getHandle()));
+    EXPECT_EQ(b, mMap->lookup(b->getHandle()));
+    EXPECT_EQ(c, mMap->lookup(c->getHandle()));
+    // same home but not in the map, the probe stops at slot 8
+    EXPECT_TRUE(mMap->lookup(handleAt(mMap, 5, 3)) == NULL);
+}
+
+TEST_F(ISVHandleMapTest, RemoveShiftsChainBack) {
+    Item *a = insert(5, 0);
+    Item *b = insert(5, 1);
+    Item *c = insert(5, 2);
+
+    mMap->remove(a->getHandle());
+    EXPECT_TRUE(mMap->lookup(a->getHandle()) == NULL);
+    EXPECT_EQ(b, mMap->slotAt(5));
+    EXPECT_EQ(c, mMap->slotAt(6));
+    EXPECT_TRUE(mMap->slotAt(7) == NULL);
+    checkChains(mMap);
+}
+
+TEST_F(ISVHandleMapTest, RemoveKeepsEntryAtItsHome) {
+    Item *a = insert(3, 0);
+    Item *b = insert(3, 1);
+    // home 5 lands on slot 5, after b in the same run
+    Item *c = insert(5, 0);
+    Item *d = insert(3, 2);
+
+    EXPECT_EQ(c, mMap->slotAt(5));
+    EXPECT_EQ(d, mMap->slotAt(6));
+    mMap->remove(a->getHandle());
+    // b and d move back, c may not move before its home
+    EXPECT_EQ(b, mMap->slotAt(3));
+    EXPECT_EQ(d, mMap->slotAt(4));
+    EXPECT_EQ(c, mMap->slotAt(5));
+    EXPECT_TRUE(mMap->slotAt(6) == NULL);
+    checkChains(mMap);
+}
+
+TEST_F(ISVHandleMapTest, RemoveMissingHandle) {
+    Item *a = insert(5, 0);
+    Item *b = insert(5, 1);
+
+    mMap->remove(handleAt(mMap, 5, 2));
+    mMap->remove(handleAt(mMap, 9, 0));
+    EXPECT_EQ(a, mMap->slotAt(5));
+    EXPECT_EQ(b, mMap->slotAt(6));
+    checkChains(mMap);
+}
+
+TEST_F(ISVHandleMapTest, ProbeWrapsAround) {
+    Item *a = insert(15, 0);
+    Item *b = insert(15, 1);
+    Item *c = insert(15, 2);
+
+    EXPECT_EQ(a, mMap->slotAt(15));
+    EXPECT_EQ(b, mMap->slotAt(0));
+    EXPECT_EQ(c, mMap->slotAt(1));
+    EXPECT_EQ(c, mMap->lookup(c->getHandle()));
+    checkChains(mMap);
+}
+
+TEST_F(ISVHandleMapTest, RemoveShiftsBackAcrossWraparound) {
+    Item *a = insert(14, 0);
+    Item *b = insert(14, 1);
+    Item *c = insert(15, 0);
+    // home 0 is taken by c, so d goes to slot 1
+    Item *d = insert(0, 0);
+    Item *e = insert(14, 2);
+
+    EXPECT_EQ(c, mMap->slotAt(0));
+    EXPECT_EQ(d, mMap->slotAt(1));
+    EXPECT_EQ(e, mMap->slotAt(2));
+
+    mMap->remove(a->getHandle());
+    EXPECT_EQ(b, mMap->slotAt(14));
+    EXPECT_EQ(c, mMap->slotAt(15));
+    EXPECT_EQ(d, mMap->slotAt(0));
+    EXPECT_EQ(e, mMap->slotAt(1));
+    EXPECT_TRUE(mMap->slotAt(2) == NULL);
+    checkChains(mMap);
+
+    // the hole wraps back from slot 0 to slot 15
+    mMap->remove(c->getHandle());
+    EXPECT_EQ(e, mMap->slotAt(15));
+    EXPECT_EQ(d, mMap->slotAt(0));
+    EXPECT_TRUE(mMap->slotAt(1) == NULL);
+    checkChains(mMap);
+}
+
+TEST_F(ISVHandleMapTest, CopyHasSameSlots) {
+    insert(15, 0);
+    insert(15, 1);
+    insert(2, 0);
+
+    Map *copy = mMap->copy();
+    ASSERT_TRUE(copy != NULL);
+    EXPECT_EQ(mMap->size(), copy->size());
+    for (uint32_t slot = 0; slot < mMap->size(); slot++)
+        EXPECT_EQ(mMap->slotAt(slot), copy->slotAt(slot));
+
+    // the copy changes on its own
+    copy->remove(mItems[0].getHandle());
+    EXPECT_EQ(&mItems[0], mMap->lookup(mItems[0].getHandle()));
+    EXPECT_TRUE(copy->lookup(mItems[0].getHandle()) == NULL);
+    delete copy;
+}
+
+TEST_F(ISVHandleMapTest, RandomInsertRemove) {
+    // few homes, so long chains that wrap around
+    static const uint32_t kHomes[] = { 13, 14, 15, 0, 1 };
+    bool present[MAX_ITEMS] = { false };
+    int inMap = 0;
+    for (int i = 0; i < MAX_ITEMS; i++)
+        mItems[i].mHandle = handleAt(mMap, kHomes[i % 5], i / 5);
+
+    srand(1);
+    for (int step = 0; step < 2000; step++) {
+        int i = rand() % MAX_ITEMS;
+        if (present[i]) {
+            mMap->remove(mItems[i].getHandle());
+            present[i] = false;
+            inMap--;
+        } else if (inMap < MAP_SIZE / 2 + 4) {
+            mMap->insert(&mItems[i]);
+            present[i] = true;
+            inMap++;
+        }
+        for (int j = 0; j < MAX_ITEMS; j++)
+            ASSERT_EQ(present[j] ? &mItems[j] : NULL, mMap->lookup(mItems[j].getHandle()))
+                    << "step " << step << " item " << j;
+    }
+    checkChains(mMap);
+}
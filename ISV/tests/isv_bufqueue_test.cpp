@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "isv_bufqueue.h"
+
+TEST(ISVRingQueueTest, CapacityIsPowerOfTwo) {
+    ISVRingQueue<int> q1(1);
+    ISVRingQueue<int> q5(5);
+    ISVRingQueue<int> q16(16);
+
+    EXPECT_EQ(1u, q1.capacity());
+    EXPECT_EQ(8u, q5.capacity());
+    EXPECT_EQ(16u, q16.capacity());
+}
+
+TEST(ISVRingQueueTest, EmptyQueue) {
+    ISVRingQueue<int*> q(4);
+
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(0u, q.size());
+    EXPECT_TRUE(q.pop() == NULL);
+    EXPECT_TRUE(q.peek(0) == NULL);
+}
+
+TEST(ISVRingQueueTest, FifoOrderAndPeek) {
+    ISVRingQueue<int> q(4);
+
+    for (int i = 1; i <= 3; i++)
+        ASSERT_TRUE(q.push(i));
+    EXPECT_EQ(3u, q.size());
+    EXPECT_EQ(1, q.peek(0));
+    EXPECT_EQ(3, q.peek(2));
+    // past the tail reads as empty
+    EXPECT_EQ(0, q.peek(3));
+
+    EXPECT_EQ(1, q.pop());
+    EXPECT_EQ(2, q.peek(0));
+    EXPECT_EQ(2u, q.size());
+}
+
+TEST(ISVRingQueueTest, PushFailsWhenFull) {
+    ISVRingQueue<int> q(4);
+
+    for (int i = 1; i <= 4; i++)
+        ASSERT_TRUE(q.push(i));
+    EXPECT_FALSE(q.push(5));
+    EXPECT_EQ(4u, q.size());
+
+    EXPECT_EQ(1, q.pop());
+    EXPECT_TRUE(q.push(5));
+    for (int i = 2; i <= 5; i++)
+        EXPECT_EQ(i, q.pop());
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(ISVRingQueueTest, WrapsAround) {
+    ISVRingQueue<int> q(4);
+
+    // head and tail wrap the ring many times
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(q.push(i));
+        ASSERT_TRUE(q.push(i + 1));
+        ASSERT_EQ(i, q.pop());
+        ASSERT_EQ(i + 1, q.peek(0));
+        ASSERT_EQ(i + 1, q.pop());
+    }
+    EXPECT_TRUE(q.empty());
+}
+
+#define SPSC_ITEMS  200000
+
+static void *producer(void *arg) {
+    ISVRingQueue<int> *queue = static_cast<ISVRingQueue<int> *>(arg);
+    for (int i = 1; i <= SPSC_ITEMS; i++) {
+        while (!queue->push(i))
+            sched_yield();
+    }
+    return NULL;
+}
+
+TEST(ISVRingQueueTest, SingleProducerSingleConsumer) {
+    ISVRingQueue<int> q(8);
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, producer, &q));
+
+    // items come out in order, none lost or repeated
+    int errors = 0;
+    int expected = 1;
+    while (expected <= SPSC_ITEMS) {
+        int item = q.pop();
+        if (item == 0) {
+            sched_yield();
+            continue;
+        }
+        if (item != expected)
+            errors++;
+        expected = item + 1;
+    }
+    pthread_join(thread, NULL);
+
+    EXPECT_EQ(0, errors);
+    EXPECT_TRUE(q.empty());
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include "isv_fpsestimator.h"
+
+/* Feed count timestamps of a clip at fps (as a double, 23.976 etc.),
+ * with jitter[i % jitterCount] us added to frame i, and return the last
+ * result.
+ */
+static status_t feed(ISVFpsEstimator *estimator, double fps, uint32_t count,
+        const int64_t *jitter, uint32_t jitterCount, uint32_t *result)
+{
+    status_t ret = NOT_ENOUGH_DATA;
+    for (uint32_t i = 0; i < count; i++) {
+        int64_t timeUs = 500000 + (int64_t)(i * 1000000.0 / fps);
+        if (jitterCount > 0)
+            timeUs += jitter[i % jitterCount];
+        ret = estimator->addTimestamp(timeUs, result);
+    }
+    return ret;
+}
+
+TEST(ISVFpsEstimatorTest, NeedsMinimumWindow) {
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+
+    EXPECT_EQ(NOT_ENOUGH_DATA, feed(&estimator, 30, ISV_FPS_MIN_WINDOW - 1, NULL, 0, &fps));
+    EXPECT_EQ(0u, fps);
+    EXPECT_EQ(OK, estimator.addTimestamp(500000 + (ISV_FPS_MIN_WINDOW - 1) * 33333, &fps));
+    EXPECT_EQ(30u, fps);
+}
+
+TEST(ISVFpsEstimatorTest, StandardRates) {
+    static const uint32_t rates[] = { 15, 24, 25, 30, 50, 60 };
+    for (uint32_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        ISVFpsEstimator estimator;
+        uint32_t fps = 0;
+        EXPECT_EQ(OK, feed(&estimator, rates[i], ISV_FPS_DEFAULT_WINDOW, NULL, 0, &fps));
+        EXPECT_EQ(rates[i], fps);
+    }
+}
+
+TEST(ISVFpsEstimatorTest, NtscRatesSnapToStandard) {
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+
+    EXPECT_EQ(OK, feed(&estimator, 24000.0 / 1001, ISV_FPS_DEFAULT_WINDOW, NULL, 0, &fps));
+    EXPECT_EQ(24u, fps);
+
+    estimator.reset();
+    EXPECT_EQ(OK, feed(&estimator, 30000.0 / 1001, ISV_FPS_DEFAULT_WINDOW, NULL, 0, &fps));
+    EXPECT_EQ(30u, fps);
+}
+
+TEST(ISVFpsEstimatorTest, ToleratesJitter) {
+    static const int64_t jitter[] = { 0, 3000, -2500, 1500, -3000, 2000, 500 };
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+
+    EXPECT_EQ(OK, feed(&estimator, 25, 20, jitter, 7, &fps));
+    EXPECT_EQ(25u, fps);
+}
+
+TEST(ISVFpsEstimatorTest, ToleratesReorderedFrames) {
+    // B frames delivered in decode order
+    static const int64_t order[] = { 0, 3, 1, 2, 6, 4, 5, 7 };
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+    status_t ret = NOT_ENOUGH_DATA;
+
+    for (uint32_t i = 0; i < 8; i++)
+        ret = estimator.addTimestamp(1000000 + order[i] * 41667, &fps);
+    EXPECT_EQ(OK, ret);
+    EXPECT_EQ(24u, fps);
+}
+
+TEST(ISVFpsEstimatorTest, ToleratesDroppedAndRepeatedFrames) {
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+    status_t ret = NOT_ENOUGH_DATA;
+
+    // frame 3 is dropped and frame 5 repeated
+    static const int64_t frames[] = { 0, 1, 2, 4, 5, 5, 6, 7 };
+    for (uint32_t i = 0; i < 8; i++)
+        ret = estimator.addTimestamp(frames[i] * 33333, &fps);
+    EXPECT_EQ(OK, ret);
+    EXPECT_EQ(30u, fps);
+}
+
+TEST(ISVFpsEstimatorTest, RejectsNonStandardCadence) {
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+
+    EXPECT_EQ(BAD_VALUE, feed(&estimator, 20, ISV_FPS_DEFAULT_WINDOW, NULL, 0, &fps));
+    EXPECT_EQ(0u, fps);
+}
+
+TEST(ISVFpsEstimatorTest, RejectsErraticTimestamps) {
+    static const int64_t intervals[] = { 10000, 70000, 25000, 90000, 40000, 15000, 60000 };
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+    int64_t timeUs = 0;
+    status_t ret = OK;
+
+    for (uint32_t i = 0; i < 7; i++) {
+        ret = estimator.addTimestamp(timeUs, &fps);
+        timeUs += intervals[i];
+    }
+    EXPECT_NE(OK, ret);
+}
+
+TEST(ISVFpsEstimatorTest, ResetDropsSamples) {
+    ISVFpsEstimator estimator;
+    uint32_t fps = 0;
+
+    EXPECT_EQ(OK, feed(&estimator, 30, ISV_FPS_DEFAULT_WINDOW, NULL, 0, &fps));
+    estimator.reset();
+
+    // after a seek, the old timestamps don't count toward the window
+    EXPECT_EQ(NOT_ENOUGH_DATA, estimator.addTimestamp(90000000, &fps));
+    EXPECT_EQ(NOT_ENOUGH_DATA, estimator.addTimestamp(90040000, &fps));
+    EXPECT_EQ(NOT_ENOUGH_DATA, estimator.addTimestamp(90080000, &fps));
+    EXPECT_EQ(OK, estimator.addTimestamp(90120000, &fps));
+    EXPECT_EQ(25u, fps);
+}
+
+TEST(ISVFpsEstimatorTest, WindowFollowsRateChange) {
+    ISVFpsEstimator estimator(ISV_FPS_MIN_WINDOW);
+    uint32_t fps = 0;
+    int64_t timeUs = 0;
+
+    for (uint32_t i = 0; i < 8; i++, timeUs += 40000)
+        estimator.addTimestamp(timeUs, &fps);
+    EXPECT_EQ(25u, fps);
+
+    // a 4 sample window forgets the old rate after 4 new frames
+    status_t ret = NOT_ENOUGH_DATA;
+    for (uint32_t i = 0; i < ISV_FPS_MIN_WINDOW; i++, timeUs += 16667)
+        ret = estimator.addTimestamp(timeUs, &fps);
+    EXPECT_EQ(OK, ret);
+    EXPECT_EQ(60u, fps);
+}
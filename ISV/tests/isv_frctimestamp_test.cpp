@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include "isv_frctimestamp.h"
+
+#define MAX_BATCH   4
+#define NUM_INPUTS  48
+
+// outputs VSP returns for the index-th input, as ISVWorker::getOutputBufCount
+static uint32_t batchSize(FRC_RATE rate, uint32_t index)
+{
+    if (index == 0)
+        return 1;
+    return rate - ((rate == FRC_RATE_2_5X) ? (index & 1) : 0);
+}
+
+/* Run NUM_INPUTS inputs spaced intervalUs apart through FRC at rate and
+ * check the outputs form a grid of intervalUs * den / num.
+ */
+static void checkGrid(FRC_RATE rate, uint32_t frameRate, double intervalUs,
+        int32_t num, int32_t den)
+{
+    ISVFrcTimestamp frc;
+    int64_t timestamps[MAX_BATCH];
+    int64_t last = -1;
+    double step = intervalUs * den / num;
+
+    for (uint32_t k = 0; k < NUM_INPUTS; k++) {
+        int64_t timeUs = 1000000 + (int64_t)(k * intervalUs);
+        uint32_t count = batchSize(rate, k);
+        frc.update(rate, frameRate, timeUs, count, timestamps);
+
+        // the last output of a batch never runs ahead of its input
+        EXPECT_LE(timestamps[count - 1], timeUs) << "input " << k;
+        EXPECT_GT(timestamps[count - 1], timeUs - (int64_t)step - 1) << "input " << k;
+
+        for (uint32_t i = 0; i < count; i++) {
+            // the first two inputs may be measured against the nominal rate
+            if (last >= 0 && k >= 2) {
+                EXPECT_NEAR(step, (double)(timestamps[i] - last), 2.0)
+                    << "input " << k << " output " << i;
+            }
+            last = timestamps[i];
+        }
+    }
+}
+
+TEST(ISVFrcTimestampTest, TwoX) {
+    checkGrid(FRC_RATE_2X, 30, 1000000.0 / 30, 2, 1);
+}
+
+TEST(ISVFrcTimestampTest, TwoAndHalfX) {
+    checkGrid(FRC_RATE_2_5X, 24, 1000000.0 / 24, 5, 2);
+}
+
+TEST(ISVFrcTimestampTest, FourX) {
+    checkGrid(FRC_RATE_4X, 15, 1000000.0 / 15, 4, 1);
+}
+
+TEST(ISVFrcTimestampTest, FollowsMeasuredCadence) {
+    // 23.976 and 29.97 fps clips are configured as 24 and 30
+    checkGrid(FRC_RATE_2_5X, 24, 1001000.0 / 24, 5, 2);
+    checkGrid(FRC_RATE_2X, 30, 1001000.0 / 30, 2, 1);
+}
+
+TEST(ISVFrcTimestampTest, SingleOutputKeepsInputTimestamp) {
+    ISVFrcTimestamp frc;
+    int64_t timestamps[MAX_BATCH];
+
+    frc.update(FRC_RATE_1X, 30, 1000000, 1, timestamps);
+    EXPECT_EQ(1000000, timestamps[0]);
+    frc.update(FRC_RATE_2X, 30, 1033333, 1, timestamps);
+    EXPECT_EQ(1033333, timestamps[0]);
+}
+
+TEST(ISVFrcTimestampTest, UnknownRateKeepsInputTimestamp) {
+    ISVFrcTimestamp frc;
+    int64_t timestamps[MAX_BATCH];
+
+    // no nominal rate and no previous input, no interval to split
+    frc.update(FRC_RATE_2X, 0, 1000000, 2, timestamps);
+    EXPECT_EQ(1000000, timestamps[0]);
+    EXPECT_EQ(1000000, timestamps[1]);
+
+    // the next input gives a measured interval
+    frc.update(FRC_RATE_2X, 0, 1040000, 2, timestamps);
+    EXPECT_EQ(1020000, timestamps[0]);
+    EXPECT_EQ(1040000, timestamps[1]);
+}
+
+TEST(ISVFrcTimestampTest, GapFallsBackToNominalRate) {
+    ISVFrcTimestamp frc;
+    int64_t timestamps[MAX_BATCH];
+
+    frc.update(FRC_RATE_2X, 25, 1000000, 1, timestamps);
+    frc.update(FRC_RATE_2X, 25, 1040000, 2, timestamps);
+    EXPECT_EQ(1020000, timestamps[0]);
+
+    // a jump of more than 4 intervals isn't a cadence
+    frc.update(FRC_RATE_2X, 25, 9000000, 2, timestamps);
+    EXPECT_EQ(8980000, timestamps[0]);
+    EXPECT_EQ(9000000, timestamps[1]);
+
+    // neither is a timestamp going backwards
+    frc.update(FRC_RATE_2X, 25, 500000, 2, timestamps);
+    EXPECT_EQ(480000, timestamps[0]);
+}
+
+TEST(ISVFrcTimestampTest, ResetForgetsCadence) {
+    ISVFrcTimestamp frc;
+    int64_t timestamps[MAX_BATCH];
+
+    frc.update(FRC_RATE_2X, 25, 1000000, 1, timestamps);
+    frc.update(FRC_RATE_2X, 25, 1030000, 2, timestamps);
+    EXPECT_EQ(1015000, timestamps[0]);
+
+    // after a seek the nominal rate is used until an interval is measured
+    frc.reset();
+    frc.update(FRC_RATE_2X, 25, 1060000, 2, timestamps);
+    EXPECT_EQ(1040000, timestamps[0]);
+    EXPECT_EQ(1060000, timestamps[1]);
+}
+
+TEST(ISVFrcTimestampTest, PhaseRecoversAfterSkippedFrame) {
+    ISVFrcTimestamp frc;
+    int64_t timestamps[MAX_BATCH];
+    int64_t intervalUs = 40000;
+
+    frc.update(FRC_RATE_2_5X, 25, 0, 1, timestamps);
+    frc.update(FRC_RATE_2_5X, 25, intervalUs, 2, timestamps);
+    frc.update(FRC_RATE_2_5X, 25, 2 * intervalUs, 3, timestamps);
+
+    // a batch of 3 again, as if one input was skipped, still ends at or
+    // before its input and keeps the grid step inside the batch
+    frc.update(FRC_RATE_2_5X, 25, 3 * intervalUs, 3, timestamps);
+    EXPECT_LE(timestamps[2], 3 * intervalUs);
+    EXPECT_EQ(intervalUs * 2 / 5, timestamps[1] - timestamps[0]);
+    EXPECT_EQ(intervalUs * 2 / 5, timestamps[2] - timestamps[1]);
+}
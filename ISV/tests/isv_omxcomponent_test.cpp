@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <string.h>
+#include <cutils/atomic.h>
+
+#include "isv_omxcomponent.h"
+
+/* Each session wires an ISVComponent to a fake decoder component the way
+ * OMX_GetHandle does: the decoder gets the ISV callbacks and the
+ * ISVComponent as its pAppData, the client gets its session as its own.
+ * ISV mode is left off, so the callbacks go straight to the client.
+ */
+#define STRESS_SESSIONS     8
+#define STRESS_CALLBACKS    20000
+#define STRESS_CHURN        200
+
+struct Session {
+    OMX_COMPONENTTYPE decoder;
+    ISVComponent *isv;
+    OMX_CALLBACKTYPE *isvCallBacks;
+    OMX_BUFFERHEADERTYPE buffer;
+    int32_t fills;
+    int32_t empties;
+    int32_t events;
+    int32_t mismatches;
+};
+
+// client side: every callback must come from its own session's handle
+static bool checkClient(OMX_HANDLETYPE hComponent, OMX_PTR pAppData)
+{
+    Session *session = static_cast<Session*>(pAppData);
+    if (session == NULL)
+        return false;
+    if (hComponent != static_cast<OMX_HANDLETYPE>(session->isv->getBaseComponent())) {
+        android_atomic_inc(&session->mismatches);
+        return false;
+    }
+    return true;
+}
+
+static OMX_ERRORTYPE clientEventHandler(OMX_HANDLETYPE hComponent, OMX_PTR pAppData,
+        OMX_EVENTTYPE, OMX_U32, OMX_U32, OMX_PTR)
+{
+    if (checkClient(hComponent, pAppData))
+        android_atomic_inc(&static_cast<Session*>(pAppData)->events);
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE clientEmptyBufferDone(OMX_HANDLETYPE hComponent, OMX_PTR pAppData,
+        OMX_BUFFERHEADERTYPE*)
+{
+    if (checkClient(hComponent, pAppData))
+        android_atomic_inc(&static_cast<Session*>(pAppData)->empties);
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE clientFillBufferDone(OMX_HANDLETYPE hComponent, OMX_PTR pAppData,
+        OMX_BUFFERHEADERTYPE* pBuffer)
+{
+    Session *session = static_cast<Session*>(pAppData);
+    if (checkClient(hComponent, pAppData) && pBuffer == &session->buffer)
+        android_atomic_inc(&session->fills);
+    return OMX_ErrorNone;
+}
+
+static OMX_CALLBACKTYPE gClientCallBacks = {
+    clientEventHandler,
+    clientEmptyBufferDone,
+    clientFillBufferDone
+};
+
+static void openSession(Session *session)
+{
+    memset(session, 0, sizeof(*session));
+    session->isv = new ISVComponent(static_cast<OMX_PTR>(session));
+    session->isvCallBacks = session->isv->getCallBacks(&gClientCallBacks);
+    session->isv->setComponent(&session->decoder, NULL);
+}
+
+static void closeSession(Session *session)
+{
+    delete session->isv;
+    session->isv = NULL;
+}
+
+// the decoder thread of one session
+static void *decode(void *arg)
+{
+    Session *session = static_cast<Session*>(arg);
+    OMX_CALLBACKTYPE *cb = session->isvCallBacks;
+    OMX_PTR appData = static_cast<OMX_PTR>(session->isv);
+
+    for (int i = 0; i < STRESS_CALLBACKS; i++) {
+        cb->EmptyBufferDone(&session->decoder, appData, &session->buffer);
+        cb->FillBufferDone(&session->decoder, appData, &session->buffer);
+        if ((i & 63) == 0)
+            cb->EventHandler(&session->decoder, appData, OMX_EventMark, 0, 0, NULL);
+    }
+    return NULL;
+}
+
+// handles opened and closed while the other sessions decode
+static void *churn(void *)
+{
+    for (int i = 0; i < STRESS_CHURN; i++) {
+        Session *session = new Session;
+        openSession(session);
+        session->isvCallBacks->FillBufferDone(&session->decoder,
+                static_cast<OMX_PTR>(session->isv), &session->buffer);
+        closeSession(session);
+        delete session;
+    }
+    return NULL;
+}
+
+TEST(ISVComponentTest, ForwardsClientAppData) {
+    Session session;
+    openSession(&session);
+    OMX_PTR appData = static_cast<OMX_PTR>(session.isv);
+
+    EXPECT_EQ(OMX_ErrorNone, session.isvCallBacks->FillBufferDone(
+            &session.decoder, appData, &session.buffer));
+    EXPECT_EQ(OMX_ErrorNone, session.isvCallBacks->EmptyBufferDone(
+            &session.decoder, appData, &session.buffer));
+    EXPECT_EQ(OMX_ErrorNone, session.isvCallBacks->EventHandler(
+            &session.decoder, appData, OMX_EventMark, 0, 0, NULL));
+    EXPECT_EQ(1, session.fills);
+    EXPECT_EQ(1, session.empties);
+    EXPECT_EQ(1, session.events);
+    EXPECT_EQ(0, session.mismatches);
+
+    closeSession(&session);
+}
+
+TEST(ISVComponentTest, RejectsForeignCallbacks) {
+    Session session, other;
+    openSession(&session);
+    openSession(&other);
+    OMX_PTR appData = static_cast<OMX_PTR>(session.isv);
+
+    // a handle that isn't this session's decoder
+    EXPECT_EQ(OMX_ErrorUndefined, session.isvCallBacks->FillBufferDone(
+            &other.decoder, appData, &session.buffer));
+    EXPECT_EQ(OMX_ErrorUndefined, session.isvCallBacks->EventHandler(
+            &other.decoder, appData, OMX_EventMark, 0, 0, NULL));
+    EXPECT_EQ(OMX_ErrorUndefined, session.isvCallBacks->EmptyBufferDone(
+            &other.decoder, appData, &session.buffer));
+    // no ISV component at all
+    EXPECT_EQ(OMX_ErrorUndefined, session.isvCallBacks->FillBufferDone(
+            &session.decoder, NULL, &session.buffer));
+
+    EXPECT_EQ(0, session.fills + session.empties + session.events);
+    EXPECT_EQ(0, other.fills + other.empties + other.events);
+
+    closeSession(&other);
+    closeSession(&session);
+}
+
+TEST(ISVComponentTest, CallbacksBeforeSetComponent) {
+    // the decoder may call back from inside its own OMX_GetHandle
+    Session session;
+    memset(&session, 0, sizeof(session));
+    session.isv = new ISVComponent(static_cast<OMX_PTR>(&session));
+    session.isvCallBacks = session.isv->getCallBacks(&gClientCallBacks);
+
+    EXPECT_EQ(OMX_ErrorNone, session.isvCallBacks->EventHandler(
+            &session.decoder, static_cast<OMX_PTR>(session.isv), OMX_EventMark, 0, 0, NULL));
+    EXPECT_EQ(1, session.events);
+
+    closeSession(&session);
+}
+
+TEST(ISVComponentTest, ConcurrentSessions) {
+    static Session sessions[STRESS_SESSIONS];
+    pthread_t decoders[STRESS_SESSIONS];
+    pthread_t churner;
+
+    for (int i = 0; i < STRESS_SESSIONS; i++)
+        openSession(&sessions[i]);
+
+    ASSERT_EQ(0, pthread_create(&churner, NULL, churn, NULL));
+    for (int i = 0; i < STRESS_SESSIONS; i++)
+        ASSERT_EQ(0, pthread_create(&decoders[i], NULL, decode, &sessions[i]));
+    for (int i = 0; i < STRESS_SESSIONS; i++)
+        pthread_join(decoders[i], NULL);
+    pthread_join(churner, NULL);
+
+    // every callback reached its own client, none was lost or crossed
+    for (int i = 0; i < STRESS_SESSIONS; i++) {
+        EXPECT_EQ(STRESS_CALLBACKS, sessions[i].fills) << "session " << i;
+        EXPECT_EQ(STRESS_CALLBACKS, sessions[i].empties) << "session " << i;
+        EXPECT_EQ((STRESS_CALLBACKS + 63) / 64, sessions[i].events) << "session " << i;
+        EXPECT_EQ(0, sessions[i].mismatches) << "session " << i;
+        closeSession(&sessions[i]);
+    }
+}
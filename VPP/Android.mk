@@ -1,7 +1,20 @@
-ifeq ($(TARGET_HAS_ISV),true)
-
 LOCAL_PATH := $(call my-dir)
 
+ifneq ($(filter true,$(TARGET_HAS_ISV) $(TARGET_HAS_VPP)),)
+#### frame tap, shared by libvpp and libisv_omx_core ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        VPPFrameTap.cpp
+
+LOCAL_MODULE := libvpp_frametap
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_STATIC_LIBRARY)
+endif
+
+ifeq ($(TARGET_HAS_ISV),true)
 #### first ####
 
 include $(CLEAR_VARS)
@@ -35,6 +48,7 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
         VPPProcessor.cpp \
         VPPProcThread.cpp \
+        VPPDisplayState.cpp \
         NuPlayerVPPProcessor.cpp
 
 LOCAL_C_INCLUDES:= \
@@ -45,6 +59,8 @@ LOCAL_C_INCLUDES:= \
 
 LOCAL_SHARED_LIBRARIES := libva
 
+LOCAL_WHOLE_STATIC_LIBRARIES := libvpp_frametap
+
 LOCAL_COPY_HEADERS_TO := libmedia_utils_vpp
 
 LOCAL_COPY_HEADERS := \
@@ -52,6 +68,9 @@ LOCAL_COPY_HEADERS := \
     VPPBuffer.h \
     VPPProcThread.h \
     VPPProcessorBase.h \
+    VPPProcessorCore.h \
+    VPPDisplayState.h \
+    VPPFrameTap.h \
     NuPlayerVPPProcessor.h
 
 ifeq ($(TARGET_HAS_MULTIPLE_DISPLAY),true)
@@ -81,3 +100,18 @@ include $(BUILD_STATIC_LIBRARY)
 
 endif
 
+
+#### frame tap tool ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := tools/vpp_frametap_extract.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)
+
+LOCAL_MODULE := vpp_frametap_extract
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
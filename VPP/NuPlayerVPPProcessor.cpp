@@ -35,43 +35,19 @@ namespace android {
 NuPlayerVPPProcessor::NuPlayerVPPProcessor(
         const sp<AMessage> &notify,
         const sp<NativeWindowWrapper> &nativeWindow)
-    : mNotify(notify),
-      mNativeWindow(nativeWindow),
-      mBufferInfos(NULL),
-      mInputBufferNum(0),
-      mOutputBufferNum(0),
-      mThreadRunning(false),
-      mInputLoadPoint(0),
-      mOutputLoadPoint(0),
+    : VPPProcessorCore<ACodec::BufferInfo>(nativeWindow->getNativeWindow()),
       mInputCount(0),
-      mACodec(NULL),
-      mEOS(false),
+      mNotify(notify),
+      mNativeWindow(nativeWindow),
       mLastInputTimeUs(-1),
-      mMds(NULL) {
-
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    mMds = new VPPMDSListener(this);
-#endif
-    mWorker = VPPWorker::getInstance(mNativeWindow->getNativeWindow());
+      mACodec(NULL) {
 }
 
 
 NuPlayerVPPProcessor::~NuPlayerVPPProcessor() {
     quitThread();
-
-    if (mWorker != NULL) {
-        delete mWorker;
-        mWorker = NULL;
-    }
-    if (mThreadRunning == false) {
-        releaseBuffers();
-    }
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    if (mMds != NULL) {
-        mMds->deInit();
-        mMds = NULL;
-    }
-#endif
+    // VPPWorker and MDS listener are released by VPPProcessorCore
+    releaseBuffers();
     mNuPlayerVPPProcessor = NULL;
     ALOGI("===== VPPInputCount = %d  =====", mInputCount);
 }
@@ -190,10 +166,7 @@ void NuPlayerVPPProcessor::getBufferFromVPP() {
         mOutputLoadPoint = (mOutputLoadPoint + 1) % mOutputBufferNum;
     }
 
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        if (mInput[i].mStatus == VPP_BUFFER_READY)
-            postAndResetInput(i);
-    }
+    releaseReadyInputs();
 }
 
 void NuPlayerVPPProcessor::onMessageReceived(const sp<AMessage> &msg) {
@@ -247,23 +220,8 @@ int64_t NuPlayerVPPProcessor::getBufferTimestamp(sp<ABuffer> buffer) {
 }
 
 status_t NuPlayerVPPProcessor::validateVideoInfo(VPPVideoInfo *videoInfo){
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    if (mMds != NULL && mMds->init() != STATUS_OK)
-        return VPP_FAIL;
-#endif
-    if (videoInfo == NULL || mWorker == NULL)
-        return VPP_FAIL;
-    if (mWorker->configFilters(videoInfo->width, videoInfo->height, videoInfo->fps, 0) != VPP_OK)
-        return VPP_FAIL;
-    mInputBufferNum = mWorker->mNumForwardReferences + 3;
-    /* reserve one buffer in VPPProcThread, on add one more buffer here */
-    mOutputBufferNum = 1 + (mWorker->mNumForwardReferences + 2) * mWorker->mFrcRate;
-    if (mInputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER
-            || mOutputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER) {
-        ALOGE("buffer number needed are exceeded limitation");
-        return VPP_FAIL;
-    }
-    return VPP_OK;
+    // NuPlayer has no slow motion playback
+    return configVideoInfo(videoInfo, 1);
 }
 
 ACodec::BufferInfo * NuPlayerVPPProcessor::findBufferByID(IOMX::buffer_id bufferID) {
@@ -281,21 +239,6 @@ ACodec::BufferInfo * NuPlayerVPPProcessor::findBufferByID(IOMX::buffer_id buffer
     return NULL;
 }
 
-ACodec::BufferInfo * NuPlayerVPPProcessor::findBufferByGraphicBuffer(sp<GraphicBuffer> graphicBuffer) {
-    if (mBufferInfos == NULL)
-        return NULL;
-
-    for (size_t i = 0; i < mBufferInfos->size(); ++i) {
-        ACodec::BufferInfo *info = &mBufferInfos->editItemAt(i);
-
-        if (info != NULL && info->mGraphicBuffer == graphicBuffer) {
-            return info;
-        }
-    }
-
-    return NULL;
-}
-
 status_t NuPlayerVPPProcessor::init(sp<ACodec> &codec) {
     ALOGI("init");
     if (codec == NULL || mWorker == NULL)
@@ -304,30 +247,9 @@ status_t NuPlayerVPPProcessor::init(sp<ACodec> &codec) {
     mACodec = codec;
 
     // set BufferInfo from decoder
-    if (mBufferInfos == NULL) {
-        mBufferInfos = &codec->mBuffers[codec->kPortIndexOutput];
-        if(mBufferInfos == NULL)
-            return VPP_FAIL;
-        uint32_t size = mBufferInfos->size();
-        if (mInputBufferNum == 0 || mOutputBufferNum == 0
-                || size <= mInputBufferNum + mOutputBufferNum
-                || mInputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER
-                || mOutputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER) {
-            ALOGE("input or output buffer number is invalid");
-            return VPP_FAIL;
-        }
-        for (uint32_t i = 0; i < size; i++) {
-            ACodec::BufferInfo *info = &mBufferInfos->editItemAt(i);
-            GraphicBuffer* graphicBuffer = info->mGraphicBuffer.get();
-            // set graphic buffer config to VPPWorker
-            if(mWorker->setGraphicBufferConfig(graphicBuffer) == STATUS_OK)
-                continue;
-            else {
-                ALOGE("set graphic buffer config to VPPWorker failed");
-                return VPP_FAIL;
-            }
-        }
-    }
+    if (mBufferInfos == NULL
+            && setCodecBuffers(&codec->mBuffers[codec->kPortIndexOutput]) != VPP_OK)
+        return VPP_FAIL;
 
     if (initBuffers() != STATUS_OK)
         return VPP_FAIL;
@@ -336,34 +258,31 @@ status_t NuPlayerVPPProcessor::init(sp<ACodec> &codec) {
     if(mWorker->init() != STATUS_OK)
         return VPP_FAIL;
 
-    // VPPThread starts to run
-    mProcThread = new VPPProcThread(false, mWorker,
-            mInput, mInputBufferNum,
-            mOutput, mOutputBufferNum);
-    if (mProcThread == NULL)
-        return VPP_FAIL;
-    mProcThread->run("VPPProcThread", ANDROID_PRIORITY_NORMAL);
-    mThreadRunning = true;
+    return createThread();
+}
 
-    return VPP_OK;
+sp<GraphicBuffer> NuPlayerVPPProcessor::getGraphicBuffer(const ACodec::BufferInfo &info) {
+    return info.mGraphicBuffer;
+}
 
+sp<GraphicBuffer> NuPlayerVPPProcessor::dequeueOutputBuffer() {
+    ACodec::BufferInfo *info = dequeueBufferFromNativeWindow();
+    if (info == NULL)
+        return NULL;
+    return info->mGraphicBuffer;
 }
 
-status_t NuPlayerVPPProcessor::initBuffers() {
-    ACodec::BufferInfo *buf = NULL;
-    uint32_t i;
-    for (i = 0; i < mInputBufferNum; i++) {
-        mInput[i].resetBuffer(NULL);
-    }
+void NuPlayerVPPProcessor::releaseInput(uint32_t index) {
+    postAndResetInput(index);
+}
 
-    for (i = 0; i < mOutputBufferNum; i++) {
-        buf = dequeueBufferFromNativeWindow();
-        if (buf == NULL)
-            return VPP_FAIL;
+void NuPlayerVPPProcessor::releaseOutput(uint32_t index) {
+    mOutput[index].resetBuffer(mOutput[index].mGraphicBuffer);
+}
 
-        mOutput[i].resetBuffer(buf->mGraphicBuffer);
-    }
-    return VPP_OK;
+void NuPlayerVPPProcessor::onFlush() {
+    mLastInputTimeUs = -1;
+    printBuffers();
 }
 
 ACodec::BufferInfo * NuPlayerVPPProcessor::dequeueBufferFromNativeWindow() {
@@ -426,16 +345,6 @@ status_t NuPlayerVPPProcessor::cancelBufferToNativeWindow(ACodec::BufferInfo *in
     return OK;
 }
 
-void NuPlayerVPPProcessor::printBuffers() {
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        ALOGI("input %d.   graphicBuffer = %p,  status = %d, time = %lld", i, mInput[i].mGraphicBuffer.get(), mInput[i].mStatus, mInput[i].mTimeUs);
-    }
-    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
-        ALOGI("output %d.   graphicBuffer = %p,  status = %d, time = %lld", i, mOutput[i].mGraphicBuffer.get(), mOutput[i].mStatus, mOutput[i].mTimeUs);
-    }
-
-}
-
 void NuPlayerVPPProcessor::postAndResetInput(uint32_t index) {
     if (mInput[index].mGraphicBuffer != NULL) {
         // release useless input buffer
@@ -449,104 +358,10 @@ void NuPlayerVPPProcessor::postAndResetInput(uint32_t index) {
     mInput[index].resetBuffer(NULL);
 }
 
-void NuPlayerVPPProcessor::quitThread() {
-    ALOGI("quitThread");
-    if (mThreadRunning) {
-        mProcThread->requestExit();
-        {
-            Mutex::Autolock autoLock(mProcThread->mLock);
-            mProcThread->mRunCond.signal();
-        }
-        mProcThread->requestExitAndWait();
-        mProcThread.clear();
-    }
-    mThreadRunning = false;
-    return;
-}
-
-
-void NuPlayerVPPProcessor::seek() {
-
-    ALOGI("seek");
-    /* invoke thread if it is waiting */
-    if (mThreadRunning) {
-        {
-            Mutex::Autolock procLock(mProcThread->mLock);
-            ALOGV("got proc lock");
-            if (!hasProcessingBuffer()) {
-                ALOGI("seek done");
-                return;
-            }
-            mProcThread->mSeek = true;
-            ALOGV("set proc seek ");
-            mProcThread->mRunCond.signal();
-            ALOGV("wake up proc thread");
-        }
-        Mutex::Autolock endLock(mProcThread->mEndLock);
-        ALOGI("waiting proc thread mEnd lock");
-        mProcThread->mEndCond.wait(mProcThread->mEndLock);
-        ALOGI("wake up from proc thread");
-        flushNoShutdown();
-        mLastInputTimeUs = -1;
-        ALOGI("seek done");
-    }
-}
-
-
-bool NuPlayerVPPProcessor::hasProcessingBuffer() {
-    ALOGV("before hasProcessingBuffer");
-    //printBuffers();
-    bool hasProcBuffer = false;
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        if (mInput[i].mStatus == VPP_BUFFER_PROCESSING)
-            hasProcBuffer = true;
-        if (mInput[i].mStatus != VPP_BUFFER_PROCESSING && mInput[i].mStatus != VPP_BUFFER_FREE) {
-            postAndResetInput(i);
-        }
-    }
-    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
-        if ((mOutput[i].mStatus != VPP_BUFFER_PROCESSING) && (mOutput[i].mStatus != VPP_BUFFER_FREE) && (mOutput[i].mStatus != VPP_BUFFER_END_FLAG)) {
-            mOutput[i].resetBuffer(mOutput[i].mGraphicBuffer);
-        }
-    }
-    mInputLoadPoint = 0;
-    mOutputLoadPoint = 0;
-    ALOGV("after hasProcessingBuffer");
-    ALOGI("hasProcessingBuffer %d", hasProcBuffer);
-    //printBuffers();
-    return hasProcBuffer;
-}
-
-void NuPlayerVPPProcessor::flushNoShutdown() {
-    ALOGV("before flushNoShutdown");
-    //printBuffers();
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        CHECK(mInput[i].mStatus != VPP_BUFFER_PROCESSING);
-        if (mInput[i].mStatus != VPP_BUFFER_FREE) {
-            postAndResetInput(i);
-        }
-    }
-
-    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
-        CHECK(mOutput[i].mStatus != VPP_BUFFER_PROCESSING);
-        if (mOutput[i].mStatus != VPP_BUFFER_FREE
-                    /*&& mOutput[i].mStatus != VPP_BUFFER_RENDERING*/) {
-            mOutput[i].resetBuffer(mOutput[i].mGraphicBuffer);
-        }
-    }
-    ALOGV("after flushNoShutdown");
-    printBuffers();
-}
-
 void NuPlayerVPPProcessor::setEOS() {
     if (!mThreadRunning)
         return;
-    ALOGI("set eos");
-    mEOS = true;
-    if (mProcThread != NULL) {
-        mProcThread->mEOS = true;
-    }
-
+    signalEOS();
 }
 
 void NuPlayerVPPProcessor::flushShutdown() {
@@ -556,11 +371,7 @@ void NuPlayerVPPProcessor::flushShutdown() {
         return;
 
     quitThread();
-
-    if (mWorker != NULL) {
-        delete mWorker;
-        mWorker = NULL;
-    }
+    destroyWorker();
 
     printBuffers();
 
@@ -585,53 +396,4 @@ void NuPlayerVPPProcessor::flushShutdown() {
     mOutputLoadPoint = 0;
 }
 
-uint32_t NuPlayerVPPProcessor::getVppOutputFps() {
-    return mWorker->getVppOutputFps();
-}
-
-void NuPlayerVPPProcessor::setDisplayMode(int32_t mode) {
-    if (mWorker != NULL) {
-        //check if frame rate conversion needed if HDMI connection status changed
-        ALOGV("display mode change. Thread  %p", &mProcThread);
-        ALOGI("old/new/connect_Bit mode %d %d %d",
-                 mWorker->getDisplayMode(),  mode, MDS_HDMI_CONNECTED);
-        if ((mWorker->getDisplayMode() != mode) && (mProcThread != NULL)) {
-            mProcThread->notifyCheckFrc();
-            ALOGI("NeedCheckFrc change");
-        }
-        mWorker->setDisplayMode(mode);
-    }
-}
-
-status_t NuPlayerVPPProcessor::configFrc4Hdmi(bool enableFrc4Hdmi) {
-
-    status_t status = STATUS_OK;
-    ALOGI("configFrc4Hdmi %d", enableFrc4Hdmi);
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    if (enableFrc4Hdmi) {
-        status_t status = mWorker->configFrc4Hdmi(enableFrc4Hdmi, &mMds);
-        if (status != STATUS_OK) {
-            ALOGE("failed to enable FRC for HDMI");
-            return status;
-        }
-
-        //Recalculate VPP FRC for HDMI
-        bool frcOn = false;
-        FRC_RATE frcRate = FRC_RATE_1X;
-        status = mWorker->calculateFrc(&frcOn, &frcRate);
-        /* Apply new FRC to VPP here.
-         * VPP FRC is configured before VPP thread start
-         */
-        bool newFrcSet = (frcOn != false) || (frcRate != FRC_RATE_1X);
-        if (newFrcSet && !mThreadRunning) {
-            mWorker->mFrcOn = frcOn;
-            mWorker->mFrcRate = frcRate;
-        } else if (mThreadRunning) {
-            ALOGW("Configure VPP FRC for HDMI too late");
-        }
-    }
-#endif
-
-    return status;
-}
 } //namespace android
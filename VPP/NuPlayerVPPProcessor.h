@@ -17,29 +17,18 @@
 #ifndef NUPLAYER_VPPPROCESSOR_H_
 #define NUPLAYER_VPPPROCESSOR_H_
 
-#include "VPPBuffer.h"
-#include "VPPProcThread.h"
+#include "VPPProcessorCore.h"
 #include "VPPSetting.h"
 #include <media/stagefright/foundation/AHandler.h>
 #include <media/stagefright/NativeWindowWrapper.h>
 #include <media/stagefright/ACodec.h>
-#include "VPPMds.h"
-#ifdef USE_IVP
-#include "ivp/VPPWorker.h"
-#else
-#include "VPPWorker.h"
-#endif
-
-#include "VPPMds.h"
 
 namespace android {
 
 struct ABuffer;
 struct ACodec;
-class VPPProcessorBase;
-class VPPMDSListener;
 
-struct NuPlayerVPPProcessor : public AHandler, VPPProcessorBase {
+struct NuPlayerVPPProcessor : public AHandler, public VPPProcessorCore<ACodec::BufferInfo> {
 public:
     static NuPlayerVPPProcessor* getInstance(const sp<AMessage> &notify,
             const sp<NativeWindowWrapper> &nativeWindow = NULL);
@@ -93,11 +82,6 @@ public:
      */
     void getBufferFromVPP();
 
-    /*
-     * seek and flush buffers
-     */
-    void seek();
-
     /*
      * indicate video stream has reached to end
      */
@@ -109,25 +93,6 @@ public:
      */
     void flushShutdown();
 
-    /*
-     * get VPP output frame rate.
-     */
-    uint32_t getVppOutputFps();
-
-    /* set display information to VPP
-     */
-    void setDisplayMode(int32_t mode);
-
-    /* config enable/disable VPP frame rate conversion for HDMI
-     */
-    status_t configFrc4Hdmi(bool enable);
-
-public:
-    // number of extra input buffer needed by VPP
-    uint32_t mInputBufferNum;
-    // number of output buffer needed by VPP
-    uint32_t mOutputBufferNum;
-
     enum {
         kWhatUpdateVppOutput = 'quvO',
         kWhatUpdateVppInput  = 'quvI',
@@ -137,62 +102,44 @@ protected:
     virtual ~NuPlayerVPPProcessor();
     virtual void onMessageReceived(const sp<AMessage> &msg);
 
+    // VPPProcessorCore
+    virtual sp<GraphicBuffer> getGraphicBuffer(const ACodec::BufferInfo &info);
+    virtual sp<GraphicBuffer> dequeueOutputBuffer();
+    virtual void releaseInput(uint32_t index);
+    virtual void releaseOutput(uint32_t index);
+    virtual void onFlush();
+
 private:
     enum {
         kWhatFreeBuffer     = 'freB',
     };
 
     static NuPlayerVPPProcessor* mNuPlayerVPPProcessor;
-    // buffer info for VPP input
-    VPPBuffer mInput[VPPBuffer::MAX_VPP_BUFFER_NUMBER];
-    // buffer info for VPP output
-    VPPBuffer mOutput[VPPBuffer::MAX_VPP_BUFFER_NUMBER];
-    // input load point
-    uint32_t mInputLoadPoint;
-    // output load point
-    uint32_t mOutputLoadPoint;
     // total input count
     uint32_t mInputCount;
 
     // vpp notify
     sp<AMessage> mNotify;
-    // VPPProceThread
-    sp<VPPProcThread> mProcThread;
-    bool mThreadRunning;
-    VPPWorker * mWorker;
     sp<NativeWindowWrapper> mNativeWindow;
-    Vector<ACodec::BufferInfo> * mBufferInfos;
-    bool mEOS;
     int64_t mLastInputTimeUs;
 
     sp<ACodec> mACodec;
-    sp<VPPMDSListener> mMds;
 
 private:
     NuPlayerVPPProcessor(const sp<AMessage> &notify,
             const sp<NativeWindowWrapper> &nativeWindow = NULL);
-    // init inputBuffer and outBuffer
-    status_t initBuffers();
     // completely release all buffers
     void releaseBuffers();
     // clear input buffer array
     void postAndResetInput(uint32_t index);
     // find buffer info by buffer id
     ACodec::BufferInfo * findBufferByID(IOMX::buffer_id bufferID);
-    // find buffer info by graphic buffer handle
-    ACodec::BufferInfo * findBufferByGraphicBuffer(sp<GraphicBuffer> graphicBuffer);
     // dequeue BufferInfo from native window
     ACodec::BufferInfo * dequeueBufferFromNativeWindow();
     status_t cancelBufferToNativeWindow(ACodec::BufferInfo *info);
     // free buffer when receiving kWhatFreeBuffer message
     void onFreeBuffer(const sp<AMessage> &msg);
     int64_t getBufferTimestamp(sp<ABuffer> buffer);
-    void printBuffers();
-    void quitThread();
-    // flush buffers without quit threads
-    void flushNoShutdown();
-    // bofore flush
-    bool hasProcessingBuffer();
 
     DISALLOW_EVIL_CONSTRUCTORS(NuPlayerVPPProcessor);
 };
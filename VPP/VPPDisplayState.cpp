@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+//#define LOG_NDEBUG 0
+
+#define LOG_TAG "VPPDisplayState"
+
+#include "VPPDisplayState.h"
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <string.h>
+
+namespace android {
+
+VPPFakeDisplayProvider::VPPFakeDisplayProvider()
+    : mTimingCount(0) {
+    memset(&mCurrTiming, 0, sizeof(MDSHdmiTiming));
+    memset(mTimingList, 0, sizeof(mTimingList));
+}
+
+void VPPFakeDisplayProvider::setHdmiTimings(const MDSHdmiTiming &curHdmiTiming,
+              const MDSHdmiTiming *timingList, int32_t timingCount) {
+    Mutex::Autolock autoLock(mLock);
+    if (timingList == NULL || timingCount < 0)
+        timingCount = 0;
+    if (timingCount > HDMI_TIMING_MAX)
+        timingCount = HDMI_TIMING_MAX;
+
+    mCurrTiming = curHdmiTiming;
+    mTimingCount = timingCount;
+    if (timingCount > 0)
+        memcpy(mTimingList, timingList, timingCount * sizeof(MDSHdmiTiming));
+}
+
+status_t VPPFakeDisplayProvider::queryHdmiMetaData(MDSHdmiTiming *curHdmiTiming,
+              MDSHdmiTiming *timingList, int32_t *timingCount) {
+    if ((curHdmiTiming == NULL) || (timingList == NULL) || (timingCount == NULL))
+        return BAD_VALUE;
+
+    Mutex::Autolock autoLock(mLock);
+    *curHdmiTiming = mCurrTiming;
+    *timingCount = mTimingCount;
+    if (mTimingCount > 0)
+        memcpy(timingList, mTimingList, mTimingCount * sizeof(MDSHdmiTiming));
+    return OK;
+}
+
+VPPDisplayState::VPPDisplayState()
+    : mSeq(0), mMode(0) {
+    memset(&mInfo, 0, sizeof(VPPDisplayInfo));
+}
+
+status_t VPPDisplayState::refresh(VPPDisplayInfoProvider *provider, int32_t mode) {
+    if (provider == NULL)
+        return BAD_VALUE;
+
+    VPPDisplayInfo info;
+    memset(&info, 0, sizeof(VPPDisplayInfo));
+    info.mode = mode;
+
+    if (mode & MDS_HDMI_CONNECTED) {
+        int32_t count = 0;
+        status_t ret = provider->queryHdmiMetaData(&info.currTiming, info.timingList, &count);
+        if (ret == OK && count > 0)
+            info.timingCount = (count > HDMI_TIMING_MAX) ? HDMI_TIMING_MAX : count;
+        else
+            ALOGW("failed to get HDMI data, ret %d count %d", ret, count);
+    }
+
+    publish(info);
+    return OK;
+}
+
+void VPPDisplayState::publish(const VPPDisplayInfo &info) {
+    Mutex::Autolock autoLock(mWriteLock);
+    int32_t seq = mSeq;
+
+    android_atomic_release_store(seq + 1, &mSeq);
+    android_memory_barrier();
+    memcpy(&mInfo, &info, sizeof(VPPDisplayInfo));
+    android_atomic_release_store(info.mode, &mMode);
+    android_atomic_release_store(seq + 2, &mSeq);
+
+    ALOGI("display state %d: mode 0x%x, HDMI %dx%d@%d, timing count %d",
+            seq + 2, info.mode, info.currTiming.width,
+            info.currTiming.height, info.currTiming.refresh, info.timingCount);
+}
+
+bool VPPDisplayState::read(VPPDisplayInfo *info) const {
+    int32_t begin, end;
+
+    if (info == NULL)
+        return false;
+
+    for (;;) {
+        begin = android_atomic_acquire_load(&mSeq);
+        if (begin & 1)
+            continue;
+        memcpy(info, (const void *)&mInfo, sizeof(VPPDisplayInfo));
+        android_memory_barrier();
+        end = android_atomic_acquire_load(&mSeq);
+        if (begin == end)
+            break;
+    }
+    return (begin >= 2);
+}
+
+bool VPPDisplayState::isValid() const {
+    return (android_atomic_acquire_load(&mSeq) >= 2);
+}
+
+int32_t VPPDisplayState::getDisplayMode() const {
+    return android_atomic_acquire_load(&mMode);
+}
+
+} /* namespace android */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __VPP_DISPLAY_STATE_H
+#define __VPP_DISPLAY_STATE_H
+
+#include <stdint.h>
+#include <utils/Errors.h>
+#include <utils/threads.h>
+
+#ifdef TARGET_HAS_MULTIPLE_DISPLAY
+#include <display/MultiDisplayService.h>
+#include <display/MultiDisplayType.h>
+using namespace android::intel;
+#else
+/** @brief HDMI timing structure */
+#define MDS_HDMI_CONNECTED (1<<1)
+typedef struct {
+    int         width;
+    int         height;
+    int         refresh;    /**< refresh rate */
+    int         interlace;  /**< 1:interlaced 0:progressive */
+    int         ratio;      /**< aspect ratio */
+    int         flags;      /**< expended flag */
+} MDSHdmiTiming;
+#endif
+
+//HDMI max timing is defined drm_hdmi.h
+#define HDMI_TIMING_MAX (128)
+
+namespace android {
+
+/* snapshot of display info used by VPP FRC policy. The VPP setting is
+ * not cached here: it changes without any MDS message, so VPPWorker
+ * queries it when it configures filters.
+ */
+struct VPPDisplayInfo {
+    int32_t mode;
+    MDSHdmiTiming currTiming;
+    int32_t timingCount;
+    MDSHdmiTiming timingList[HDMI_TIMING_MAX];
+};
+
+/*
+ * Source of display info. Queries may block on IPC, so they are only
+ * issued from MDS callback threads, never from the VPP processing thread.
+ */
+class VPPDisplayInfoProvider {
+public:
+    virtual ~VPPDisplayInfoProvider() {}
+    virtual status_t queryHdmiMetaData(MDSHdmiTiming *curHdmiTiming,
+              MDSHdmiTiming *timingList, int32_t *timingCount) = 0;
+};
+
+/*
+ * In-process display info provider, used where MDS is not available
+ * and to drive VPPDisplayState in tests.
+ */
+class VPPFakeDisplayProvider : public VPPDisplayInfoProvider {
+public:
+    VPPFakeDisplayProvider();
+    virtual ~VPPFakeDisplayProvider() {}
+
+    void setHdmiTimings(const MDSHdmiTiming &curHdmiTiming,
+              const MDSHdmiTiming *timingList, int32_t timingCount);
+
+    virtual status_t queryHdmiMetaData(MDSHdmiTiming *curHdmiTiming,
+              MDSHdmiTiming *timingList, int32_t *timingCount);
+
+private:
+    Mutex mLock;
+    MDSHdmiTiming mCurrTiming;
+    int32_t mTimingCount;
+    MDSHdmiTiming mTimingList[HDMI_TIMING_MAX];
+};
+
+/*
+ * Display state cache. It is refreshed from MDS callbacks and read by
+ * the VPP processing thread without taking any lock or doing IPC.
+ * Writers are serialized by a mutex, readers use a sequence counter
+ * and retry if a refresh happened while they were copying.
+ */
+class VPPDisplayState {
+public:
+    VPPDisplayState();
+    ~VPPDisplayState() {}
+
+    // query provider and publish a new snapshot, called on callback threads
+    status_t refresh(VPPDisplayInfoProvider *provider, int32_t mode);
+
+    // publish a snapshot given by caller
+    void publish(const VPPDisplayInfo &info);
+
+    // copy latest snapshot, return false if nothing is published yet
+    bool read(VPPDisplayInfo *info) const;
+
+    bool isValid() const;
+    int32_t getDisplayMode() const;
+
+private:
+    VPPDisplayState(const VPPDisplayState &);
+    VPPDisplayState &operator=(const VPPDisplayState &);
+
+private:
+    Mutex mWriteLock;
+    // odd while a snapshot is being written
+    volatile int32_t mSeq;
+    volatile int32_t mMode;
+    VPPDisplayInfo mInfo;
+};
+
+} /* namespace android */
+
+#endif /* __VPP_DISPLAY_STATE_H */
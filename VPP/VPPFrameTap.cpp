@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "VPPFrameTap"
+#include "VPPFrameTap.h"
+#include <cutils/properties.h>
+#include <utils/Log.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+VPPFrameTap::VPPFrameTap(const char *path, uint32_t slotNum, uint32_t interval)
+    : Thread(false),
+      mFile(NULL),
+      mSlotNum(slotNum > 0 ? slotNum : VPP_FRAME_TAP_DEFAULT_SLOTS),
+      mInterval(interval > 0 ? interval : 1),
+      mSlotSize(0),
+      mMaxPayload(0),
+      mRing(NULL),
+      mReadIdx(0),
+      mFilled(0),
+      mRunning(false),
+      mFrameCount(0),
+      mTappedCount(0),
+      mDroppedCount(0) {
+    strncpy(mPath, path, sizeof(mPath) - 1);
+    mPath[sizeof(mPath) - 1] = '\0';
+}
+
+VPPFrameTap::~VPPFrameTap() {
+    stop();
+    if (mRing != NULL) {
+        free(mRing);
+        mRing = NULL;
+    }
+}
+
+//static
+sp<VPPFrameTap> VPPFrameTap::createFromProperties(const char *prefix, const char *defaultPath) {
+    char name[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+
+    snprintf(name, sizeof(name), "%s.frametap.interval", prefix);
+    property_get(name, value, "0");
+    uint32_t interval = atoi(value);
+    if (interval == 0)
+        return NULL;
+
+    snprintf(name, sizeof(name), "%s.frametap.slots", prefix);
+    property_get(name, value, "0");
+    uint32_t slotNum = atoi(value);
+
+    char path[PROPERTY_VALUE_MAX];
+    snprintf(name, sizeof(name), "%s.frametap.path", prefix);
+    property_get(name, path, defaultPath);
+
+    ALOGI("frame tap is on: %s, interval %d, slots %d", path, interval, slotNum);
+    return new VPPFrameTap(path, slotNum, interval);
+}
+
+status_t VPPFrameTap::start(uint32_t width, uint32_t height) {
+    if (mRunning)
+        return OK;
+
+    if (width == 0 || height == 0 || (width % 2) || (height % 2))
+        return BAD_VALUE;
+
+    // keep every slot 4KB aligned, so a run of slots is written in one request
+    mMaxPayload = width * height * 3 / 2;
+    mSlotSize = (sizeof(VPPFrameTapRecord) + mMaxPayload + 4095) & ~4095;
+    void *ring = NULL;
+    if (posix_memalign(&ring, 4096, mSlotSize * mSlotNum) != 0) {
+        ALOGE("failed to allocate %d frame slots", mSlotNum);
+        return NO_MEMORY;
+    }
+    mRing = (uint8_t *)ring;
+
+    mFile = fopen(mPath, "wb");
+    if (mFile == NULL) {
+        ALOGE("Open %s failed!", mPath);
+        free(mRing);
+        mRing = NULL;
+        return UNKNOWN_ERROR;
+    }
+    // the writer issues its own large writes
+    setvbuf(mFile, NULL, _IONBF, 0);
+
+    mReadIdx = 0;
+    mFilled = 0;
+    mRunning = true;
+    status_t err = run("VPPFrameTap", ANDROID_PRIORITY_BACKGROUND);
+    if (err != OK) {
+        mRunning = false;
+        fclose(mFile);
+        mFile = NULL;
+    }
+    return err;
+}
+
+void VPPFrameTap::stop() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (!mRunning)
+            return;
+        mRunning = false;
+        mCond.signal();
+    }
+    requestExitAndWait();
+
+    // write what is left in the ring
+    while (drain())
+        ;
+
+    if (mFile != NULL) {
+        fclose(mFile);
+        mFile = NULL;
+    }
+    ALOGI("frame tap stopped: %d frames, %d tapped, %d dropped",
+            mFrameCount, mTappedCount, mDroppedCount);
+}
+
+bool VPPFrameTap::shouldTap() {
+    if (!mRunning)
+        return false;
+    return ((mFrameCount++ % mInterval) == 0);
+}
+
+status_t VPPFrameTap::tapNV12(uint32_t width, uint32_t height,
+        const uint8_t *y, uint32_t yPitch,
+        const uint8_t *uv, uint32_t uvPitch, int64_t timeUs) {
+    uint32_t writeIdx;
+
+    if (y == NULL || uv == NULL || (width % 2) || (height % 2))
+        return BAD_VALUE;
+
+    uint32_t size = width * height * 3 / 2;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (!mRunning)
+            return NO_INIT;
+        if (size > mMaxPayload) {
+            mDroppedCount++;
+            return BAD_VALUE;
+        }
+        if (mFilled == mSlotNum) {
+            // writer is behind, drop the frame rather than stall the caller
+            mDroppedCount++;
+            return WOULD_BLOCK;
+        }
+        writeIdx = (mReadIdx + mFilled) % mSlotNum;
+    }
+
+    // only this thread writes to a free slot, so copy without lock
+    uint8_t *slot = mRing + writeIdx * mSlotSize;
+    VPPFrameTapRecord *record = (VPPFrameTapRecord *)slot;
+    record->magic = VPP_FRAME_TAP_MAGIC;
+    record->frameIndex = mFrameCount - 1;
+    record->width = width;
+    record->height = height;
+    record->size = size;
+    record->recordSize = mSlotSize;
+    record->timeUs = timeUs;
+
+    uint8_t *dst = slot + sizeof(VPPFrameTapRecord);
+    for (uint32_t h = 0; h < height; h++) {
+        memcpy(dst, y, width);
+        dst += width;
+        y += yPitch;
+    }
+    for (uint32_t h = 0; h < height / 2; h++) {
+        memcpy(dst, uv, width);
+        dst += width;
+        uv += uvPitch;
+    }
+    // the padding goes to the file too, don't leak old heap or frame data
+    memset(dst, 0, slot + mSlotSize - dst);
+
+    Mutex::Autolock autoLock(mLock);
+    mFilled++;
+    mTappedCount++;
+    mCond.signal();
+    return OK;
+}
+
+uint32_t VPPFrameTap::getDroppedCount() {
+    Mutex::Autolock autoLock(mLock);
+    return mDroppedCount;
+}
+
+bool VPPFrameTap::drain() {
+    uint32_t start, count;
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (mFilled == 0)
+            return false;
+        start = mReadIdx;
+        // contiguous slots up to the end of the ring
+        count = mFilled;
+        if (start + count > mSlotNum)
+            count = mSlotNum - start;
+    }
+
+    // slots are self describing, so a run of them goes out in one write
+    size_t len = count * mSlotSize;
+    if (fwrite(mRing + start * mSlotSize, 1, len, mFile) != len)
+        ALOGW("failed to write %d frames", count);
+
+    Mutex::Autolock autoLock(mLock);
+    mReadIdx = (start + count) % mSlotNum;
+    mFilled -= count;
+    return true;
+}
+
+bool VPPFrameTap::threadLoop() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        while (mFilled == 0 && mRunning)
+            mCond.wait(mLock);
+        if (mFilled == 0 && !mRunning)
+            return false;
+    }
+    drain();
+    return true;
+}
+
+} /* namespace android */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __VPP_FRAME_TAP_H
+#define __VPP_FRAME_TAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <utils/Errors.h>
+#include <utils/threads.h>
+
+#define VPP_FRAME_TAP_MAGIC 0x52544656 // "VFTR"
+#define VPP_FRAME_TAP_DEFAULT_SLOTS 8
+
+namespace android {
+
+/*
+ * Record header in a frame tap dump. Each record is followed by
+ * "size" bytes of tightly packed NV12 data (Y plane, then UV plane),
+ * and padded so the next record starts "recordSize" bytes after this one.
+ */
+struct VPPFrameTapRecord {
+    uint32_t magic;
+    uint32_t frameIndex;    // index of the frame in the tapped stream
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;          // payload size in bytes
+    uint32_t recordSize;    // header + payload + padding
+    int64_t timeUs;
+};
+
+/*
+ * Debug only. Copies sampled NV12 frames into a preallocated ring on the
+ * caller's thread, and a writer thread drains the ring to a file in large
+ * sequential writes. When the ring is full the frame is dropped, so the
+ * processing thread never waits for storage.
+ *
+ * Properties, where <prefix> is given to createFromProperties():
+ *     <prefix>.frametap.interval: tap one frame out of every N, 0 is off
+ *     <prefix>.frametap.slots:    number of frames the ring holds
+ *     <prefix>.frametap.path:     dump file
+ */
+class VPPFrameTap : public Thread {
+public:
+    VPPFrameTap(const char *path, uint32_t slotNum, uint32_t interval);
+    virtual ~VPPFrameTap();
+
+    // return NULL if frame tap is not enabled by properties
+    static sp<VPPFrameTap> createFromProperties(const char *prefix, const char *defaultPath);
+
+    // allocate ring for frames up to width x height, open file and start writer
+    status_t start(uint32_t width, uint32_t height);
+
+    // drain the ring and stop writer thread
+    void stop();
+
+    // count one frame, return true if it is sampled and should be tapped
+    bool shouldTap();
+
+    // copy one sampled NV12 frame into the ring
+    status_t tapNV12(uint32_t width, uint32_t height,
+            const uint8_t *y, uint32_t yPitch,
+            const uint8_t *uv, uint32_t uvPitch, int64_t timeUs = -1);
+
+    uint32_t getDroppedCount();
+
+private:
+    virtual bool threadLoop();
+    // write filled slots from mReadIdx, return false if nothing was written
+    bool drain();
+
+    VPPFrameTap(const VPPFrameTap &);
+    VPPFrameTap &operator=(const VPPFrameTap &);
+
+private:
+    char mPath[256];
+    FILE *mFile;
+    uint32_t mSlotNum;
+    uint32_t mInterval;
+    uint32_t mSlotSize;
+    uint32_t mMaxPayload;
+    uint8_t *mRing;
+
+    Mutex mLock;
+    Condition mCond;
+    // slots [mReadIdx, mReadIdx + mFilled) hold frames waiting to be written
+    uint32_t mReadIdx;
+    uint32_t mFilled;
+    bool mRunning;
+
+    uint32_t mFrameCount;
+    uint32_t mTappedCount;
+    uint32_t mDroppedCount;
+};
+
+} /* namespace android */
+
+#endif /* __VPP_FRAME_TAP_H */
@@ -27,7 +27,8 @@ namespace android {
 #ifdef TARGET_HAS_MULTIPLE_DISPLAY
 VPPMDSListener::VPPMDSListener(VPPProcessorBase* vppprocessor)
     : BnMultiDisplayListener(), mMode(0), mVppState(false),
-      mVpp(vppprocessor), mListenerId(-1), mHdmiClient(NULL), mMds(NULL) {
+      mVpp(vppprocessor), mListenerId(-1), mHdmiClient(NULL), mMds(NULL),
+      mState(NULL) {
     ALOGI("A new Mds listener is created");
 }
 
@@ -67,6 +68,8 @@ status_t VPPMDSListener::init() {
     mMode = mdsInfoProvider->getDisplayMode(false);
     ALOGI("%s: The initial display mode is set to %d", __func__, mMode);
 
+    // publish the HDMI state first, setDisplayMode() wakes the FRC check
+    refreshDisplayState();
     if (mVpp != NULL)
         mVpp->setDisplayMode(mMode);
 
@@ -93,6 +96,7 @@ VPPMDSListener::~VPPMDSListener() {
     mMode = MDS_MODE_NONE;
     mVppState = false;
     mVpp = NULL;
+    setDisplayState(NULL);
     mHdmiClient = NULL;
     mMds = NULL;
 
@@ -107,6 +111,9 @@ status_t VPPMDSListener::onMdsMessage(int msg, void* value, int size) {
     if ((msg & MDS_MSG_MODE_CHANGE) && (size == sizeof(int))) {
         mMode = *(static_cast<int*>(value));
         ALOGI("Display mode is %d", mMode);
+        // query HDMI data here, so VPP thread never blocks on MDS, and
+        // before setDisplayMode() so its FRC check sees the new state
+        refreshDisplayState();
         if (mVpp != NULL)
             mVpp->setDisplayMode(mMode);
     }
@@ -114,6 +121,22 @@ status_t VPPMDSListener::onMdsMessage(int msg, void* value, int size) {
     return NO_ERROR;
 }
 
+void VPPMDSListener::setDisplayState(VPPDisplayState* state) {
+    Mutex::Autolock autoLock(mStateLock);
+    mState = state;
+}
+
+void VPPMDSListener::refreshDisplayState() {
+    Mutex::Autolock autoLock(mStateLock);
+    if (mState != NULL)
+        mState->refresh(this, mMode);
+}
+
+status_t VPPMDSListener::queryHdmiMetaData(MDSHdmiTiming *curHdmiTiming,
+              MDSHdmiTiming *timingList, int32_t *timingCount) {
+    return getHdmiMetaData(curHdmiTiming, timingList, timingCount);
+}
+
 int32_t VPPMDSListener::getMode() {
     //ALOGV("Mds mode 0x%x", mMode);
     return mMode;
@@ -28,6 +28,7 @@
 #include <utils/Errors.h>
 #include <VPPSetting.h>
 #include "VPPProcessorBase.h"
+#include "VPPDisplayState.h"
 
 #ifdef TARGET_HAS_MULTIPLE_DISPLAY
 using namespace android :: intel;
@@ -35,7 +36,7 @@ using namespace android :: intel;
 namespace android {
 class VPPProcessorBase;
 
-class VPPMDSListener : public BnMultiDisplayListener {
+class VPPMDSListener : public BnMultiDisplayListener, public VPPDisplayInfoProvider {
 private:
     int32_t     mMode;
     bool    mVppState;
@@ -43,6 +44,9 @@ private:
     int32_t     mListenerId;
     sp<IMultiDisplayHdmiControl> mHdmiClient;
     sp<IMDService> mMds;
+    // display state cache refreshed on MDS messages
+    Mutex mStateLock;
+    VPPDisplayState* mState;
 
 public:
     VPPMDSListener(VPPProcessorBase*);
@@ -55,21 +59,18 @@ public:
     bool getVppState();
     status_t getHdmiMetaData(MDSHdmiTiming *curHdmiTiming,
               MDSHdmiTiming *frameRateLst,  int32_t *dispayTimingCount);
+    void setDisplayState(VPPDisplayState* state);
+
+    // VPPDisplayInfoProvider, may block on binder
+    virtual status_t queryHdmiMetaData(MDSHdmiTiming *curHdmiTiming,
+              MDSHdmiTiming *timingList, int32_t *timingCount);
+
+private:
+    void refreshDisplayState();
 };
 };
 #else
 
-/** @brief HDMI timing structure */
-#define MDS_HDMI_CONNECTED (1<<1)
-typedef struct {
-    int         width;
-    int         height;
-    int         refresh;    /**< refresh rate */
-    int         interlace;  /**< 1:interlaced 0:progressive */
-    int         ratio;      /**< aspect ratio */
-    int         flags;      /**< expended flag */
-} MDSHdmiTiming;
-
 namespace android {
 
 class VPPProcessorBase;
@@ -18,6 +18,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "VPPProcThread"
 #include "VPPProcThread.h"
+#include <cutils/properties.h>
 #include <utils/Log.h>
 
 namespace android {
@@ -41,7 +42,13 @@ VPPProcThread::VPPProcThread(bool canCallJava, VPPWorker* vppWorker,
     mOutputFillIdx(0),
     mbFlushPipelineInProcessing(false),
     mFrcChange(false),
-    mNeedCheckFrc(false) {
+    mNeedCheckFrc(false),
+    mPipelineDepth(inputBufferNum) {
+    char propValueString[PROPERTY_VALUE_MAX];
+    property_get("vpp.proc.pipeline.depth", propValueString, "0");
+    uint32_t depth = atoi(propValueString);
+    if (depth > 0)
+        setPipelineDepth(depth);
 }
 
 VPPProcThread::~VPPProcThread() {
@@ -212,6 +219,28 @@ int VPPProcThread::updateFirmwareInputBufStatus(Vector< sp<GraphicBuffer> > proc
 }
 
 
+void VPPProcThread::setPipelineDepth(uint32_t depth) {
+    if (depth < 1)
+        depth = 1;
+    if (depth > mInputBufferNum)
+        depth = mInputBufferNum;
+    Mutex::Autolock autoLock(mLock);
+    mPipelineDepth = depth;
+    ALOGI("pipeline depth %d", mPipelineDepth);
+    // threadLoop may be waiting for a slot
+    mRunCond.signal();
+}
+
+uint32_t VPPProcThread::getPipelineDepth() {
+    Mutex::Autolock autoLock(mLock);
+    return mPipelineDepth;
+}
+
+// called with mLock held
+bool VPPProcThread::isPipelineFull() const {
+    return (mNumTaskInProcesing >= mPipelineDepth);
+}
+
 bool VPPProcThread::isReadytoRun() {
 
     bool bInputReady = (mInput[mInputProcIdx].mStatus == VPP_BUFFER_LOADED) ? true : false;
@@ -327,30 +356,45 @@ bool VPPProcThread::threadLoop() {
         ALOGV("wait for input/outpu ...");
         mRunCond.wait(mLock);
         ALOGV("wake up from mLock ...");
+    } else if (bPendingOnFirmware && isPipelineFull() && !bFlushPipeline) {
+        // all pipeline slots are taken, give firmware time to complete one
+        ALOGV("pipeline full, tasks %d", mNumTaskInProcesing);
+        mRunCond.waitRelative(mLock, VPP_PIPELINE_POLL_INTERVAL);
+        return true;
     }
 
     ALOGV("before send: bInputReady %d flush: %d flushinProcess %d", bInputReady, bFlushPipeline, mbFlushPipelineInProcessing);
 
-    if (((bInputReady && bOutputBufFree) || bFlushPipeline) && !mbFlushPipelineInProcessing ) {
+    // submit as many inputs as the pipeline depth allows; flush is sent alone
+    while (((bInputReady && bOutputBufFree) || bFlushPipeline) && !mbFlushPipelineInProcessing
+            && (bFlushPipeline || !isPipelineFull())) {
+        procBufList.clear();
         bool bGetInBuf = getBufForFirmwareInput(&procBufList, &inputBuf, bFlushPipeline, &procBufNum);
-        if (bGetInBuf) {
-            if (!bFlushPipeline) {
-                flags = mInput[mInputProcIdx].mFlags;
-                // get input buffer timestamp
-                timeUs = mInput[mInputProcIdx].mTimeUs;
-            }
-            status_t ret = mVPPWorker->process(inputBuf, procBufList, procBufNum, bFlushPipeline, flags);
-            if (ret == STATUS_OK) {
-                mNumTaskInProcesing++;
-                if (bFlushPipeline) {
-                    mbFlushPipelineInProcessing = true;
-                    ALOGI("Vpp FlushPipeline set to driver");
-                }
-                updateFirmwareInputBufStatus(procBufList, procBufNum, timeUs, bFlushPipeline);
-            } else {
-                ALOGE("process error %d ...", __LINE__);
-            }
+        if (!bGetInBuf)
+            break;
+
+        if (!bFlushPipeline) {
+            flags = mInput[mInputProcIdx].mFlags;
+            // get input buffer timestamp
+            timeUs = mInput[mInputProcIdx].mTimeUs;
+        }
+        status_t ret = mVPPWorker->process(inputBuf, procBufList, procBufNum, bFlushPipeline, flags);
+        if (ret != STATUS_OK) {
+            ALOGE("process error %d ...", __LINE__);
+            break;
+        }
+
+        mNumTaskInProcesing++;
+        if (bFlushPipeline) {
+            mbFlushPipelineInProcessing = true;
+            ALOGI("Vpp FlushPipeline set to driver");
         }
+        updateFirmwareInputBufStatus(procBufList, procBufNum, timeUs, bFlushPipeline);
+        if (bFlushPipeline)
+            break;
+
+        bInputReady = (mInput[mInputProcIdx].mStatus == VPP_BUFFER_LOADED);
+        bOutputBufFree = isOutputBufFree();
     }
 
     ALOGV("Process End: bInputReady %d  tasks %d outbufFree %d", bInputReady, mNumTaskInProcesing, bOutputBufFree);
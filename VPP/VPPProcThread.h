@@ -30,6 +30,8 @@
 #include <utils/threads.h>
 #include <utils/Errors.h>
 
+// interval to poll firmware completion when the pipeline is full (ns)
+#define VPP_PIPELINE_POLL_INTERVAL 2000000
 
 namespace android {
 class VPPWorker;
@@ -55,6 +57,14 @@ class VPPProcThread : public Thread {
         bool isReadytoRun();
         void notifyCheckFrc();
 
+        /* Set how many inputs may be outstanding in VPPWorker at once.
+         * The value is clamped to [1, inputBufferNum], the default is
+         * inputBufferNum. It can also be set by the "vpp.proc.pipeline.depth"
+         * property. Must not be called with mLock held.
+         */
+        void setPipelineDepth(uint32_t depth);
+        uint32_t getPipelineDepth();
+
     public:
         Mutex mLock;
         Mutex mEndLock;
@@ -82,6 +92,7 @@ class VPPProcThread : public Thread {
                                    uint32_t procBufNum, int64_t timeUs,
                                    bool bFlushPipeline);
         bool isOutputBufFree();
+        bool isPipelineFull() const;
 
     private:
         android_thread_id_t mThreadId;
@@ -100,6 +111,7 @@ class VPPProcThread : public Thread {
         bool mbFlushPipelineInProcessing;
         bool mFrcChange;
         bool mNeedCheckFrc;
+        uint32_t mPipelineDepth;
 };
 
 } /* END namespace android */
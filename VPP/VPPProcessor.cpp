@@ -35,38 +35,16 @@ using namespace android::intel;
 namespace android {
 
 VPPProcessor::VPPProcessor(const sp<ANativeWindow> &native, OMXCodec *codec)
-        :mInputBufferNum(0), mOutputBufferNum(0),
-         mInputLoadPoint(0), mOutputLoadPoint(0),
+        :VPPProcessorCore<OMXCodec::BufferInfo>(native),
          mNativeWindow(native), mCodec(codec),
-         mBufferInfos(NULL),
-         mThreadRunning(false), mEOS(false), mIsEosRead(false),
-         mTotalDecodedCount(0), mInputCount(0), mVPPProcCount(0), mVPPRenderCount(0),
-         mMds(NULL) {
+         mIsEosRead(false), mRestarting(false),
+         mTotalDecodedCount(0), mInputCount(0), mVPPProcCount(0), mVPPRenderCount(0) {
     ALOGI("construction");
-    memset(mInput, 0, VPPBuffer::MAX_VPP_BUFFER_NUMBER * sizeof(VPPBuffer));
-    memset(mOutput, 0, VPPBuffer::MAX_VPP_BUFFER_NUMBER * sizeof(VPPBuffer));
-
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    mMds = new VPPMDSListener(this);
-#endif
-    mWorker = VPPWorker::getInstance(mNativeWindow);
 }
 
 VPPProcessor::~VPPProcessor() {
     quitThread();
-    mThreadRunning = false;
-
-    if (mWorker != NULL) {
-        delete mWorker;
-        mWorker = NULL;
-    }
-
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    if (mMds != NULL) {
-        mMds->deInit();
-        mMds = NULL;
-    }
-#endif
+    // VPPWorker and MDS listener are released by VPPProcessorCore
     releaseBuffers();
     mVPPProcessor = NULL;
     ALOGI("VPPProcessor is deleted");
@@ -98,33 +76,9 @@ status_t VPPProcessor::init() {
         return VPP_FAIL;
 
     // set BufferInfo from decoder
-    if (mBufferInfos == NULL) {
-        mBufferInfos = &mCodec->mPortBuffers[mCodec->kPortIndexOutput];
-        if(mBufferInfos == NULL)
-            return VPP_FAIL;
-        uint32_t size = mBufferInfos->size();
-        ALOGI("mBufferInfo size is %d",size);
-        if (mInputBufferNum == 0 || mOutputBufferNum == 0
-                || size <= mInputBufferNum + mOutputBufferNum
-                || mInputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER
-                || mOutputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER) {
-            ALOGE("input or output buffer number is invalid");
-            return VPP_FAIL;
-        }
-        for (uint32_t i = 0; i < size; i++) {
-            MediaBuffer* mediaBuffer = mBufferInfos->editItemAt(i).mMediaBuffer;
-            if(mediaBuffer == NULL)
-                return VPP_FAIL;
-            GraphicBuffer* graphicBuffer = mediaBuffer->graphicBuffer().get();
-            // set graphic buffer config to VPPWorker
-            if(mWorker->setGraphicBufferConfig(graphicBuffer) == STATUS_OK)
-                continue;
-            else {
-                ALOGE("set graphic buffer config to VPPWorker failed");
-                return VPP_FAIL;
-            }
-        }
-    }
+    if (mBufferInfos == NULL
+            && setCodecBuffers(&mCodec->mPortBuffers[mCodec->kPortIndexOutput]) != VPP_OK)
+        return VPP_FAIL;
 
     if (initBuffers() != STATUS_OK)
         return VPP_FAIL;
@@ -136,37 +90,6 @@ status_t VPPProcessor::init() {
     return createThread();
 }
 
-status_t VPPProcessor::configFrc4Hdmi(bool enableFrc4Hdmi) {
-
-    status_t status = STATUS_OK;
-    ALOGI("configFrc4Hdmi %d", enableFrc4Hdmi);
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    if (enableFrc4Hdmi) {
-        status_t status = mWorker->configFrc4Hdmi(enableFrc4Hdmi, &mMds);
-        if (status != STATUS_OK) {
-            ALOGE("failed to enable FRC for HDMI");
-            return status;
-        }
-
-        //Recalculate VPP FRC for HDMI
-        bool frcOn = false;
-        FRC_RATE frcRate = FRC_RATE_1X;
-        status = mWorker->calculateFrc(&frcOn, &frcRate);
-        /* Apply new FRC to VPP here.
-         * VPP FRC is configured before VPP thread start
-         */
-        bool newFrcSet = (frcOn != false) || (frcRate != FRC_RATE_1X);
-        if (newFrcSet && !mThreadRunning) {
-            mWorker->mFrcOn = frcOn;
-            mWorker->mFrcRate = frcRate;
-        } else if (mThreadRunning) {
-            ALOGW("Configure VPP FRC for HDMI too late");
-        }
-    }
-#endif
-    return status;
-}
-
 bool VPPProcessor::canSetDecoderBufferToVPP() {
     if (!mThreadRunning)
         return true;
@@ -177,7 +100,7 @@ bool VPPProcessor::canSetDecoderBufferToVPP() {
     mProcThread->mRunCond.signal();
 
     // release obsolete input buffers
-    clearInput();
+    releaseReadyInputs();
 
     if (countBuffersWeOwn() > (mOutputBufferNum + mInputBufferNum)) {
         return false;
@@ -227,20 +150,6 @@ int32_t VPPProcessor::countBuffersWeOwn() {
     return n;
 }
 
-void VPPProcessor::printBuffers() {
-    MediaBuffer *mediaBuffer = NULL;
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        mediaBuffer = findMediaBuffer(mInput[i]);
-        ALOGV("input %d.   %p,  status = %d, time = %lld", i, mediaBuffer, mInput[i].mStatus, mInput[i].mTimeUs);
-    }
-    ALOGV("======================================= ");
-    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
-        mediaBuffer = findMediaBuffer(mOutput[i]);
-        ALOGV("output %d.   %p,  status = %d, time = %lld", i, mediaBuffer, mOutput[i].mStatus, mOutput[i].mTimeUs);
-    }
-
-}
-
 void VPPProcessor::printRenderList() {
     List<MediaBuffer*>::iterator it;
     for (it = mRenderList.begin(); it != mRenderList.end(); it++) {
@@ -288,154 +197,67 @@ int64_t VPPProcessor::getBufferTimestamp(MediaBuffer * buff) {
     return timeUs;
 }
 
-void VPPProcessor::seek() {
-    ALOGI("seek");
-    /* invoke thread if it is waiting */
-    if (mThreadRunning) {
-        {
-            Mutex::Autolock procLock(mProcThread->mLock);
-            ALOGV("got proc lock");
-            if (!hasProcessingBuffer()) {
-                ALOGI("seek done");
-                return;
-             }
-             mProcThread->mSeek = true;
-             ALOGV("set proc seek ");
-             mProcThread->mRunCond.signal();
-             ALOGI("wake up proc thread");
-        }
-        ALOGI("try to get mEnd lock");
-        Mutex::Autolock endLock(mProcThread->mEndLock);
-        ALOGI("waiting mEnd lock(seek finish) ");
-        mProcThread->mEndCond.wait(mProcThread->mEndLock);
-        ALOGI("wake up proc thread");
-        flush();
-        ALOGI("seek done");
-    }
-}
-
 status_t VPPProcessor::reset() {
     ALOGW("Error happens in VSP and VPPProcessor need to reset");
     quitThread();
+    /* output buffers released by flush come back through signalBufferReturned,
+     * keep them in their slots for the new thread instead of cancelling them.
+     * mThreadRunning stays false until createThread() succeeds.
+     */
+    mRestarting = true;
     flush();
+    mRestarting = false;
     if (mWorker->reset() != STATUS_OK)
         return VPP_FAIL;
     return createThread();
 }
 
-status_t VPPProcessor::createThread() {
-    // VPPThread starts to run
-    mProcThread = new VPPProcThread(false, mWorker,
-            mInput, mInputBufferNum,
-            mOutput, mOutputBufferNum);
-    if (mProcThread == NULL)
-        return VPP_FAIL;
-    mProcThread->run("VPPProcThread", ANDROID_PRIORITY_NORMAL);
-    mThreadRunning = true;
-    return VPP_OK;
-}
-
-void VPPProcessor::quitThread() {
-    ALOGI("quitThread");
-    if(mThreadRunning) {
-        mProcThread->requestExit();
-        {
-            Mutex::Autolock autoLock(mProcThread->mLock);
-            mProcThread->mRunCond.signal();
-        }
-        mProcThread->requestExitAndWait();
-        mProcThread.clear();
-    }
-    return;
-}
-
 void VPPProcessor::releaseBuffers() {
     ALOGI("releaseBuffers");
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        MediaBuffer *mediaBuffer = findMediaBuffer(mInput[i]);
-        if (mediaBuffer != NULL && mediaBuffer->refcount() > 0)
-            mediaBuffer->release();
-        mInput[i].resetBuffer(NULL);
-    }
+    for (uint32_t i = 0; i < mInputBufferNum; i++)
+        releaseInput(i);
 
-    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
-        MediaBuffer *mediaBuffer = findMediaBuffer(mOutput[i]);
-        if (mediaBuffer != NULL && mediaBuffer->refcount() > 0) {
-        OMXCodec::BufferInfo *info = findBufferInfo(mediaBuffer);
-        if (info != NULL && info->mStatus != OMXCodec::OWNED_BY_CLIENT)
-            mediaBuffer->release();
-        }
-    }
+    for (uint32_t i = 0; i < mOutputBufferNum; i++)
+        releaseOutput(i);
 
     mInputLoadPoint = 0;
     mOutputLoadPoint = 0;
+    onFlush();
+}
 
-    if (!mRenderList.empty()) {
-        List<MediaBuffer*>::iterator it;
-        for (it = mRenderList.begin(); it != mRenderList.end(); it++) {
-            if (*it == NULL) break;
-            MediaBuffer* renderBuffer = *it;
-            if (renderBuffer->refcount() > 0)
-                renderBuffer->release();
-        }
-        mRenderList.clear();
-    }
+sp<GraphicBuffer> VPPProcessor::getGraphicBuffer(const OMXCodec::BufferInfo &info) {
+    if (info.mMediaBuffer == NULL)
+        return NULL;
+    return info.mMediaBuffer->graphicBuffer();
 }
 
-bool VPPProcessor::hasProcessingBuffer() {
-    bool hasProcBuffer = false;
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        if (mInput[i].mStatus == VPP_BUFFER_PROCESSING)
-            hasProcBuffer = true;
-        if (mInput[i].mStatus != VPP_BUFFER_PROCESSING &&
-            mInput[i].mStatus != VPP_BUFFER_FREE) {
-            MediaBuffer *mediaBuffer = findMediaBuffer(mInput[i]);
-            if (mediaBuffer != NULL && mediaBuffer->refcount() > 0)
-                mediaBuffer->release();
-            mInput[i].resetBuffer(NULL);
-        }
-    }
-    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
-        if ((mOutput[i].mStatus != VPP_BUFFER_PROCESSING) &&
-            (mOutput[i].mStatus != VPP_BUFFER_FREE) && (mOutput[i].mStatus != VPP_BUFFER_END_FLAG)) {
-            MediaBuffer *mediaBuffer = findMediaBuffer(mOutput[i]);
-            if (mediaBuffer != NULL && mediaBuffer->refcount() > 0) {
-                OMXCodec::BufferInfo *info = findBufferInfo(mediaBuffer);
-                if (info != NULL && info->mStatus != OMXCodec::OWNED_BY_CLIENT)
-                    mediaBuffer->release();
-            }
-        }
-    }
-    mInputLoadPoint = 0;
-    mOutputLoadPoint = 0;
-    ALOGI("hasProcBuffer %d", hasProcBuffer);
-    return hasProcBuffer;
+sp<GraphicBuffer> VPPProcessor::dequeueOutputBuffer() {
+    MediaBuffer *buf = dequeueBufferFromNativeWindow();
+    if (buf == NULL)
+        return NULL;
+    return buf->graphicBuffer();
 }
 
-void VPPProcessor::flush() {
-    ALOGV("flush");
-    // flush all input buffers
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        if (mInput[i].mStatus != VPP_BUFFER_FREE) {
-            MediaBuffer *mediaBuffer = findMediaBuffer(mInput[i]);
-            if (mediaBuffer != NULL && mediaBuffer->refcount() > 0)
-                mediaBuffer->release();
-            mInput[i].resetBuffer(NULL);
-        }
+void VPPProcessor::releaseInput(uint32_t index) {
+    MediaBuffer *mediaBuffer = findMediaBuffer(mInput[index]);
+    if (mediaBuffer != NULL && mediaBuffer->refcount() > 0) {
+        ALOGV("releaseInput: mediaBuffer = %p, refcount = %d", mediaBuffer, mediaBuffer->refcount());
+        mediaBuffer->release();
     }
+    mInput[index].resetBuffer(NULL);
+}
 
-    // flush all output buffers
-    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
-        if (mOutput[i].mStatus != VPP_BUFFER_FREE) {
-            MediaBuffer *mediaBuffer = findMediaBuffer(mOutput[i]);
-            if (mediaBuffer != NULL && mediaBuffer->refcount() > 0) {
-                OMXCodec::BufferInfo *info = findBufferInfo(mediaBuffer);
-                if (info != NULL && info->mStatus != OMXCodec::OWNED_BY_CLIENT)
-                    mediaBuffer->release();
-            }
-        }
+void VPPProcessor::releaseOutput(uint32_t index) {
+    // buffer returns to its slot in signalBufferReturned
+    MediaBuffer *mediaBuffer = findMediaBuffer(mOutput[index]);
+    if (mediaBuffer != NULL && mediaBuffer->refcount() > 0) {
+        OMXCodec::BufferInfo *info = findBufferInfo(mediaBuffer);
+        if (info != NULL && info->mStatus != OMXCodec::OWNED_BY_CLIENT)
+            mediaBuffer->release();
     }
+}
 
+void VPPProcessor::onFlush() {
     // flush render list
     if (!mRenderList.empty()) {
         List<MediaBuffer*>::iterator it;
@@ -447,24 +269,6 @@ void VPPProcessor::flush() {
         }
         mRenderList.clear();
     }
-    mInputLoadPoint = 0;
-    mOutputLoadPoint = 0;
-    ALOGV("flush end");
-}
-
-status_t VPPProcessor::clearInput() {
-    // release useless input buffer
-    for (uint32_t i = 0; i < mInputBufferNum; i++) {
-        if (mInput[i].mStatus == VPP_BUFFER_READY) {
-            MediaBuffer *mediaBuffer = findMediaBuffer(mInput[i]);
-            if (mediaBuffer != NULL && mediaBuffer->refcount() > 0) {
-                ALOGV("clearInput: mediaBuffer = %p, refcount = %d",mediaBuffer, mediaBuffer->refcount());
-                mediaBuffer->release();
-            }
-            mInput[i].resetBuffer(NULL);
-        }
-    }
-    return VPP_OK;
 }
 
 status_t VPPProcessor::updateRenderList() {
@@ -593,23 +397,6 @@ MediaBuffer * VPPProcessor::dequeueBufferFromNativeWindow() {
     return info->mMediaBuffer;
 }
 
-status_t VPPProcessor::initBuffers() {
-    MediaBuffer *buf = NULL;
-    uint32_t i;
-    for (i = 0; i < mInputBufferNum; i++) {
-        mInput[i].resetBuffer(NULL);
-    }
-
-    for (i = 0; i < mOutputBufferNum; i++) {
-        buf = dequeueBufferFromNativeWindow();
-        if (buf == NULL)
-            return VPP_FAIL;
-
-        mOutput[i].resetBuffer(buf->graphicBuffer());
-    }
-    return VPP_OK;
-}
-
 void VPPProcessor::signalBufferReturned(MediaBuffer *buff) {
     // Only called by client
     ALOGV("VPPProcessor::signalBufferReturned, buff = %p", buff);
@@ -624,7 +411,7 @@ void VPPProcessor::signalBufferReturned(MediaBuffer *buff) {
     OMXCodec::BufferInfo *info = findBufferInfo(buff);
     if (info == NULL) return;
 
-    if (mThreadRunning) {
+    if (mThreadRunning || mRestarting) {
         if (info->mStatus == OMXCodec::OWNED_BY_CLIENT && rendered) {
             // Buffer has been rendered and returned to NativeWindow
             metaData->setInt32(kKeyRendered, 0);
@@ -674,29 +461,12 @@ void VPPProcessor::signalBufferReturned(MediaBuffer *buff) {
 
 status_t VPPProcessor::validateVideoInfo(VPPVideoInfo * videoInfo, uint32_t slowMotionFactor)
 {
-#ifdef TARGET_HAS_MULTIPLE_DISPLAY
-    if (mMds != NULL && mMds->init() != STATUS_OK)
-        return VPP_FAIL;
-#endif
 #ifdef USE_IVP
     // init VPPWorker
-    if(mWorker->init() != STATUS_OK)
+    if(mWorker == NULL || mWorker->init() != STATUS_OK)
         return VPP_FAIL;
 #endif
-    if (videoInfo == NULL || mWorker == NULL)
-        return VPP_FAIL;
-    if (mWorker->configFilters(videoInfo->width, videoInfo->height, videoInfo->fps, slowMotionFactor, 0) != VPP_OK)
-        return VPP_FAIL;
-    mInputBufferNum = mWorker->mNumForwardReferences + 3;
-    /* reserve one buffer in VPPProcThread, so add one more buffer here */
-    mOutputBufferNum = 1 + (mWorker->mNumForwardReferences + 2) * mWorker->mFrcRate;
-    if (mInputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER 
-            || mOutputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER) {
-        ALOGE("buffer number needed are exceeded limitation");
-        return VPP_FAIL;
-    }
-
-    return VPP_OK;
+    return configVideoInfo(videoInfo, slowMotionFactor);
 }
 
 void VPPProcessor::setEOS()
@@ -704,47 +474,24 @@ void VPPProcessor::setEOS()
     if (mIsEosRead)
         return;
 
-    ALOGI("setEOS");
-    mEOS = true;
-
-    if ((mProcThread != NULL) && mThreadRunning) {
-        mProcThread->mEOS = true;
-    } else {
-        ALOGW("VPP processs thread is not running");
-    }
+    signalEOS();
 }
 
 MediaBuffer * VPPProcessor::findMediaBuffer(VPPBuffer &buff) {
-    if (!mBufferInfos)
+    OMXCodec::BufferInfo *info = findBufferByGraphicBuffer(buff.mGraphicBuffer);
+    if (info == NULL)
         return NULL;
-
-    MediaBuffer* mediaBuffer = NULL;
-    for (uint32_t i = 0; i < mBufferInfos->size(); i++) {
-        mediaBuffer = mBufferInfos->editItemAt(i).mMediaBuffer;
-        if (mediaBuffer->graphicBuffer() == buff.mGraphicBuffer) {
-            return mediaBuffer;
-        }
-    }
-    return NULL;
-}
-
-uint32_t VPPProcessor::getVppOutputFps() {
-    return mWorker->getVppOutputFps();
+    return info->mMediaBuffer;
 }
 
 void VPPProcessor::setDisplayMode(int32_t mode) {
-    if (mWorker != NULL) {
-#ifndef TARGET_VPP_USE_GEN
-        //check if frame rate conversion needed if HDMI connection status changed
-        ALOGV("old/new/connect_Bit mode %d %d %d",
-                 mWorker->getDisplayMode(),  mode, MDS_HDMI_CONNECTED);
-        if ((mWorker->getDisplayMode() != mode) && (mProcThread != NULL)) {
-            mProcThread->notifyCheckFrc();
-            ALOGI("NeedCheckFrc change");
-        }
-#endif
+#ifdef TARGET_VPP_USE_GEN
+    // no FRC re-check on display change for GEN
+    if (mWorker != NULL)
         mWorker->setDisplayMode(mode);
-    }
+#else
+    VPPProcessorCore<OMXCodec::BufferInfo>::setDisplayMode(mode);
+#endif
 }
 
 } /* namespace android */
@@ -17,17 +17,8 @@
 
 #ifndef __VPP_PROCESSOR_H
 #define __VPP_PROCESSOR_H
-#include "VPPProcessorBase.h"
-#include "VPPBuffer.h"
-#include "VPPProcThread.h"
+#include "VPPProcessorCore.h"
 #include "VPPSetting.h"
-#include "VPPMds.h"
-
-#ifdef USE_IVP
-#include "ivp/VPPWorker.h"
-#else
-#include "VPPWorker.h"
-#endif
 #include <stdint.h>
 
 #include <android/native_window.h>
@@ -39,12 +30,8 @@ namespace android {
 struct MediaBuffer;
 struct MediaBufferObserver;
 struct OMXCodec;
-class VPPProcessorBase;
-class VPPProcThread;
-class VPPMDSListener;
-class VPPWorker;
 
-class VPPProcessor : public MediaBufferObserver, VPPProcessorBase {
+class VPPProcessor : public MediaBufferObserver, public VPPProcessorCore<OMXCodec::BufferInfo> {
 public:
     /* Single instance
      * Only create VPPProcessor once and return handle to client that construct it
@@ -71,13 +58,6 @@ public:
      */
     status_t init();
 
-    /*
-     * Set VPPWorker::mSeek flag to true, send run signal to VPPThread to
-     * make sure VPPThread is activated, and then wait for VPPThread's ready
-     * signal to reset all input and output buffers.
-     */
-    void seek();
-
     /*
      * Check whether there is empty input buffer to put decoder buffer in,
      * or RenderList is empty. Input buffer, output buffer and RenderList
@@ -124,46 +104,26 @@ public:
       */
      void setEOS();
 
-     /* return VPP output video frame rate.
-      * 1. If Vpp FRC is on, Output FPS is after converted, which is different from input.
-      *    If VPP FRC is off, output fps is the same as input fps.
-      *
-      * 2. If VPP is off, input is the same as output.
-      * 3. unsupported video size, neithere VPP nor the method are not available for APP.
-      */
-     uint32_t getVppOutputFps();
-
      /* set display information to VPP
       */
-     void setDisplayMode(int32_t mode);
-
-     /* config enable/disable VPP frame rate conversion for HDMI
-      */
-     status_t configFrc4Hdmi(bool enable);
+     virtual void setDisplayMode(int32_t mode);
 
-public:
-    // number of extra input buffer needed by VPP
-    uint32_t mInputBufferNum;
-    // number of output buffer needed by VPP
-    uint32_t mOutputBufferNum;
+protected:
+    // VPPProcessorCore
+    virtual sp<GraphicBuffer> getGraphicBuffer(const OMXCodec::BufferInfo &info);
+    virtual sp<GraphicBuffer> dequeueOutputBuffer();
+    virtual void releaseInput(uint32_t index);
+    virtual void releaseOutput(uint32_t index);
+    // flush renderlist for seek
+    virtual void onFlush();
 
 private:
     // construction
     VPPProcessor(const sp<ANativeWindow> &native, OMXCodec* codec);
-    // init inputBuffer and outBuffer
-    status_t initBuffers();
     // completely release all buffers
     void releaseBuffers();
-    // before seek
-    bool hasProcessingBuffer();
     // reset
     status_t reset();
-    // flush buffers and renderlist for seek
-    void flush();
-    // create threads and run
-    status_t createThread();
-    // stop thread if needed
-    void quitThread();
     // return the BufferInfo accordingly to MediaBuffer
     OMXCodec::BufferInfo *findBufferInfo(MediaBuffer *buff);
     // cancel MediaBuffer to native window
@@ -172,8 +132,6 @@ private:
     MediaBuffer * dequeueBufferFromNativeWindow();
     // get MediaBuffer's time stamp from meta data field
     int64_t getBufferTimestamp(MediaBuffer * buff);
-    // release useless input buffers as well
-    status_t clearInput();
     // add output buffer into Renderlist
     status_t updateRenderList();
     // return MediaBuffer according to VPPBuffer
@@ -181,7 +139,6 @@ private:
 
     int32_t countBuffersWeOwn();
     // debug only
-    void printBuffers();
     void printRenderList();
 
     VPPProcessor(const VPPProcessor &);
@@ -190,30 +147,17 @@ private:
 private:
     // VPPProcessor instance
     static VPPProcessor* mVPPProcessor;
-    // buffer info for VPP input
-    VPPBuffer mInput[VPPBuffer::MAX_VPP_BUFFER_NUMBER];
-    // buffer info for VPP output
-    VPPBuffer mOutput[VPPBuffer::MAX_VPP_BUFFER_NUMBER];
     // mRenderList is used to render
     List<MediaBuffer *> mRenderList;
-    // input load point
-    uint32_t mInputLoadPoint;
-    // output load to RenderList point
-    uint32_t mOutputLoadPoint;
 
-    sp<VPPProcThread> mProcThread;
     friend class VPPProcThread;
-    VPPWorker* mWorker;
 
     sp<ANativeWindow> mNativeWindow;
     OMXCodec* mCodec;
-    // mBufferInfos is all buffer Infos allocated by OMXCodec
-    Vector<OMXCodec::BufferInfo> * mBufferInfos;
-    bool mThreadRunning;
-    bool mEOS;
     bool mIsEosRead;
+    // set while reset() flushes, returned output buffers stay in their slots
+    bool mRestarting;
     uint32_t mTotalDecodedCount, mInputCount, mVPPProcCount, mVPPRenderCount;
-    sp<VPPMDSListener> mMds;
 };
 
 } /* namespace android */
@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __VPP_PROCESSOR_CORE_H
+#define __VPP_PROCESSOR_CORE_H
+
+#include <stdint.h>
+#include <android/native_window.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+
+#include "VPPProcessorBase.h"
+#include "VPPBuffer.h"
+#include "VPPProcThread.h"
+#include "VPPMds.h"
+#ifdef USE_IVP
+#include "ivp/VPPWorker.h"
+#else
+#include "VPPWorker.h"
+#endif
+
+namespace android {
+
+/*
+ * VPPProcessorCore holds what VPPProcessor (AwesomePlayer) and
+ * NuPlayerVPPProcessor (NuPlayer) have in common: the VPPBuffer input
+ * and output rings, VPPProcThread, VPPWorker and MDS listener lifecycle,
+ * and the seek/flush handshake with VPPProcThread.
+ *
+ * CodecBuffer is the decoder's output buffer info type. The player
+ * specific class implements the hooks below to move buffers between
+ * the decoder, the native window and VPP.
+ */
+template <typename CodecBuffer>
+class VPPProcessorCore : public VPPProcessorBase {
+public:
+    VPPProcessorCore(const sp<ANativeWindow> &nativeWindow);
+    virtual ~VPPProcessorCore();
+
+    /* return VPP output video frame rate.
+     */
+    uint32_t getVppOutputFps();
+
+    /* set display information to VPP
+     */
+    virtual void setDisplayMode(int32_t mode);
+
+    /* config enable/disable VPP frame rate conversion for HDMI
+     */
+    status_t configFrc4Hdmi(bool enable);
+
+    /*
+     * Set VPPProcThread seek flag, wake it up, wait until the pipeline
+     * is flushed, and then flush all input and output buffers.
+     */
+    void seek();
+
+public:
+    // number of extra input buffer needed by VPP
+    uint32_t mInputBufferNum;
+    // number of output buffer needed by VPP
+    uint32_t mOutputBufferNum;
+
+protected:
+    // return graphic buffer of one decoder buffer
+    virtual sp<GraphicBuffer> getGraphicBuffer(const CodecBuffer &info) = 0;
+    // dequeue a buffer from native window for VPP output
+    virtual sp<GraphicBuffer> dequeueOutputBuffer() = 0;
+    // return input slot to decoder and free the slot
+    virtual void releaseInput(uint32_t index) = 0;
+    // drop output slot that is not in processing
+    virtual void releaseOutput(uint32_t index) = 0;
+    // flush buffers the player keeps outside of the VPP slots
+    virtual void onFlush() {}
+
+    // config VPPWorker and calculate buffer number needed
+    status_t configVideoInfo(VPPVideoInfo *info, uint32_t slowMotionFactor);
+    // validate decoder buffers and pass their config to VPPWorker
+    status_t setCodecBuffers(Vector<CodecBuffer> *bufferInfos);
+    // init inputBuffer and outBuffer
+    status_t initBuffers();
+    // create threads and run
+    status_t createThread();
+    // stop thread if needed
+    void quitThread();
+    // tell VPPProcThread that input is ended
+    void signalEOS();
+    // bofore flush; release all buffers not in processing
+    bool hasProcessingBuffer();
+    // flush buffers for seek
+    void flush();
+    // release input buffers VPP has finished with
+    void releaseReadyInputs();
+    // delete VPPWorker
+    void destroyWorker();
+    // find decoder buffer by graphic buffer
+    CodecBuffer *findBufferByGraphicBuffer(const sp<GraphicBuffer> &graphicBuffer);
+    // debug only
+    void printBuffers();
+
+protected:
+    // buffer info for VPP input
+    VPPBuffer mInput[VPPBuffer::MAX_VPP_BUFFER_NUMBER];
+    // buffer info for VPP output
+    VPPBuffer mOutput[VPPBuffer::MAX_VPP_BUFFER_NUMBER];
+    // input load point
+    uint32_t mInputLoadPoint;
+    // output load point
+    uint32_t mOutputLoadPoint;
+
+    sp<VPPProcThread> mProcThread;
+    bool mThreadRunning;
+    bool mEOS;
+    VPPWorker *mWorker;
+    // all buffers allocated by decoder
+    Vector<CodecBuffer> *mBufferInfos;
+    sp<VPPMDSListener> mMds;
+
+private:
+    VPPProcessorCore(const VPPProcessorCore &);
+    VPPProcessorCore &operator=(const VPPProcessorCore &);
+};
+
+template <typename CodecBuffer>
+VPPProcessorCore<CodecBuffer>::VPPProcessorCore(const sp<ANativeWindow> &nativeWindow)
+    : mInputBufferNum(0),
+      mOutputBufferNum(0),
+      mInputLoadPoint(0),
+      mOutputLoadPoint(0),
+      mThreadRunning(false),
+      mEOS(false),
+      mWorker(NULL),
+      mBufferInfos(NULL),
+      mMds(NULL) {
+    for (uint32_t i = 0; i < VPPBuffer::MAX_VPP_BUFFER_NUMBER; i++) {
+        mInput[i].resetBuffer(NULL);
+        mInput[i].mFlags = 0;
+        mOutput[i].resetBuffer(NULL);
+        mOutput[i].mFlags = 0;
+    }
+
+#ifdef TARGET_HAS_MULTIPLE_DISPLAY
+    mMds = new VPPMDSListener(this);
+#endif
+    mWorker = VPPWorker::getInstance(nativeWindow);
+#ifdef TARGET_HAS_MULTIPLE_DISPLAY
+    if (mMds != NULL && mWorker != NULL)
+        mMds->setDisplayState(mWorker->getDisplayState());
+#endif
+}
+
+template <typename CodecBuffer>
+VPPProcessorCore<CodecBuffer>::~VPPProcessorCore() {
+    // player class has quit thread and released its buffers by now
+    quitThread();
+    destroyWorker();
+#ifdef TARGET_HAS_MULTIPLE_DISPLAY
+    if (mMds != NULL) {
+        mMds->deInit();
+        mMds = NULL;
+    }
+#endif
+}
+
+template <typename CodecBuffer>
+uint32_t VPPProcessorCore<CodecBuffer>::getVppOutputFps() {
+    return mWorker->getVppOutputFps();
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::setDisplayMode(int32_t mode) {
+    if (mWorker != NULL) {
+        //check if frame rate conversion needed if HDMI connection status changed
+        ALOGV("old/new/connect_Bit mode %d %d %d",
+                 mWorker->getDisplayMode(),  mode, MDS_HDMI_CONNECTED);
+        if ((mWorker->getDisplayMode() != mode) && (mProcThread != NULL)) {
+            mProcThread->notifyCheckFrc();
+            ALOGI("NeedCheckFrc change");
+        }
+        mWorker->setDisplayMode(mode);
+    }
+}
+
+template <typename CodecBuffer>
+status_t VPPProcessorCore<CodecBuffer>::configFrc4Hdmi(bool enableFrc4Hdmi) {
+    status_t status = STATUS_OK;
+    ALOGI("configFrc4Hdmi %d", enableFrc4Hdmi);
+#ifdef TARGET_HAS_MULTIPLE_DISPLAY
+    if (enableFrc4Hdmi) {
+        status_t status = mWorker->configFrc4Hdmi(enableFrc4Hdmi, &mMds);
+        if (status != STATUS_OK) {
+            ALOGE("failed to enable FRC for HDMI");
+            return status;
+        }
+
+        //Recalculate VPP FRC for HDMI
+        bool frcOn = false;
+        FRC_RATE frcRate = FRC_RATE_1X;
+        status = mWorker->calculateFrc(&frcOn, &frcRate);
+        /* Apply new FRC to VPP here.
+         * VPP FRC is configured before VPP thread start
+         */
+        bool newFrcSet = (frcOn != false) || (frcRate != FRC_RATE_1X);
+        if (newFrcSet && !mThreadRunning) {
+            mWorker->mFrcOn = frcOn;
+            mWorker->mFrcRate = frcRate;
+        } else if (mThreadRunning) {
+            ALOGW("Configure VPP FRC for HDMI too late");
+        }
+    }
+#endif
+    return status;
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::seek() {
+    ALOGI("seek");
+    /* invoke thread if it is waiting */
+    if (mThreadRunning) {
+        {
+            Mutex::Autolock procLock(mProcThread->mLock);
+            ALOGV("got proc lock");
+            if (!hasProcessingBuffer()) {
+                ALOGI("seek done");
+                return;
+            }
+            mProcThread->mSeek = true;
+            ALOGV("set proc seek ");
+            mProcThread->mRunCond.signal();
+            ALOGV("wake up proc thread");
+        }
+        Mutex::Autolock endLock(mProcThread->mEndLock);
+        ALOGI("waiting proc thread mEnd lock");
+        mProcThread->mEndCond.wait(mProcThread->mEndLock);
+        ALOGI("wake up from proc thread");
+        flush();
+        ALOGI("seek done");
+    }
+}
+
+template <typename CodecBuffer>
+status_t VPPProcessorCore<CodecBuffer>::configVideoInfo(VPPVideoInfo *videoInfo,
+        uint32_t slowMotionFactor) {
+#ifdef TARGET_HAS_MULTIPLE_DISPLAY
+    if (mMds != NULL && mMds->init() != STATUS_OK)
+        return VPP_FAIL;
+#endif
+    if (videoInfo == NULL || mWorker == NULL)
+        return VPP_FAIL;
+    if (mWorker->configFilters(videoInfo->width, videoInfo->height, videoInfo->fps, slowMotionFactor, 0) != VPP_OK)
+        return VPP_FAIL;
+    mInputBufferNum = mWorker->mNumForwardReferences + 3;
+    /* reserve one buffer in VPPProcThread, so add one more buffer here */
+    mOutputBufferNum = 1 + (mWorker->mNumForwardReferences + 2) * mWorker->mFrcRate;
+    if (mInputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER
+            || mOutputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER) {
+        ALOGE("buffer number needed are exceeded limitation");
+        return VPP_FAIL;
+    }
+    return VPP_OK;
+}
+
+template <typename CodecBuffer>
+status_t VPPProcessorCore<CodecBuffer>::setCodecBuffers(Vector<CodecBuffer> *bufferInfos) {
+    if (bufferInfos == NULL || mWorker == NULL)
+        return VPP_FAIL;
+
+    uint32_t size = bufferInfos->size();
+    ALOGI("mBufferInfo size is %d", size);
+    if (mInputBufferNum == 0 || mOutputBufferNum == 0
+            || size <= mInputBufferNum + mOutputBufferNum
+            || mInputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER
+            || mOutputBufferNum > VPPBuffer::MAX_VPP_BUFFER_NUMBER) {
+        ALOGE("input or output buffer number is invalid");
+        return VPP_FAIL;
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        sp<GraphicBuffer> graphicBuffer = getGraphicBuffer(bufferInfos->itemAt(i));
+        if (graphicBuffer == NULL)
+            return VPP_FAIL;
+        // set graphic buffer config to VPPWorker
+        if (mWorker->setGraphicBufferConfig(graphicBuffer) != STATUS_OK) {
+            ALOGE("set graphic buffer config to VPPWorker failed");
+            return VPP_FAIL;
+        }
+    }
+    mBufferInfos = bufferInfos;
+    return VPP_OK;
+}
+
+template <typename CodecBuffer>
+status_t VPPProcessorCore<CodecBuffer>::initBuffers() {
+    uint32_t i;
+    for (i = 0; i < mInputBufferNum; i++) {
+        mInput[i].resetBuffer(NULL);
+    }
+
+    for (i = 0; i < mOutputBufferNum; i++) {
+        sp<GraphicBuffer> graphicBuffer = dequeueOutputBuffer();
+        if (graphicBuffer == NULL)
+            return VPP_FAIL;
+
+        mOutput[i].resetBuffer(graphicBuffer);
+    }
+    return VPP_OK;
+}
+
+template <typename CodecBuffer>
+status_t VPPProcessorCore<CodecBuffer>::createThread() {
+    // VPPThread starts to run
+    mProcThread = new VPPProcThread(false, mWorker,
+            mInput, mInputBufferNum,
+            mOutput, mOutputBufferNum);
+    if (mProcThread == NULL)
+        return VPP_FAIL;
+    mProcThread->run("VPPProcThread", ANDROID_PRIORITY_NORMAL);
+    mThreadRunning = true;
+    return VPP_OK;
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::quitThread() {
+    if (mThreadRunning) {
+        ALOGI("quitThread");
+        mProcThread->requestExit();
+        {
+            Mutex::Autolock autoLock(mProcThread->mLock);
+            mProcThread->mRunCond.signal();
+        }
+        mProcThread->requestExitAndWait();
+        mProcThread.clear();
+    }
+    mThreadRunning = false;
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::signalEOS() {
+    ALOGI("set eos");
+    mEOS = true;
+    if ((mProcThread != NULL) && mThreadRunning) {
+        mProcThread->mEOS = true;
+    } else {
+        ALOGW("VPP processs thread is not running");
+    }
+}
+
+template <typename CodecBuffer>
+bool VPPProcessorCore<CodecBuffer>::hasProcessingBuffer() {
+    bool hasProcBuffer = false;
+    for (uint32_t i = 0; i < mInputBufferNum; i++) {
+        if (mInput[i].mStatus == VPP_BUFFER_PROCESSING)
+            hasProcBuffer = true;
+        else if (mInput[i].mStatus != VPP_BUFFER_FREE)
+            releaseInput(i);
+    }
+    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
+        if ((mOutput[i].mStatus != VPP_BUFFER_PROCESSING)
+                && (mOutput[i].mStatus != VPP_BUFFER_FREE)
+                && (mOutput[i].mStatus != VPP_BUFFER_END_FLAG))
+            releaseOutput(i);
+    }
+    mInputLoadPoint = 0;
+    mOutputLoadPoint = 0;
+    ALOGI("hasProcBuffer %d", hasProcBuffer);
+    return hasProcBuffer;
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::flush() {
+    ALOGV("flush");
+    // flush all input buffers
+    for (uint32_t i = 0; i < mInputBufferNum; i++) {
+        if (mInput[i].mStatus != VPP_BUFFER_FREE)
+            releaseInput(i);
+    }
+
+    // flush all output buffers
+    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
+        if (mOutput[i].mStatus != VPP_BUFFER_FREE)
+            releaseOutput(i);
+    }
+
+    onFlush();
+    mInputLoadPoint = 0;
+    mOutputLoadPoint = 0;
+    ALOGV("flush end");
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::releaseReadyInputs() {
+    for (uint32_t i = 0; i < mInputBufferNum; i++) {
+        if (mInput[i].mStatus == VPP_BUFFER_READY)
+            releaseInput(i);
+    }
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::destroyWorker() {
+#ifdef TARGET_HAS_MULTIPLE_DISPLAY
+    if (mMds != NULL)
+        mMds->setDisplayState(NULL);
+#endif
+    if (mWorker != NULL) {
+        delete mWorker;
+        mWorker = NULL;
+    }
+}
+
+template <typename CodecBuffer>
+CodecBuffer *VPPProcessorCore<CodecBuffer>::findBufferByGraphicBuffer(
+        const sp<GraphicBuffer> &graphicBuffer) {
+    if (mBufferInfos == NULL || graphicBuffer == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < mBufferInfos->size(); i++) {
+        CodecBuffer *info = &mBufferInfos->editItemAt(i);
+        if (getGraphicBuffer(*info) == graphicBuffer)
+            return info;
+    }
+    return NULL;
+}
+
+template <typename CodecBuffer>
+void VPPProcessorCore<CodecBuffer>::printBuffers() {
+    for (uint32_t i = 0; i < mInputBufferNum; i++) {
+        ALOGV("input %d.   graphicBuffer = %p,  status = %d, time = %lld",
+                i, mInput[i].mGraphicBuffer.get(), mInput[i].mStatus, mInput[i].mTimeUs);
+    }
+    ALOGV("======================================= ");
+    for (uint32_t i = 0; i < mOutputBufferNum; i++) {
+        ALOGV("output %d.   graphicBuffer = %p,  status = %d, time = %lld",
+                i, mOutput[i].mGraphicBuffer.get(), mOutput[i].mStatus, mOutput[i].mTimeUs);
+    }
+}
+
+} /* namespace android */
+
+#endif /* __VPP_PROCESSOR_CORE_H */
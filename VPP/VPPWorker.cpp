@@ -23,6 +23,7 @@
 
 #include "VPPSetting.h"
 #include "VPPWorker.h"
+#include "VPPFrameTap.h"
 #define CHECK_VASTATUS(str) \
     do { \
         if (vaStatus != VA_STATUS_SUCCESS) { \
@@ -50,11 +51,15 @@ enum STRENGTH {
 #define VGA_AREA (640 * 480)
 #define HD1080P_AREA (1920 * 1080)
 
+// Debug only, see VPPFrameTap.h for the properties that enable it
+#define FRAME_OUTPUT_FILE_TAP "/storage/sdcard0/vpp_output.tap"
+
 namespace android {
 
 VPPWorker::VPPWorker(const sp<ANativeWindow> &nativeWindow)
     :mGraphicBufferNum(0),
         mWidth(0), mHeight(0), mInputFps(FRAME_RATE_0),
+        mConfigFps(FRAME_RATE_0), mSlowMotionFactor(1), mConfigFlags(0),
         mVAStarted(false), mVAContext(VA_INVALID_ID),
         mDisplay(NULL), mVADisplay(NULL), mVAConfig(VA_INVALID_ID),
         mNumSurfaces(0), mSurfaces(NULL), mVAExtBuf(NULL),
@@ -62,6 +67,7 @@ VPPWorker::VPPWorker(const sp<ANativeWindow> &nativeWindow)
         mNumFilterBuffers(0),
         mDeblockOn(false), mDenoiseOn(false), mDeinterlacingOn(false),
         mSharpenOn(false), mColorOn(false),
+        mNumSupportedFilters(0), mNumDeinterlacingCaps(0), mNumColorCaps(0),
         mFrcRate(FRC_RATE_1X), mFrcOn(false),
         mUpdatedFrcRate(FRC_RATE_1X), mUpdatedFrcOn(false),
         mInputIndex(0), mOutputIndex(0), mDisplayMode(0),
@@ -69,6 +75,23 @@ VPPWorker::VPPWorker(const sp<ANativeWindow> &nativeWindow)
     memset(&mFilterBuffers, 0, VAProcFilterCount * sizeof(VABufferID));
     memset(&mGraphicBufferConfig, 0, sizeof(GraphicBufferConfig));
     memset(&currHdmiTiming, 0, sizeof(MDSHdmiTiming));
+    memset(mFilterCapsQueried, 0, sizeof(mFilterCapsQueried));
+}
+
+bool VPPFilterPlan::matches(const VPPFilterPlan &other) const {
+    return (width == other.width) && (height == other.height)
+        && (fps == other.fps) && (slowMotionFactor == other.slowMotionFactor)
+        && (flags == other.flags) && (inputFps == other.inputFps)
+        && (deblockOn == other.deblockOn) && (denoiseOn == other.denoiseOn)
+        && (deinterlacingOn == other.deinterlacingOn) && (sharpenOn == other.sharpenOn)
+        && (colorOn == other.colorOn) && (frcOn == other.frcOn)
+        && (frcRate == other.frcRate)
+#ifdef TARGET_VPP_USE_GEN
+        && (denoiseFactor == other.denoiseFactor) && (hue == other.hue)
+        && (saturation == other.saturation) && (brightness == other.brightness)
+        && (contrast == other.contrast)
+#endif
+        ;
 }
 
 //static
@@ -103,12 +126,21 @@ status_t VPPWorker::init() {
             return ret;
     }
 
+    if (mFilterPlans.isEmpty())
+        prepopulateFilterPlans();
+
     if (mNumFilterBuffers == 0) {
         ret = setupFilters();
         if(ret != STATUS_OK)
             return ret;
     }
 
+    if (mFrameTap == NULL) {
+        mFrameTap = VPPFrameTap::createFromProperties("vpp", FRAME_OUTPUT_FILE_TAP);
+        if (mFrameTap != NULL && mFrameTap->start(mWidth, mHeight) != OK)
+            mFrameTap.clear();
+    }
+
     return setupPipelineCaps();
 }
 
@@ -386,20 +418,52 @@ status_t VPPWorker::configFilters(const uint32_t width, const uint32_t height, c
     mWidth = width;
     mHeight = height;
     mInputFps = fps;
-    uint32_t area = mWidth * mHeight;
+    mConfigFps = fps;
+    mSlowMotionFactor = slowMotionFactor;
+    mConfigFlags = flags;
 
     //initialize vpp status here
     isVppOn();
 
     ALOGE("mVPPOn = %d, VPP_COMMON_ON = %d, VPP_FRC_ON = %d", mVPPOn, VPP_COMMON_ON, VPP_FRC_ON);
+
+    VPPFilterPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.width = width;
+    plan.height = height;
+    plan.fps = fps;
+    plan.slowMotionFactor = slowMotionFactor;
+    plan.flags = flags;
+    plan.frcOn = mFrcOn;
+    plan.frcRate = mFrcRate;
+
+    status_t ret = selectFilters(&plan, mVPPOn);
+
+    mInputFps = plan.inputFps;
+    mDeblockOn = plan.deblockOn;
+    mDenoiseOn = plan.denoiseOn;
+    mDeinterlacingOn = plan.deinterlacingOn;
+    mSharpenOn = plan.sharpenOn;
+    mColorOn = plan.colorOn;
+    mFrcOn = plan.frcOn;
+    mFrcRate = plan.frcRate;
+    return ret;
+}
+
+status_t VPPWorker::selectFilters(VPPFilterPlan *plan, uint32_t vppOn) {
+    const uint32_t fps = plan->fps;
+    const uint32_t slowMotionFactor = plan->slowMotionFactor;
+    uint32_t area = plan->width * plan->height;
+    plan->inputFps = fps;
+
 #ifdef TARGET_VPP_USE_GEN
-    if (mVPPOn & VPP_COMMON_ON) {
+    if (vppOn & VPP_COMMON_ON) {
         ALOGV("vpp is on in settings");
         if (area <= VGA_AREA) {
-            mDenoiseOn = true;
+            plan->denoiseOn = true;
         }
-        //mColorOn = true;
-        mDeinterlacingOn = true;
+        //plan->colorOn = true;
+        plan->deinterlacingOn = true;
 
         return STATUS_OK;
     } else {
@@ -408,81 +472,86 @@ status_t VPPWorker::configFilters(const uint32_t width, const uint32_t height, c
     }
 #endif
     // limit resolution that VPP supported for **Merifield/Moorefield**: <QCIF or >1080P
-    if ((mHeight < 144) || (mHeight > 1080) || (area > HD1080P_AREA)) {
-        ALOGW("unspported resolution %d x %d, limit (176x144 - 1920x1080)", mWidth, mHeight);
+    if ((plan->height < 144) || (plan->height > 1080) || (area > HD1080P_AREA)) {
+        ALOGW("unspported resolution %d x %d, limit (176x144 - 1920x1080)", plan->width, plan->height);
         return STATUS_NOT_SUPPORT;
     }
 
-    if (mVPPOn & VPP_COMMON_ON) {
+    if (vppOn & VPP_COMMON_ON) {
         ALOGV("vpp is on in settings");
 
         // QCIF to QVGA
         if (area <= QVGA_AREA) {
-            mDeblockOn = true;
-            mSharpenOn = true;
-            mColorOn = true;
+            plan->deblockOn = true;
+            plan->sharpenOn = true;
+            plan->colorOn = true;
         }
         // QVGA to VGA
         else if (area <= VGA_AREA) {
-            mDenoiseOn = true;
-            mSharpenOn = true;
-            mColorOn = true;
+            plan->denoiseOn = true;
+            plan->sharpenOn = true;
+            plan->colorOn = true;
         }
         // VGA to 1080P
         else if (area <= HD1080P_AREA) {
-            mSharpenOn = true;
+            plan->sharpenOn = true;
         }
     }
 
     if (slowMotionFactor == 2 || slowMotionFactor == 4) {
         // slow motion mode, only do FRC according to slow motion factor
-        mFrcOn = true;
-        mInputFps = fps / slowMotionFactor;
+        plan->frcOn = true;
+        plan->inputFps = fps / slowMotionFactor;
 
         if (fps == FRAME_RATE_24) {
-            mFrcRate = FRC_RATE_2_5X;
+            plan->frcRate = FRC_RATE_2_5X;
         } else if (fps == FRAME_RATE_30 || fps == FRAME_RATE_60) {
-            mFrcRate = FRC_RATE_2X;
+            plan->frcRate = FRC_RATE_2X;
         }
 
-    } else if (mVPPOn & VPP_FRC_ON) {
+    } else if (vppOn & VPP_FRC_ON) {
         ALOGV("FRC is on in Settings");
-        calcFrcByInputFps(&mFrcOn, &mFrcRate);
-        ALOGV("FRC enable %d, FrcRate %d", mFrcOn, mFrcRate);
+        getFrcByInputFps(plan->inputFps, &plan->frcOn, &plan->frcRate);
+        ALOGV("FRC enable %d, FrcRate %d", plan->frcOn, plan->frcRate);
     }
 
     // enable sharpen always while FRC is on
-    if (mFrcOn)
-        mSharpenOn = true;
+    if (plan->frcOn)
+        plan->sharpenOn = true;
 
     ALOGI("width=%d, height=%d, fps=%d, slowmotion=%d, \
             mDeblockOn=%d, mDenoiseOn=%d, mSharpenOn=%d, mColorOn=%d, mFrcOn=%d, mFrcRate=%d",
-          mWidth, mHeight, fps, slowMotionFactor, mDeblockOn, mDenoiseOn, mSharpenOn, mColorOn, mFrcOn, mFrcRate);
+          plan->width, plan->height, fps, slowMotionFactor, plan->deblockOn, plan->denoiseOn,
+          plan->sharpenOn, plan->colorOn, plan->frcOn, plan->frcRate);
 
-    if (!mDeblockOn && !mDenoiseOn && !mSharpenOn && !mColorOn && !mFrcOn) {
+    if (!plan->deblockOn && !plan->denoiseOn && !plan->sharpenOn && !plan->colorOn && !plan->frcOn) {
         ALOGW("all the filters are off, do not do VPP, either FRC");
         return STATUS_NOT_SUPPORT;
     }
     return STATUS_OK;
 }
 
-status_t VPPWorker::calcFrcByInputFps(bool *FrcOn, FRC_RATE *FrcRate) {
-    if (!FrcRate || !FrcOn) {
-        return STATUS_ERROR;
-    }
-
-    if ((mInputFps == FRAME_RATE_15) || (mInputFps == FRAME_RATE_25) || (mInputFps == FRAME_RATE_30)) {
+//static
+void VPPWorker::getFrcByInputFps(uint32_t fps, bool *FrcOn, FRC_RATE *FrcRate) {
+    if ((fps == FRAME_RATE_15) || (fps == FRAME_RATE_25) || (fps == FRAME_RATE_30)) {
         *FrcOn = true;
         *FrcRate = FRC_RATE_2X;
-    } else if (mInputFps == FRAME_RATE_24) {
+    } else if (fps == FRAME_RATE_24) {
         *FrcOn = true;
         *FrcRate = FRC_RATE_2_5X;
     } else {
         *FrcOn = false;
         *FrcRate = FRC_RATE_1X;
-        ALOGI("Unsupported input frame rate %d. VPP FRC is OFF.", mInputFps);
+        ALOGI("Unsupported input frame rate %d. VPP FRC is OFF.", fps);
     }
+}
 
+status_t VPPWorker::calcFrcByInputFps(bool *FrcOn, FRC_RATE *FrcRate) {
+    if (!FrcRate || !FrcOn) {
+        return STATUS_ERROR;
+    }
+
+    getFrcByInputFps(mInputFps, FrcOn, FrcRate);
     return STATUS_OK;
 }
 
@@ -552,220 +621,328 @@ bool VPPWorker::isFpsSupport(int32_t fps, int32_t *fpsSet, int32_t fpsSetCnt) {
 
 status_t VPPWorker::setupFilters() {
     ALOGV("setupFilters");
-    VAProcFilterParameterBuffer deblock, denoise, sharpen;
-    VAProcFilterParameterBufferDeinterlacing deint;
-    VAProcFilterParameterBufferColorBalance color[COLOR_NUM];
-    VAProcFilterParameterBufferFrameRateConversion frc;
-    VABufferID deblockId, denoiseId, deintId, sharpenId, colorId, frcId;
+    const VPPFilterPlan *plan = getFilterPlan();
+    if (plan == NULL)
+        return STATUS_ERROR;
+
+    return applyFilterPlan(*plan);
+}
+
+const VPPFilterPlan *VPPWorker::getFilterPlan() {
+    VPPFilterPlan key;
+    memset(&key, 0, sizeof(key));
+    key.width = mWidth;
+    key.height = mHeight;
+    key.fps = mConfigFps;
+    key.slowMotionFactor = mSlowMotionFactor;
+    key.flags = mConfigFlags;
+    key.inputFps = mInputFps;
+    key.deblockOn = mDeblockOn;
+    key.denoiseOn = mDenoiseOn;
+    key.deinterlacingOn = mDeinterlacingOn;
+    key.sharpenOn = mSharpenOn;
+    key.colorOn = mColorOn;
+    key.frcOn = mFrcOn;
+    key.frcRate = mFrcRate;
+    getTunedFilterValues(&key);
+
+    for (size_t i = 0; i < mFilterPlans.size(); i++) {
+        if (mFilterPlans[i].matches(key)) {
+            ALOGV("filter plan %d is reused", i);
+            return &mFilterPlans[i];
+        }
+    }
+
+    if (buildFilterPlan(&key) != STATUS_OK)
+        return NULL;
+    addFilterPlan(key);
+    return &mFilterPlans[mFilterPlans.size() - 1];
+}
+
+#ifdef TARGET_VPP_USE_GEN
+static float getFilterProperty(const char *name, const char *defaultValue,
+        float minValue, float maxValue) {
+    char propValueString[PROPERTY_VALUE_MAX];
+    property_get(name, propValueString, defaultValue);
+    float value = atof(propValueString);
+    value = (value < minValue) ? minValue : value;
+    value = (value > maxValue) ? maxValue : value;
+    return value;
+}
+#endif
+
+void VPPWorker::getTunedFilterValues(VPPFilterPlan *plan) {
+#ifdef TARGET_VPP_USE_GEN
+    /* placeholder for vpg driver: can't support denoise factor auto adjust
+     * nor auto color balance, so leave config to user. They are read on
+     * every lookup, so a changed property selects (or builds) another plan.
+     */
+    plan->denoiseFactor = getFilterProperty("vpp.filter.denoise.factor", "64.0", 0.0f, 64.0f);
+    plan->hue = getFilterProperty("vpp.filter.procamp.hue", "0.0", -180.0f, 180.0f);
+    plan->saturation = getFilterProperty("vpp.filter.procamp.saturation", "1.0", 0.0f, 10.0f);
+    plan->brightness = getFilterProperty("vpp.filter.procamp.brightness", "0.0", -100.0f, 100.0f);
+    plan->contrast = getFilterProperty("vpp.filter.procamp.contrast", "1.0", 0.0f, 10.0f);
+#endif
+}
+
+void VPPWorker::addFilterPlan(const VPPFilterPlan &plan) {
+    // drop the oldest plan when the cache is full
+    if (mFilterPlans.size() >= VPP_MAX_FILTER_PLANS)
+        mFilterPlans.removeAt(0);
+    mFilterPlans.push_back(plan);
+}
+
+void VPPWorker::prepopulateFilterPlans() {
+    /* compile the session config with FRC as the settings select it and
+     * with FRC off, as HDMI FRC policy can switch between them. Any other
+     * config is compiled when it is first used.
+     */
+    for (int32_t withFrc = 1; withFrc >= 0; withFrc--) {
+        VPPFilterPlan plan;
+        memset(&plan, 0, sizeof(plan));
+        plan.width = mWidth;
+        plan.height = mHeight;
+        plan.fps = mConfigFps;
+        plan.slowMotionFactor = mSlowMotionFactor;
+        plan.flags = mConfigFlags;
+        plan.frcRate = FRC_RATE_1X;
+        getTunedFilterValues(&plan);
+
+        uint32_t vppOn = withFrc ? mVPPOn : (mVPPOn & ~VPP_FRC_ON);
+        if (selectFilters(&plan, vppOn) != STATUS_OK)
+            continue;
+
+        bool cached = false;
+        for (size_t j = 0; j < mFilterPlans.size() && !cached; j++)
+            cached = mFilterPlans[j].matches(plan);
+        if (cached)
+            continue;
+
+        if (buildFilterPlan(&plan) != STATUS_OK) {
+            ALOGW("failed to compile filter plan for %dx%d@%d", plan.width, plan.height, plan.fps);
+            return;
+        }
+        addFilterPlan(plan);
+    }
+    ALOGV("%d filter plans are compiled", mFilterPlans.size());
+}
+
+status_t VPPWorker::queryFilterCaps(VAProcFilterType type) {
+    VAStatus vaStatus;
     uint32_t numCaps;
-    VAProcFilterCap deblockCaps, denoiseCaps, sharpenCaps, frcCaps;
-    VAProcFilterCapDeinterlacing deinterlacingCaps[VAProcDeinterlacingCount];
-    VAProcFilterCapColorBalance colorCaps[COLOR_NUM];
+
+    if (mFilterCapsQueried[type])
+        return STATUS_OK;
+
+    switch (type) {
+        case VAProcFilterDeblocking:
+            numCaps = 1;
+            vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
+                    VAProcFilterDeblocking,
+                    &mDeblockCaps,
+                    &numCaps);
+            CHECK_VASTATUS("vaQueryVideoProcFilterCaps for deblocking");
+            break;
+        case VAProcFilterNoiseReduction:
+            numCaps = 1;
+            vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
+                    VAProcFilterNoiseReduction,
+                    &mDenoiseCaps,
+                    &numCaps);
+            CHECK_VASTATUS("vaQueryVideoProcFilterCaps for denoising");
+            break;
+        case VAProcFilterDeinterlacing:
+            numCaps = VAProcDeinterlacingCount;
+            vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
+                    VAProcFilterDeinterlacing,
+                    &mDeinterlacingCaps[0],
+                    &numCaps);
+            CHECK_VASTATUS("vaQueryVideoProcFilterCaps for deinterlacing");
+            mNumDeinterlacingCaps = numCaps;
+            break;
+        case VAProcFilterSharpening:
+            numCaps = 1;
+            vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
+                    VAProcFilterSharpening,
+                    &mSharpenCaps,
+                    &numCaps);
+            CHECK_VASTATUS("vaQueryVideoProcFilterCaps for sharpening");
+            break;
+        case VAProcFilterColorBalance:
+            // FIXME: it's not used at all!
+            numCaps = COLOR_NUM;
+            vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
+                    VAProcFilterColorBalance,
+                    mColorCaps,
+                    &numCaps);
+            CHECK_VASTATUS("vaQueryVideoProcFilterCaps for color balance");
+            mNumColorCaps = numCaps;
+            break;
+        default:
+            break;
+    }
+
+    mFilterCapsQueried[type] = true;
+    return STATUS_OK;
+}
+
+status_t VPPWorker::buildFilterPlan(VPPFilterPlan *plan) {
     VAStatus vaStatus;
-    uint32_t numSupportedFilters = VAProcFilterCount;
-    VAProcFilterType supportedFilters[VAProcFilterCount];
+    status_t ret;
+    VPPFilterParam *param;
 
     // query supported filters
-    vaStatus = vaQueryVideoProcFilters(mVADisplay, mVAContext, supportedFilters, &numSupportedFilters);
-    CHECK_VASTATUS("vaQueryVideoProcFilters");
-
-    // create filter buffer for each filter
-    for (uint32_t i = 0; i < numSupportedFilters; i++) {
-        switch (supportedFilters[i]) {
+    if (mNumSupportedFilters == 0) {
+        uint32_t numSupportedFilters = VAProcFilterCount;
+        vaStatus = vaQueryVideoProcFilters(mVADisplay, mVAContext, mSupportedFilters, &numSupportedFilters);
+        CHECK_VASTATUS("vaQueryVideoProcFilters");
+        mNumSupportedFilters = numSupportedFilters;
+    }
+
+    // compile parameter for each filter
+    plan->numFilters = 0;
+    for (uint32_t i = 0; i < mNumSupportedFilters && plan->numFilters < VAProcFilterCount; i++) {
+        param = &plan->filters[plan->numFilters];
+        memset(param, 0, sizeof(VPPFilterParam));
+        switch (mSupportedFilters[i]) {
             case VAProcFilterDeblocking:
-                if (mDeblockOn) {
-                    // check filter caps
-                    numCaps = 1;
-                    vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
-                            VAProcFilterDeblocking,
-                            &deblockCaps,
-                            &numCaps);
-                    CHECK_VASTATUS("vaQueryVideoProcFilterCaps for deblocking");
-                    // create parameter buffer
-                    deblock.type = VAProcFilterDeblocking;
-                    deblock.value = deblockCaps.range.min_value + DENOISE_DEBLOCK_STRENGTH * deblockCaps.range.step;
-                    vaStatus = vaCreateBuffer(mVADisplay, mVAContext,
-                        VAProcFilterParameterBufferType, sizeof(deblock), 1,
-                        &deblock, &deblockId);
-                    CHECK_VASTATUS("vaCreateBuffer for deblocking");
-                    mFilterBuffers[mNumFilterBuffers] = deblockId;
-                    mNumFilterBuffers++;
+                if (plan->deblockOn) {
+                    ret = queryFilterCaps(VAProcFilterDeblocking);
+                    if (ret != STATUS_OK)
+                        return ret;
+                    param->type = VAProcFilterDeblocking;
+                    param->size = sizeof(VAProcFilterParameterBuffer);
+                    param->count = 1;
+                    param->data.base.type = VAProcFilterDeblocking;
+                    param->data.base.value = mDeblockCaps.range.min_value + DENOISE_DEBLOCK_STRENGTH * mDeblockCaps.range.step;
+                    plan->numFilters++;
                 }
                 break;
             case VAProcFilterNoiseReduction:
-                if(mDenoiseOn) {
-                    // check filter caps
-                    numCaps = 1;
-                    vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
-                            VAProcFilterNoiseReduction,
-                            &denoiseCaps,
-                            &numCaps);
-                    CHECK_VASTATUS("vaQueryVideoProcFilterCaps for denoising");
-                    // create parameter buffer
-                    denoise.type = VAProcFilterNoiseReduction;
+                if(plan->denoiseOn) {
+                    ret = queryFilterCaps(VAProcFilterNoiseReduction);
+                    if (ret != STATUS_OK)
+                        return ret;
+                    param->type = VAProcFilterNoiseReduction;
+                    param->size = sizeof(VAProcFilterParameterBuffer);
+                    param->count = 1;
+                    param->data.base.type = VAProcFilterNoiseReduction;
 #ifdef TARGET_VPP_USE_GEN
-                    char propValueString[PROPERTY_VALUE_MAX];
-
-                    // placeholder for vpg driver: can't support denoise factor auto adjust, so leave config to user.
-                    property_get("vpp.filter.denoise.factor", propValueString, "64.0");
-                    denoise.value = atof(propValueString);
-                    denoise.value = (denoise.value < 0.0f) ? 0.0f : denoise.value;
-                    denoise.value = (denoise.value > 64.0f) ? 64.0f : denoise.value;
+                    param->data.base.value = plan->denoiseFactor;
 #else
-                    denoise.value = denoiseCaps.range.min_value + DENOISE_DEBLOCK_STRENGTH * denoiseCaps.range.step;
+                    param->data.base.value = mDenoiseCaps.range.min_value + DENOISE_DEBLOCK_STRENGTH * mDenoiseCaps.range.step;
 #endif
-                    vaStatus = vaCreateBuffer(mVADisplay, mVAContext,
-                        VAProcFilterParameterBufferType, sizeof(denoise), 1,
-                        &denoise, &denoiseId);
-                    CHECK_VASTATUS("vaCreateBuffer for denoising");
-                    mFilterBuffers[mNumFilterBuffers] = denoiseId;
-                    mNumFilterBuffers++;
+                    plan->numFilters++;
                 }
                 break;
             case VAProcFilterDeinterlacing:
-                if (mDeinterlacingOn) {
-                    numCaps = VAProcDeinterlacingCount;
-                    vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
-                            VAProcFilterDeinterlacing,
-                            &deinterlacingCaps[0],
-                            &numCaps);
-                    CHECK_VASTATUS("vaQueryVideoProcFilterCaps for deinterlacing");
-                    for (int i = 0; i < numCaps; i++)
+                if (plan->deinterlacingOn) {
+                    ret = queryFilterCaps(VAProcFilterDeinterlacing);
+                    if (ret != STATUS_OK)
+                        return ret;
+                    for (uint32_t j = 0; j < mNumDeinterlacingCaps && plan->numFilters < VAProcFilterCount; j++)
                     {
-                        VAProcFilterCapDeinterlacing * const cap = &deinterlacingCaps[i];
+                        VAProcFilterCapDeinterlacing * const cap = &mDeinterlacingCaps[j];
                         if (cap->type != VAProcDeinterlacingBob) // desired Deinterlacing Type
                             continue;
 
-                        deint.type = VAProcFilterDeinterlacing;
-                        deint.algorithm = VAProcDeinterlacingBob;
-                        vaStatus = vaCreateBuffer(mVADisplay,
-                                mVAContext,
-                                VAProcFilterParameterBufferType,
-                                sizeof(deint), 1,
-                                &deint, &deintId);
-                        CHECK_VASTATUS("vaCreateBuffer for deinterlacing");
-                        mFilterBuffers[mNumFilterBuffers] = deintId;
-                        mNumFilterBuffers++;
+                        param = &plan->filters[plan->numFilters];
+                        memset(param, 0, sizeof(VPPFilterParam));
+                        param->type = VAProcFilterDeinterlacing;
+                        param->size = sizeof(VAProcFilterParameterBufferDeinterlacing);
+                        param->count = 1;
+                        param->data.deint.type = VAProcFilterDeinterlacing;
+                        param->data.deint.algorithm = VAProcDeinterlacingBob;
+                        plan->numFilters++;
                     }
                 }
                 break;
             case VAProcFilterSharpening:
-                if(mSharpenOn) {
-                    // check filter caps
-                    numCaps = 1;
-                    vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
-                            VAProcFilterSharpening,
-                            &sharpenCaps,
-                            &numCaps);
-                    CHECK_VASTATUS("vaQueryVideoProcFilterCaps for sharpening");
-                    // create parameter buffer
-                    sharpen.type = VAProcFilterSharpening;
-                    sharpen.value = sharpenCaps.range.default_value;
-                    vaStatus = vaCreateBuffer(mVADisplay, mVAContext,
-                        VAProcFilterParameterBufferType, sizeof(sharpen), 1,
-                        &sharpen, &sharpenId);
-                    CHECK_VASTATUS("vaCreateBuffer for sharpening");
-                    mFilterBuffers[mNumFilterBuffers] = sharpenId;
-                    mNumFilterBuffers++;
+                if(plan->sharpenOn) {
+                    ret = queryFilterCaps(VAProcFilterSharpening);
+                    if (ret != STATUS_OK)
+                        return ret;
+                    param->type = VAProcFilterSharpening;
+                    param->size = sizeof(VAProcFilterParameterBuffer);
+                    param->count = 1;
+                    param->data.base.type = VAProcFilterSharpening;
+                    param->data.base.value = mSharpenCaps.range.default_value;
+                    plan->numFilters++;
                 }
                 break;
             case VAProcFilterColorBalance:
-                if(mColorOn) {
+                if(plan->colorOn) {
+                    VAProcFilterParameterBufferColorBalance *color = param->data.color;
                     uint32_t featureCount = 0;
-                    // check filter caps
-                    // FIXME: it's not used at all!
-                    numCaps = COLOR_NUM;
-                    vaStatus = vaQueryVideoProcFilterCaps(mVADisplay, mVAContext,
-                            VAProcFilterColorBalance,
-                            colorCaps,
-                            &numCaps);
-                    CHECK_VASTATUS("vaQueryVideoProcFilterCaps for color balance");
-                    // create parameter buffer
-                    for (uint32_t i = 0; i < numCaps; i++) {
-                        if (colorCaps[i].type == VAProcColorBalanceAutoSaturation) {
-                            color[i].type = VAProcFilterColorBalance;
-                            color[i].attrib = VAProcColorBalanceAutoSaturation;
-                            color[i].value = colorCaps[i].range.min_value + COLOR_STRENGTH * colorCaps[i].range.step;
+                    ret = queryFilterCaps(VAProcFilterColorBalance);
+                    if (ret != STATUS_OK)
+                        return ret;
+                    for (uint32_t j = 0; j < mNumColorCaps; j++) {
+                        if (mColorCaps[j].type == VAProcColorBalanceAutoSaturation) {
+                            color[j].type = VAProcFilterColorBalance;
+                            color[j].attrib = VAProcColorBalanceAutoSaturation;
+                            color[j].value = mColorCaps[j].range.min_value + COLOR_STRENGTH * mColorCaps[j].range.step;
                             featureCount++;
                         }
-                        else if (colorCaps[i].type == VAProcColorBalanceAutoBrightness) {
-                            color[i].type = VAProcFilterColorBalance;
-                            color[i].attrib = VAProcColorBalanceAutoBrightness;
-                            color[i].value = colorCaps[i].range.min_value + COLOR_STRENGTH * colorCaps[i].range.step;
+                        else if (mColorCaps[j].type == VAProcColorBalanceAutoBrightness) {
+                            color[j].type = VAProcFilterColorBalance;
+                            color[j].attrib = VAProcColorBalanceAutoBrightness;
+                            color[j].value = mColorCaps[j].range.min_value + COLOR_STRENGTH * mColorCaps[j].range.step;
                             featureCount++;
                         }
                     }
 #ifdef TARGET_VPP_USE_GEN
                     //TODO: VPG need to support check input value by colorCaps.
                     enum {kHue = 0, kSaturation, kBrightness, kContrast};
-                    char propValueString[PROPERTY_VALUE_MAX];
                     color[kHue].type = VAProcFilterColorBalance;
                     color[kHue].attrib = VAProcColorBalanceHue;
-
-                    // placeholder for vpg driver: can't support auto color balance, so leave config to user.
-                    property_get("vpp.filter.procamp.hue", propValueString, "0.0");
-                    color[kHue].value = atof(propValueString);
-                    color[kHue].value = (color[kHue].value < -180.0f) ? -180.0f : color[kHue].value;
-                    color[kHue].value = (color[kHue].value > 180.0f) ? 180.0f : color[kHue].value;
+                    color[kHue].value = plan->hue;
                     featureCount++;
 
                     color[kSaturation].type   = VAProcFilterColorBalance;
                     color[kSaturation].attrib = VAProcColorBalanceSaturation;
-                    property_get("vpp.filter.procamp.saturation", propValueString, "1.0");
-                    color[kSaturation].value = atof(propValueString);
-                    color[kSaturation].value = (color[kSaturation].value < 0.0f) ? 0.0f : color[kSaturation].value;
-                    color[kSaturation].value = (color[kSaturation].value > 10.0f) ? 10.0f : color[kSaturation].value;
+                    color[kSaturation].value = plan->saturation;
                     featureCount++;
 
                     color[kBrightness].type   = VAProcFilterColorBalance;
                     color[kBrightness].attrib = VAProcColorBalanceBrightness;
-                    property_get("vpp.filter.procamp.brightness", propValueString, "0.0");
-                    color[kBrightness].value = atof(propValueString);
-                    color[kBrightness].value = (color[kBrightness].value < -100.0f) ? -100.0f : color[kBrightness].value;
-                    color[kBrightness].value = (color[kBrightness].value > 100.0f) ? 100.0f : color[kBrightness].value;
+                    color[kBrightness].value = plan->brightness;
                     featureCount++;
 
                     color[kContrast].type   = VAProcFilterColorBalance;
                     color[kContrast].attrib = VAProcColorBalanceContrast;
-                    property_get("vpp.filter.procamp.contrast", propValueString, "1.0");
-                    color[kContrast].value = atof(propValueString);
-                    color[kContrast].value = (color[kContrast].value < 0.0f) ? 0.0f : color[kContrast].value;
-                    color[kContrast].value = (color[kContrast].value > 10.0f) ? 10.0f : color[kContrast].value;
+                    color[kContrast].value = plan->contrast;
                     featureCount++;
 #endif
-                    vaStatus = vaCreateBuffer(mVADisplay, mVAContext,
-                        VAProcFilterParameterBufferType, sizeof(*color), featureCount,
-                        color, &colorId);
-                    CHECK_VASTATUS("vaCreateBuffer for color balance");
-                    mFilterBuffers[mNumFilterBuffers] = colorId;
-                    mNumFilterBuffers++;
+                    param->type = VAProcFilterColorBalance;
+                    param->size = sizeof(VAProcFilterParameterBufferColorBalance);
+                    param->count = featureCount;
+                    plan->numFilters++;
                 }
                 break;
             case VAProcFilterFrameRateConversion:
-                if(mFrcOn) {
-                    frc.type = VAProcFilterFrameRateConversion;
-                    frc.input_fps = mInputFps;
-                    switch (mFrcRate){
+                if(plan->frcOn) {
+                    VAProcFilterParameterBufferFrameRateConversion *frc = &param->data.frc;
+                    frc->type = VAProcFilterFrameRateConversion;
+                    frc->input_fps = plan->inputFps;
+                    switch (plan->frcRate){
                         case FRC_RATE_1X:
-                            frc.output_fps = frc.input_fps;
+                            frc->output_fps = frc->input_fps;
                             break;
                         case FRC_RATE_2X:
-                            frc.output_fps = frc.input_fps * 2;
+                            frc->output_fps = frc->input_fps * 2;
                             break;
                         case FRC_RATE_2_5X:
-                            frc.output_fps = frc.input_fps * 5/2;
+                            frc->output_fps = frc->input_fps * 5/2;
                             break;
                         case FRC_RATE_4X:
-                            frc.output_fps = frc.input_fps * 4;
+                            frc->output_fps = frc->input_fps * 4;
                             break;
                     }
-                    vaStatus = vaCreateBuffer(mVADisplay, mVAContext,
-                        VAProcFilterParameterBufferType, sizeof(frc), 1,
-                        &frc, &frcId);
-                    CHECK_VASTATUS("vaCreateBuffer for frc");
-                    mFilterBuffers[mNumFilterBuffers] = frcId;
-                    mNumFilterBuffers++;
-                    mFilterFrc = frcId;
+                    param->type = VAProcFilterFrameRateConversion;
+                    param->size = sizeof(VAProcFilterParameterBufferFrameRateConversion);
+                    param->count = 1;
+                    plan->numFilters++;
                 }
                 break;
             default:
@@ -776,6 +953,26 @@ status_t VPPWorker::setupFilters() {
     return STATUS_OK;
 }
 
+status_t VPPWorker::applyFilterPlan(const VPPFilterPlan &plan) {
+    VAStatus vaStatus;
+    VABufferID filterId;
+
+    // filter buffers belong to current context, so they are always created here
+    mNumFilterBuffers = 0;
+    for (uint32_t i = 0; i < plan.numFilters; i++) {
+        const VPPFilterParam *param = &plan.filters[i];
+        vaStatus = vaCreateBuffer(mVADisplay, mVAContext,
+            VAProcFilterParameterBufferType, param->size, param->count,
+            (void *)&param->data, &filterId);
+        CHECK_VASTATUS("vaCreateBuffer for filter");
+        mFilterBuffers[mNumFilterBuffers] = filterId;
+        mNumFilterBuffers++;
+        if (param->type == VAProcFilterFrameRateConversion)
+            mFilterFrc = filterId;
+    }
+    return STATUS_OK;
+}
+
 status_t VPPWorker::setupPipelineCaps() {
     ALOGV("setupPipelineCaps");
     //TODO color standards
@@ -984,7 +1181,8 @@ status_t VPPWorker::fill(Vector< sp<GraphicBuffer> > outputGraphicBuffer, uint32
         vaStatus = vaSyncSurface(mVADisplay, output[i]);
         CHECK_VASTATUS("vaSyncSurface");
         vaStatus = STATUS_OK;
-        //dumpYUVFrameData(output[i]);
+        if (mFrameTap != NULL)
+            dumpYUVFrameData(output[i]);
     }
 
     if (vaStatus == STATUS_OK)
@@ -995,6 +1193,11 @@ status_t VPPWorker::fill(Vector< sp<GraphicBuffer> > outputGraphicBuffer, uint32
 }
 
 VPPWorker::~VPPWorker() {
+    if (mFrameTap != NULL) {
+        mFrameTap->stop();
+        mFrameTap.clear();
+    }
+
     if (mForwardReferences != NULL) {
         free(mForwardReferences);
         mForwardReferences = NULL;
@@ -1013,12 +1216,15 @@ VPPWorker::~VPPWorker() {
 }
 
 // Debug only
-#define FRAME_OUTPUT_FILE_NV12 "/storage/sdcard0/vpp_output.nv12"
 status_t VPPWorker::dumpYUVFrameData(VASurfaceID surfaceID) {
     status_t ret;
     if (surfaceID == VA_INVALID_SURFACE)
         return STATUS_ERROR;
 
+    // skip mapping the surface for frames that are not sampled
+    if (!mFrameTap->shouldTap())
+        return STATUS_OK;
+
     VAStatus vaStatus;
     VAImage image;
     unsigned char *data_ptr;
@@ -1031,11 +1237,11 @@ status_t VPPWorker::dumpYUVFrameData(VASurfaceID surfaceID) {
     vaStatus = vaMapBuffer(mVADisplay, image.buf, (void **)&data_ptr);
     CHECK_VASTATUS("vaMapBuffer");
 
-    ret = writeNV12(mWidth, mHeight, data_ptr, image.pitches[0], image.pitches[1]);
-    if (ret != STATUS_OK) {
-        AALOGV("writeNV12 error");
-        return STATUS_ERROR;
-    }
+    ret = mFrameTap->tapNV12(mWidth, mHeight,
+            data_ptr + image.offsets[0], image.pitches[0],
+            data_ptr + image.offsets[1], image.pitches[1]);
+    if (ret != OK)
+        ALOGV("frame %d is not tapped: %d", mOutputIndex, ret);
 
     vaStatus = vaUnmapBuffer(mVADisplay, image.buf);
     CHECK_VASTATUS("vaUnMapBuffer");
@@ -1101,15 +1307,28 @@ status_t VPPWorker::getHdmiData() {
         ALOGW("HDMI is NOT connected. Cannot get HDMI data");
         return STATUS_ERROR;
     }
-    if ((mMds == NULL) || (hdmiTimingList == NULL)) {
+    if (hdmiTimingList == NULL) {
         ALOGW("Error. Input parameter is invalid.");
         return STATUS_ERROR;
     }
-    status_t ret = (*mMds)->getHdmiMetaData(&currHdmiTiming, hdmiTimingList,&hdmiListCount);
+
+    VPPDisplayInfo info;
+    if (!mDisplayState.read(&info) || !(info.mode & MDS_HDMI_CONNECTED) || info.timingCount <= 0) {
+        ALOGW("HDMI data is not cached yet");
+        return STATUS_ERROR;
+    }
+
+    currHdmiTiming = info.currTiming;
+    hdmiListCount = info.timingCount;
+    memcpy(hdmiTimingList, info.timingList, hdmiListCount * sizeof(MDSHdmiTiming));
     ALOGI("HDMI setting: %d x %d @ %d, count %d", currHdmiTiming.width, currHdmiTiming.height,
               currHdmiTiming.refresh, hdmiListCount);
 
-    return ret;
+    return STATUS_OK;
+}
+
+VPPDisplayState* VPPWorker::getDisplayState() {
+    return &mDisplayState;
 }
 
 //set display mode
@@ -1164,49 +1383,6 @@ status_t VPPWorker::calculateFrc(bool *pFrcOn, FRC_RATE *pFrcRate) {
     return status;
 }
 
-status_t VPPWorker::writeNV12(int width, int height, unsigned char *out_buf, int y_pitch, int uv_pitch) {
-    size_t result;
-    int frame_size;
-    unsigned char *y_start, *uv_start;
-    int h;
-
-    FILE *ofile = fopen(FRAME_OUTPUT_FILE_NV12, "ab");
-    if(ofile == NULL) {
-        ALOGE("Open %s failed!", FRAME_OUTPUT_FILE_NV12);
-        return STATUS_ERROR;
-    }
-
-    if (out_buf == NULL)
-    {
-        fclose(ofile);
-        return STATUS_ERROR;
-    }
-    if ((width % 2) || (height % 2))
-    {
-        fclose(ofile);
-        return STATUS_ERROR;
-    }
-    // Set frame size
-    frame_size = height * width * 3/2;
-
-    /* write y */
-    y_start = out_buf;
-    for (h = 0; h < height; ++h) {
-        result = fwrite(y_start, sizeof(unsigned char), width, ofile);
-        y_start += y_pitch;
-    }
-
-    /* write uv */
-    uv_start = out_buf + uv_pitch * height;
-    for (h = 0; h < height / 2; ++h) {
-        result = fwrite(uv_start, sizeof(unsigned char), width, ofile);
-        uv_start += uv_pitch;
-    }
-    // Close file
-    fclose(ofile);
-    return STATUS_OK;
-}
-
 uint32_t VPPWorker::isVppOn() {
     ALOGE("VPPWorkder::isVppOn");
     sp<IServiceManager> sm = defaultServiceManager();
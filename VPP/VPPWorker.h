@@ -27,11 +27,12 @@
 #include "va/va_android.h"
 #define Display unsigned int
 #include <stdint.h>
+#include <utils/Vector.h>
 #include "VPPMds.h"
+#include "VPPDisplayState.h"
+#include "VPPFrameTap.h"
 
 #include <android/native_window.h>
-//HDMI max timing is defined drm_hdmi.h
-#define HDMI_TIMING_MAX (128)
 
 #ifdef TARGET_HAS_MULTIPLE_DISPLAY
 using namespace android::intel;
@@ -65,6 +66,57 @@ enum VPPWorkerStatus {
     STATUS_DATA_RENDERING
 };
 
+// max number of compiled filter chains kept by VPPWorker
+#define VPP_MAX_FILTER_PLANS 16
+
+// parameter of one filter in a compiled filter chain
+struct VPPFilterParam {
+    VAProcFilterType type;
+    uint32_t size;      // size of one parameter element
+    uint32_t count;     // number of parameter elements
+    union {
+        VAProcFilterParameterBuffer base;
+        VAProcFilterParameterBufferDeinterlacing deint;
+        VAProcFilterParameterBufferColorBalance color[VAProcColorBalanceCount];
+        VAProcFilterParameterBufferFrameRateConversion frc;
+    } data;
+};
+
+/* A compiled filter chain. The key fields fully determine the filter
+ * parameters, so a plan can be reused whenever the same configuration
+ * is seen again (seek, FRC change, HDMI mode change).
+ */
+struct VPPFilterPlan {
+    // key
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    uint32_t slowMotionFactor;
+    uint32_t flags;
+    uint32_t inputFps;
+    bool deblockOn;
+    bool denoiseOn;
+    bool deinterlacingOn;
+    bool sharpenOn;
+    bool colorOn;
+    bool frcOn;
+    FRC_RATE frcRate;
+#ifdef TARGET_VPP_USE_GEN
+    // user tuned values from vpp.filter.* properties, clamped to range
+    float denoiseFactor;
+    float hue;
+    float saturation;
+    float brightness;
+    float contrast;
+#endif
+
+    // compiled filter parameters, in the order they are sent to driver
+    uint32_t numFilters;
+    VPPFilterParam filters[VAProcFilterCount];
+
+    bool matches(const VPPFilterPlan &other) const;
+};
+
 struct GraphicBufferConfig {
     uint32_t colorFormat;
     uint32_t stride;
@@ -121,6 +173,9 @@ class VPPWorker {
         uint32_t getVppOutputFps();
         status_t calculateFrc(bool *frcOn, FRC_RATE *rate);
 
+        // display state cache, refreshed by MDS listener callbacks
+        VPPDisplayState* getDisplayState();
+
         ~VPPWorker();
 
     private:
@@ -137,6 +192,28 @@ class VPPWorker {
         // Check filter caps and create filter buffers
         status_t setupFilters();
 
+        // select filters and FRC for the video config given in plan key
+        status_t selectFilters(VPPFilterPlan *plan, uint32_t vppOn);
+
+        // query filter caps of one filter type, cached across reset
+        status_t queryFilterCaps(VAProcFilterType type);
+
+        // compile filter parameters for the filters enabled in plan
+        status_t buildFilterPlan(VPPFilterPlan *plan);
+
+        // create filter buffers from a compiled plan
+        status_t applyFilterPlan(const VPPFilterPlan &plan);
+
+        // fill in the key fields set by properties rather than by config
+        void getTunedFilterValues(VPPFilterPlan *plan);
+
+        // find a compiled plan for current config, build it if not cached
+        const VPPFilterPlan *getFilterPlan();
+
+        // compile plans for the session config so FRC switches are lookups
+        void prepopulateFilterPlans();
+        void addFilterPlan(const VPPFilterPlan &plan);
+
         // Setup pipeline caps
         status_t setupPipelineCaps();
 
@@ -148,6 +225,7 @@ class VPPWorker {
          * input are limited to 24, 25, 30, and 60
          */
         status_t calcFrcByInputFps(bool *FrcOn, FRC_RATE *FrcRat);
+        static void getFrcByInputFps(uint32_t fps, bool *FrcOn, FRC_RATE *FrcRate);
 
         /* calcualte VPP FRC rate according to hdmi capability
          * Here set VPP output target fps to match HDMI supported.
@@ -157,6 +235,7 @@ class VPPWorker {
         status_t calcFrcByMatchHdmiCap(bool *FrcOn, FRC_RATE *FrcRate);
 
         /* read HDMI device capability and current HDMI setting
+         * from display state cache, it never blocks on MDS
          */
         status_t getHdmiData();
 
@@ -167,9 +246,8 @@ class VPPWorker {
         bool isFpsSupport(int32_t fps, int32_t *fpsSet, int32_t fpsSetCnt);
 
         // Debug only
-        // Dump YUV frame
+        // Dump YUV frame to frame tap
         status_t dumpYUVFrameData(VASurfaceID surfaceID);
-        status_t writeNV12(int width, int height, unsigned char *out_buf, int y_pitch, int uv_pitch);
 
         VPPWorker(const VPPWorker &);
         VPPWorker &operator=(const VPPWorker &);
@@ -195,6 +273,9 @@ class VPPWorker {
         uint32_t mWidth;
         uint32_t mHeight;
         uint32_t mInputFps;
+        uint32_t mConfigFps;
+        uint32_t mSlowMotionFactor;
+        uint32_t mConfigFlags;
 
         // VA common variables
         bool mVAStarted;
@@ -222,6 +303,21 @@ class VPPWorker {
         bool mColorOn;
         VABufferID mFilterFrc;
 
+        // filter caps, queried once per filter type
+        bool mFilterCapsQueried[VAProcFilterCount];
+        uint32_t mNumSupportedFilters;
+        VAProcFilterType mSupportedFilters[VAProcFilterCount];
+        VAProcFilterCap mDeblockCaps;
+        VAProcFilterCap mDenoiseCaps;
+        VAProcFilterCap mSharpenCaps;
+        uint32_t mNumDeinterlacingCaps;
+        VAProcFilterCapDeinterlacing mDeinterlacingCaps[VAProcDeinterlacingCount];
+        uint32_t mNumColorCaps;
+        VAProcFilterCapColorBalance mColorCaps[VAProcColorBalanceCount];
+
+        // compiled filter chains, the most recently added is at the end
+        Vector<VPPFilterPlan> mFilterPlans;
+
         // status
         uint32_t mInputIndex;
         uint32_t mOutputIndex;
@@ -235,6 +331,10 @@ class VPPWorker {
         int32_t hdmiListCount;
 
         uint32_t mVPPOn;
+        VPPDisplayState mDisplayState;
+
+        // debug only, NULL unless enabled by vpp.frametap.* properties
+        sp<VPPFrameTap> mFrameTap;
 
         // FIXME: not very sure how to check color standard
         VAProcColorStandardType in_color_standards[VAProcColorStandardCount];
@@ -0,0 +1,68 @@
+LOCAL_PATH := $(call my-dir)
+
+#### VPP host unit tests ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        VPPDisplayStateTest.cpp \
+        VPPFrameTapTest.cpp \
+        ../VPPDisplayState.cpp \
+        ../VPPFrameTap.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+
+LOCAL_MODULE := vpp_unit_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+ifeq ($(TARGET_HAS_VPP),true)
+#### VPP device unit tests ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        VPPProcessorCoreTest.cpp
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/.. \
+        $(call include-path-for, frameworks-av) \
+        $(call include-path-for, frameworks-native) \
+        $(call include-path-for, frameworks-native)/media/openmax \
+        $(TARGET_OUT_HEADERS)/libva
+
+LOCAL_STATIC_LIBRARIES := libvpp
+
+LOCAL_SHARED_LIBRARIES := \
+        libva \
+        libva-android \
+        libui \
+        libbinder \
+        libstagefright_foundation \
+        libutils \
+        libcutils \
+        liblog
+
+ifeq ($(TARGET_HAS_MULTIPLE_DISPLAY),true)
+LOCAL_CFLAGS += -DTARGET_HAS_MULTIPLE_DISPLAY
+ifeq ($(USE_MDS_LEGACY),true)
+LOCAL_CFLAGS += -DUSE_MDS_LEGACY
+endif
+LOCAL_SHARED_LIBRARIES += libmultidisplay
+else
+LOCAL_SHARED_LIBRARIES += libvpp_setting
+endif
+
+LOCAL_CFLAGS += -DTARGET_HAS_VPP -Wno-non-virtual-dtor
+ifeq ($(TARGET_VPP_USE_GEN),true)
+	LOCAL_CFLAGS += -DTARGET_VPP_USE_GEN
+endif
+
+LOCAL_MODULE := vpp_core_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+endif
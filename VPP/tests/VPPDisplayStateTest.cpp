@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "VPPDisplayState.h"
+
+using namespace android;
+
+static MDSHdmiTiming makeTiming(int width, int height, int refresh) {
+    MDSHdmiTiming timing;
+    memset(&timing, 0, sizeof(timing));
+    timing.width = width;
+    timing.height = height;
+    timing.refresh = refresh;
+    return timing;
+}
+
+TEST(VPPDisplayStateTest, NothingPublished) {
+    VPPDisplayState state;
+    VPPDisplayInfo info;
+
+    EXPECT_FALSE(state.isValid());
+    EXPECT_FALSE(state.read(&info));
+    EXPECT_FALSE(state.read(NULL));
+    EXPECT_EQ(0, state.getDisplayMode());
+}
+
+TEST(VPPDisplayStateTest, PublishThenRead) {
+    VPPDisplayState state;
+    VPPDisplayInfo info;
+    memset(&info, 0, sizeof(info));
+    info.mode = MDS_HDMI_CONNECTED;
+    info.currTiming = makeTiming(1920, 1080, 60);
+    info.timingCount = 2;
+    info.timingList[0] = makeTiming(1920, 1080, 60);
+    info.timingList[1] = makeTiming(1920, 1080, 24);
+    state.publish(info);
+
+    VPPDisplayInfo out;
+    ASSERT_TRUE(state.read(&out));
+    EXPECT_TRUE(state.isValid());
+    EXPECT_EQ(MDS_HDMI_CONNECTED, state.getDisplayMode());
+    EXPECT_EQ(0, memcmp(&info, &out, sizeof(info)));
+}
+
+TEST(VPPDisplayStateTest, RefreshRejectsNullProvider) {
+    VPPDisplayState state;
+
+    EXPECT_EQ(BAD_VALUE, state.refresh(NULL, MDS_HDMI_CONNECTED));
+    EXPECT_FALSE(state.isValid());
+}
+
+TEST(VPPDisplayStateTest, RefreshQueriesHdmiOnlyWhenConnected) {
+    VPPFakeDisplayProvider provider;
+    MDSHdmiTiming list[3] = {
+        makeTiming(1920, 1080, 60),
+        makeTiming(1920, 1080, 50),
+        makeTiming(1280, 720, 60),
+    };
+    provider.setHdmiTimings(list[0], list, 3);
+
+    VPPDisplayState state;
+    VPPDisplayInfo info;
+
+    ASSERT_EQ(OK, state.refresh(&provider, 0));
+    ASSERT_TRUE(state.read(&info));
+    EXPECT_EQ(0, info.mode);
+    EXPECT_EQ(0, info.timingCount);
+    EXPECT_EQ(0, info.currTiming.width);
+
+    ASSERT_EQ(OK, state.refresh(&provider, MDS_HDMI_CONNECTED));
+    ASSERT_TRUE(state.read(&info));
+    EXPECT_EQ(MDS_HDMI_CONNECTED, info.mode);
+    EXPECT_EQ(MDS_HDMI_CONNECTED, state.getDisplayMode());
+    ASSERT_EQ(3, info.timingCount);
+    EXPECT_EQ(1920, info.currTiming.width);
+    EXPECT_EQ(60, info.currTiming.refresh);
+    EXPECT_EQ(0, memcmp(list, info.timingList, sizeof(list)));
+}
+
+TEST(VPPDisplayStateTest, RefreshWithoutTimingsPublishesMode) {
+    // a connected display whose timings can't be read still updates the mode
+    VPPFakeDisplayProvider provider;
+    VPPDisplayState state;
+    VPPDisplayInfo info;
+
+    ASSERT_EQ(OK, state.refresh(&provider, MDS_HDMI_CONNECTED));
+    ASSERT_TRUE(state.read(&info));
+    EXPECT_EQ(MDS_HDMI_CONNECTED, info.mode);
+    EXPECT_EQ(0, info.timingCount);
+}
+
+TEST(VPPFakeDisplayProviderTest, ClampsTimingCount) {
+    static MDSHdmiTiming list[HDMI_TIMING_MAX + 4];
+    for (int i = 0; i < HDMI_TIMING_MAX + 4; i++)
+        list[i] = makeTiming(1920, 1080, i);
+
+    VPPFakeDisplayProvider provider;
+    provider.setHdmiTimings(list[0], list, HDMI_TIMING_MAX + 4);
+
+    MDSHdmiTiming curr;
+    static MDSHdmiTiming out[HDMI_TIMING_MAX];
+    int32_t count = 0;
+    ASSERT_EQ(OK, provider.queryHdmiMetaData(&curr, out, &count));
+    EXPECT_EQ(HDMI_TIMING_MAX, count);
+    EXPECT_EQ(HDMI_TIMING_MAX - 1, out[HDMI_TIMING_MAX - 1].refresh);
+
+    provider.setHdmiTimings(list[0], NULL, 5);
+    ASSERT_EQ(OK, provider.queryHdmiMetaData(&curr, out, &count));
+    EXPECT_EQ(0, count);
+
+    provider.setHdmiTimings(list[0], list, -1);
+    ASSERT_EQ(OK, provider.queryHdmiMetaData(&curr, out, &count));
+    EXPECT_EQ(0, count);
+
+    EXPECT_EQ(BAD_VALUE, provider.queryHdmiMetaData(NULL, out, &count));
+    EXPECT_EQ(BAD_VALUE, provider.queryHdmiMetaData(&curr, NULL, &count));
+    EXPECT_EQ(BAD_VALUE, provider.queryHdmiMetaData(&curr, out, NULL));
+}
+
+/* Every field of a snapshot carries its generation, so a reader that
+ * copied half of one snapshot and half of the next sees mixed values.
+ */
+#define TORN_READ_GENERATIONS   20000
+#define TORN_READ_READERS       2
+
+struct TornReadContext {
+    VPPDisplayState *state;
+    volatile int32_t done;
+    int32_t torn;
+};
+
+static void fillGeneration(VPPDisplayInfo *info, int32_t gen) {
+    info->mode = gen;
+    info->currTiming = makeTiming(gen, gen, gen);
+    info->timingCount = HDMI_TIMING_MAX;
+    for (int i = 0; i < HDMI_TIMING_MAX; i++)
+        info->timingList[i] = makeTiming(gen, gen, gen);
+}
+
+static bool isConsistent(const VPPDisplayInfo &info) {
+    int32_t gen = info.mode;
+    if (info.currTiming.width != gen || info.currTiming.refresh != gen)
+        return false;
+    for (int i = 0; i < HDMI_TIMING_MAX; i++) {
+        if (info.timingList[i].width != gen || info.timingList[i].refresh != gen)
+            return false;
+    }
+    return true;
+}
+
+static void *tornReader(void *arg) {
+    TornReadContext *ctx = static_cast<TornReadContext *>(arg);
+    VPPDisplayInfo *info = new VPPDisplayInfo;
+    int32_t torn = 0;
+
+    while (!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        if (!ctx->state->read(info))
+            continue;
+        if (!isConsistent(*info))
+            torn++;
+    }
+
+    delete info;
+    __atomic_add_fetch(&ctx->torn, torn, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+TEST(VPPDisplayStateTest, ReadersNeverSeeTornSnapshots) {
+    VPPDisplayState state;
+    TornReadContext ctx;
+    ctx.state = &state;
+    ctx.done = 0;
+    ctx.torn = 0;
+
+    pthread_t readers[TORN_READ_READERS];
+    for (int i = 0; i < TORN_READ_READERS; i++)
+        ASSERT_EQ(0, pthread_create(&readers[i], NULL, tornReader, &ctx));
+
+    VPPDisplayInfo *info = new VPPDisplayInfo;
+    for (int32_t gen = 1; gen <= TORN_READ_GENERATIONS; gen++) {
+        fillGeneration(info, gen);
+        state.publish(*info);
+    }
+    delete info;
+
+    __atomic_store_n(&ctx.done, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < TORN_READ_READERS; i++)
+        pthread_join(readers[i], NULL);
+
+    EXPECT_EQ(0, ctx.torn);
+    EXPECT_EQ(TORN_READ_GENERATIONS, state.getDisplayMode());
+}
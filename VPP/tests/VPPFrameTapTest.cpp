@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "VPPFrameTap.h"
+
+using namespace android;
+
+#define TAP_WIDTH   64
+#define TAP_HEIGHT  32
+// the decoder surfaces are wider than the picture
+#define TAP_PITCH   80
+
+class VPPFrameTapTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        strcpy(mPath, "/tmp/vpp_frametap_XXXXXX");
+        int fd = mkstemp(mPath);
+        ASSERT_GE(fd, 0);
+        close(fd);
+
+        mY = new uint8_t[TAP_PITCH * TAP_HEIGHT];
+        mUV = new uint8_t[TAP_PITCH * TAP_HEIGHT / 2];
+    }
+
+    virtual void TearDown() {
+        delete[] mY;
+        delete[] mUV;
+        unlink(mPath);
+    }
+
+    // fill the surface with a pattern of the frame, padding with 0xee
+    void fillFrame(uint32_t frame, uint32_t width = TAP_WIDTH, uint32_t height = TAP_HEIGHT) {
+        memset(mY, 0xee, TAP_PITCH * TAP_HEIGHT);
+        memset(mUV, 0xee, TAP_PITCH * TAP_HEIGHT / 2);
+        for (uint32_t h = 0; h < height; h++)
+            for (uint32_t w = 0; w < width; w++)
+                mY[h * TAP_PITCH + w] = (uint8_t)(frame + h + w);
+        for (uint32_t h = 0; h < height / 2; h++)
+            for (uint32_t w = 0; w < width; w++)
+                mUV[h * TAP_PITCH + w] = (uint8_t)(frame * 3 + h);
+    }
+
+    status_t tapFrame(const sp<VPPFrameTap> &tap, uint32_t frame,
+            uint32_t width = TAP_WIDTH, uint32_t height = TAP_HEIGHT) {
+        fillFrame(frame, width, height);
+        return tap->tapNV12(width, height, mY, TAP_PITCH, mUV, TAP_PITCH, frame * 1000);
+    }
+
+    // check the records in the dump, return how many there are
+    int checkDump() {
+        FILE *file = fopen(mPath, "rb");
+        EXPECT_TRUE(file != NULL);
+        if (file == NULL)
+            return -1;
+
+        uint8_t *payload = new uint8_t[TAP_WIDTH * TAP_HEIGHT * 3 / 2];
+        VPPFrameTapRecord record;
+        int count = 0;
+        int64_t lastIndex = -1;
+        long offset = 0;
+        while (fread(&record, sizeof(record), 1, file) == 1) {
+            EXPECT_EQ((uint32_t)VPP_FRAME_TAP_MAGIC, record.magic);
+            EXPECT_LE(record.width, (uint32_t)TAP_WIDTH);
+            EXPECT_LE(record.height, (uint32_t)TAP_HEIGHT);
+            EXPECT_EQ(record.width * record.height * 3 / 2, record.size);
+            EXPECT_EQ(0u, record.recordSize % 4096);
+            EXPECT_EQ((int64_t)record.frameIndex * 1000, record.timeUs);
+            EXPECT_GT((int64_t)record.frameIndex, lastIndex);
+            lastIndex = record.frameIndex;
+
+            // padding of the source surface is left out
+            if (fread(payload, record.size, 1, file) != 1) {
+                ADD_FAILURE() << "truncated record " << count;
+                break;
+            }
+            fillFrame(record.frameIndex, record.width, record.height);
+            const uint8_t *p = payload;
+            for (uint32_t h = 0; h < record.height; h++, p += record.width)
+                EXPECT_EQ(0, memcmp(p, mY + h * TAP_PITCH, record.width)) << "Y row " << h;
+            for (uint32_t h = 0; h < record.height / 2; h++, p += record.width)
+                EXPECT_EQ(0, memcmp(p, mUV + h * TAP_PITCH, record.width)) << "UV row " << h;
+
+            // the padding up to the next record is zeroed
+            for (long pad = sizeof(record) + record.size; pad < (long)record.recordSize; pad++) {
+                int c = fgetc(file);
+                if (c != 0) {
+                    ADD_FAILURE() << "padding byte " << pad << " of record " << count << " is " << c;
+                    break;
+                }
+            }
+
+            offset += record.recordSize;
+            fseek(file, offset, SEEK_SET);
+            count++;
+        }
+        delete[] payload;
+        fclose(file);
+        return count;
+    }
+
+    char mPath[64];
+    uint8_t *mY;
+    uint8_t *mUV;
+};
+
+TEST_F(VPPFrameTapTest, StartRejectsBadSize) {
+    sp<VPPFrameTap> tap = new VPPFrameTap(mPath, 4, 1);
+
+    EXPECT_EQ(BAD_VALUE, tap->start(0, TAP_HEIGHT));
+    EXPECT_EQ(BAD_VALUE, tap->start(TAP_WIDTH + 1, TAP_HEIGHT));
+    EXPECT_FALSE(tap->shouldTap());
+}
+
+TEST_F(VPPFrameTapTest, SamplesEveryInterval) {
+    sp<VPPFrameTap> tap = new VPPFrameTap(mPath, 4, 3);
+    ASSERT_EQ(OK, tap->start(TAP_WIDTH, TAP_HEIGHT));
+
+    for (int i = 0; i < 9; i++)
+        EXPECT_EQ(i % 3 == 0, tap->shouldTap()) << "frame " << i;
+    tap->stop();
+    EXPECT_FALSE(tap->shouldTap());
+}
+
+TEST_F(VPPFrameTapTest, WritesPackedRecords) {
+    sp<VPPFrameTap> tap = new VPPFrameTap(mPath, 4, 2);
+    ASSERT_EQ(OK, tap->start(TAP_WIDTH, TAP_HEIGHT));
+
+    int tapped = 0;
+    for (uint32_t i = 0; i < 10; i++) {
+        if (!tap->shouldTap())
+            continue;
+        // retry instead of dropping, so every sampled frame is in the dump
+        status_t err;
+        while ((err = tapFrame(tap, i)) == WOULD_BLOCK)
+            usleep(1000);
+        ASSERT_EQ(OK, err);
+        tapped++;
+    }
+    tap->stop();
+
+    EXPECT_EQ(5, tapped);
+    EXPECT_EQ(tapped, checkDump());
+}
+
+TEST_F(VPPFrameTapTest, DropsOversizedFrame) {
+    sp<VPPFrameTap> tap = new VPPFrameTap(mPath, 4, 1);
+    ASSERT_EQ(OK, tap->start(TAP_WIDTH / 2, TAP_HEIGHT));
+
+    ASSERT_TRUE(tap->shouldTap());
+    EXPECT_EQ(BAD_VALUE, tapFrame(tap, 0));
+    EXPECT_EQ(1u, tap->getDroppedCount());
+    tap->stop();
+    EXPECT_EQ(0, checkDump());
+}
+
+TEST_F(VPPFrameTapTest, ZeroesPaddingOfSmallerFrame) {
+    // one slot, so the small frame reuses the slot of the full one
+    sp<VPPFrameTap> tap = new VPPFrameTap(mPath, 1, 1);
+    ASSERT_EQ(OK, tap->start(TAP_WIDTH, TAP_HEIGHT));
+
+    ASSERT_TRUE(tap->shouldTap());
+    ASSERT_EQ(OK, tapFrame(tap, 0));
+    ASSERT_TRUE(tap->shouldTap());
+    status_t err;
+    while ((err = tapFrame(tap, 1, TAP_WIDTH / 2, TAP_HEIGHT / 2)) == WOULD_BLOCK)
+        usleep(1000);
+    ASSERT_EQ(OK, err);
+    tap->stop();
+
+    EXPECT_EQ(2, checkDump());
+}
+
+TEST_F(VPPFrameTapTest, BurstDropsButNeverCorrupts) {
+    // a small ring fed faster than it is written
+    sp<VPPFrameTap> tap = new VPPFrameTap(mPath, 2, 1);
+    ASSERT_EQ(OK, tap->start(TAP_WIDTH, TAP_HEIGHT));
+
+    int tapped = 0;
+    for (uint32_t i = 0; i < 200; i++) {
+        ASSERT_TRUE(tap->shouldTap());
+        status_t err = tapFrame(tap, i);
+        ASSERT_TRUE(err == OK || err == WOULD_BLOCK);
+        if (err == OK)
+            tapped++;
+    }
+    tap->stop();
+
+    EXPECT_EQ(200u, tapped + tap->getDroppedCount());
+    EXPECT_EQ(tapped, checkDump());
+}
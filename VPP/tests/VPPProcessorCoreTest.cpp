@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include "VPPProcessorCore.h"
+
+using namespace android;
+
+// what a player keeps for one decoder buffer
+struct MockCodecBuffer {
+    sp<GraphicBuffer> mGraphicBuffer;
+};
+
+/* Player hooks that only record what the core asks for. Nothing here
+ * starts VA, so it runs without a VSP.
+ */
+class MockProcessor : public VPPProcessorCore<MockCodecBuffer> {
+public:
+    MockProcessor()
+        : VPPProcessorCore<MockCodecBuffer>(NULL),
+          mFlushCount(0) {}
+
+    void setSlots(uint32_t inputNum, uint32_t outputNum) {
+        mInputBufferNum = inputNum;
+        mOutputBufferNum = outputNum;
+        for (uint32_t i = 0; i < VPPBuffer::MAX_VPP_BUFFER_NUMBER; i++) {
+            mInput[i].resetBuffer(NULL);
+            mOutput[i].resetBuffer(NULL);
+        }
+        mInputLoadPoint = inputNum - 1;
+        mOutputLoadPoint = outputNum - 1;
+    }
+
+    void setInput(uint32_t i, VPPBufferStatus status) { mInput[i].mStatus = status; }
+    void setOutput(uint32_t i, VPPBufferStatus status) { mOutput[i].mStatus = status; }
+    uint32_t inputLoadPoint() const { return mInputLoadPoint; }
+    uint32_t outputLoadPoint() const { return mOutputLoadPoint; }
+    bool eos() const { return mEOS; }
+
+    void setBufferInfos(Vector<MockCodecBuffer> *infos) { mBufferInfos = infos; }
+
+    using VPPProcessorCore<MockCodecBuffer>::setCodecBuffers;
+    using VPPProcessorCore<MockCodecBuffer>::hasProcessingBuffer;
+    using VPPProcessorCore<MockCodecBuffer>::flush;
+    using VPPProcessorCore<MockCodecBuffer>::releaseReadyInputs;
+    using VPPProcessorCore<MockCodecBuffer>::signalEOS;
+    using VPPProcessorCore<MockCodecBuffer>::findBufferByGraphicBuffer;
+
+    Vector<uint32_t> mReleasedInputs;
+    Vector<uint32_t> mReleasedOutputs;
+    int mFlushCount;
+
+protected:
+    virtual sp<GraphicBuffer> getGraphicBuffer(const MockCodecBuffer &info) {
+        return info.mGraphicBuffer;
+    }
+    virtual sp<GraphicBuffer> dequeueOutputBuffer() { return NULL; }
+    virtual void releaseInput(uint32_t index) {
+        mReleasedInputs.push(index);
+        mInput[index].resetBuffer(NULL);
+    }
+    virtual void releaseOutput(uint32_t index) {
+        mReleasedOutputs.push(index);
+        mOutput[index].resetBuffer(NULL);
+    }
+    virtual void onFlush() { mFlushCount++; }
+};
+
+static void expectIndexes(const Vector<uint32_t> &actual, const uint32_t *expected, size_t count) {
+    ASSERT_EQ(count, actual.size());
+    for (size_t i = 0; i < count; i++)
+        EXPECT_EQ(expected[i], actual[i]) << "at " << i;
+}
+
+TEST(VPPProcessorCoreTest, SetCodecBuffersValidatesCounts) {
+    MockProcessor processor;
+    Vector<MockCodecBuffer> infos;
+    infos.insertAt(MockCodecBuffer(), 0, 9);
+
+    // nothing configured yet
+    EXPECT_EQ(VPP_FAIL, processor.setCodecBuffers(&infos));
+    EXPECT_EQ(VPP_FAIL, processor.setCodecBuffers(NULL));
+
+    // the decoder must keep at least one buffer of its own
+    processor.setSlots(4, 5);
+    EXPECT_EQ(VPP_FAIL, processor.setCodecBuffers(&infos));
+
+    // enough buffers, but one without a graphic buffer
+    infos.push(MockCodecBuffer());
+    EXPECT_EQ(VPP_FAIL, processor.setCodecBuffers(&infos));
+}
+
+TEST(VPPProcessorCoreTest, HasProcessingBufferReleasesIdleSlots) {
+    MockProcessor processor;
+    processor.setSlots(4, 5);
+    processor.setInput(0, VPP_BUFFER_PROCESSING);
+    processor.setInput(1, VPP_BUFFER_READY);
+    processor.setInput(2, VPP_BUFFER_LOADED);
+    processor.setOutput(0, VPP_BUFFER_PROCESSING);
+    processor.setOutput(1, VPP_BUFFER_RENDERING);
+    processor.setOutput(2, VPP_BUFFER_READY);
+    processor.setOutput(3, VPP_BUFFER_END_FLAG);
+
+    EXPECT_TRUE(processor.hasProcessingBuffer());
+    static const uint32_t inputs[] = { 1, 2 };
+    static const uint32_t outputs[] = { 1, 2 };
+    expectIndexes(processor.mReleasedInputs, inputs, 2);
+    expectIndexes(processor.mReleasedOutputs, outputs, 2);
+    EXPECT_EQ(0u, processor.inputLoadPoint());
+    EXPECT_EQ(0u, processor.outputLoadPoint());
+    EXPECT_EQ(0, processor.mFlushCount);
+
+    // only the slots VSP holds are left
+    processor.setInput(0, VPP_BUFFER_FREE);
+    processor.setOutput(0, VPP_BUFFER_FREE);
+    EXPECT_FALSE(processor.hasProcessingBuffer());
+}
+
+TEST(VPPProcessorCoreTest, FlushReleasesEverySlot) {
+    MockProcessor processor;
+    processor.setSlots(3, 4);
+    processor.setInput(0, VPP_BUFFER_PROCESSING);
+    processor.setInput(2, VPP_BUFFER_LOADED);
+    processor.setOutput(1, VPP_BUFFER_RENDERING);
+    processor.setOutput(3, VPP_BUFFER_END_FLAG);
+
+    processor.flush();
+    static const uint32_t inputs[] = { 0, 2 };
+    static const uint32_t outputs[] = { 1, 3 };
+    expectIndexes(processor.mReleasedInputs, inputs, 2);
+    expectIndexes(processor.mReleasedOutputs, outputs, 2);
+    EXPECT_EQ(1, processor.mFlushCount);
+    EXPECT_EQ(0u, processor.inputLoadPoint());
+    EXPECT_EQ(0u, processor.outputLoadPoint());
+}
+
+TEST(VPPProcessorCoreTest, ReleaseReadyInputsOnly) {
+    MockProcessor processor;
+    processor.setSlots(4, 4);
+    processor.setInput(0, VPP_BUFFER_READY);
+    processor.setInput(1, VPP_BUFFER_PROCESSING);
+    processor.setInput(2, VPP_BUFFER_LOADED);
+    processor.setInput(3, VPP_BUFFER_READY);
+    processor.setOutput(0, VPP_BUFFER_READY);
+
+    processor.releaseReadyInputs();
+    static const uint32_t inputs[] = { 0, 3 };
+    expectIndexes(processor.mReleasedInputs, inputs, 2);
+    EXPECT_EQ(0u, processor.mReleasedOutputs.size());
+}
+
+TEST(VPPProcessorCoreTest, SignalEOSWithoutThread) {
+    MockProcessor processor;
+
+    processor.signalEOS();
+    EXPECT_TRUE(processor.eos());
+}
+
+TEST(VPPProcessorCoreTest, FindBufferByGraphicBuffer) {
+    MockProcessor processor;
+    Vector<MockCodecBuffer> infos;
+    sp<GraphicBuffer> buffers[3];
+    for (int i = 0; i < 3; i++) {
+        MockCodecBuffer info;
+        // no allocation is needed to compare buffers
+        buffers[i] = new GraphicBuffer();
+        info.mGraphicBuffer = buffers[i];
+        infos.push(info);
+    }
+
+    EXPECT_TRUE(processor.findBufferByGraphicBuffer(buffers[1]) == NULL);
+    processor.setBufferInfos(&infos);
+    EXPECT_EQ(&infos.editItemAt(1), processor.findBufferByGraphicBuffer(buffers[1]));
+    EXPECT_EQ(&infos.editItemAt(2), processor.findBufferByGraphicBuffer(buffers[2]));
+    EXPECT_TRUE(processor.findBufferByGraphicBuffer(new GraphicBuffer()) == NULL);
+    EXPECT_TRUE(processor.findBufferByGraphicBuffer(NULL) == NULL);
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2012 Intel Corporation.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Reassemble a frame tap dump written by VPPFrameTap into a raw NV12
+ * stream that YUV viewers can play.
+ *
+ * usage: vpp_frametap_extract [-v] <input.tap> <output.nv12>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "VPPFrameTap.h"
+
+using android::VPPFrameTapRecord;
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-v] <input.tap> <output.nv12>\n", name);
+}
+
+int main(int argc, char **argv) {
+    bool verbose = false;
+    int arg = 1;
+
+    if (arg < argc && !strcmp(argv[arg], "-v")) {
+        verbose = true;
+        arg++;
+    }
+    if (argc - arg != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[arg], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[arg]);
+        return 1;
+    }
+    FILE *out = fopen(argv[arg + 1], "wb");
+    if (out == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[arg + 1]);
+        fclose(in);
+        return 1;
+    }
+
+    VPPFrameTapRecord record;
+    unsigned char *payload = NULL;
+    uint32_t payloadSize = 0;
+    uint32_t width = 0, height = 0;
+    uint32_t frames = 0, step = 0, lastIndex = 0, missing = 0;
+    int ret = 0;
+
+    while (fread(&record, sizeof(record), 1, in) == 1) {
+        if (record.magic != VPP_FRAME_TAP_MAGIC
+                || record.recordSize < sizeof(record) + record.size
+                || record.size != record.width * record.height * 3 / 2) {
+            fprintf(stderr, "bad record at offset %ld\n", ftell(in) - (long)sizeof(record));
+            ret = 1;
+            break;
+        }
+
+        if (record.size > payloadSize) {
+            unsigned char *buf = (unsigned char *)realloc(payload, record.size);
+            if (buf == NULL) {
+                fprintf(stderr, "out of memory\n");
+                ret = 1;
+                break;
+            }
+            payload = buf;
+            payloadSize = record.size;
+        }
+        if (fread(payload, 1, record.size, in) != record.size) {
+            fprintf(stderr, "truncated frame %u\n", record.frameIndex);
+            ret = 1;
+            break;
+        }
+        // skip the padding up to the next record
+        if (fseek(in, record.recordSize - sizeof(record) - record.size, SEEK_CUR) != 0)
+            break;
+
+        if (frames == 0) {
+            width = record.width;
+            height = record.height;
+        } else if (record.width != width || record.height != height) {
+            fprintf(stderr, "frame %u is %ux%u, stream is %ux%u, skipped\n",
+                    record.frameIndex, record.width, record.height, width, height);
+            continue;
+        }
+
+        // the smallest index step is the sampling interval, larger ones are drops
+        if (frames > 0) {
+            uint32_t delta = record.frameIndex - lastIndex;
+            if (step == 0 || delta < step)
+                step = delta;
+            if (step > 0 && delta > step)
+                missing += delta / step - 1;
+        }
+        lastIndex = record.frameIndex;
+
+        if (verbose)
+            printf("frame %u: %ux%u, time %lld us\n", record.frameIndex,
+                    record.width, record.height, (long long)record.timeUs);
+
+        if (fwrite(payload, 1, record.size, out) != record.size) {
+            fprintf(stderr, "failed to write frame %u\n", record.frameIndex);
+            ret = 1;
+            break;
+        }
+        frames++;
+    }
+
+    printf("%u frames of %ux%u NV12, sampling interval %u, %u sampled frames dropped\n",
+            frames, width, height, step, missing);
+
+    free(payload);
+    fclose(out);
+    fclose(in);
+    return ret;
+}
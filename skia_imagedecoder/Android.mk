@@ -241,3 +241,4 @@ LOCAL_MODULE_TAGS := optional
 include external/stlport/libstlport.mk
 include $(BUILD_STATIC_LIBRARY)
 
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -21,11 +21,24 @@
  */
 
 #include "SkImageDecoder_libjpeg_turbo.h"
+#include "SkJPEGTurboLruCache.h"
+#include "SkJPEGTurboRows.h"
+#include "SkJPEGTurboStrips.h"
+#include "SkJPEGTurboTileBands.h"
+#include "SkData.h"
+#include "SkTDArray.h"
+#include "SkThread.h"
 #include <cutils/properties.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <utils/Timers.h>
 #include <utils/Log.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 // These enable timing code that report milliseconds for an encoding/decoding
 //#define TIME_ENCODE
 //#define TIME_DECODE
@@ -102,10 +115,214 @@ static void initialize_info(jpeg_decompress_struct* cinfo, skjpeg_source_mgr* sr
 }
 
 #ifdef SK_BUILD_FOR_ANDROID
+// default byte budget of the huffman index cache, in KB
+#define HUFFMAN_INDEX_CACHE_DEFAULT_KB (8 * 1024)
+#define HUFFMAN_INDEX_READ_CHUNK (64 * 1024)
+
+/**
+ *  A huffman index. It is only read once built, so it is shared by
+ *  every SkJPEGTurboImageIndex opened on the same data, and by the
+ *  threads decoding their bands.
+ */
+class SkJPEGTurboHuffmanIndex : public SkRefCnt {
+public:
+    explicit SkJPEGTurboHuffmanIndex(jpeg_decompress_struct* cinfo) : fBuilt(false) {
+        jpeg_create_huffman_index(cinfo, &fIndex);
+    }
+
+    virtual ~SkJPEGTurboHuffmanIndex() {
+        if (fBuilt) {
+            // Like SkJPEGTurboImageIndex, clear first in case libjpeg longjmps.
+            fBuilt = false;
+            jpeg_destroy_huffman_index(&fIndex);
+        }
+    }
+
+    bool build(jpeg_decompress_struct* cinfo) {
+        SkASSERT(!fBuilt);
+        fBuilt = jpeg_build_huffman_index(cinfo, &fIndex);
+        return fBuilt;
+    }
+
+    huffman_index* index() { return &fIndex; }
+
+    size_t size() const { return sizeof(*this) + fIndex.mem_used; }
+
+private:
+    huffman_index fIndex;
+    bool fBuilt;
+};
+
+/**
+ *  The whole content of stream, which is left rewound, or NULL if it is
+ *  longer than limit or can't be read twice. The content of a memory
+ *  stream is not copied, *borrowed is then set and the returned SkData is
+ *  only valid as long as the stream.
+ */
+static SkData* stream_data(SkStreamRewindable* stream, size_t limit, bool* borrowed) {
+    const void* base = stream->getMemoryBase();
+    if (base && stream->hasLength()) {
+        if (stream->getLength() > limit) {
+            return NULL;
+        }
+        *borrowed = true;
+        return SkData::NewWithoutCopy(base, stream->getLength());
+    }
+
+    if ((stream->hasLength() && stream->getLength() > limit) || !stream->rewind()) {
+        return NULL;
+    }
+    SkDynamicMemoryWStream copy;
+    SkAutoMalloc storage(HUFFMAN_INDEX_READ_CHUNK);
+    size_t total = 0;
+    bool ok = true;
+    for (;;) {
+        size_t bytes = stream->read(storage.get(), HUFFMAN_INDEX_READ_CHUNK);
+        if (0 == bytes) {
+            break;
+        }
+        total += bytes;
+        if (total > limit || !copy.write(storage.get(), bytes)) {
+            ok = false;
+            break;
+        }
+    }
+    if (!stream->rewind() || !ok || 0 == total) {
+        return NULL;
+    }
+    *borrowed = false;
+    return copy.detachAsData();
+}
+
+// 64 bit FNV-1a
+static uint64_t hash_data(const SkData* data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint8_t* bytes = data->bytes();
+    for (size_t i = 0; i < data->size(); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ *  Recently built huffman indexes, with a copy of the JPEG data each was
+ *  built from, so reopening a picture for region decoding skips the
+ *  entropy decoding pass. Entries are looked up by a hash of the data,
+ *  and only used if the data is the same byte for byte. Least recently
+ *  used entries are dropped to keep their indexes and data under
+ *  skia.libjpegturbo.index.cache.kb, 0 disables the cache.
+ */
+class SkJPEGTurboHuffmanIndexCache {
+public:
+    SkJPEGTurboHuffmanIndexCache() : fBudget(0), fBudgetRead(false) {}
+
+    ~SkJPEGTurboHuffmanIndexCache() {
+        for (int i = 0; i < fEntries.count(); i++) {
+            fEntries.valueAt(i).fIndex->unref();
+            fEntries.valueAt(i).fData->unref();
+        }
+    }
+
+    /**
+     *  Largest JPEG data an entry may hold, 0 if the cache is disabled.
+     */
+    size_t maxDataSize() {
+        SkAutoMutexAcquire lock(fMutex);
+        return this->budget();
+    }
+
+    /**
+     *  Returns a ref'ed index built for data, hashed to hash, or NULL.
+     */
+    SkJPEGTurboHuffmanIndex* find(uint64_t hash, const SkData* data) {
+        SkAutoTUnref<SkJPEGTurboHuffmanIndex> index;
+        SkAutoTUnref<SkData> stored;
+        {
+            SkAutoMutexAcquire lock(fMutex);
+            const Value* value = fEntries.find(hash, data->size());
+            if (value) {
+                index.reset(SkRef(value->fIndex));
+                stored.reset(SkRef(value->fData));
+            }
+        }
+        // a hash match alone could be a crafted collision, compare outside
+        // the lock
+        if (NULL == index.get() || !stored->equals(data)) {
+            return NULL;
+        }
+        return index.detach();
+    }
+
+    /**
+     *  Cache index, built for data, hashed to hash. A borrowed data is
+     *  copied, any other is ref'ed.
+     */
+    void add(uint64_t hash, SkData* data, bool borrowed, SkJPEGTurboHuffmanIndex* index) {
+        const size_t size = index->size() + data->size();
+        {
+            SkAutoMutexAcquire lock(fMutex);
+            if (size > this->budget()) {
+                return;
+            }
+        }
+        // copy the data outside the lock
+        SkAutoTUnref<SkData> stored(borrowed ?
+                SkData::NewWithCopy(data->data(), data->size()) : SkRef(data));
+
+        Value value;
+        value.fIndex = index;
+        value.fData = stored.get();
+        SkTDArray<Value> victims;
+        {
+            SkAutoMutexAcquire lock(fMutex);
+            // fails if built concurrently by another decoder, or a collision
+            if (fEntries.add(hash, data->size(), value, size, this->budget(), &victims)) {
+                index->ref();
+                stored.detach();
+            }
+        }
+        // free the dropped entries outside the lock
+        for (int i = 0; i < victims.count(); i++) {
+            victims[i].fIndex->unref();
+            victims[i].fData->unref();
+        }
+    }
+
+private:
+    struct Value {
+        SkJPEGTurboHuffmanIndex* fIndex;
+        // the JPEG data fIndex was built from
+        SkData* fData;
+    };
+
+    size_t budget() {
+        if (!fBudgetRead) {
+            char property[PROPERTY_VALUE_MAX];
+            long kb = HUFFMAN_INDEX_CACHE_DEFAULT_KB;
+            if (property_get("skia.libjpegturbo.index.cache.kb", property, NULL) > 0) {
+                kb = atol(property);
+            }
+            fBudget = (kb > 0) ? (size_t)kb * 1024 : 0;
+            fBudgetRead = true;
+        }
+        return fBudget;
+    }
+
+    SkMutex fMutex;
+    SkJPEGTurboLruCache<Value, SkTDArray> fEntries;
+    size_t fBudget;
+    bool fBudgetRead;
+};
+
+static SkJPEGTurboHuffmanIndexCache gHuffmanIndexCache;
+
 class SkJPEGTurboImageIndex {
 public:
     SkJPEGTurboImageIndex(SkStreamRewindable* stream, SkImageDecoder* decoder)
         : fSrcMgr(stream, decoder)
+        , fStream(stream)
+        , fHuffmanIndex(NULL)
         , fInfoInitialized(false)
         , fHuffmanCreated(false)
         , fDecompressStarted(false)
@@ -114,14 +331,17 @@ public:
         }
 
     ~SkJPEGTurboImageIndex() {
-        if (fHuffmanCreated) {
-            // Set to false before calling the libjpeg function, in case
+        if (fHuffmanIndex) {
+            // Clear before calling the libjpeg function, in case
             // the libjpeg function calls longjmp. Our setjmp handler may
             // attempt to delete this SkJPEGTurboImageIndex, thus entering this
-            // destructor again. Setting fHuffmanCreated to false first
-            // prevents an infinite loop.
+            // destructor again. Clearing fHuffmanIndex first
+            // prevents an infinite loop. The index may be shared, it is
+            // destroyed with its last reference.
+            SkJPEGTurboHuffmanIndex* index = fHuffmanIndex;
+            fHuffmanIndex = NULL;
             fHuffmanCreated = false;
-            jpeg_destroy_huffman_index(&fHuffmanIndex);
+            index->unref();
         }
         if (fDecompressStarted) {
             // Like fHuffmanCreated, set to false before calling libjpeg
@@ -170,7 +390,11 @@ public:
 
     jpeg_decompress_struct* cinfo() { return &fCInfo; }
 
-    huffman_index* huffmanIndex() { return &fHuffmanIndex; }
+    huffman_index* huffmanIndex() { return fHuffmanIndex->index(); }
+
+    SkJPEGTurboHuffmanIndex* sharedHuffmanIndex() { return fHuffmanIndex; }
+
+    SkStreamRewindable* stream() { return fStream; }
 
     /**
      *  Build the index to be used for tile based decoding.
@@ -181,12 +405,22 @@ public:
     bool buildHuffmanIndex() {
         SkASSERT(fReadHeaderSucceeded);
         SkASSERT(!fHuffmanCreated);
-        jpeg_create_huffman_index(&fCInfo, &fHuffmanIndex);
+        fHuffmanIndex = SkNEW_ARGS(SkJPEGTurboHuffmanIndex, (&fCInfo));
         SkASSERT(1 == fCInfo.scale_num && 1 == fCInfo.scale_denom);
-        fHuffmanCreated = jpeg_build_huffman_index(&fCInfo, &fHuffmanIndex);
+        fHuffmanCreated = fHuffmanIndex->build(&fCInfo);
         return fHuffmanCreated;
     }
 
+    /**
+     *  Use an index built earlier for the same data instead of
+     *  building one. Must not be called after buildHuffmanIndex.
+     */
+    void setHuffmanIndex(SkJPEGTurboHuffmanIndex* index) {
+        SkASSERT(!fHuffmanCreated && NULL == fHuffmanIndex);
+        fHuffmanIndex = SkRef(index);
+        fHuffmanCreated = true;
+    }
+
     /**
      *  Start tile based decoding. Must only be called after a
      *  successful call to buildHuffmanIndex, and must only be
@@ -205,8 +439,9 @@ public:
 
 private:
     skjpeg_source_mgr  fSrcMgr;
+    SkStreamRewindable* fStream;
     jpeg_decompress_struct fCInfo;
-    huffman_index fHuffmanIndex;
+    SkJPEGTurboHuffmanIndex* fHuffmanIndex;
     bool fInfoInitialized;
     bool fHuffmanCreated;
     bool fDecompressStarted;
@@ -292,29 +527,6 @@ static bool return_false(const jpeg_decompress_struct& cinfo,
     return false;   // must always return false
 }
 
-// Convert a scanline of CMYK samples to RGBX in place. Note that this
-// method moves the "scanline" pointer in its processing
-static void convert_CMYK_to_RGB(uint8_t* scanline, unsigned int width) {
-    // At this point we've received CMYK pixels from libjpeg. We
-    // perform a crude conversion to RGB (based on the formulae
-    // from easyrgb.com):
-    //  CMYK -> CMY
-    //    C = ( C * (1 - K) + K )      // for each CMY component
-    //  CMY -> RGB
-    //    R = ( 1 - C ) * 255          // for each RGB component
-    // Unfortunately we are seeing inverted CMYK so all the original terms
-    // are 1-. This yields:
-    //  CMYK -> CMY
-    //    C = ( (1-C) * (1 - (1-K) + (1-K) ) -> C = 1 - C*K
-    // The conversion from CMY->RGB remains the same
-    for (unsigned int x = 0; x < width; ++x, scanline += 4) {
-        scanline[0] = SkMulDiv255Round(scanline[0], scanline[3]);
-        scanline[1] = SkMulDiv255Round(scanline[1], scanline[3]);
-        scanline[2] = SkMulDiv255Round(scanline[2], scanline[3]);
-        scanline[3] = 255;
-    }
-}
-
 /**
  *  Common code for setting the error manager.
  */
@@ -357,6 +569,201 @@ static void set_dct_method(const SkImageDecoder& decoder, jpeg_decompress_struct
 #endif
 }
 
+#ifdef SK_BUILD_FOR_ANDROID
+// regions with fewer output pixels are decoded on the calling thread only
+#define SUBSET_PARALLEL_MIN_PIXELS (1024 * 1024)
+#define SUBSET_MAX_THREADS 8
+
+/**
+ *  Number of threads a region decode may use, the online CPUs unless
+ *  overridden by skia.libjpegturbo.subset.threads. 1 disables the
+ *  parallel path.
+ */
+static int get_subset_threads() {
+    char property[PROPERTY_VALUE_MAX];
+    int threads = 0;
+    if (property_get("skia.libjpegturbo.subset.threads", property, NULL) > 0) {
+        threads = atoi(property);
+    }
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > SUBSET_MAX_THREADS) {
+        threads = SUBSET_MAX_THREADS;
+    }
+    return threads;
+}
+
+/**
+ *  One horizontal band of a region decode. A band starts on an iMCU row,
+ *  so it can be decoded from the shared huffman index by its own
+ *  decompress struct reading its own duplicate of the stream.
+ */
+struct TileBand {
+    SkImageDecoder* decoder;
+    huffman_index* index;
+    // the main cinfo, output settings are copied from it
+    const jpeg_decompress_struct* config;
+    SkStreamRewindable* stream;
+    // region passed to jpeg_init_read_tile_scanline
+    int startX, startY, width, height;
+    // what jpeg_init_read_tile_scanline returned to the main cinfo
+    int alignedX, outWidth;
+    uint8_t* dst;
+    size_t rowBytes;
+    int rows;
+    bool ok;
+};
+
+static void decode_tile_band(TileBand* band) {
+    band->ok = false;
+
+    JPEGTurboAutoClean autoClean;
+
+    jpeg_decompress_struct  cinfo;
+    skjpeg_source_mgr       srcManager(band->stream, band->decoder);
+
+    skjpeg_error_mgr errorManager;
+    set_error_mgr(&cinfo, &errorManager);
+
+    // All objects need to be instantiated before this setjmp call so that
+    // they will be cleaned up properly if an error occurs.
+    if (setjmp(errorManager.fJmpBuf)) {
+        return;
+    }
+
+    initialize_info(&cinfo, &srcManager);
+    autoClean.set(&cinfo);
+
+    if (JPEG_HEADER_OK != jpeg_read_header(&cinfo, true)) {
+        return;
+    }
+
+    const jpeg_decompress_struct* config = band->config;
+    cinfo.out_color_space = config->out_color_space;
+    cinfo.dither_mode = config->dither_mode;
+    cinfo.dct_method = config->dct_method;
+    cinfo.do_fancy_upsampling = config->do_fancy_upsampling;
+    cinfo.do_block_smoothing = config->do_block_smoothing;
+
+    if (!jpeg_start_tile_decompress(&cinfo)) {
+        return;
+    }
+    cinfo.scale_num = config->scale_num;
+    cinfo.scale_denom = config->scale_denom;
+
+    int startX = band->startX;
+    int startY = band->startY;
+    int width = band->width;
+    int height = band->height;
+    jpeg_init_read_tile_scanline(&cinfo, band->index, &startX, &startY, &width, &height);
+    if (startX != band->alignedX || startY != band->startY ||
+        width != band->outWidth || height < band->rows) {
+        SkDebugf("tile band at %d decodes %dx%d at (%d, %d), expected %dx%d at (%d, %d)\n",
+                 band->startY, width, height, startX, startY,
+                 band->outWidth, band->rows, band->alignedX, band->startY);
+        return;
+    }
+
+    JSAMPLE* rowptr = (JSAMPLE*)band->dst;
+    int rowTotalCount = 0;
+    while (rowTotalCount < band->rows) {
+        int rowCount = jpeg_read_tile_scanline(&cinfo, band->index, &rowptr);
+        if (0 == rowCount || band->decoder->shouldCancelDecode()) {
+            return;
+        }
+        rowTotalCount += rowCount;
+        rowptr += band->rowBytes;
+    }
+    band->ok = true;
+}
+
+static void* tile_band_thread(void* arg) {
+    decode_tile_band((TileBand*)arg);
+    return NULL;
+}
+
+/**
+ *  Decode a region into bitmap in bands of whole iMCU rows, one thread
+ *  per band. alignedX, alignedY, outWidth and outHeight are what
+ *  jpeg_init_read_tile_scanline returned for rect on the main cinfo,
+ *  which only serves as the template for the bands and is not read from.
+ *  Returns false if the region is not worth splitting, the stream can't
+ *  be duplicated or a band failed, the caller then decodes serially.
+ *  Only for output that goes straight into the bitmap rows.
+ */
+static bool decode_tile_bands(SkImageDecoder* decoder, SkJPEGTurboImageIndex* index,
+                              const SkIRect& rect, int alignedX, int alignedY,
+                              int outWidth, int outHeight, int sampleSize,
+                              SkBitmap* bitmap) {
+    jpeg_decompress_struct* cinfo = index->cinfo();
+    // progressive scans are not split, their coefficients span the image
+    if (cinfo->progressive_mode ||
+        outWidth * outHeight < SUBSET_PARALLEL_MIN_PIXELS) {
+        return false;
+    }
+    int threads = get_subset_threads();
+    if (threads < 2) {
+        return false;
+    }
+
+    SkJPEGTurboBandRows rows[SUBSET_MAX_THREADS];
+    const int bandCount = sk_jpeg_split_bands(alignedY, rect.fBottom, outHeight,
+                                              cinfo->max_v_samp_factor * DCTSIZE,
+                                              sampleSize, threads, rows);
+    if (0 == bandCount) {
+        return false;
+    }
+
+    TileBand bands[SUBSET_MAX_THREADS];
+    SkAutoTUnref<SkStreamRewindable> streams[SUBSET_MAX_THREADS];
+    for (int i = 0; i < bandCount; i++) {
+        // duplicate on this thread, file streams reopen their file
+        streams[i].reset(index->stream()->duplicate());
+        if (NULL == streams[i].get()) {
+            return false;
+        }
+
+        TileBand& band = bands[i];
+        band.decoder = decoder;
+        band.index = index->huffmanIndex();
+        band.config = cinfo;
+        band.stream = streams[i].get();
+        band.startX = rect.fLeft;
+        band.startY = rows[i].startY;
+        band.width = rect.width();
+        band.height = rows[i].height;
+        band.alignedX = alignedX;
+        band.outWidth = outWidth;
+        band.dst = (uint8_t*)bitmap->getAddr(0, rows[i].outRow);
+        band.rowBytes = bitmap->rowBytes();
+        band.rows = rows[i].outRows;
+        band.ok = false;
+    }
+
+    // the first band runs on this thread
+    pthread_t tids[SUBSET_MAX_THREADS];
+    bool started[SUBSET_MAX_THREADS];
+    for (int i = 1; i < bandCount; i++) {
+        started[i] = (0 == pthread_create(&tids[i], NULL, tile_band_thread, &bands[i]));
+        if (!started[i]) {
+            decode_tile_band(&bands[i]);
+        }
+    }
+    decode_tile_band(&bands[0]);
+
+    bool ok = bands[0].ok;
+    for (int i = 1; i < bandCount; i++) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        }
+        ok = ok && bands[i].ok;
+    }
+    return ok;
+}
+#endif
+
+
 SkColorType SkJPEGTurboImageDecoder::getBitmapColorType(jpeg_decompress_struct* cinfo) {
     SkASSERT(cinfo != NULL);
 
@@ -486,6 +893,9 @@ static bool get_src_config(const jpeg_decompress_struct& cinfo,
     return true;
 }
 
+// most scanlines handed to jpeg_read_scanlines at once
+#define MAX_SCANLINES_PER_READ 16
+
 #define LOG_DECODE_TIME
 
 bool SkJPEGTurboImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode) {
@@ -601,26 +1011,84 @@ bool SkJPEGTurboImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode
     /* short-circuit the SkScaledBitmapSampler when possible, as this gives
        a significant performance boost.
     */
-    if (sampleSize == 1 &&
-        ((kN32_SkColorType == colorType && cinfo.out_color_space == JCS_RGBA_8888) ||
-         (kRGB_565_SkColorType == colorType && cinfo.out_color_space == JCS_RGB_565)))
+    if ((kN32_SkColorType == colorType && cinfo.out_color_space == JCS_RGBA_8888) ||
+        (kRGB_565_SkColorType == colorType && cinfo.out_color_space == JCS_RGB_565))
     {
-        JSAMPLE* rowptr = (JSAMPLE*)bm->getPixels();
+        JSAMPLE* rows[MAX_SCANLINES_PER_READ];
         INT32 const bpr =  bm->rowBytes();
 
-        while (cinfo.output_scanline < cinfo.output_height) {
-            int row_count = jpeg_read_scanlines(&cinfo, &rowptr, 1);
-            if (0 == row_count) {
-                // if row_count == 0, then we didn't get a scanline,
-                // so return early.  We will return a partial image.
-                fill_below_level(cinfo.output_scanline, bm);
-                cinfo.output_scanline = cinfo.output_height;
-                break;  // Skip to jpeg_finish_decompress()
+        if (1 == sampleSize) {
+            // scanlines go straight to the bitmap, several per call
+            JSAMPLE* pixels = (JSAMPLE*)bm->getPixels();
+            while (cinfo.output_scanline < cinfo.output_height) {
+                int count = SkTMin<int>(MAX_SCANLINES_PER_READ,
+                                        cinfo.output_height - cinfo.output_scanline);
+                for (int i = 0; i < count; i++) {
+                    rows[i] = pixels + (cinfo.output_scanline + i) * bpr;
+                }
+                int row_count = jpeg_read_scanlines(&cinfo, rows, count);
+                if (0 == row_count) {
+                    // if row_count == 0, then we didn't get a scanline,
+                    // so return early.  We will return a partial image.
+                    fill_below_level(cinfo.output_scanline, bm);
+                    cinfo.output_scanline = cinfo.output_height;
+                    break;  // Skip to jpeg_finish_decompress()
+                }
+                if (this->shouldCancelDecode()) {
+                    return return_false(cinfo, *bm, "shouldCancelDecode");
+                }
             }
-            if (this->shouldCancelDecode()) {
-                return return_false(cinfo, *bm, "shouldCancelDecode");
+        } else {
+            // The DCT scaling could not reach sampleSize, point sample
+            // what it left over, at the pixels SkScaledBitmapSampler
+            // would pick.
+            const int bytesPerPixel = (kN32_SkColorType == colorType) ? 4 : 2;
+            const int srcX0 = sampleSize >> 1;
+            const int srcRowBytes = cinfo.output_width * bytesPerPixel;
+            const int stripRows = SkTMin<int>(SkTMax<int>(cinfo.rec_outbuf_height, 1),
+                                              MAX_SCANLINES_PER_READ);
+            SkAutoMalloc stripStorage(stripRows * srcRowBytes);
+            for (int i = 0; i < stripRows; i++) {
+                rows[i] = (JSAMPLE*)stripStorage.get() + i * srcRowBytes;
+            }
+
+            int y = 0;
+            while (y < bm->height()) {
+                int srcY = cinfo.output_scanline;
+                int row_count = jpeg_read_scanlines(&cinfo, rows, stripRows);
+                if (0 == row_count) {
+                    // if row_count == 0, then we didn't get a scanline,
+                    // so return early.  We will return a partial image.
+                    fill_below_level(y, bm);
+                    cinfo.output_scanline = cinfo.output_height;
+                    break;  // Skip to jpeg_finish_decompress()
+                }
+                if (this->shouldCancelDecode()) {
+                    return return_false(cinfo, *bm, "shouldCancelDecode");
+                }
+                for (int i = 0; i < row_count && y < bm->height(); i++) {
+                    if (srcY + i != sampler.srcY0() + y * sampler.srcDY()) {
+                        continue;
+                    }
+                    if (4 == bytesPerPixel) {
+                        sk_jpeg_sample_row_32(bm->getAddr32(0, y),
+                                              (const uint32_t*)rows[i] + srcX0,
+                                              bm->width(), sampleSize);
+                    } else {
+                        sk_jpeg_sample_row_16(bm->getAddr16(0, y),
+                                              (const uint16_t*)rows[i] + srcX0,
+                                              bm->width(), sampleSize);
+                    }
+                    y++;
+                }
+            }
+
+            // we formally skip the rest, so we don't get a complaint from libjpeg
+            while (cinfo.output_scanline < cinfo.output_height) {
+                if (0 == jpeg_read_scanlines(&cinfo, rows, stripRows)) {
+                    return return_false(cinfo, *bm, "skip rows");
+                }
             }
-            rowptr += bpr;
         }
         jpeg_finish_decompress(&cinfo);
         endtime = systemTime(SYSTEM_TIME_MONOTONIC);
@@ -669,7 +1137,7 @@ bool SkJPEGTurboImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode
         }
 
         if (JCS_CMYK == cinfo.out_color_space) {
-            convert_CMYK_to_RGB(srcRow, cinfo.output_width);
+            sk_jpeg_convert_CMYK_to_RGB(srcRow, cinfo.output_width);
         }
 
         sampler.next(srcRow);
@@ -703,6 +1171,21 @@ bool SkJPEGTurboImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode
 #ifdef SK_BUILD_FOR_ANDROID
 bool SkJPEGTurboImageDecoder::onBuildTileIndex(SkStreamRewindable* stream, int *width, int *height) {
 
+    // an index built before for the same data is reused. The data is read
+    // once, only if the cache is on, and compared with the cached copy
+    SkAutoTUnref<SkData> data;
+    bool borrowed = false;
+    uint64_t hash = 0;
+    const size_t maxDataSize = gHuffmanIndexCache.maxDataSize();
+    if (maxDataSize > 0) {
+        data.reset(stream_data(stream, maxDataSize, &borrowed));
+    }
+    if (data.get()) {
+        hash = hash_data(data.get());
+    }
+    SkAutoTUnref<SkJPEGTurboHuffmanIndex> cachedIndex(
+            data.get() ? gHuffmanIndexCache.find(hash, data.get()) : NULL);
+
     SkAutoTDelete<SkJPEGTurboImageIndex> imageIndex(SkNEW_ARGS(SkJPEGTurboImageIndex, (stream, this)));
     jpeg_decompress_struct* cinfo = imageIndex->cinfo();
 
@@ -715,17 +1198,25 @@ bool SkJPEGTurboImageDecoder::onBuildTileIndex(SkStreamRewindable* stream, int *
         return false;
     }
 
-    // create the cinfo used to create/build the huffmanIndex
-    if (!imageIndex->initializeInfoAndReadHeader()) {
-        return false;
-    }
+    if (cachedIndex.get()) {
+        imageIndex->setHuffmanIndex(cachedIndex.get());
+    } else {
+        // create the cinfo used to create/build the huffmanIndex
+        if (!imageIndex->initializeInfoAndReadHeader()) {
+            return false;
+        }
 
-    if (!imageIndex->buildHuffmanIndex()) {
-        return false;
-    }
+        if (!imageIndex->buildHuffmanIndex()) {
+            return false;
+        }
 
-    // destroy the cinfo used to create/build the huffman index
-    imageIndex->destroyInfo();
+        // destroy the cinfo used to create/build the huffman index
+        imageIndex->destroyInfo();
+
+        if (data.get()) {
+            gHuffmanIndexCache.add(hash, data.get(), borrowed, imageIndex->sharedHuffmanIndex());
+        }
+    }
 
     // Init decoder to image decode mode
     if (!imageIndex->initializeInfoAndReadHeader()) {
@@ -845,6 +1336,14 @@ bool SkJPEGTurboImageDecoder::onDecodeSubset(SkBitmap* bm, const SkIRect& region
         INT32 const bpr = bitmap.rowBytes();
         int rowTotalCount = 0;
 
+        // large regions are split in bands decoded concurrently
+        if (decode_tile_bands(this, fImageIndex, rect, startX, startY, width, height,
+                              actualSampleSize, &bitmap)) {
+            rowTotalCount = height;
+        } else if (this->shouldCancelDecode()) {
+            return return_false(*cinfo, bitmap, "shouldCancelDecode");
+        }
+
         while (rowTotalCount < height) {
             int rowCount = jpeg_read_tile_scanline(cinfo,
                                                    fImageIndex->huffmanIndex(),
@@ -907,7 +1406,7 @@ bool SkJPEGTurboImageDecoder::onDecodeSubset(SkBitmap* bm, const SkIRect& region
         }
 
         if (JCS_CMYK == cinfo->out_color_space) {
-            convert_CMYK_to_RGB(srcRow, width);
+            sk_jpeg_convert_CMYK_to_RGB(srcRow, width);
         }
 
         sampler.next(srcRow);
@@ -1097,24 +1596,144 @@ static WriteScanline ChooseWriter(const SkBitmap& bm) {
     }
 }
 
-bool SkJPEGTurboImageEncoder::onEncode(SkWStream* stream, const SkBitmap& bm, int quality) {
-#ifdef TIME_ENCODE
-    SkAutoTime atm("JPEG Encode");
+#ifdef WE_CONVERT_TO_YUV
+/*  Planar writers, for feeding libjpeg raw data. They fill full resolution
+    Y, U and V rows, the chroma is downsampled afterwards.
+ */
+typedef void (*WritePlanar)(uint8_t* SK_RESTRICT y, uint8_t* SK_RESTRICT u,
+                            uint8_t* SK_RESTRICT v, const void* SK_RESTRICT src,
+                            int width, const SkPMColor* SK_RESTRICT ctable);
+
+static void Write_16_Planar(uint8_t* SK_RESTRICT y, uint8_t* SK_RESTRICT u,
+                            uint8_t* SK_RESTRICT v, const void* SK_RESTRICT srcRow,
+                            int width, const SkPMColor*) {
+    const uint16_t* SK_RESTRICT src = (const uint16_t*)srcRow;
+    int x = 0;
+#ifdef __SSE2__
+    // same arithmetic as rgb2yuv_16, all terms fit in 16 bits
+    const __m128i rmask = _mm_set1_epi16(SK_R16_MASK);
+    const __m128i gmask = _mm_set1_epi16(SK_G16_MASK);
+    const __m128i bmask = _mm_set1_epi16(SK_B16_MASK);
+    const __m128i bias = _mm_set1_epi16(128);
+    for (; x + 8 <= width; x += 8) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i r = _mm_and_si128(_mm_srli_epi16(c, SK_R16_SHIFT), rmask);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(c, SK_G16_SHIFT), gmask);
+        __m128i b = _mm_and_si128(_mm_srli_epi16(c, SK_B16_SHIFT), bmask);
+
+        __m128i yy = _mm_add_epi16(_mm_add_epi16(
+                         _mm_mullo_epi16(r, _mm_set1_epi16(2*CYR)),
+                         _mm_mullo_epi16(g, _mm_set1_epi16(CYG))),
+                         _mm_mullo_epi16(b, _mm_set1_epi16(2*CYB)));
+        __m128i uu = _mm_add_epi16(_mm_add_epi16(
+                         _mm_mullo_epi16(r, _mm_set1_epi16(2*CUR)),
+                         _mm_mullo_epi16(g, _mm_set1_epi16(CUG))),
+                         _mm_mullo_epi16(b, _mm_set1_epi16(2*CUB)));
+        __m128i vv = _mm_add_epi16(_mm_add_epi16(
+                         _mm_mullo_epi16(r, _mm_set1_epi16(2*CVR)),
+                         _mm_mullo_epi16(g, _mm_set1_epi16(CVG))),
+                         _mm_mullo_epi16(b, _mm_set1_epi16(2*CVB)));
+        yy = _mm_srai_epi16(yy, CSHIFT - 2);
+        uu = _mm_add_epi16(_mm_srai_epi16(uu, CSHIFT - 2), bias);
+        vv = _mm_add_epi16(_mm_srai_epi16(vv, CSHIFT - 2), bias);
+
+        _mm_storel_epi64((__m128i*)(y + x), _mm_packus_epi16(yy, yy));
+        _mm_storel_epi64((__m128i*)(u + x), _mm_packus_epi16(uu, uu));
+        _mm_storel_epi64((__m128i*)(v + x), _mm_packus_epi16(vv, vv));
+    }
 #endif
-    nsecs_t starttime = systemTime(SYSTEM_TIME_MONOTONIC);
-    nsecs_t endtime;
+    for (; x < width; x++) {
+        uint8_t yuv[3];
+        rgb2yuv_16(yuv, src[x]);
+        y[x] = yuv[0];
+        u[x] = yuv[1];
+        v[x] = yuv[2];
+    }
+}
 
-    SkAutoLockPixels alp(bm);
-    if (NULL == bm.getPixels()) {
-        return false;
+static void Write_4444_Planar(uint8_t* SK_RESTRICT y, uint8_t* SK_RESTRICT u,
+                              uint8_t* SK_RESTRICT v, const void* SK_RESTRICT srcRow,
+                              int width, const SkPMColor*) {
+    const SkPMColor16* SK_RESTRICT src = (const SkPMColor16*)srcRow;
+    for (int x = 0; x < width; x++) {
+        uint8_t yuv[3];
+        rgb2yuv_4444(yuv, src[x]);
+        y[x] = yuv[0];
+        u[x] = yuv[1];
+        v[x] = yuv[2];
+    }
+}
+
+static void Write_Index_Planar(uint8_t* SK_RESTRICT y, uint8_t* SK_RESTRICT u,
+                               uint8_t* SK_RESTRICT v, const void* SK_RESTRICT srcRow,
+                               int width, const SkPMColor* SK_RESTRICT ctable) {
+    const uint8_t* SK_RESTRICT src = (const uint8_t*)srcRow;
+    for (int x = 0; x < width; x++) {
+        uint8_t yuv[3];
+        rgb2yuv_32(yuv, ctable[src[x]]);
+        y[x] = yuv[0];
+        u[x] = yuv[1];
+        v[x] = yuv[2];
     }
+}
+
+/*  8888 is not here, libjpeg-turbo converts JCS_EXT_RGBA with its own SIMD
+    code, which is what the row path feeds it.
+ */
+static WritePlanar ChoosePlanarWriter(const SkBitmap& bm) {
+    switch (bm.colorType()) {
+        case kRGB_565_SkColorType:
+            return Write_16_Planar;
+        case kARGB_4444_SkColorType:
+            return Write_4444_Planar;
+        case kIndex_8_SkColorType:
+            return Write_Index_Planar;
+        default:
+            return NULL;
+    }
+}
 
+// repeat the last sample of a row up to paddedWidth
+static void pad_row(uint8_t* row, int width, int paddedWidth) {
+    memset(row + width, row[width - 1], paddedWidth - width);
+}
+
+// 2x2 box filter two full resolution rows into width samples
+static void downsample_h2v2(uint8_t* SK_RESTRICT dst, const uint8_t* SK_RESTRICT row0,
+                            const uint8_t* SK_RESTRICT row1, int width) {
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i round = _mm_set1_epi16(2);
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row0 + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(row1 + 2 * x));
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8)),
+                                    _mm_add_epi16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8)));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(sum, sum));
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+    }
+}
+#endif
+
+// rows handed to libjpeg per call, one iMCU row with 2x2 subsampled chroma
+#define ENCODE_ROWS (2 * DCTSIZE)
+
+/**
+ *  Encode rows [top, top + height) of bm as a complete JPEG into stream.
+ */
+static bool encode_rows(const SkBitmap& bm, int top, int height, int quality,
+                        SkWStream* stream) {
     jpeg_compress_struct    cinfo;
     skjpeg_error_mgr        sk_err;
     skjpeg_destination_mgr  sk_wstream(stream);
 
     // allocate these before set call setjmp
-    SkAutoMalloc    oneRow;
+    SkAutoMalloc    storage;
     SkAutoLockColors ctLocker;
 
     cinfo.err = jpeg_std_error(&sk_err);
@@ -1128,18 +1747,22 @@ bool SkJPEGTurboImageEncoder::onEncode(SkWStream* stream, const SkBitmap& bm, in
     if (NULL == writer) {
         return false;
     }
+    const bool direct = (bm.config() == SkBitmap::kARGB_8888_Config);
+#ifdef WE_CONVERT_TO_YUV
+    WritePlanar planar = direct ? NULL : ChoosePlanarWriter(bm);
+#endif
 
     jpeg_create_compress(&cinfo);
     cinfo.dest = &sk_wstream;
     cinfo.image_width = bm.width();
-    cinfo.image_height = bm.height();
+    cinfo.image_height = height;
     cinfo.input_components = 3;
 #ifdef WE_CONVERT_TO_YUV
     cinfo.in_color_space = JCS_YCbCr;
 #else
     cinfo.in_color_space = JCS_RGB;
 #endif
-    if (bm.config() == SkBitmap::kARGB_8888_Config) {
+    if (direct) {
             cinfo.in_color_space = JCS_EXT_RGBA;
             cinfo.input_components = 4;
     }
@@ -1152,27 +1775,210 @@ bool SkJPEGTurboImageEncoder::onEncode(SkWStream* stream, const SkBitmap& bm, in
     cinfo.dct_method = JDCT_IFAST;
 #endif
 
+#ifdef WE_CONVERT_TO_YUV
+    // we downsample the chroma ourselves, libjpeg takes the planes as is
+    if (planar &&
+        2 == cinfo.comp_info[0].h_samp_factor && 2 == cinfo.comp_info[0].v_samp_factor &&
+        1 == cinfo.comp_info[1].h_samp_factor && 1 == cinfo.comp_info[1].v_samp_factor &&
+        1 == cinfo.comp_info[2].h_samp_factor && 1 == cinfo.comp_info[2].v_samp_factor) {
+        cinfo.raw_data_in = TRUE;
+    } else {
+        planar = NULL;
+    }
+#endif
+
     jpeg_start_compress(&cinfo, TRUE);
 
     const int       width = bm.width();
-    uint8_t*        oneRowP = (uint8_t*)oneRow.reset(width * 3);
-
+    const size_t    rowBytes = bm.rowBytes();
+    const char*     srcRows = (const char*)bm.getPixels() + top * rowBytes;
     const SkPMColor* colors = ctLocker.lockColors(bm);
-    const void*      srcRow = bm.getPixels();
 
-    while (cinfo.next_scanline < cinfo.image_height) {
-        JSAMPROW row_pointer[1];    /* pointer to JSAMPLE row[s] */
-        if (bm.config() == SkBitmap::kARGB_8888_Config)
-            oneRowP = (uint8_t *)srcRow;
-        else
-            writer(oneRowP, srcRow, width, colors);
-        row_pointer[0] = oneRowP;
-        (void) jpeg_write_scanlines(&cinfo, row_pointer, 1);
-        srcRow = (const void*)((const char*)srcRow + bm.rowBytes());
+#ifdef WE_CONVERT_TO_YUV
+    if (planar) {
+        const int cWidth = cinfo.comp_info[1].width_in_blocks * DCTSIZE;
+        const int yWidth = 2 * cWidth;
+        uint8_t* buf = (uint8_t*)storage.reset(ENCODE_ROWS * yWidth + ENCODE_ROWS * cWidth
+                                               + 4 * yWidth);
+        JSAMPROW yRows[ENCODE_ROWS];
+        JSAMPROW uRows[ENCODE_ROWS / 2];
+        JSAMPROW vRows[ENCODE_ROWS / 2];
+        JSAMPARRAY planes[3] = { yRows, uRows, vRows };
+        for (int i = 0; i < ENCODE_ROWS; i++) {
+            yRows[i] = buf;
+            buf += yWidth;
+        }
+        for (int i = 0; i < ENCODE_ROWS / 2; i++) {
+            uRows[i] = buf;
+            vRows[i] = buf + cWidth;
+            buf += 2 * cWidth;
+        }
+        // full resolution chroma of a row pair
+        uint8_t* fullU[2] = { buf, buf + yWidth };
+        uint8_t* fullV[2] = { buf + 2 * yWidth, buf + 3 * yWidth };
+
+        while (cinfo.next_scanline < cinfo.image_height) {
+            for (int i = 0; i < ENCODE_ROWS; i++) {
+                // rows past the bottom repeat the last one
+                int y = SkTMin<int>(cinfo.next_scanline + i, cinfo.image_height - 1);
+                int k = i & 1;
+                planar(yRows[i], fullU[k], fullV[k], srcRows + y * rowBytes, width, colors);
+                pad_row(yRows[i], width, yWidth);
+                pad_row(fullU[k], width, yWidth);
+                pad_row(fullV[k], width, yWidth);
+                if (k) {
+                    downsample_h2v2(uRows[i >> 1], fullU[0], fullU[1], cWidth);
+                    downsample_h2v2(vRows[i >> 1], fullV[0], fullV[1], cWidth);
+                }
+            }
+            (void) jpeg_write_raw_data(&cinfo, planes, ENCODE_ROWS);
+        }
+    } else
+#endif
+    {
+        JSAMPROW row_pointer[ENCODE_ROWS];    /* pointer to JSAMPLE row[s] */
+        uint8_t* strip = direct ? NULL : (uint8_t*)storage.reset(ENCODE_ROWS * width * 3);
+
+        while (cinfo.next_scanline < cinfo.image_height) {
+            int count = SkTMin<int>(ENCODE_ROWS, cinfo.image_height - cinfo.next_scanline);
+            for (int i = 0; i < count; i++) {
+                const void* srcRow = srcRows + (cinfo.next_scanline + i) * rowBytes;
+                if (direct) {
+                    row_pointer[i] = (JSAMPROW)srcRow;
+                } else {
+                    row_pointer[i] = strip + i * width * 3;
+                    writer(row_pointer[i], srcRow, width, colors);
+                }
+            }
+            (void) jpeg_write_scanlines(&cinfo, row_pointer, count);
+        }
     }
 
     jpeg_finish_compress(&cinfo);
     jpeg_destroy_compress(&cinfo);
+    return true;
+}
+
+#ifdef SK_BUILD_FOR_ANDROID
+#define ENCODE_MAX_THREADS 8
+// pictures with fewer pixels are always encoded on one thread
+#define ENCODE_PARALLEL_MIN_PIXELS (1024 * 1024)
+
+/**
+ *  Number of strips an encode is split in, from
+ *  skia.libjpegturbo.encode.threads. Off by default, since the output
+ *  then carries restart markers.
+ */
+static int get_encode_threads() {
+    char property[PROPERTY_VALUE_MAX];
+    int threads = 1;
+    if (property_get("skia.libjpegturbo.encode.threads", property, NULL) > 0) {
+        threads = atoi(property);
+    }
+    if (threads > ENCODE_MAX_THREADS) {
+        threads = ENCODE_MAX_THREADS;
+    }
+    return threads;
+}
+
+struct EncodeStrip {
+    const SkBitmap* bm;
+    int top;
+    int height;
+    int quality;
+    SkDynamicMemoryWStream stream;
+    bool ok;
+};
+
+static void* encode_strip_thread(void* arg) {
+    EncodeStrip* strip = (EncodeStrip*)arg;
+    strip->ok = encode_rows(*strip->bm, strip->top, strip->height, strip->quality,
+                            &strip->stream);
+    return NULL;
+}
+
+/**
+ *  Encode horizontal strips of bm on separate threads and stitch them
+ *  into one JPEG, see SkJPEGTurboStrips.h. Returns NULL if the picture
+ *  can't be split.
+ */
+static SkData* encode_strips(const SkBitmap& bm, int quality, int threads) {
+    const int height = bm.height();
+    int stripRows = 0, interval = 0;
+    const int stripCount = sk_jpeg_split_strips(bm.width(), height, threads,
+                                                &stripRows, &interval);
+    if (0 == stripCount) {
+        return NULL;
+    }
+
+    EncodeStrip strips[ENCODE_MAX_THREADS];
+    pthread_t tids[ENCODE_MAX_THREADS];
+    bool started[ENCODE_MAX_THREADS];
+    for (int i = 0; i < stripCount; i++) {
+        strips[i].bm = &bm;
+        strips[i].top = i * stripRows;
+        strips[i].height = SkTMin<int>(stripRows, height - strips[i].top);
+        strips[i].quality = quality;
+        strips[i].ok = false;
+    }
+    // the first strip is encoded on this thread
+    for (int i = 1; i < stripCount; i++) {
+        started[i] = (0 == pthread_create(&tids[i], NULL, encode_strip_thread, &strips[i]));
+        if (!started[i]) {
+            encode_strip_thread(&strips[i]);
+        }
+    }
+    encode_strip_thread(&strips[0]);
+    bool ok = strips[0].ok;
+    for (int i = 1; i < stripCount; i++) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        }
+        ok = ok && strips[i].ok;
+    }
+    if (!ok) {
+        return NULL;
+    }
+
+    SkDynamicMemoryWStream out;
+    for (int i = 0; i < stripCount; i++) {
+        SkAutoTUnref<SkData> data(strips[i].stream.detachAsData());
+        if (!sk_jpeg_append_strip(&out, i, data->bytes(), data->size(), height, interval)) {
+            return NULL;
+        }
+    }
+    sk_jpeg_end_strips(&out);
+    return out.detachAsData();
+}
+#endif
+
+bool SkJPEGTurboImageEncoder::onEncode(SkWStream* stream, const SkBitmap& bm, int quality) {
+#ifdef TIME_ENCODE
+    SkAutoTime atm("JPEG Encode");
+#endif
+    nsecs_t starttime = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t endtime;
+
+    SkAutoLockPixels alp(bm);
+    if (NULL == bm.getPixels()) {
+        return false;
+    }
+
+    bool ok = false;
+    bool encoded = false;
+#ifdef SK_BUILD_FOR_ANDROID
+    int threads = get_encode_threads();
+    if (threads > 1 && bm.width() * bm.height() >= ENCODE_PARALLEL_MIN_PIXELS) {
+        SkAutoTUnref<SkData> data(encode_strips(bm, quality, threads));
+        if (data.get()) {
+            ok = stream->write(data->data(), data->size());
+            encoded = true;
+        }
+    }
+#endif
+    if (!encoded) {
+        ok = encode_rows(bm, 0, bm.height(), quality, stream);
+    }
 
     endtime = systemTime(SYSTEM_TIME_MONOTONIC);
 #ifdef LOG_DECODE_TIME
@@ -1181,7 +1987,7 @@ bool SkJPEGTurboImageEncoder::onEncode(SkWStream* stream, const SkBitmap& bm, in
         bm.width(), bm.height());
 #endif
 
-    return true;
+    return ok;
 }
 
 
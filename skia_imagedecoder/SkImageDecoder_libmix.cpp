@@ -23,12 +23,18 @@
 //#define LOG_NDEBUG 0
 
 #include "SkImageDecoder_libmix.h"
+#include "SkJPEGMixCostModel.h"
 #include <va/va.h>
 #include <va/va_android.h>
 #include "va/va_dec_jpeg.h"
 #include "JPEGDecoder.h"
+#include "SkMallocPixelRef.h"
 #include <hardware/gralloc.h>
 #include <utils/Timers.h>
+#include <cutils/atomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 // this enables our rgb->yuv code, which is faster than libjpeg on ARM
 #define WE_CONVERT_TO_YUV
@@ -60,7 +66,24 @@ enum IMGDEC_INIT_STATUS {
     IMGDEC_INIT_STATUS_SUCCEEDED,
 };
 
-static IMGDEC_INIT_STATUS global_init_status = IMGDEC_INIT_STATUS_NOT_STARTED;
+// an IMGDEC_INIT_STATUS, only moves forward
+static volatile int32_t global_init_status = IMGDEC_INIT_STATUS_NOT_STARTED;
+// broadcast when global_init_status leaves IMGDEC_INIT_STATUS_IN_PROGRESS
+static Mutex init_lock;
+static Condition init_cond;
+// set by the one decode allowed to wait for the global init
+static volatile int32_t init_wait_claimed = 0;
+
+// default time the first decode waits for the global init, changed with
+// skia.libmix.init.wait.ms, 0 never waits
+#define GLOBAL_INIT_WAIT_MS_DEFAULT 200
+
+static void set_global_init_status(int32_t status)
+{
+    Mutex::Autolock autoLock(init_lock);
+    android_atomic_release_store(status, &global_init_status);
+    init_cond.broadcast();
+}
 
 // No need for global_uninitialize.
 // when the process is killed, the global VA resource is automatically released.
@@ -74,7 +97,6 @@ static void *global_initialize(void * args)
         int va_major_version, va_minor_version;
         VAStatus st;
         JpegDecodeStatus dst;
-        global_init_status = IMGDEC_INIT_STATUS_IN_PROGRESS;
         global_vadisplay = vaGetDisplay(&dpy);
         if (global_vadisplay == NULL)
             goto cleanup;
@@ -83,7 +105,7 @@ static void *global_initialize(void * args)
             goto cleanup;
         dst = JpegDecoder::preInit(global_vadisplay);
         if (dst == JD_SUCCESS) {
-            global_init_status = IMGDEC_INIT_STATUS_SUCCEEDED;
+            set_global_init_status(IMGDEC_INIT_STATUS_SUCCEEDED);
             ALOGI("Successfully initialized VA global resource");
         }
         else {
@@ -97,7 +119,7 @@ static void *global_initialize(void * args)
 cleanup:
     if (global_vadisplay != 0)
         vaTerminate(global_vadisplay);
-    global_init_status = IMGDEC_INIT_STATUS_FAILED;
+    set_global_init_status(IMGDEC_INIT_STATUS_FAILED);
     ALOGE("Failed initializing VA global resource");
     return NULL;
 }
@@ -114,29 +136,475 @@ static void init_render_target(RenderTarget &target, int width, int height, uint
     target.rect.height = target.height;
 }
 
+/* Decoder contexts are expensive to set up (VA context and surface), so
+ * they are leased from a process-wide pool instead of being created for
+ * every decode. A context is initialized for the aligned size and fourcc
+ * of its render target and can decode any picture with the same ones.
+ * Idle contexts are dropped after DECODER_POOL_IDLE_TIMEOUT, or least
+ * recently used first beyond DECODER_POOL_MAX_IDLE contexts or
+ * DECODER_POOL_MAX_IDLE_PIXELS pixels. Trimming happens on lease/release,
+ * and on a trimmer thread that runs while contexts are idle, so the last
+ * ones are dropped even if no decode follows.
+ */
+#define DECODER_POOL_MAX_IDLE 4
+#define DECODER_POOL_MAX_IDLE_PIXELS (4096 * 4096)
+#define DECODER_POOL_IDLE_TIMEOUT seconds(5)
+
+struct JpegDecoderContext {
+    JpegDecoder *decoder;
+    // the decoder is initialized with target if initialized is true
+    RenderTarget target;
+    bool initialized;
+    nsecs_t lastUse;
+
+    bool matches(uint32_t width, uint32_t height, uint32_t fourcc) const {
+        return initialized && target.width == (int)width
+            && target.height == (int)height && target.pixel_format == fourcc;
+    }
+};
+
+class JpegDecoderPool {
+public:
+    JpegDecoderPool()
+        : mIdlePixels(0), mTrimmerRunning(false),
+          mLeases(0), mHits(0), mMisses(0), mTrimmed(0) {}
+
+    // lease an idle context initialized for the given render target,
+    // returns NULL if there is none
+    JpegDecoderContext* lease(uint32_t width, uint32_t height, uint32_t fourcc);
+    // lease the most recently used idle context or a new one, for header parsing
+    JpegDecoderContext* leaseAny();
+    // return a context, a context that failed is destroyed
+    void release(JpegDecoderContext *ctx, bool reusable);
+    // prepare a leased context to decode into the given render target
+    JpegDecodeStatus prepare(JpegDecoderContext *ctx, uint32_t width, uint32_t height, uint32_t fourcc);
+
+    // destroy all idle contexts, e.g. on low memory
+    void purge();
+
+    void getStatistics(uint32_t *leases, uint32_t *hits, uint32_t *misses, uint32_t *trimmed);
+
+private:
+    static uint32_t pixels(const JpegDecoderContext *ctx) {
+        return ctx->initialized ? ctx->target.width * ctx->target.height : 0;
+    }
+    static void destroy(JpegDecoderContext *ctx);
+    // called with mLock held, contexts to drop are moved to victims and
+    // destroyed by the caller after unlocking
+    void trimLocked(nsecs_t now, android::Vector<JpegDecoderContext*> *victims);
+    static void destroyAll(const android::Vector<JpegDecoderContext*> &victims);
+    // called with mLock held, starts the trimmer thread unless it runs
+    void startTrimmerLocked();
+    static void *trimmerThread(void *arg);
+
+    Mutex mLock;
+    // idle contexts, the most recently used is at the end
+    android::Vector<JpegDecoderContext*> mIdle;
+    uint32_t mIdlePixels;
+    // signaled when the trimmer has to look at mIdle again
+    Condition mTrimCond;
+    bool mTrimmerRunning;
+    uint32_t mLeases;
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mTrimmed;
+};
+
+static JpegDecoderPool decoder_pool;
+
+void JpegDecoderPool::destroy(JpegDecoderContext *ctx)
+{
+    if (ctx->decoder) {
+        if (ctx->initialized)
+            ctx->decoder->deinit();
+        delete ctx->decoder;
+    }
+    delete ctx;
+}
+
+void JpegDecoderPool::destroyAll(const android::Vector<JpegDecoderContext*> &victims)
+{
+    for (size_t i = 0; i < victims.size(); i++)
+        destroy(victims[i]);
+}
+
+JpegDecoderContext* JpegDecoderPool::lease(uint32_t width, uint32_t height, uint32_t fourcc)
+{
+    Mutex::Autolock autoLock(mLock);
+    for (size_t i = mIdle.size(); i > 0; i--) {
+        JpegDecoderContext *ctx = mIdle[i - 1];
+        if (ctx->matches(width, height, fourcc)) {
+            mIdle.removeAt(i - 1);
+            mIdlePixels -= pixels(ctx);
+            return ctx;
+        }
+    }
+    return NULL;
+}
+
+JpegDecoderContext* JpegDecoderPool::leaseAny()
+{
+    android::Vector<JpegDecoderContext*> victims;
+    JpegDecoderContext *ctx = NULL;
+    {
+        Mutex::Autolock autoLock(mLock);
+        mLeases++;
+        trimLocked(systemTime(SYSTEM_TIME_MONOTONIC), &victims);
+        if (!mIdle.isEmpty()) {
+            ctx = mIdle.top();
+            mIdle.pop();
+            mIdlePixels -= pixels(ctx);
+        }
+    }
+    destroyAll(victims);
+    if (ctx)
+        return ctx;
+
+    ctx = new JpegDecoderContext;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->decoder = new JpegDecoder(global_vadisplay,
+        VA_INVALID_ID, VA_INVALID_ID, true);
+    if (!ctx->decoder) {
+        delete ctx;
+        return NULL;
+    }
+    return ctx;
+}
+
+JpegDecodeStatus JpegDecoderPool::prepare(JpegDecoderContext *ctx,
+        uint32_t width, uint32_t height, uint32_t fourcc)
+{
+    bool hit = ctx->matches(width, height, fourcc);
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (hit)
+            mHits++;
+        else
+            mMisses++;
+    }
+    if (hit)
+        return JD_SUCCESS;
+
+    if (ctx->initialized) {
+        ctx->decoder->deinit();
+        ctx->initialized = false;
+    }
+
+    init_render_target(ctx->target, width, height, fourcc);
+    // the context covers every picture of this aligned size
+    RenderTarget *targets = &ctx->target;
+    JpegDecodeStatus st = ctx->decoder->init(ctx->target.width, ctx->target.height, &targets, 1);
+    ctx->initialized = (st == JD_SUCCESS);
+    return st;
+}
+
+void JpegDecoderPool::release(JpegDecoderContext *ctx, bool reusable)
+{
+    if (ctx == NULL)
+        return;
+
+    // contexts too big to keep idle are not pooled at all
+    if (!reusable || pixels(ctx) > DECODER_POOL_MAX_IDLE_PIXELS) {
+        destroy(ctx);
+        return;
+    }
+
+    android::Vector<JpegDecoderContext*> victims;
+    {
+        Mutex::Autolock autoLock(mLock);
+        ctx->lastUse = systemTime(SYSTEM_TIME_MONOTONIC);
+        mIdle.push(ctx);
+        mIdlePixels += pixels(ctx);
+        trimLocked(ctx->lastUse, &victims);
+        if (!mIdle.isEmpty())
+            startTrimmerLocked();
+    }
+    destroyAll(victims);
+}
+
+void JpegDecoderPool::purge()
+{
+    android::Vector<JpegDecoderContext*> victims;
+    {
+        Mutex::Autolock autoLock(mLock);
+        mTrimmed += mIdle.size();
+        victims.appendVector(mIdle);
+        mIdle.clear();
+        mIdlePixels = 0;
+        // let the trimmer exit now rather than at its deadline
+        mTrimCond.signal();
+    }
+    destroyAll(victims);
+}
+
+void JpegDecoderPool::startTrimmerLocked()
+{
+    if (mTrimmerRunning)
+        return;
+
+    pthread_t trimmer;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&trimmer, &attr, trimmerThread, this);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        // idle contexts are still trimmed on the next lease/release
+        ALOGW("%s failed to start decoder pool trimmer: %d", __func__, err);
+        return;
+    }
+    mTrimmerRunning = true;
+}
+
+// sleeps until the oldest idle context expires, exits once none is idle
+void *JpegDecoderPool::trimmerThread(void *arg)
+{
+    JpegDecoderPool *pool = (JpegDecoderPool*)arg;
+    android::Vector<JpegDecoderContext*> victims;
+
+    pool->mLock.lock();
+    while (!pool->mIdle.isEmpty()) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        pool->trimLocked(now, &victims);
+        if (!victims.isEmpty()) {
+            pool->mLock.unlock();
+            destroyAll(victims);
+            victims.clear();
+            pool->mLock.lock();
+            continue;
+        }
+        pool->mTrimCond.waitRelative(pool->mLock,
+            pool->mIdle[0]->lastUse + DECODER_POOL_IDLE_TIMEOUT - now);
+    }
+    pool->mTrimmerRunning = false;
+    pool->mLock.unlock();
+    return NULL;
+}
+
+void JpegDecoderPool::trimLocked(nsecs_t now, android::Vector<JpegDecoderContext*> *victims)
+{
+    while (!mIdle.isEmpty()) {
+        JpegDecoderContext *oldest = mIdle[0];
+        if (mIdle.size() <= DECODER_POOL_MAX_IDLE
+                && mIdlePixels <= DECODER_POOL_MAX_IDLE_PIXELS
+                && now - oldest->lastUse < DECODER_POOL_IDLE_TIMEOUT)
+            break;
+        mIdle.removeAt(0);
+        mIdlePixels -= pixels(oldest);
+        mTrimmed++;
+        victims->push(oldest);
+    }
+}
+
+void JpegDecoderPool::getStatistics(uint32_t *leases, uint32_t *hits,
+        uint32_t *misses, uint32_t *trimmed)
+{
+    Mutex::Autolock autoLock(mLock);
+    *leases = mLeases;
+    *hits = mHits;
+    *misses = mMisses;
+    *trimmed = mTrimmed;
+}
+
+/* Chooses libmix or libjpeg-turbo for a picture from the cost models in
+ * SkJPEGMixCostModel.h. The predicted HW cost grows with the HW decodes
+ * in flight, the SW cost with the CPU load. Every
+ * DISPATCH_EXPLORE_INTERVAL decisions a close loser is picked anyway.
+ */
+class JpegDispatcher {
+public:
+    JpegDispatcher();
+
+    // pick the decoder for a picture of the given size
+    JpegDecoderType choose(uint32_t pixels, int sampleSize);
+    // feed back the time a decode took
+    void record(JpegDecoderType type, uint32_t pixels, int sampleSize, nsecs_t time);
+
+    // HW decodes in flight
+    void hwStarted() { android_atomic_inc(&mHwInFlight); }
+    void hwFinished() { android_atomic_dec(&mHwInFlight); }
+
+private:
+    static int sampleIndex(int sampleSize);
+    // 1 minute load average per CPU, read at most once a second
+    double cpuLoad();
+
+    Mutex mLock;
+    JpegCostModel mModels[JPEG_DECODER_TYPES][DISPATCH_SAMPLE_SIZES];
+    uint32_t mDecisions;
+    volatile int32_t mHwInFlight;
+    double mCpuLoad;
+    nsecs_t mCpuLoadTime;
+};
+
+static JpegDispatcher decoder_dispatcher;
+
+JpegDispatcher::JpegDispatcher()
+    : mDecisions(0), mHwInFlight(0), mCpuLoad(0), mCpuLoadTime(0)
+{
+    for (int i = 0; i < DISPATCH_SAMPLE_SIZES; i++) {
+        mModels[JPEG_DECODER_HW][i].seed(DISPATCH_SEED_HW_FIXED, DISPATCH_SEED_HW_RATE);
+        mModels[JPEG_DECODER_SW][i].seed(0, DISPATCH_SEED_SW_RATE);
+    }
+}
+
+int JpegDispatcher::sampleIndex(int sampleSize)
+{
+    switch (sampleSize) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    default: return 3;
+    }
+}
+
+double JpegDispatcher::cpuLoad()
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (mCpuLoadTime != 0 && now - mCpuLoadTime < seconds(1))
+        return mCpuLoad;
+    mCpuLoadTime = now;
+
+    FILE *f = fopen("/proc/loadavg", "r");
+    if (f) {
+        double load;
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (fscanf(f, "%lf", &load) == 1 && cpus > 0)
+            mCpuLoad = load / cpus;
+        fclose(f);
+    }
+    return mCpuLoad;
+}
+
+JpegDecoderType JpegDispatcher::choose(uint32_t pixels, int sampleSize)
+{
+    Mutex::Autolock autoLock(mLock);
+    int index = sampleIndex(sampleSize);
+    double x = pixels / 1000000.0;
+    double load = cpuLoad();
+
+    double hw = mModels[JPEG_DECODER_HW][index].predict(x)
+        * (1 + android_atomic_acquire_load(&mHwInFlight));
+    double sw = mModels[JPEG_DECODER_SW][index].predict(x)
+        * ((load > 1.0) ? load : 1.0);
+
+    JpegDecoderType type = jpeg_pick_decoder(hw, sw,
+        ++mDecisions % DISPATCH_EXPLORE_INTERVAL == 0);
+
+    ALOGV("%s %.2fMP (%dx downscale): HW %.2fms, SW %.2fms, load %.2f -> %s",
+        __func__, x, sampleSize, hw, sw, load,
+        (type == JPEG_DECODER_HW) ? "HW" : "SW");
+    return type;
+}
+
+void JpegDispatcher::record(JpegDecoderType type, uint32_t pixels,
+        int sampleSize, nsecs_t time)
+{
+    Mutex::Autolock autoLock(mLock);
+    mModels[type][sampleIndex(sampleSize)].add(pixels / 1000000.0, time / 1000000.0);
+}
+
+// stream chunks grow from MIN_READ_CHUNK to MAX_READ_CHUNK bytes
+#define MIN_READ_CHUNK (16 * 1024)
+#define MAX_READ_CHUNK (1024 * 1024)
+
+// Make the rest of the stream available to the parser in one buffer.
+// A memory backed stream is parsed in place, anything else is read into
+// inputvec, which is sized up front when the stream length is known.
+// Returns false if the stream is empty or decoding was canceled.
+bool SkJPEGMixImageDecoder::readInput(SkStream* stream, JpegInfo *jinfo,
+        android::Vector<uint8_t> *inputvec) {
+    size_t offset = stream->hasPosition() ? stream->getPosition() : 0;
+    size_t expected = 0;
+    if (stream->hasLength() && stream->getLength() > offset)
+        expected = stream->getLength() - offset;
+
+    const void *base = stream->getMemoryBase();
+    if (base != NULL && expected > 0) {
+        jinfo->use_vector_input = false;
+        jinfo->buf = (uint8_t*)base + offset;
+        jinfo->bufsize = expected;
+        ALOGV("%s parse %u bytes from memory stream", __func__, expected);
+        return true;
+    }
+
+    inputvec->clear();
+    if (expected > 0)
+        inputvec->setCapacity(expected);
+
+    size_t total = 0;
+    size_t chunk = MIN_READ_CHUNK;
+    for (;;) {
+        // stay inside the preallocated buffer until the expected length
+        size_t want = chunk;
+        if (expected > total && expected - total < want)
+            want = expected - total;
+        inputvec->resize(total + want);
+        size_t bytes = stream->read(inputvec->editArray() + total, want);
+        total += bytes;
+        if (bytes == 0 || stream->isAtEnd())
+            break;
+        if (this->shouldCancelDecode()) {
+            inputvec->clear();
+            return false;
+        }
+        if (chunk < MAX_READ_CHUNK)
+            chunk <<= 1;
+    }
+    inputvec->resize(total);
+
+    jinfo->use_vector_input = true;
+    jinfo->inputs = inputvec;
+    ALOGV("%s read %u bytes from stream", __func__, total);
+    return total > 0;
+}
+
+/* The blitter writes RGBA rows with the stride of the aligned output
+ * width into a page aligned buffer of aligned_outw * aligned_outh pixels.
+ */
+#define BLIT_ALIGNMENT 0x1000
+
+// whether the blitter can write straight into the allocated bitmap pixels
+static bool can_blit_to(const SkBitmap *bm, uint32_t aligned_outw, uint32_t aligned_outh)
+{
+    return bm->getPixels() != NULL
+        && ((uintptr_t)bm->getPixels() & (BLIT_ALIGNMENT - 1)) == 0
+        && bm->rowBytes() == aligned_outw * 4
+        && bm->getSize() >= aligned_outw * aligned_outh * 4;
+}
+
+static void free_blit_pixels(void *addr, void *context)
+{
+    free(addr);
+}
+
 //#define DUMP_RGBA
 //#define DUMP_DECODE
 #define LOG_DECODE_TIME
-#define MIN_PIXEL (1000 * 1000)
 #define MAX_PIXEL (6000 * 6000)
 bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode) {
-#define BUFSIZE 1024
     int i;
     bool ret;
     JpegInfo jinfo;
     android::Vector<uint8_t> inputvec;
-    static char tmpbuf[BUFSIZE];
+    bool inputRead = false;
     JpegDecodeStatus st;
-    RenderTarget decbuf, blitbuf;
+    RenderTarget blitbuf;
     uint32_t outw, outh, aligned_outw, aligned_outh;
     BlitEvent blit_event;
+    // staging buffer, or the pixels themselves when wrapPixels is set
     uint8_t *rgba_out = NULL;
+    // where the blitter writes, rgba_out or the bitmap pixels
+    uint8_t *blit_out = NULL;
+    // without a client allocator the blit buffer becomes the pixel ref
+    bool wrapPixels = (this->getAllocator() == NULL);
+    SkMallocPixelRef *pixelref = NULL;
     SkStream *newstream = NULL;
-    size_t bytes;
     INT32 bpr;
     uint8_t *rowptr = NULL;
-    RenderTarget *targets = NULL;
     int sampleSize;
+    // cleared while the leased context may be left in a bad state
+    bool reusable = true;
 #if defined(DUMP_RGBA) || defined(DUMP_DECODE)
     char fn[128];
     FILE *fdump = NULL;
@@ -146,10 +614,11 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
 #endif
     nsecs_t starttime = systemTime(SYSTEM_TIME_MONOTONIC);
     nsecs_t fallbacktime, endtime;
+    // set when the dispatcher picked the decoder, so its time is recorded
+    nsecs_t dispatchtime = 0;
+    JpegDecoderType dispatched = JPEG_DECODER_TYPES;
 
     memset(&jinfo, 0, sizeof(jinfo));
-    jinfo.use_vector_input = true;
-    jinfo.inputs = &inputvec;
     jinfo.need_header_only = true;
 #ifdef TIME_DECODE
     SkAutoTime atm("JPEG Decode");
@@ -169,28 +638,30 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
         goto fallback;
     }
 
-    mDecoder = new JpegDecoder(global_vadisplay,
-        VA_INVALID_ID, VA_INVALID_ID, true);
-    if (!mDecoder) {
+    // any context can parse the header
+    mContext = decoder_pool.leaseAny();
+    if (!mContext) {
         ALOGE("%s failed to new JpegDecoder", __func__);
         goto fallback;
     }
+    mDecoder = mContext->decoder;
 
-    jinfo.inputs->clear();
-
-    do {
-        bytes = stream->read(tmpbuf, BUFSIZE);
-        if (bytes == 0) {
-            ALOGV("%s unexpected EOF, fallback", __func__);
-            goto fallback;
-        }
-        jinfo.inputs->appendArray((const uint8_t*)tmpbuf, bytes);
-        st = mDecoder->parse(jinfo);
+    inputRead = true;
+    if (!readInput(stream, &jinfo, &inputvec)) {
         if (this->shouldCancelDecode()) {
             ALOGV("%s decoding canceled", __func__);
             goto return_false;
         }
-    } while (st == JD_INSUFFICIENT_BYTE);
+        ALOGV("%s unexpected EOF, fallback", __func__);
+        goto fallback;
+    }
+
+    // the whole file is available, so the header is parsed only once
+    st = mDecoder->parse(jinfo);
+    if (this->shouldCancelDecode()) {
+        ALOGV("%s decoding canceled", __func__);
+        goto return_false;
+    }
 
     switch (st) {
     case JD_SUCCESS:
@@ -200,48 +671,53 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
         goto fallback;
     }
 
-    // fall back to SW for small pictures to decode faster
-    if (jinfo.image_height * jinfo.image_width < MIN_PIXEL) {
-        ALOGV("%s JPEG resolution %ux%u too small, fallback",
+    // fall back to SW for big pictures to reduce memory footprint
+    if (jinfo.image_height * jinfo.image_width > MAX_PIXEL) {
+        ALOGV("%s JPEG resolution %ux%u too big, fallback",
             __func__, jinfo.image_width, jinfo.image_height);
         goto fallback;
     }
 
-    // fall back to SW for big pictures to reduce memory footprint
-    if (jinfo.image_height * jinfo.image_width > MAX_PIXEL) {
-        ALOGV("%s JPEG resolution %ux%u too big, fallback",
+    dispatchtime = systemTime(SYSTEM_TIME_MONOTONIC);
+    dispatched = decoder_dispatcher.choose(jinfo.image_width * jinfo.image_height, sampleSize);
+    if (dispatched == JPEG_DECODER_SW) {
+        ALOGV("%s JPEG resolution %ux%u is cheaper in SW, fallback",
             __func__, jinfo.image_width, jinfo.image_height);
         goto fallback;
     }
+    decoder_dispatcher.hwStarted();
 
     outw = jinfo.image_width / sampleSize;
     outh = jinfo.image_height / sampleSize;
     aligned_outw = aligned_width(outw, SURF_TILING_Y);
     aligned_outh = aligned_width(outh, SURF_TILING_Y);
     bm->setInfo(SkImageInfo::Make(outw, outh,
-                                  kN32_SkColorType, kOpaque_SkAlphaType));
-    do {
-        bytes = stream->read(tmpbuf, BUFSIZE);
-        jinfo.inputs->appendArray((const uint8_t*)tmpbuf, bytes);
-        if (this->shouldCancelDecode()) {
-            ALOGV("%s decoding canceled", __func__);
-            goto return_false;
-        }
-    } while (bytes > 0 && !stream->isAtEnd());
-
-    ALOGV("%s Got all data from JPEG file: %d bytes", __func__,
-        jinfo.inputs->size());
-
-    init_render_target(decbuf, jinfo.image_width, jinfo.image_height,
-        jinfo.image_color_fourcc);
+                                  kN32_SkColorType, kOpaque_SkAlphaType),
+                wrapPixels ? aligned_outw * 4 : 0);
 
     if (this->shouldCancelDecode()) {
         ALOGV("%s decoding canceled", __func__);
         goto return_false;
     }
 
-    targets = &decbuf;
-    st = mDecoder->init(jinfo.image_width, jinfo.image_height, &targets, 1);
+    {
+        // switch to an idle context set up for this size if the one that
+        // parsed the header is not
+        uint32_t targetw = aligned_width(jinfo.image_width, SURF_TILING_Y);
+        uint32_t targeth = aligned_width(jinfo.image_height, SURF_TILING_Y);
+        if (!mContext->matches(targetw, targeth, jinfo.image_color_fourcc)) {
+            JpegDecoderContext *ctx = decoder_pool.lease(targetw, targeth,
+                jinfo.image_color_fourcc);
+            if (ctx) {
+                decoder_pool.release(mContext, true);
+                mContext = ctx;
+                mDecoder = mContext->decoder;
+            }
+        }
+
+        reusable = false;
+        st = decoder_pool.prepare(mContext, targetw, targeth, jinfo.image_color_fourcc);
+    }
     if (st != JD_SUCCESS) {
         ALOGE("%s libmix init returns %d, fallback", __func__, st);
         goto fallback;
@@ -253,7 +729,7 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
         ALOGE("%s libmix full parse returns %d, fallback", __func__, st);
         goto fallback;
     }
-    st = mDecoder->decode(jinfo, decbuf);
+    st = mDecoder->decode(jinfo, mContext->target);
     if (st != JD_SUCCESS) {
         ALOGE("%s libmix decode returns %d, fallback", __func__, st);
         goto fallback;
@@ -261,15 +737,34 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
 
     ALOGV("%s successfully decoded JPEG", __func__);
 
-    rgba_out = (uint8_t*)memalign(0x1000,
-            aligned_outw * aligned_outh * 4);
+    if (!wrapPixels) {
+        if (this->shouldCancelDecode()) {
+            ALOGV("%s decoding canceled", __func__);
+            goto return_false;
+        }
 
-    if (!rgba_out) {
-        ALOGE("%s failed to allocate RGBA buf, fallback", __func__);
-        goto fallback;
+        if (!this->allocPixelRef(bm, NULL)) {
+            ALOGE("%s failed to allocPixelRef", __func__);
+            goto return_false;
+        }
+
+        if (can_blit_to(bm, aligned_outw, aligned_outh))
+            blit_out = (uint8_t*)bm->getPixels();
     }
 
-    st = mDecoder->blitToLinearRgba(decbuf, rgba_out,
+    // stage the blit if it can't go to the bitmap pixels directly
+    if (!blit_out) {
+        rgba_out = (uint8_t*)memalign(BLIT_ALIGNMENT,
+                aligned_outw * aligned_outh * 4);
+
+        if (!rgba_out) {
+            ALOGE("%s failed to allocate RGBA buf, fallback", __func__);
+            goto fallback;
+        }
+        blit_out = rgba_out;
+    }
+
+    st = mDecoder->blitToLinearRgba(mContext->target, blit_out,
         jinfo.image_width, jinfo.image_height,
         blit_event, sampleSize);
 
@@ -277,11 +772,12 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
         ALOGE("%s blit returns %d, fallback", __func__, st);
         goto fallback;
     }
+    reusable = true;
 
     ALOGV("%s successfully blitted JPEG to RGBA8888", __func__);
 
 #ifdef DUMP_DECODE
-    maphandle = mDecoder->mapData(decbuf, (void**)&mapaddr, mapoffsets, mappitches);
+    maphandle = mDecoder->mapData(mContext->target, (void**)&mapaddr, mapoffsets, mappitches);
     sprintf(fn, "/sdcard/%ux%u.%s", mappitches[0], jinfo.image_height,
         fourcc2str(jinfo.image_color_fourcc));
     fdump = fopen(fn, "wb+");
@@ -292,14 +788,14 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
         fclose(fdump);
     }
     else abort();
-    mDecoder->unmapData(decbuf, maphandle);
+    mDecoder->unmapData(mContext->target, maphandle);
 #endif
 
 #ifdef DUMP_DECODE
     sprintf(fn, "/sdcard/%ux%u.rgba", aligned_outw, aligned_outh);
     fdump = fopen(fn, "wb+");
     if (fdump) {
-        fwrite(rgba_out, aligned_outw * aligned_outh * 4, 1, fdump);
+        fwrite(blit_out, aligned_outw * aligned_outh * 4, 1, fdump);
         fclose(fdump);
     }
     else abort();
@@ -310,60 +806,78 @@ bool SkJPEGMixImageDecoder::onDecode(SkStream* stream, SkBitmap* bm, Mode mode)
         goto return_false;
     }
 
-    if (!this->allocPixelRef(bm, NULL)) {
-        ALOGE("%s failed to allocPixelRef", __func__);
-        goto return_false;
-    }
-
-    //SkAutoLockPixels alp(*bm);
-    bpr =  bm->rowBytes();
-    rowptr = (uint8_t*)bm->getPixels();
-
-    for (i = 0; i < outh; ++i) {
-        memcpy(rowptr, rgba_out + i * aligned_outw * 4,
-            bpr);
-        rowptr += bpr;
-        if (this->shouldCancelDecode()) {
-            ALOGV("%s decoding canceled", __func__);
+    if (wrapPixels) {
+        pixelref = SkMallocPixelRef::NewWithProc(bm->info(), bm->rowBytes(),
+            NULL, rgba_out, free_blit_pixels, NULL);
+        if (!pixelref) {
+            ALOGE("%s failed to create pixel ref", __func__);
             goto return_false;
         }
+        // owned by the pixel ref now
+        rgba_out = NULL;
+        bm->setPixelRef(pixelref)->unref();
+        bm->lockPixels();
+    } else if (rgba_out) {
+        //SkAutoLockPixels alp(*bm);
+        bpr =  bm->rowBytes();
+        rowptr = (uint8_t*)bm->getPixels();
+
+        for (i = 0; i < outh; ++i) {
+            memcpy(rowptr, rgba_out + i * aligned_outw * 4,
+                outw * 4);
+            rowptr += bpr;
+            if (this->shouldCancelDecode()) {
+                ALOGV("%s decoding canceled", __func__);
+                goto return_false;
+            }
+        }
     }
-    mDecoder->deinit();
-    delete mDecoder;
+    decoder_pool.release(mContext, true);
+    mContext = NULL;
     mDecoder = NULL;
-    free(rgba_out);
+    if (rgba_out)
+        free(rgba_out);
     endtime = systemTime(SYSTEM_TIME_MONOTONIC);
+    decoder_dispatcher.hwFinished();
+    decoder_dispatcher.record(JPEG_DECODER_HW, jinfo.image_width * jinfo.image_height,
+        sampleSize, endtime - dispatchtime);
 #ifdef LOG_DECODE_TIME
-    ALOGD("mixImageDecoder took %.2fms to decode %ux%u (%dx downscale) "
-        "with HW+GPU", (endtime - starttime)/1000000.0,
-        jinfo.image_width, jinfo.image_height, sampleSize);
+    {
+        uint32_t leases, hits, misses, trimmed;
+        decoder_pool.getStatistics(&leases, &hits, &misses, &trimmed);
+        ALOGD("mixImageDecoder took %.2fms to decode %ux%u (%dx downscale) "
+            "with HW+GPU, decoder pool %u leases, %u hits, %u misses, %u trimmed",
+            (endtime - starttime)/1000000.0,
+            jinfo.image_width, jinfo.image_height, sampleSize,
+            leases, hits, misses, trimmed);
+    }
 #endif
     return true;
 
 fallback:
     fallbacktime = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (dispatched == JPEG_DECODER_HW)
+        decoder_dispatcher.hwFinished();
     if (rgba_out)
         free(rgba_out);
-    if (mDecoder) {
-        mDecoder->deinit();
-        delete mDecoder;
-    }
+    decoder_pool.release(mContext, reusable);
+    mContext = NULL;
     mDecoder = NULL;
 
     if (!stream->rewind()) {
         ALOGV("%s failed to rewind stream for falling back, use work around", __func__);
-        // drain the stream and create a new stream
-        do {
-            bytes = stream->read(tmpbuf, BUFSIZE);
-            jinfo.inputs->appendArray((const uint8_t*)tmpbuf, bytes);
-            if (this->shouldCancelDecode()) {
-                ALOGV("%s decoding canceled", __func__);
-                goto return_false;
-            }
-        } while (bytes > 0 && !stream->isAtEnd());
+        // decode from the data read for HW, or drain the stream now
+        if (!inputRead && !readInput(stream, &jinfo, &inputvec)
+                && this->shouldCancelDecode()) {
+            ALOGV("%s decoding canceled", __func__);
+            goto return_false;
+        }
 
         // FIXME: remove this dirty work around...
-        newstream = new SkMemoryStream(jinfo.inputs->array(), jinfo.inputs->size(), false);
+        if (jinfo.use_vector_input)
+            newstream = new SkMemoryStream(inputvec.array(), inputvec.size(), false);
+        else
+            newstream = new SkMemoryStream(jinfo.buf, jinfo.bufsize, false);
         ret = SkJPEGTurboImageDecoder::onDecode(newstream, bm, mode);
         delete newstream;
     }
@@ -372,16 +886,19 @@ fallback:
     endtime = systemTime(SYSTEM_TIME_MONOTONIC);
     if (!ret)
         ALOGE("%s failed to decode with fallback", __func__);
+    else if (dispatched == JPEG_DECODER_SW)
+        decoder_dispatcher.record(JPEG_DECODER_SW, jinfo.image_width * jinfo.image_height,
+            sampleSize, endtime - fallbacktime);
 
     return ret;
 
 return_false:
+    if (dispatched == JPEG_DECODER_HW)
+        decoder_dispatcher.hwFinished();
     if (rgba_out)
         free(rgba_out);
-    if (mDecoder) {
-        mDecoder->deinit();
-        delete mDecoder;
-    }
+    decoder_pool.release(mContext, reusable);
+    mContext = NULL;
     mDecoder = NULL;
     endtime = systemTime(SYSTEM_TIME_MONOTONIC);
     return false;
@@ -446,31 +963,96 @@ static bool is_jpeg(SkStreamRewindable* stream) {
     return true;
 }
 
-static inline bool check_libmix_global_init() {
-    static pthread_t init_thread;
-    int err;
-
+static bool libmix_disabled()
+{
 #ifndef BAYTRAIL
-    return false;
-#endif
-
-    static char property[PROPERTY_VALUE_MAX];
+    return true;
+#else
+    char property[PROPERTY_VALUE_MAX];
     if (property_get("skia.libmix.disabled", property, NULL) > 0) {
         if (strcmp(property, "1") == 0) {
-            return false;
+            return true;
         }
     }
+    return false;
+#endif
+}
 
-    switch (global_init_status) {
-    case IMGDEC_INIT_STATUS_NOT_STARTED:
-        err = pthread_create(&init_thread, NULL, global_initialize, NULL);
-        if (err) {
-            global_init_status = IMGDEC_INIT_STATUS_FAILED;
-            ALOGE("%s Failed to start global init thread: %d (%s)",
-                __FUNCTION__, err, strerror(err));
-        }
-        ALOGV("%s started global init thread", __func__);
+// start the global init thread, only the first caller does
+static void start_global_init()
+{
+    if (android_atomic_acquire_cas(IMGDEC_INIT_STATUS_NOT_STARTED,
+            IMGDEC_INIT_STATUS_IN_PROGRESS, &global_init_status) != 0)
+        return;
+
+    pthread_t init_thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&init_thread, &attr, global_initialize, NULL);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        ALOGE("%s Failed to start global init thread: %d (%s)",
+            __FUNCTION__, err, strerror(err));
+        set_global_init_status(IMGDEC_INIT_STATUS_FAILED);
+        return;
+    }
+    ALOGV("%s started global init thread", __func__);
+}
+
+// wait until the global init is done or timeout passed, returns the status
+static int32_t wait_global_init(nsecs_t timeout)
+{
+    nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + timeout;
+    int32_t status;
+
+    Mutex::Autolock autoLock(init_lock);
+    while ((status = android_atomic_acquire_load(&global_init_status)) ==
+            IMGDEC_INIT_STATUS_IN_PROGRESS) {
+        nsecs_t left = deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+        if (left <= 0)
+            break;
+        init_cond.waitRelative(init_lock, left);
+    }
+    return status;
+}
+
+static nsecs_t global_init_wait_time()
+{
+    char property[PROPERTY_VALUE_MAX];
+    int ms = GLOBAL_INIT_WAIT_MS_DEFAULT;
+    if (property_get("skia.libmix.init.wait.ms", property, NULL) > 0)
+        ms = atoi(property);
+    return (ms > 0) ? milliseconds(ms) : 0;
+}
+
+/* The first JPEG decode of the process starts the global init and waits a
+ * bounded time for it, so cold start decodes are not all SW. Only that one
+ * decode ever waits, the others fall back to SW until the init is done.
+ */
+static inline bool check_libmix_global_init() {
+    if (libmix_disabled())
         return false;
+
+    int32_t status = android_atomic_acquire_load(&global_init_status);
+    if (status == IMGDEC_INIT_STATUS_SUCCEEDED)
+        return true;
+
+    if (status == IMGDEC_INIT_STATUS_NOT_STARTED)
+        start_global_init();
+
+    if (status != IMGDEC_INIT_STATUS_FAILED &&
+            android_atomic_cmpxchg(0, 1, &init_wait_claimed) == 0) {
+        nsecs_t timeout = global_init_wait_time();
+        if (timeout > 0) {
+            status = wait_global_init(timeout);
+            if (status == IMGDEC_INIT_STATUS_IN_PROGRESS)
+                ALOGW("%s global init still in progress, fallback", __func__);
+        }
+    }
+    status = android_atomic_acquire_load(&global_init_status);
+
+    switch (status) {
     case IMGDEC_INIT_STATUS_IN_PROGRESS:
         return false;
     case IMGDEC_INIT_STATUS_FAILED:
@@ -480,20 +1062,156 @@ static inline bool check_libmix_global_init() {
         return true;
     default:
         ALOGW("%s unknown global init status %d",
-            __func__, global_init_status);
+            __func__, status);
         return false;
     }
     return false;
 }
 
+bool SkJPEGMixImageDecoder::warmUp(int timeoutMs)
+{
+    if (libmix_disabled())
+        return false;
+
+    start_global_init();
+    int32_t status = (timeoutMs > 0) ?
+        wait_global_init(milliseconds(timeoutMs)) :
+        android_atomic_acquire_load(&global_init_status);
+    return status == IMGDEC_INIT_STATUS_SUCCEEDED;
+}
+
+void SkJPEGMixImageDecoder::purgeDecoderPool()
+{
+    decoder_pool.purge();
+}
+
+#define BATCH_MAX_THREADS 8
+
+struct BatchJob {
+    SkStreamRewindable **streams;
+    int count;
+    int targetWidth;
+    int targetHeight;
+    SkColorType colorType;
+    SkBitmap *bitmaps;
+    SkJPEGMixBatchDecoder::Callback callback;
+    void *cookie;
+    bool useMix;
+
+    // index of the next stream to take
+    volatile int32_t next;
+    // protects decoded and the callback
+    Mutex lock;
+    int decoded;
+};
+
+static int batch_sample_size(int width, int height, int targetWidth, int targetHeight)
+{
+    int sampleSize = 1;
+    while (sampleSize < 8 &&
+            width / (sampleSize * 2) >= targetWidth &&
+            height / (sampleSize * 2) >= targetHeight)
+        sampleSize *= 2;
+    return sampleSize;
+}
+
+static bool batch_decode_one(BatchJob *job, SkImageDecoder *decoder,
+        SkStreamRewindable *stream, SkBitmap *bm)
+{
+    // the bounds only need the header, read by the turbo decoder
+    if (!decoder->decode(stream, bm, job->colorType, SkImageDecoder::kDecodeBounds_Mode))
+        return false;
+    if (!stream->rewind())
+        return false;
+
+    decoder->setSampleSize(batch_sample_size(bm->width(), bm->height(),
+        job->targetWidth, job->targetHeight));
+    return decoder->decode(stream, bm, job->colorType, SkImageDecoder::kDecodePixels_Mode);
+}
+
+static void *batch_worker(void *arg)
+{
+    BatchJob *job = (BatchJob*)arg;
+
+    for (;;) {
+        int index = android_atomic_inc(&job->next);
+        if (index >= job->count)
+            break;
+
+        SkBitmap *bm = &job->bitmaps[index];
+        SkAutoTDelete<SkImageDecoder> decoder(job->useMix ?
+            (SkImageDecoder*)SkNEW(SkJPEGMixImageDecoder) :
+            (SkImageDecoder*)SkNEW(SkJPEGTurboImageDecoder));
+        bool ok = batch_decode_one(job, decoder.get(), job->streams[index], bm);
+        if (!ok) {
+            ALOGV("%s failed to decode picture %d", __func__, index);
+            bm->reset();
+        }
+
+        Mutex::Autolock autoLock(job->lock);
+        if (ok)
+            job->decoded++;
+        if (job->callback)
+            job->callback(job->cookie, index, bm, ok);
+    }
+    return NULL;
+}
+
+int SkJPEGMixBatchDecoder::decode(SkStreamRewindable *streams[], int count,
+        int targetWidth, int targetHeight, SkColorType colorType,
+        SkBitmap bitmaps[], Callback callback, void *cookie)
+{
+    if (count <= 0)
+        return 0;
+
+    BatchJob job;
+    job.streams = streams;
+    job.count = count;
+    job.targetWidth = targetWidth > 0 ? targetWidth : 1;
+    job.targetHeight = targetHeight > 0 ? targetHeight : 1;
+    job.colorType = colorType;
+    job.bitmaps = bitmaps;
+    job.callback = callback;
+    job.cookie = cookie;
+    job.useMix = check_libmix_global_init();
+    job.next = 0;
+    job.decoded = 0;
+
+    // at least two workers, so one parses while the other waits for HW
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (cpus > 2) ? (int)cpus : 2;
+    if (threads > BATCH_MAX_THREADS)
+        threads = BATCH_MAX_THREADS;
+    if (threads > count)
+        threads = count;
+
+    pthread_t tids[BATCH_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&tids[started], NULL, batch_worker, &job) != 0) {
+            ALOGW("%s failed to start worker %d", __func__, i);
+            break;
+        }
+        started++;
+    }
+    // the calling thread works too
+    batch_worker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    ALOGV("%s decoded %d of %d pictures with %d threads",
+        __func__, job.decoded, count, started + 1);
+    return job.decoded;
+}
+
 static SkImageDecoder* sk_libmix_dfactory(SkStreamRewindable* stream) {
-    if (check_libmix_global_init() && is_jpeg(stream))
+    if (is_jpeg(stream) && check_libmix_global_init())
         return SkNEW(SkJPEGMixImageDecoder);
     return NULL;
 }
 
 static SkImageDecoder::Format get_format_jpeg(SkStreamRewindable* stream) {
-    if (check_libmix_global_init() && is_jpeg(stream))
+    if (is_jpeg(stream) && check_libmix_global_init())
         return SkImageDecoder::kJPEG_Format;
     return SkImageDecoder::kUnknown_Format;
 }
@@ -34,22 +34,64 @@
 
 class JpegDecoder;
 class JpegBlitter;
+struct JpegInfo;
+struct JpegDecoderContext;
 
 class SkJPEGMixImageDecoder : public SkJPEGTurboImageDecoder {
 public:
-    SkJPEGMixImageDecoder(): mDecoder(NULL) {}
+    SkJPEGMixImageDecoder(): mDecoder(NULL), mContext(NULL) {}
     virtual ~SkJPEGMixImageDecoder() {}
     virtual Format getFormat() const {
         return kJPEG_Format;
     }
 
+    /* Start the VA global initialization in the background, so the first
+     * decodes can use HW. Waits up to timeoutMs for it to finish, 0 returns
+     * right away. Returns true if HW decoding is ready. Safe to call from
+     * any thread, any number of times, but not before fork() in a zygote:
+     * it starts a thread. Without it the first JPEG decode starts the
+     * initialization and waits up to skia.libmix.init.wait.ms (200 by
+     * default) for it, the other decodes fall back to SW until it is done.
+     */
+    static bool warmUp(int timeoutMs = 0);
+
+    /* Destroy the idle HW decoder contexts kept for later decodes, and the
+     * VA resources they hold. Call it on low memory; idle contexts are also
+     * dropped on their own after a few seconds.
+     */
+    static void purgeDecoderPool();
+
 protected:
     virtual bool onBuildTileIndex(SkStreamRewindable *stream, int *width, int *height) SK_OVERRIDE;
     virtual bool onDecodeSubset(SkBitmap* bitmap, const SkIRect& rect) SK_OVERRIDE;
     virtual bool onDecode(SkStream* stream, SkBitmap* bm, Mode) SK_OVERRIDE;
 
 private:
+    bool readInput(SkStream* stream, JpegInfo *jinfo, android::Vector<uint8_t> *inputvec);
+
+    // decoder of mContext, which is leased from the decoder pool
     JpegDecoder *mDecoder;
+    JpegDecoderContext *mContext;
+};
+
+/* Decodes many JPEGs downscaled towards a target size, on a pool of
+ * worker threads. While one worker waits for a HW decode, the others
+ * read and parse the next pictures, so HW and CPU work overlap.
+ */
+class SkJPEGMixBatchDecoder {
+public:
+    // called once per stream as soon as it is done, never concurrently
+    typedef void (*Callback)(void *cookie, int index, SkBitmap *bitmap, bool success);
+
+    /* Decode streams[0..count) into bitmaps[0..count). Each picture is
+     * downsampled by the largest sample size, up to 8, that keeps it at
+     * least targetWidth x targetHeight. callback, if not NULL, gets the
+     * pictures in completion order. Blocks until all are done and returns
+     * the number decoded successfully.
+     */
+    static int decode(SkStreamRewindable *streams[], int count,
+                      int targetWidth, int targetHeight, SkColorType colorType,
+                      SkBitmap bitmaps[], Callback callback = NULL, void *cookie = NULL);
 };
 
 class SkJPEGMixImageEncoder : public SkJPEGTurboImageEncoder {
@@ -0,0 +1,93 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef SKJPEGMIX_COSTMODEL_H
+#define SKJPEGMIX_COSTMODEL_H
+
+/* Decode time models used to choose libmix or libjpeg-turbo for a
+ * picture. Each decoder has a linear cost model per sample size,
+ * time = fixed + rate * pixels, fitted by exponentially weighted least
+ * squares to the decode times measured so far. The seed costs break even
+ * at 1 megapixel for every sample size, which is where the fixed
+ * threshold used to be.
+ */
+#define DISPATCH_SAMPLE_SIZES 4     // sample size 1, 2, 4, 8
+#define DISPATCH_DECAY 0.95
+#define DISPATCH_EXPLORE_INTERVAL 64
+#define DISPATCH_EXPLORE_MARGIN 2.0
+// seed costs in ms and ms per megapixel
+#define DISPATCH_SEED_HW_FIXED 10.0
+#define DISPATCH_SEED_HW_RATE 10.0
+#define DISPATCH_SEED_SW_RATE 20.0
+
+enum JpegDecoderType {
+    JPEG_DECODER_HW = 0,
+    JPEG_DECODER_SW,
+    JPEG_DECODER_TYPES,
+};
+
+struct JpegCostModel {
+    // weighted sums of samples, x in megapixels and y in ms
+    double w, sx, sy, sxx, sxy;
+
+    void add(double x, double y) {
+        w = w * DISPATCH_DECAY + 1;
+        sx = sx * DISPATCH_DECAY + x;
+        sy = sy * DISPATCH_DECAY + y;
+        sxx = sxx * DISPATCH_DECAY + x * x;
+        sxy = sxy * DISPATCH_DECAY + x * y;
+    }
+
+    // two points on the seed line, so the fit is defined from the start
+    void seed(double fixed, double rate) {
+        const double seedx[2] = { 0.5, 4.0 };
+        w = sx = sy = sxx = sxy = 0;
+        for (int j = 0; j < 2; j++)
+            add(seedx[j], fixed + rate * seedx[j]);
+    }
+
+    double predict(double x) const {
+        double det = w * sxx - sx * sx;
+        // all samples at the same size, use their mean
+        if (det <= 1e-9 * w * w)
+            return (w > 0) ? sy / w : 0;
+        double slope = (w * sxy - sx * sy) / det;
+        double intercept = (sy - slope * sx) / w;
+        if (slope < 0)
+            slope = 0;
+        if (intercept < 0)
+            intercept = 0;
+        return intercept + slope * x;
+    }
+};
+
+/* Pick the decoder with the lower predicted cost. When explore is set a
+ * loser within DISPATCH_EXPLORE_MARGIN of the winner is picked instead,
+ * so both models keep following the device.
+ */
+static inline JpegDecoderType jpeg_pick_decoder(double hw, double sw, bool explore)
+{
+    JpegDecoderType type = (hw < sw) ? JPEG_DECODER_HW : JPEG_DECODER_SW;
+    if (explore) {
+        double best = (hw < sw) ? hw : sw;
+        double other = (hw < sw) ? sw : hw;
+        if (other < best * DISPATCH_EXPLORE_MARGIN)
+            type = (type == JPEG_DECODER_HW) ? JPEG_DECODER_SW : JPEG_DECODER_HW;
+    }
+    return type;
+}
+
+#endif // SKJPEGMIX_COSTMODEL_H
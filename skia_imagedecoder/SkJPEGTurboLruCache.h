@@ -0,0 +1,112 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef SKJPEGTURBO_LRUCACHE_H
+#define SKJPEGTURBO_LRUCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Size bounded least recently used bookkeeping for the huffman index
+ *  cache. Entries are keyed by a hash and length of the data they were
+ *  built from. Values are copied in and out as is; the owner refs and
+ *  unrefs them and does the locking. Array is an SkTDArray-like array
+ *  template, with count(), operator[], append() and remove().
+ */
+template <typename Value, template <typename> class Array>
+class SkJPEGTurboLruCache {
+public:
+    SkJPEGTurboLruCache() : fSize(0), fClock(0) {}
+
+    int count() const { return fEntries.count(); }
+    size_t size() const { return fSize; }
+    const Value& valueAt(int i) const { return fEntries[i].fValue; }
+
+    /**
+     *  Returns the value cached for the key and marks it used, or NULL.
+     */
+    const Value* find(uint64_t hash, size_t length) {
+        int i = this->indexOf(hash, length);
+        if (i < 0) {
+            return NULL;
+        }
+        fEntries[i].fLastUse = ++fClock;
+        return &fEntries[i].fValue;
+    }
+
+    /**
+     *  Cache value, which takes size bytes, dropping least recently used
+     *  entries into victims until everything fits in budget. Returns false,
+     *  and changes nothing, if size alone is over budget or the key is
+     *  already cached.
+     */
+    bool add(uint64_t hash, size_t length, const Value& value, size_t size,
+             size_t budget, Array<Value>* victims) {
+        if (size > budget || this->indexOf(hash, length) >= 0) {
+            return false;
+        }
+        this->trim(budget - size, victims);
+
+        Entry* entry = fEntries.append();
+        entry->fHash = hash;
+        entry->fLength = length;
+        entry->fValue = value;
+        entry->fSize = size;
+        entry->fLastUse = ++fClock;
+        fSize += size;
+        return true;
+    }
+
+    // drop least recently used entries into victims until size() <= budget
+    void trim(size_t budget, Array<Value>* victims) {
+        while (fSize > budget && fEntries.count() > 0) {
+            int oldest = 0;
+            for (int i = 1; i < fEntries.count(); i++) {
+                if (fEntries[i].fLastUse < fEntries[oldest].fLastUse) {
+                    oldest = i;
+                }
+            }
+            fSize -= fEntries[oldest].fSize;
+            *victims->append() = fEntries[oldest].fValue;
+            fEntries.remove(oldest);
+        }
+    }
+
+private:
+    struct Entry {
+        uint64_t fHash;
+        size_t fLength;
+        Value fValue;
+        size_t fSize;
+        uint32_t fLastUse;
+    };
+
+    int indexOf(uint64_t hash, size_t length) const {
+        for (int i = 0; i < fEntries.count(); i++) {
+            if (fEntries[i].fHash == hash && fEntries[i].fLength == length) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    Array<Entry> fEntries;
+    size_t fSize;
+    uint32_t fClock;
+};
+
+#endif // SKJPEGTURBO_LRUCACHE_H
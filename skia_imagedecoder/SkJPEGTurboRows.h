@@ -0,0 +1,125 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef SKJPEGTURBO_ROWS_H
+#define SKJPEGTURBO_ROWS_H
+
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Per row pixel loops of the decoder. The SSE2 paths give the same bits
+ * as the scalar loops, which also finish the pixels left over at the end
+ * of a row.
+ */
+
+// a * b / 255 rounded, same as SkMulDiv255Round
+static inline uint8_t sk_jpeg_mul_div_255_round(unsigned a, unsigned b) {
+    unsigned prod = a * b + 128;
+    return (uint8_t)((prod + (prod >> 8)) >> 8);
+}
+
+// Convert a scanline of CMYK samples to RGBX in place. Note that this
+// method moves the "scanline" pointer in its processing
+static inline void sk_jpeg_convert_CMYK_to_RGB(uint8_t* scanline, unsigned int width) {
+    // At this point we've received CMYK pixels from libjpeg. We
+    // perform a crude conversion to RGB (based on the formulae
+    // from easyrgb.com):
+    //  CMYK -> CMY
+    //    C = ( C * (1 - K) + K )      // for each CMY component
+    //  CMY -> RGB
+    //    R = ( 1 - C ) * 255          // for each RGB component
+    // Unfortunately we are seeing inverted CMYK so all the original terms
+    // are 1-. This yields:
+    //  CMYK -> CMY
+    //    C = ( (1-C) * (1 - (1-K) + (1-K) ) -> C = 1 - C*K
+    // The conversion from CMY->RGB remains the same
+    unsigned int x = 0;
+#ifdef __SSE2__
+    // four pixels at a time, with the rounding of SkMulDiv255Round
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    for (; x + 4 <= width; x += 4, scanline += 16) {
+        __m128i px = _mm_loadu_si128((const __m128i*)scanline);
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        // K of each pixel in all four of its lanes
+        __m128i klo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)),
+                                          _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i khi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)),
+                                          _MM_SHUFFLE(3, 3, 3, 3));
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, klo), round);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, khi), round);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        px = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+        _mm_storeu_si128((__m128i*)scanline, px);
+    }
+#endif
+    for (; x < width; ++x, scanline += 4) {
+        scanline[0] = sk_jpeg_mul_div_255_round(scanline[0], scanline[3]);
+        scanline[1] = sk_jpeg_mul_div_255_round(scanline[1], scanline[3]);
+        scanline[2] = sk_jpeg_mul_div_255_round(scanline[2], scanline[3]);
+        scanline[3] = 255;
+    }
+}
+
+/**
+ *  Point sample a row, dst[x] = src[x * dx] for x in [0, width).
+ *  src must hold (width - 1) * dx + 1 pixels.
+ */
+static inline void sk_jpeg_sample_row_32(uint32_t* dst, const uint32_t* src, int width,
+                                         int dx) {
+    int x = 0;
+#ifdef __SSE2__
+    if (2 == dx) {
+        // keep the even pixels of two vectors, the shuffle moves bits only
+        for (; x + 5 <= width; x += 4) {
+            __m128 a = _mm_loadu_ps((const float*)(src + 2 * x));
+            __m128 b = _mm_loadu_ps((const float*)(src + 2 * x + 4));
+            _mm_storeu_ps((float*)(dst + x), _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x] = src[x * dx];
+    }
+}
+
+static inline void sk_jpeg_sample_row_16(uint16_t* dst, const uint16_t* src, int width,
+                                         int dx) {
+    int x = 0;
+#ifdef __SSE2__
+    if (2 == dx) {
+        // sign extend the even pixels to 32 bits, so the saturating pack
+        // gives back their exact bits
+        for (; x + 9 <= width; x += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * x));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * x + 8));
+            a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+            b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_packs_epi32(a, b));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x] = src[x * dx];
+    }
+}
+
+#endif // SKJPEGTURBO_ROWS_H
@@ -0,0 +1,120 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef SKJPEGTURBO_STRIPS_H
+#define SKJPEGTURBO_STRIPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A parallel encode splits a picture in horizontal strips of whole 16x16
+ * MCU rows, encodes each as a baseline 4:2:0 JPEG with the same quality,
+ * and joins them into one JPEG. Each strip is one restart interval, so
+ * the entropy coded data of the strips is joined with RST markers under
+ * the header of the first strip, which gets the full height and a DRI.
+ * Strips share the tables, which only depend on the quality.
+ */
+#define SK_JPEG_STRIP_MCU_ROWS 16
+
+/**
+ *  Split a width x height picture into at most maxStrips strips. Returns
+ *  the number of strips, with the lines of every strip but the last in
+ *  stripRows and the restart interval in MCUs in interval, or 0 if the
+ *  picture can't be split in two or more.
+ */
+static inline int sk_jpeg_split_strips(int width, int height, int maxStrips,
+                                       int* stripRows, int* interval) {
+    if (maxStrips < 2 || width <= 0 || height <= 0) {
+        return 0;
+    }
+    int rows = (height + maxStrips - 1) / maxStrips;
+    rows = (rows + SK_JPEG_STRIP_MCU_ROWS - 1) / SK_JPEG_STRIP_MCU_ROWS * SK_JPEG_STRIP_MCU_ROWS;
+    const int count = (height + rows - 1) / rows;
+    const int mcus = rows / SK_JPEG_STRIP_MCU_ROWS
+            * ((width + SK_JPEG_STRIP_MCU_ROWS - 1) / SK_JPEG_STRIP_MCU_ROWS);
+    if (count < 2 || mcus > 0xFFFF) {
+        return 0;
+    }
+    *stripRows = rows;
+    *interval = mcus;
+    return count;
+}
+
+/**
+ *  Find the SOF and SOS markers of a JPEG, and where its entropy coded
+ *  data starts.
+ */
+static inline bool sk_jpeg_find_scan(const uint8_t* data, size_t size, size_t* sof,
+                                     size_t* sos, size_t* scan) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+    *sof = 0;
+    size_t pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xFF) {
+        uint8_t marker = data[pos + 1];
+        size_t length = (data[pos + 2] << 8) | data[pos + 3];
+        if (marker >= 0xC0 && marker <= 0xC2) {
+            *sof = pos;
+        } else if (marker == 0xDA) {
+            *sos = pos;
+            *scan = pos + 2 + length;
+            return *sof != 0 && *scan + 2 <= size;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+/**
+ *  Append strip index of a picture height lines high, encoded as the
+ *  complete JPEG data, to out. Stream is anything with an SkWStream-like
+ *  write(const void*, size_t). Strips are appended in order, and the
+ *  picture is finished with sk_jpeg_end_strips().
+ */
+template <typename Stream>
+static bool sk_jpeg_append_strip(Stream* out, int index, const uint8_t* data, size_t size,
+                                 int height, int interval) {
+    size_t sof, sos, scan;
+    if (!sk_jpeg_find_scan(data, size, &sof, &sos, &scan)) {
+        return false;
+    }
+    if (0 == index) {
+        // the first header with the full height and a restart interval
+        const uint8_t lines[2] = { (uint8_t)(height >> 8), (uint8_t)(height & 0xFF) };
+        const uint8_t dri[6] = { 0xFF, 0xDD, 0x00, 0x04,
+                                 (uint8_t)(interval >> 8), (uint8_t)(interval & 0xFF) };
+        out->write(data, sof + 5);
+        out->write(lines, sizeof(lines));
+        out->write(data + sof + 7, sos - sof - 7);
+        out->write(dri, sizeof(dri));
+        out->write(data + sos, scan - sos);
+    } else {
+        const uint8_t rst[2] = { 0xFF, (uint8_t)(0xD0 + ((index - 1) & 7)) };
+        out->write(rst, sizeof(rst));
+    }
+    // everything up to the EOI
+    out->write(data + scan, size - 2 - scan);
+    return true;
+}
+
+template <typename Stream>
+static void sk_jpeg_end_strips(Stream* out) {
+    const uint8_t eoi[2] = { 0xFF, 0xD9 };
+    out->write(eoi, sizeof(eoi));
+}
+
+#endif // SKJPEGTURBO_STRIPS_H
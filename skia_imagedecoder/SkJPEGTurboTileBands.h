@@ -0,0 +1,63 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef SKJPEGTURBO_TILEBANDS_H
+#define SKJPEGTURBO_TILEBANDS_H
+
+/**
+ *  Rows of one band of a region decode.
+ */
+struct SkJPEGTurboBandRows {
+    // source lines, startY is on an iMCU row
+    int startY, height;
+    // rows of the output bitmap
+    int outRow, outRows;
+};
+
+/**
+ *  Split the source lines [alignedY, bottom) of a region, which decodes
+ *  to outHeight rows at sampleSize, into at most maxBands bands of whole
+ *  iMCU rows of iMCURowLines lines each. Every band but the last has the
+ *  same height, which must be a multiple of sampleSize so each band
+ *  starts on an output row. Returns the number of bands written to bands,
+ *  or 0 if the region can't be split in two or more.
+ */
+static inline int sk_jpeg_split_bands(int alignedY, int bottom, int outHeight,
+                                      int iMCURowLines, int sampleSize, int maxBands,
+                                      SkJPEGTurboBandRows bands[]) {
+    if (maxBands < 2 || iMCURowLines <= 0 || sampleSize <= 0 || bottom <= alignedY) {
+        return 0;
+    }
+    const int iMCURows = (bottom - alignedY + iMCURowLines - 1) / iMCURowLines;
+    const int bandiMCURows = (iMCURows + maxBands - 1) / maxBands;
+    const int bandLines = bandiMCURows * iMCURowLines;
+    const int bandCount = (iMCURows + bandiMCURows - 1) / bandiMCURows;
+    if (bandCount < 2 || bandLines % sampleSize != 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < bandCount; i++) {
+        SkJPEGTurboBandRows& band = bands[i];
+        const bool last = (i == bandCount - 1);
+        band.startY = alignedY + i * bandLines;
+        band.height = last ? bottom - band.startY : bandLines;
+        band.outRow = i * bandLines / sampleSize;
+        band.outRows = last ? outHeight - band.outRow : bandLines / sampleSize;
+    }
+    return bandCount;
+}
+
+#endif // SKJPEGTURBO_TILEBANDS_H
@@ -0,0 +1,55 @@
+LOCAL_PATH := $(call my-dir)
+
+#### skia_ext host unit tests ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	SkJPEGMixCostModelTest.cpp \
+	SkJPEGTurboLruCacheTest.cpp \
+	SkJPEGTurboRowsTest.cpp \
+	SkJPEGTurboTileBandsTest.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+LOCAL_MODULE := skia_ext_unit_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_NATIVE_TEST)
+
+#### strip encode host test, against libjpeg-turbo ####
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	SkJPEGTurboStripsTest.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/.. \
+	vendor/intel/external/libjpeg-turbo
+
+# libjpeg-turbo-static exports the jt_ names, see ../Android.mk
+LOCAL_CFLAGS += \
+	-Djpeg_CreateCompress=jt_jpeg_CreateCompress	\
+	-Djpeg_CreateDecompress=jt_jpeg_CreateDecompress	\
+	-Djpeg_destroy_compress=jt_jpeg_destroy_compress	\
+	-Djpeg_destroy_decompress=jt_jpeg_destroy_decompress	\
+	-Djpeg_finish_compress=jt_jpeg_finish_compress	\
+	-Djpeg_finish_decompress=jt_jpeg_finish_decompress	\
+	-Djpeg_mem_dest=jt_jpeg_mem_dest	\
+	-Djpeg_mem_src=jt_jpeg_mem_src	\
+	-Djpeg_read_header=jt_jpeg_read_header	\
+	-Djpeg_read_scanlines=jt_jpeg_read_scanlines	\
+	-Djpeg_set_defaults=jt_jpeg_set_defaults	\
+	-Djpeg_set_quality=jt_jpeg_set_quality	\
+	-Djpeg_start_compress=jt_jpeg_start_compress	\
+	-Djpeg_start_decompress=jt_jpeg_start_decompress	\
+	-Djpeg_std_error=jt_jpeg_std_error	\
+	-Djpeg_write_scanlines=jt_jpeg_write_scanlines
+
+LOCAL_STATIC_LIBRARIES := libjpeg-turbo-static
+
+LOCAL_MODULE := skia_ext_strip_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_NATIVE_TEST)
@@ -0,0 +1,109 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "SkJPEGMixCostModel.h"
+
+static void seedModels(JpegCostModel *hw, JpegCostModel *sw)
+{
+    hw->seed(DISPATCH_SEED_HW_FIXED, DISPATCH_SEED_HW_RATE);
+    sw->seed(0, DISPATCH_SEED_SW_RATE);
+}
+
+TEST(SkJPEGMixCostModelTest, EmptyModelPredictsZero) {
+    JpegCostModel model;
+    memset(&model, 0, sizeof(model));
+
+    EXPECT_EQ(0, model.predict(1.0));
+}
+
+TEST(SkJPEGMixCostModelTest, SeedsBreakEvenAtOneMegapixel) {
+    JpegCostModel hw, sw;
+    seedModels(&hw, &sw);
+
+    EXPECT_NEAR(15.0, hw.predict(0.5), 1e-6);
+    EXPECT_NEAR(10.0, sw.predict(0.5), 1e-6);
+    EXPECT_NEAR(hw.predict(1.0), sw.predict(1.0), 1e-6);
+    EXPECT_EQ(JPEG_DECODER_SW, jpeg_pick_decoder(hw.predict(0.5), sw.predict(0.5), false));
+    EXPECT_EQ(JPEG_DECODER_HW, jpeg_pick_decoder(hw.predict(8.0), sw.predict(8.0), false));
+}
+
+TEST(SkJPEGMixCostModelTest, FitsMeasuredLine) {
+    JpegCostModel model;
+    model.seed(DISPATCH_SEED_HW_FIXED, DISPATCH_SEED_HW_RATE);
+
+    // the device decodes at 3 ms + 5 ms per megapixel
+    static const double sizes[] = { 0.3, 1.0, 2.0, 5.0, 8.0 };
+    for (int i = 0; i < 200; i++) {
+        double x = sizes[i % 5];
+        model.add(x, 3.0 + 5.0 * x);
+    }
+    EXPECT_NEAR(3.0 + 5.0 * 0.5, model.predict(0.5), 0.05);
+    EXPECT_NEAR(3.0 + 5.0 * 12.0, model.predict(12.0), 0.5);
+}
+
+TEST(SkJPEGMixCostModelTest, RecentSamplesOutweighOld) {
+    JpegCostModel model;
+    memset(&model, 0, sizeof(model));
+
+    for (int i = 0; i < 100; i++)
+        model.add(1.0 + (i & 1), 10.0 * (1.0 + (i & 1)));
+    // the decoder got twice as slow, e.g. a lower GPU frequency
+    for (int i = 0; i < 100; i++)
+        model.add(1.0 + (i & 1), 20.0 * (1.0 + (i & 1)));
+    EXPECT_NEAR(30.0, model.predict(1.5), 0.5);
+}
+
+TEST(SkJPEGMixCostModelTest, SameSizeSamplesUseMean) {
+    JpegCostModel model;
+    memset(&model, 0, sizeof(model));
+
+    model.add(2.0, 10.0);
+    model.add(2.0, 14.0);
+    // no slope can be fit, every size gets the weighted mean
+    double mean = (10.0 * DISPATCH_DECAY + 14.0) / (DISPATCH_DECAY + 1);
+    EXPECT_NEAR(mean, model.predict(0.1), 1e-9);
+    EXPECT_NEAR(mean, model.predict(20.0), 1e-9);
+}
+
+TEST(SkJPEGMixCostModelTest, ClampsNegativeFit) {
+    JpegCostModel model;
+    memset(&model, 0, sizeof(model));
+
+    // noise making bigger pictures look faster, the slope is dropped
+    model.add(1.0, 20.0);
+    model.add(4.0, 5.0);
+    EXPECT_NEAR(25.0, model.predict(10.0), 1e-6);
+
+    // a negative fixed cost is dropped, small pictures aren't free
+    memset(&model, 0, sizeof(model));
+    model.add(1.0, 1.0);
+    model.add(4.0, 40.0);
+    EXPECT_NEAR(0.0, model.predict(0.0), 1e-6);
+    EXPECT_NEAR(13.0, model.predict(1.0), 1e-6);
+}
+
+TEST(SkJPEGMixCostModelTest, ExploresOnlyCloseLosers) {
+    EXPECT_EQ(JPEG_DECODER_HW, jpeg_pick_decoder(10.0, 15.0, false));
+    EXPECT_EQ(JPEG_DECODER_SW, jpeg_pick_decoder(10.0, 15.0, true));
+    EXPECT_EQ(JPEG_DECODER_HW, jpeg_pick_decoder(15.0, 10.0, true));
+
+    // a loser over the margin is never tried
+    EXPECT_EQ(JPEG_DECODER_HW, jpeg_pick_decoder(10.0, 10.0 * DISPATCH_EXPLORE_MARGIN + 1, true));
+    EXPECT_EQ(JPEG_DECODER_SW, jpeg_pick_decoder(10.0 * DISPATCH_EXPLORE_MARGIN + 1, 10.0, true));
+}
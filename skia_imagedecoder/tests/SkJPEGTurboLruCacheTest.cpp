@@ -0,0 +1,113 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "SkJPEGTurboLruCache.h"
+
+// the SkTDArray calls the cache makes, without Skia
+template <typename T> class TestArray {
+public:
+    int count() const { return (int)fItems.size(); }
+    T& operator[](int i) { return fItems[i]; }
+    const T& operator[](int i) const { return fItems[i]; }
+    T* append() { fItems.push_back(T()); return &fItems.back(); }
+    void remove(int i) { fItems.erase(fItems.begin() + i); }
+
+private:
+    std::vector<T> fItems;
+};
+
+typedef SkJPEGTurboLruCache<int, TestArray> TestCache;
+
+TEST(SkJPEGTurboLruCacheTest, FindByHashAndLength) {
+    TestCache cache;
+    TestArray<int> victims;
+
+    EXPECT_TRUE(NULL == cache.find(1, 100));
+    ASSERT_TRUE(cache.add(1, 100, 11, 10, 100, &victims));
+    ASSERT_TRUE(cache.find(1, 100) != NULL);
+    EXPECT_EQ(11, *cache.find(1, 100));
+    // same hash but other data
+    EXPECT_TRUE(NULL == cache.find(1, 101));
+    EXPECT_TRUE(NULL == cache.find(2, 100));
+    EXPECT_EQ(10u, cache.size());
+    EXPECT_EQ(0, victims.count());
+}
+
+TEST(SkJPEGTurboLruCacheTest, RejectsDuplicateAndOversized) {
+    TestCache cache;
+    TestArray<int> victims;
+
+    ASSERT_TRUE(cache.add(1, 100, 11, 10, 100, &victims));
+    EXPECT_FALSE(cache.add(1, 100, 12, 10, 100, &victims));
+    EXPECT_EQ(11, *cache.find(1, 100));
+
+    // too big to ever fit, nothing is dropped for it
+    EXPECT_FALSE(cache.add(2, 100, 21, 101, 100, &victims));
+    EXPECT_EQ(1, cache.count());
+    EXPECT_EQ(0, victims.count());
+
+    // a zero budget caches nothing
+    EXPECT_FALSE(cache.add(3, 100, 31, 1, 0, &victims));
+}
+
+TEST(SkJPEGTurboLruCacheTest, EvictsLeastRecentlyUsed) {
+    TestCache cache;
+    TestArray<int> victims;
+
+    ASSERT_TRUE(cache.add(1, 1, 11, 30, 100, &victims));
+    ASSERT_TRUE(cache.add(2, 2, 22, 30, 100, &victims));
+    ASSERT_TRUE(cache.add(3, 3, 33, 30, 100, &victims));
+    EXPECT_EQ(0, victims.count());
+
+    // 1 is used again, so 2 is the oldest
+    cache.find(1, 1);
+    ASSERT_TRUE(cache.add(4, 4, 44, 30, 100, &victims));
+    ASSERT_EQ(1, victims.count());
+    EXPECT_EQ(22, victims[0]);
+    EXPECT_TRUE(NULL == cache.find(2, 2));
+    EXPECT_EQ(90u, cache.size());
+
+    // a big entry drops as many as it needs, oldest first
+    ASSERT_TRUE(cache.add(5, 5, 55, 70, 100, &victims));
+    ASSERT_EQ(3, victims.count());
+    EXPECT_EQ(33, victims[1]);
+    EXPECT_EQ(11, victims[2]);
+    EXPECT_EQ(2, cache.count());
+    EXPECT_EQ(100u, cache.size());
+}
+
+TEST(SkJPEGTurboLruCacheTest, TrimToSmallerBudget) {
+    TestCache cache;
+    TestArray<int> victims;
+
+    for (int i = 0; i < 5; i++)
+        ASSERT_TRUE(cache.add(i, 1, i, 10, 100, &victims));
+
+    cache.trim(25, &victims);
+    ASSERT_EQ(3, victims.count());
+    for (int i = 0; i < 3; i++)
+        EXPECT_EQ(i, victims[i]);
+    EXPECT_EQ(20u, cache.size());
+    EXPECT_EQ(2, cache.count());
+
+    cache.trim(0, &victims);
+    EXPECT_EQ(5, victims.count());
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_EQ(0, cache.count());
+}
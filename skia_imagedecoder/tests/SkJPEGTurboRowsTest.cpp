@@ -0,0 +1,162 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "SkJPEGTurboRows.h"
+
+// dst pixels past the row that must be left alone
+#define GUARD_PIXELS 16
+
+// widths around the 4 and 8 pixel vectors, and odd ones
+static const int kWidths[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 15, 16, 17,
+                               31, 32, 33, 63, 64, 65, 1023 };
+static const int kSteps[] = { 1, 2, 3, 4 };
+
+template <typename T>
+static std::vector<T> random_pixels(size_t count) {
+    std::vector<T> pixels(count);
+    for (size_t i = 0; i < count; i++) {
+        // every bit, so the 16 bit sign extension is exercised
+        pixels[i] = (T)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+    }
+    return pixels;
+}
+
+/**
+ *  Copy of pixels that ends right before an inaccessible page, so a read
+ *  past the end faults.
+ */
+template <typename T>
+class GuardedPixels {
+public:
+    explicit GuardedPixels(const std::vector<T>& pixels) {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t bytes = pixels.size() * sizeof(T);
+        fSize = (bytes + page - 1) / page * page + page;
+        fBase = (uint8_t*)mmap(NULL, fSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        EXPECT_TRUE(MAP_FAILED != fBase);
+        EXPECT_EQ(0, mprotect(fBase + fSize - page, page, PROT_NONE));
+        fPixels = (T*)(fBase + fSize - page - bytes);
+        memcpy(fPixels, &pixels[0], bytes);
+    }
+    ~GuardedPixels() { munmap(fBase, fSize); }
+    const T* get() const { return fPixels; }
+
+private:
+    uint8_t* fBase;
+    size_t fSize;
+    T* fPixels;
+};
+
+// the scalar loop the vector paths have to match
+template <typename T>
+static void sample_row_scalar(T* dst, const T* src, int width, int dx) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = src[x * dx];
+    }
+}
+
+template <typename T>
+static void check_sample_row(void (*sample)(T*, const T*, int, int)) {
+    srand(1);
+    for (size_t w = 0; w < sizeof(kWidths) / sizeof(kWidths[0]); w++) {
+        for (size_t s = 0; s < sizeof(kSteps) / sizeof(kSteps[0]); s++) {
+            const int width = kWidths[w];
+            const int dx = kSteps[s];
+            // exactly the pixels the row may read
+            const std::vector<T> src = random_pixels<T>((width - 1) * dx + 1);
+            std::vector<T> expected = random_pixels<T>(width + GUARD_PIXELS);
+            std::vector<T> actual = expected;
+
+            sample_row_scalar(&expected[0], &src[0], width, dx);
+            GuardedPixels<T> guarded(src);
+            sample(&actual[0], guarded.get(), width, dx);
+            for (int x = 0; x < width + GUARD_PIXELS; x++) {
+                ASSERT_EQ(expected[x], actual[x])
+                        << "width " << width << " dx " << dx << " x " << x;
+            }
+        }
+    }
+}
+
+TEST(SkJPEGTurboRowsTest, SampleRow32) {
+    check_sample_row<uint32_t>(sk_jpeg_sample_row_32);
+}
+
+TEST(SkJPEGTurboRowsTest, SampleRow16) {
+    check_sample_row<uint16_t>(sk_jpeg_sample_row_16);
+}
+
+// the scalar conversion, with a * b / 255 rounded to nearest
+static void convert_CMYK_scalar(uint8_t* scanline, unsigned int width) {
+    for (unsigned int x = 0; x < width; x++, scanline += 4) {
+        for (int c = 0; c < 3; c++) {
+            scanline[c] = (uint8_t)((2 * scanline[c] * scanline[3] + 255) / 510);
+        }
+        scanline[3] = 255;
+    }
+}
+
+TEST(SkJPEGTurboRowsTest, ConvertCMYKWidths) {
+    srand(1);
+    for (size_t w = 0; w < sizeof(kWidths) / sizeof(kWidths[0]); w++) {
+        const int width = kWidths[w];
+        std::vector<uint8_t> expected = random_pixels<uint8_t>((width + GUARD_PIXELS) * 4);
+        std::vector<uint8_t> actual = expected;
+
+        convert_CMYK_scalar(&expected[0], width);
+        sk_jpeg_convert_CMYK_to_RGB(&actual[0], width);
+        for (int i = 0; i < (width + GUARD_PIXELS) * 4; i++) {
+            ASSERT_EQ(expected[i], actual[i]) << "width " << width << " byte " << i;
+        }
+    }
+}
+
+TEST(SkJPEGTurboRowsTest, ConvertCMYKAllValues) {
+    // every component against every K, mostly through the vector path
+    const int width = 256 * 256;
+    std::vector<uint8_t> expected(width * 4);
+    for (int i = 0; i < width; i++) {
+        expected[4 * i + 0] = (uint8_t)(i >> 8);
+        expected[4 * i + 1] = (uint8_t)~(i >> 8);
+        expected[4 * i + 2] = (uint8_t)(i >> 8) ^ 0x5A;
+        expected[4 * i + 3] = (uint8_t)i;
+    }
+    std::vector<uint8_t> actual = expected;
+
+    convert_CMYK_scalar(&expected[0], width);
+    sk_jpeg_convert_CMYK_to_RGB(&actual[0], width);
+    for (int i = 0; i < width * 4; i++) {
+        ASSERT_EQ(expected[i], actual[i]) << "pixel " << i / 4 << " component " << i % 4;
+    }
+}
+
+TEST(SkJPEGTurboRowsTest, MulDiv255Round) {
+    for (unsigned a = 0; a < 256; a++) {
+        for (unsigned b = 0; b < 256; b++) {
+            ASSERT_EQ((2 * a * b + 255) / 510, sk_jpeg_mul_div_255_round(a, b))
+                    << a << " * " << b;
+        }
+    }
+}
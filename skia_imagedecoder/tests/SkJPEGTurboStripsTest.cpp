@@ -0,0 +1,202 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+extern "C" {
+#include "jpeglib.h"
+}
+
+#include "SkJPEGTurboStrips.h"
+
+#define TEST_QUALITY 90
+
+typedef std::vector<uint8_t> Bytes;
+
+// the write() sk_jpeg_append_strip() needs, on a vector
+class VectorStream {
+public:
+    explicit VectorStream(Bytes* bytes) : fBytes(bytes) {}
+    bool write(const void* data, size_t size) {
+        const uint8_t* p = (const uint8_t*)data;
+        fBytes->insert(fBytes->end(), p, p + size);
+        return true;
+    }
+private:
+    Bytes* fBytes;
+};
+
+// RGB test picture with detail in every MCU, so a strip in the wrong
+// place or a lost DC prediction reset shows in the pixels
+static Bytes make_picture(int width, int height) {
+    Bytes rgb(width * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* p = &rgb[(y * width + x) * 3];
+            p[0] = (uint8_t)(x * 7 + y * 3);
+            p[1] = (uint8_t)((x ^ y) * 5);
+            p[2] = (uint8_t)(y * 11 - x);
+        }
+    }
+    return rgb;
+}
+
+// encode lines [top, top + height) as a baseline 4:2:0 JPEG, as
+// encode_rows() does for a strip
+static Bytes encode(const Bytes& rgb, int width, int top, int height) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    unsigned char* buffer = NULL;
+    unsigned long size = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, TEST_QUALITY, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)&rgb[(top + cinfo.next_scanline) * width * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    Bytes jpeg(buffer, buffer + size);
+    free(buffer);
+    return jpeg;
+}
+
+// decode to RGB, failing on any corrupt data warning
+static Bytes decode(const Bytes& jpeg, int width, int height) {
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)&jpeg[0], jpeg.size());
+    EXPECT_EQ(JPEG_HEADER_OK, jpeg_read_header(&cinfo, TRUE));
+    EXPECT_EQ((JDIMENSION)width, cinfo.image_width);
+    EXPECT_EQ((JDIMENSION)height, cinfo.image_height);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    Bytes rgb(cinfo.output_width * cinfo.output_height * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = &rgb[cinfo.output_scanline * cinfo.output_width * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    EXPECT_EQ(0, jerr.num_warnings);
+    jpeg_destroy_decompress(&cinfo);
+    return rgb;
+}
+
+// encode in strips as encode_strips() does, splice them and check the
+// result decodes to the same pixels as a single pass encode
+static void check_strips(int width, int height, int maxStrips, int expectedCount) {
+    int stripRows = 0, interval = 0;
+    const int count = sk_jpeg_split_strips(width, height, maxStrips, &stripRows, &interval);
+    ASSERT_EQ(expectedCount, count);
+
+    const Bytes rgb = make_picture(width, height);
+    Bytes spliced;
+    VectorStream out(&spliced);
+    for (int i = 0; i < count; i++) {
+        const int top = i * stripRows;
+        const int rows = (i == count - 1) ? height - top : stripRows;
+        const Bytes strip = encode(rgb, width, top, rows);
+        ASSERT_TRUE(sk_jpeg_append_strip(&out, i, &strip[0], strip.size(), height, interval))
+                << "strip " << i;
+    }
+    sk_jpeg_end_strips(&out);
+
+    // one RST marker between each pair of strips, numbered modulo 8
+    int rst = 0;
+    for (size_t i = 0; i + 1 < spliced.size(); i++) {
+        if (spliced[i] == 0xFF && spliced[i + 1] >= 0xD0 && spliced[i + 1] <= 0xD7) {
+            EXPECT_EQ(0xD0 + (rst & 7), spliced[i + 1]) << "marker " << rst;
+            rst++;
+        }
+    }
+    EXPECT_EQ(count - 1, rst);
+
+    const Bytes expected = decode(encode(rgb, width, 0, height), width, height);
+    const Bytes actual = decode(spliced, width, height);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int y = 0; y < height; y++) {
+        const size_t row = y * width * 3;
+        ASSERT_TRUE(0 == memcmp(&expected[row], &actual[row], width * 3)) << "line " << y;
+    }
+}
+
+TEST(SkJPEGTurboStripsTest, SplitStrips) {
+    int stripRows = 0, interval = 0;
+    // 8 strips of 8 MCU rows
+    EXPECT_EQ(8, sk_jpeg_split_strips(100, 1024, 8, &stripRows, &interval));
+    EXPECT_EQ(128, stripRows);
+    EXPECT_EQ(8 * 7, interval);
+    // strips are rounded up to MCU rows, so fewer of them
+    EXPECT_EQ(3, sk_jpeg_split_strips(64, 40, 4, &stripRows, &interval));
+    EXPECT_EQ(16, stripRows);
+    EXPECT_EQ(4, interval);
+}
+
+TEST(SkJPEGTurboStripsTest, NoSplit) {
+    int stripRows = 0, interval = 0;
+    EXPECT_EQ(0, sk_jpeg_split_strips(64, 16, 4, &stripRows, &interval));
+    EXPECT_EQ(0, sk_jpeg_split_strips(64, 1024, 1, &stripRows, &interval));
+    EXPECT_EQ(0, sk_jpeg_split_strips(0, 1024, 4, &stripRows, &interval));
+    // the restart interval doesn't fit in the DRI
+    EXPECT_EQ(0, sk_jpeg_split_strips(16 * 0x8000, 64, 2, &stripRows, &interval));
+}
+
+TEST(SkJPEGTurboStripsTest, FindScan) {
+    const Bytes jpeg = encode(make_picture(32, 32), 32, 0, 32);
+    size_t sof, sos, scan;
+    ASSERT_TRUE(sk_jpeg_find_scan(&jpeg[0], jpeg.size(), &sof, &sos, &scan));
+    EXPECT_EQ(0xC0, jpeg[sof + 1]);
+    EXPECT_EQ(0xDA, jpeg[sos + 1]);
+    EXPECT_LT(sos, scan);
+    // not a JPEG, and one cut before its scan
+    EXPECT_FALSE(sk_jpeg_find_scan(&jpeg[1], jpeg.size() - 1, &sof, &sos, &scan));
+    EXPECT_FALSE(sk_jpeg_find_scan(&jpeg[0], sos + 2, &sof, &sos, &scan));
+}
+
+TEST(SkJPEGTurboStripsTest, WholeMCURows) {
+    check_strips(256, 256, 4, 4);
+}
+
+TEST(SkJPEGTurboStripsTest, PartialLastMCURow) {
+    // the last strip ends 8 lines into an MCU row, and the width 5 pixels in
+    check_strips(261, 200, 4, 4);
+    check_strips(100, 17, 2, 2);
+}
+
+TEST(SkJPEGTurboStripsTest, RestartMarkerWraparound) {
+    // 11 strips use RST0-7 and then RST0-1 again
+    check_strips(96, 170, 11, 11);
+    check_strips(50, 16 * 20 - 3, 20, 20);
+}
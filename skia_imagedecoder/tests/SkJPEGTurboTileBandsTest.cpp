@@ -0,0 +1,93 @@
+/*
+* Copyright (c) 2014 Intel Corporation.  All rights reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <gtest/gtest.h>
+
+#include "SkJPEGTurboTileBands.h"
+
+#define TEST_MAX_BANDS 8
+
+// output rows of lines [alignedY, bottom) at sampleSize, as the decoder scales them
+static int out_height(int alignedY, int bottom, int sampleSize) {
+    return (bottom - alignedY + sampleSize - 1) / sampleSize;
+}
+
+// the bands tile the region and the bitmap without gaps or overlap
+static void check_bands(int alignedY, int bottom, int iMCURowLines, int sampleSize,
+                        int maxBands, int expectedCount) {
+    SkJPEGTurboBandRows bands[TEST_MAX_BANDS];
+    const int outHeight = out_height(alignedY, bottom, sampleSize);
+    const int count = sk_jpeg_split_bands(alignedY, bottom, outHeight, iMCURowLines,
+                                          sampleSize, maxBands, bands);
+    ASSERT_EQ(expectedCount, count);
+    ASSERT_LE(count, maxBands);
+
+    int nextY = alignedY;
+    int nextRow = 0;
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(nextY, bands[i].startY) << "band " << i;
+        EXPECT_EQ(0, (bands[i].startY - alignedY) % iMCURowLines) << "band " << i;
+        EXPECT_GT(bands[i].height, 0) << "band " << i;
+        EXPECT_EQ(nextRow, bands[i].outRow) << "band " << i;
+        EXPECT_GT(bands[i].outRows, 0) << "band " << i;
+        if (i < count - 1) {
+            EXPECT_EQ(bands[0].height, bands[i].height) << "band " << i;
+            EXPECT_EQ(bands[i].height / sampleSize, bands[i].outRows) << "band " << i;
+        }
+        nextY += bands[i].height;
+        nextRow += bands[i].outRows;
+    }
+    EXPECT_EQ(bottom, nextY);
+    EXPECT_EQ(outHeight, nextRow);
+}
+
+TEST(SkJPEGTurboTileBandsTest, EvenSplit) {
+    // 4:2:0, 16 line iMCU rows, 8 rows over 4 bands
+    check_bands(0, 128, 16, 1, 4, 4);
+    check_bands(0, 128, 16, 2, 4, 4);
+    check_bands(0, 128, 16, 4, 2, 2);
+}
+
+TEST(SkJPEGTurboTileBandsTest, ShortLastBand) {
+    // the region ends partway into its last iMCU row
+    check_bands(32, 32 + 100, 16, 1, 4, 4);
+    check_bands(32, 32 + 100, 16, 2, 4, 4);
+    // 7 iMCU rows over 4 bands is 2, 2, 2, 1
+    check_bands(0, 7 * 8, 8, 1, 4, 4);
+}
+
+TEST(SkJPEGTurboTileBandsTest, FewerBandsThanAllowed) {
+    // 5 iMCU rows over 4 bands is 2, 2, 1
+    check_bands(0, 5 * 16, 16, 1, 4, 3);
+    // 3 iMCU rows can't use 8 bands
+    check_bands(16, 16 + 3 * 16, 16, 1, 8, 3);
+}
+
+TEST(SkJPEGTurboTileBandsTest, RejectsUnsplittable) {
+    SkJPEGTurboBandRows bands[TEST_MAX_BANDS];
+
+    // a single iMCU row
+    EXPECT_EQ(0, sk_jpeg_split_bands(0, 16, 16, 16, 1, 4, bands));
+    EXPECT_EQ(0, sk_jpeg_split_bands(0, 10, 10, 16, 1, 4, bands));
+    // one thread
+    EXPECT_EQ(0, sk_jpeg_split_bands(0, 128, 128, 16, 1, 1, bands));
+    // empty region
+    EXPECT_EQ(0, sk_jpeg_split_bands(16, 16, 0, 16, 1, 4, bands));
+    // 16 line bands don't start on an output row at sample size 3
+    EXPECT_EQ(0, sk_jpeg_split_bands(0, 128, out_height(0, 128, 3), 16, 3, 8, bands));
+    // nor do 8 line bands at sample size 16
+    EXPECT_EQ(0, sk_jpeg_split_bands(0, 64, out_height(0, 64, 16), 8, 16, 8, bands));
+}